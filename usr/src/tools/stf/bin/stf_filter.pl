@@ -179,7 +179,15 @@ foreach $i (0 .. $#ARGV) {
 
 	$JNL_FILE = $ARGV[$i];
 
+##  A compressed journal is read through stf_jnl_ztail ##
 	open(JNL_FILE, $JNL_FILE) || die "\n$Progname: ERROR - Can't open journal file, $JNL_FILE.\n";
+	read(JNL_FILE, $magic, 2);
+	close(JNL_FILE);
+	if ( $magic eq "\x1f\x8b" ) {
+		open(JNL_FILE, "stf_jnl_ztail $JNL_FILE |") || die "\n$Progname: ERROR - Can't run stf_jnl_ztail on $JNL_FILE.\n";
+	} else {
+		open(JNL_FILE, $JNL_FILE) || die "\n$Progname: ERROR - Can't open journal file, $JNL_FILE.\n";
+	}
 
 ##  Flag for 1st line read ##
 	$FIRSTLINE = 0;
@@ -318,6 +326,9 @@ foreach $i (0 .. $#ARGV) {
 		elsif (( $opt_v eq "[^|]*"  ) || /^$opt_v\|/) {
 			if ( $testcase_match ) {
 				$msg = $_;
+				# drop the gethrtime() stamp of a Msg record,
+				# so identical runs filter the same
+				$msg =~ s/^(Msg\|\s*\d+) \d+ \|/$1 |/;
 				if ( $opt_s ) {
 					$msg =~ s/^$opt_v\|\s/	/;
 				}
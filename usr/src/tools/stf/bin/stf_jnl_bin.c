@@ -0,0 +1,389 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ *
+ */
+
+
+/*
+ * stf_jnl_bin - read the binary companion journal
+ *
+ *	Usage: stf_jnl_bin [-t | -i | -l] journal
+ *
+ *	options:
+ *	-t	- write the text journal the records came from (default)
+ *	-i	- index the journal, appending the testcase index
+ *	-l	- list the testcases in an indexed journal
+ *
+ *	The record layout is described in stf_jbin.h.
+ */
+
+#include <stf_impl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+/* prototypes */
+static void usage();
+static char *map_journal(char *, size_t *);
+static stf_jbin_rec_t *next_record(char *, size_t, size_t *);
+static char *record_name(stf_jbin_rec_t *, size_t *);
+static int text_journal(char *, size_t);
+static int index_journal(char *, char *, size_t);
+static int list_journal(char *, size_t);
+
+int
+main(int argc, char *argv[])
+{
+	extern int optind;
+	char *options = "til";
+	char *base;
+	size_t size;
+	int c, mode = 't';
+
+	while ((c = getopt(argc, argv, options)) != EOF) {
+		switch (c) {
+			case 't':
+			case 'i':
+			case 'l':
+				mode = c;
+				break;
+			default:
+				usage();
+				exit(1);
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		exit(1);
+	}
+
+	if ((base = map_journal(argv[optind], &size)) == NULL)
+		exit(1);
+
+	switch (mode) {
+		case 'i':
+			return (index_journal(argv[optind], base, size));
+		case 'l':
+			return (list_journal(base, size));
+		default:
+			return (text_journal(base, size));
+	}
+}
+
+/* map the whole journal read only, an empty journal maps to "" */
+static char *
+map_journal(char *name, size_t *sizep)
+{
+	struct stat st;
+	char *base;
+	int fd;
+
+	if ((fd = open(name, O_RDONLY)) == -1) {
+		perror(name);
+		return (NULL);
+	}
+	if (fstat(fd, &st) == -1) {
+		perror(name);
+		return (NULL);
+	}
+	*sizep = (size_t)st.st_size;
+	if (*sizep == 0) {
+		(void) close(fd);
+		return ("");
+	}
+	base = mmap((caddr_t)0, *sizep, PROT_READ, MAP_SHARED, fd, 0);
+	(void) close(fd);
+	if (base == (void *)-1) {
+		perror("stf_jnl_bin: mmap");
+		return (NULL);
+	}
+	return (base);
+}
+
+/*
+ * Return the record at *offp and step *offp over it, or NULL at the end
+ * of the journal.  A damaged record ends the scan with a complaint.
+ */
+static stf_jbin_rec_t *
+next_record(char *base, size_t size, size_t *offp)
+{
+	stf_jbin_rec_t *rec;
+	size_t off = *offp;
+
+	if (off + sizeof (stf_jbin_rec_t) > size)
+		return (NULL);
+	rec = (stf_jbin_rec_t *)(base + off);
+	if (rec->jr_magic != JBIN_REC_MAGIC ||
+	    off + sizeof (*rec) + rec->jr_len > size) {
+		(void) fprintf(stderr,
+		    "stf_jnl_bin: bad record at offset %llu\n",
+		    (u_longlong_t)off);
+		return (NULL);
+	}
+	*offp = off + JBIN_ALIGN(sizeof (*rec) + rec->jr_len);
+	return (rec);
+}
+
+/*
+ * The testcase name in a "Test_Case_Start| pid name | ..." or
+ * "Test_Case_End| pid name | ..." record, *lenp bytes long.
+ */
+static char *
+record_name(stf_jbin_rec_t *rec, size_t *lenp)
+{
+	char *p = (char *)(rec + 1);
+	char *end = p + rec->jr_len;
+	size_t len;
+
+	while (p < end && *p != '|')
+		p++;
+	while (p < end && (*p == '|' || *p == ' '))
+		p++;
+	while (p < end && *p != ' ')
+		p++;
+	while (p < end && *p == ' ')
+		p++;
+	for (len = 0; p + len < end && p[len] != ' ' && p[len] != '|'; len++)
+		;
+	*lenp = len;
+	return (p);
+}
+
+/* rebuild the text journal on stdout */
+static int
+text_journal(char *base, size_t size)
+{
+	stf_jbin_rec_t *rec;
+	size_t off = 0;
+
+	while ((rec = next_record(base, size, &off)) != NULL) {
+		if (rec->jr_type == JBIN_T_INDEX)
+			continue;
+		(void) fwrite(rec + 1, 1, rec->jr_len, stdout);
+	}
+	return (fflush(stdout) == 0 ? 0 : 1);
+}
+
+/*
+ * Index the journal: one entry per Test_Case_Start, completed by the
+ * next Test_Case_End with the same pid.  stf_timeout journals a -1 pid
+ * for a testcase it had to kill, so an End that matches no pid goes to
+ * the latest unfinished testcase of the same name.  The index, the name
+ * string table and the trailer go out as a single appended record.
+ */
+static int
+index_journal(char *name, char *base, size_t size)
+{
+	static const char pad[8];
+	stf_jbin_rec_t *rec, hdr;
+	stf_jbin_idx_t *idx = NULL, *ip;
+	stf_jbin_trailer_t trailer;
+	struct iovec iov[5];
+	char *strtab = NULL, *p;
+	size_t nidx = 0, maxidx = 0, strsize = 0, maxstr = 0;
+	size_t off = 0, recoff, namelen, total;
+	ssize_t count;
+	int fd, i;
+
+	while (recoff = off, (rec = next_record(base, size, &off)) != NULL) {
+		if (rec->jr_type == JBIN_T_TC_START) {
+			if (nidx == maxidx) {
+				maxidx = maxidx ? maxidx * 2 : 256;
+				if ((idx = realloc(idx,
+				    maxidx * sizeof (*idx))) == NULL) {
+					perror("stf_jnl_bin: realloc");
+					return (1);
+				}
+			}
+			p = record_name(rec, &namelen);
+			if (strsize + namelen + 1 > maxstr) {
+				maxstr = (maxstr + namelen + 1) * 2;
+				if ((strtab = realloc(strtab, maxstr)) ==
+				    NULL) {
+					perror("stf_jnl_bin: realloc");
+					return (1);
+				}
+			}
+
+			ip = &idx[nidx++];
+			(void) memset(ip, 0, sizeof (*ip));
+			ip->ji_tcid = rec->jr_tcid;
+			ip->ji_name = (uint32_t)strsize;
+			ip->ji_start = recoff;
+			ip->ji_start_ns = rec->jr_ns;
+			ip->ji_result = JBIN_NORESULT;
+			(void) memcpy(strtab + strsize, p, namelen);
+			strtab[strsize + namelen] = '\0';
+			strsize += namelen + 1;
+		} else if (rec->jr_type == JBIN_T_TC_END) {
+			for (i = (int)nidx - 1; i >= 0; i--) {
+				if (idx[i].ji_tcid == rec->jr_tcid &&
+				    idx[i].ji_end == 0)
+					break;
+			}
+			if (i < 0) {
+				p = record_name(rec, &namelen);
+				for (i = (int)nidx - 1; i >= 0; i--) {
+					if (idx[i].ji_end == 0 &&
+					    strlen(&strtab[idx[i].ji_name]) ==
+					    namelen && strncmp(p,
+					    &strtab[idx[i].ji_name],
+					    namelen) == 0)
+						break;
+				}
+			}
+			if (i >= 0) {
+				idx[i].ji_end = recoff;
+				idx[i].ji_end_ns = rec->jr_ns;
+				idx[i].ji_result = rec->jr_result;
+			}
+		}
+	}
+	if (off != size)
+		return (1);
+
+	(void) memset(&trailer, 0, sizeof (trailer));
+	trailer.jt_magic = JBIN_MAGIC;
+	trailer.jt_records = size;
+	trailer.jt_index = size + sizeof (hdr);
+	trailer.jt_strtab = trailer.jt_index + nidx * sizeof (*idx);
+	trailer.jt_nindex = (uint32_t)nidx;
+	trailer.jt_strsize = (uint32_t)strsize;
+
+	total = nidx * sizeof (*idx) + JBIN_ALIGN(strsize) + sizeof (trailer);
+	(void) memset(&hdr, 0, sizeof (hdr));
+	hdr.jr_magic = JBIN_REC_MAGIC;
+	hdr.jr_type = JBIN_T_INDEX;
+	hdr.jr_result = JBIN_NORESULT;
+	hdr.jr_len = (uint32_t)total;
+	hdr.jr_pid = (int32_t)getpid();
+	hdr.jr_ns = gethrtime();
+
+	iov[0].iov_base = (caddr_t)&hdr;
+	iov[0].iov_len = sizeof (hdr);
+	iov[1].iov_base = (caddr_t)idx;
+	iov[1].iov_len = nidx * sizeof (*idx);
+	iov[2].iov_base = strtab;
+	iov[2].iov_len = strsize;
+	iov[3].iov_base = (caddr_t)pad;
+	iov[3].iov_len = JBIN_ALIGN(strsize) - strsize;
+	iov[4].iov_base = (caddr_t)&trailer;
+	iov[4].iov_len = sizeof (trailer);
+
+	if ((fd = open(name, O_WRONLY | O_APPEND)) == -1) {
+		perror(name);
+		return (1);
+	}
+	count = writev(fd, iov, 5);
+	if (count != (ssize_t)(sizeof (hdr) + total)) {
+		perror("stf_jnl_bin: writev");
+		return (1);
+	}
+	/* somebody still writing the journal would spoil the offsets */
+	if (lseek(fd, 0, SEEK_END) != (off_t)(size + sizeof (hdr) + total))
+		(void) fprintf(stderr,
+		    "stf_jnl_bin: %s grew while it was indexed, "
+		    "index it again\n", name);
+	(void) close(fd);
+	return (0);
+}
+
+/* list the testcases from the index at the end of the journal */
+static int
+list_journal(char *base, size_t size)
+{
+	stf_jbin_trailer_t *trailer;
+	stf_jbin_idx_t *ip;
+	char *strtab;
+	uint32_t i;
+
+	if (size < sizeof (*trailer)) {
+		(void) fprintf(stderr,
+		    "stf_jnl_bin: journal is not indexed, use -i\n");
+		return (1);
+	}
+	trailer = (stf_jbin_trailer_t *)(base + size - sizeof (*trailer));
+	if (trailer->jt_magic != JBIN_MAGIC) {
+		(void) fprintf(stderr,
+		    "stf_jnl_bin: journal is not indexed, use -i\n");
+		return (1);
+	}
+
+	/* the index, then the string table, all ahead of the trailer */
+	if (trailer->jt_index > size ||
+	    trailer->jt_nindex > (size - trailer->jt_index) /
+	    sizeof (stf_jbin_idx_t) ||
+	    trailer->jt_index + trailer->jt_nindex * sizeof (stf_jbin_idx_t) >
+	    trailer->jt_strtab ||
+	    trailer->jt_strtab > size - sizeof (*trailer) ||
+	    trailer->jt_strsize > size - sizeof (*trailer) -
+	    trailer->jt_strtab ||
+	    (trailer->jt_strsize > 0 &&
+	    base[trailer->jt_strtab + trailer->jt_strsize - 1] != '\0')) {
+		(void) fprintf(stderr,
+		    "stf_jnl_bin: journal index is damaged, use -i\n");
+		return (1);
+	}
+	ip = (stf_jbin_idx_t *)(base + trailer->jt_index);
+	strtab = base + trailer->jt_strtab;
+
+	for (i = 0; i < trailer->jt_nindex; i++, ip++) {
+		if (ip->ji_name >= trailer->jt_strsize) {
+			(void) fprintf(stderr,
+			    "stf_jnl_bin: journal index is damaged, use -i\n");
+			return (1);
+		}
+		if (ip->ji_end == 0) {
+			(void) printf("%s %s\n", &strtab[ip->ji_name],
+			    "UNFINISHED");
+			continue;
+		}
+		(void) printf("%s %s %llu.%03llu\n", &strtab[ip->ji_name],
+		    ip->ji_result >= STF_MAX_RESULTS ? "?" :
+		    result_tbl[ip->ji_result],
+		    (u_longlong_t)(ip->ji_end_ns - ip->ji_start_ns) /
+		    (NANOSEC / MILLISEC),
+		    (u_longlong_t)((ip->ji_end_ns - ip->ji_start_ns) /
+		    (NANOSEC / MICROSEC)) % 1000);
+	}
+	return (0);
+}
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr,
+	"Usage: stf_jnl_bin [-t | -i | -l] journal\n");
+	(void) fprintf(stderr,
+	"\noptions:\n");
+	(void) fprintf(stderr,
+	"\t-t\t- write the text journal the records came from (default)\n");
+	(void) fprintf(stderr,
+	"\t-i\t- index the journal, appending the testcase index\n");
+	(void) fprintf(stderr,
+	"\t-l\t- list the testcases in an indexed journal, with the\n"
+	"\t\t  result and the run time in milliseconds\n");
+}
@@ -0,0 +1,179 @@
+#! /usr/perl5/bin/perl
+#
+# CDDL HEADER START
+#
+# The contents of this file are subject to the terms of the
+# Common Development and Distribution License (the "License").
+# You may not use this file except in compliance with the License.
+#
+# You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+# or http://www.opensolaris.org/os/licensing.
+# See the License for the specific language governing permissions
+# and limitations under the License.
+#
+# When distributing Covered Code, include this CDDL HEADER in each
+# file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+# If applicable, add the following below this CDDL HEADER, with the
+# fields enclosed by brackets "[]" replaced with your own identifying
+# information: Portions Copyright [yyyy] [name of copyright owner]
+#
+# CDDL HEADER END
+#
+
+#
+# Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+# Use is subject to license terms.
+#
+
+# File: stf_jnl_durations
+## read in journal files and keep a database of how long each testcase,
+## and each directory of testcases, takes to run
+
+###############################################################################
+# SUBROUTINES
+###############################################################################
+
+#####################################################################
+# subroutine name: out_usage
+# args: none
+#
+# returns: none
+#
+# print out usage info for stf_jnl_durations.
+#####################################################################
+sub out_usage
+{
+	die "usage: $Progname [-u database] journalfile {journalfile} \
+\
+options: \
+-u database \
+	Fold the durations into database, creating it if need be, \
+	rather than printing them.  stf_execute does this with \
+	STF_DURATIONS after every run. \
+\
+Each line of the database, and of the output, is \
+\
+	name seconds runs \
+\
+where name is a testcase as it's named in the journal, or a \
+directory of them ending in /, whose time is the sum of every \
+testcase, setup and cleanup under it.  seconds moves a quarter \
+of the way to each new duration once there have been four runs. \
+";
+}
+
+#####################################################################
+# subroutine name: stamp
+# arg1: Test_Case_Start or Test_Case_End record
+#
+# returns: the gethrtime() stamp of the record, or undef
+#####################################################################
+sub stamp
+{
+	return $1 if ( $_[0] =~ /\| \d\d:\d\d:\d\d (\d+) / );
+	return undef;
+}
+
+#####################################################################
+# subroutine name: add
+# arg1: testcase or directory name
+# arg2: seconds
+#
+# Add arg2 seconds to the time of arg1 in this run.
+#####################################################################
+sub add
+{
+	$run{$_[0]} += $_[1];
+}
+
+#####################################################################
+# subroutine name: journal
+# arg1: journal file name
+#
+# Read the durations of the testcases in a journal into %run.  A
+# compressed journal is read through stf_jnl_ztail.
+#####################################################################
+sub journal
+{
+	my ($file) = @_;
+	my ($magic, $name, $start, $ns, $sec, $dir);
+
+	open(JNL_FILE, $file) || die "\n$Progname: ERROR - Can't open journal file, $file.\n";
+	read(JNL_FILE, $magic, 2);
+	close(JNL_FILE);
+	if ( $magic eq "\x1f\x8b" ) {
+		open(JNL_FILE, "stf_jnl_ztail $file |") || die "\n$Progname: ERROR - Can't run stf_jnl_ztail on $file.\n";
+	} else {
+		open(JNL_FILE, $file) || die "\n$Progname: ERROR - Can't open journal file, $file.\n";
+	}
+
+	undef $start;
+	while (<JNL_FILE>) {
+		if ( /^Test_Case_Start\|\s*\d+\s+(\S+)/ ) {
+			$name = $1;
+			$start = stamp($_);
+			next;
+		}
+		next unless ( defined $start );
+		next unless ( /^Test_Case_End\|/ );
+
+		$ns = stamp($_);
+		if ( defined $ns && $ns >= $start ) {
+			$sec = ($ns - $start) / 1000000000;
+			add($name, $sec);
+			$dir = $name;
+			while ( $dir =~ s,/[^/]*$,, ) {
+				add("$dir/", $sec);
+			}
+		}
+		undef $start;
+	}
+	close(JNL_FILE);
+}
+
+$Progname = 'stf_jnl_durations';
+
+use Getopt::Std;	# Std.pm is a standard perl module
+
+getopts("u:");
+
+if ($#ARGV < 0) {
+	out_usage;
+	exit 1;
+}
+
+foreach $i (0 .. $#ARGV) {
+	journal($ARGV[$i]);
+}
+
+if ( ! $opt_u ) {
+	foreach $name (sort keys %run) {
+		printf("%s %.3f 1\n", $name, $run{$name});
+	}
+	exit 0;
+}
+
+if ( open(DB_FILE, $opt_u) ) {
+	while (<DB_FILE>) {
+		($name, $sec, $runs) = split;
+		next unless ( defined $runs );
+		$db{$name} = $sec;
+		$dbruns{$name} = $runs;
+	}
+	close(DB_FILE);
+}
+
+##  Average the first few runs, then follow the newer ones ##
+foreach $name (keys %run) {
+	$runs = $dbruns{$name} + 1;
+	$weight = $runs < 4 ? $runs : 4;
+	$db{$name} += ($run{$name} - $db{$name}) / $weight;
+	$dbruns{$name} = $runs;
+}
+
+open(DB_FILE, "> $opt_u.$$") || die "\n$Progname: ERROR - Can't write $opt_u.$$.\n";
+foreach $name (sort keys %db) {
+	printf DB_FILE ("%s %.3f %d\n", $name, $db{$name}, $dbruns{$name});
+}
+close(DB_FILE) || die "\n$Progname: ERROR - Can't write $opt_u.$$.\n";
+rename("$opt_u.$$", $opt_u) || die "\n$Progname: ERROR - Can't rename $opt_u.$$.\n";
@@ -0,0 +1,162 @@
+#! /usr/perl5/bin/perl
+#
+# CDDL HEADER START
+#
+# The contents of this file are subject to the terms of the
+# Common Development and Distribution License (the "License").
+# You may not use this file except in compliance with the License.
+#
+# You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+# or http://www.opensolaris.org/os/licensing.
+# See the License for the specific language governing permissions
+# and limitations under the License.
+#
+# When distributing Covered Code, include this CDDL HEADER in each
+# file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+# If applicable, add the following below this CDDL HEADER, with the
+# fields enclosed by brackets "[]" replaced with your own identifying
+# information: Portions Copyright [yyyy] [name of copyright owner]
+#
+# CDDL HEADER END
+#
+
+#
+# Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+# Use is subject to license terms.
+#
+
+# File: stf_jnl_times
+## read in journal files and report testcase timings from the
+## gethrtime() stamps in the journal records
+
+###############################################################################
+# SUBROUTINES
+###############################################################################
+
+#####################################################################
+# subroutine name: out_usage
+# args: none
+#
+# returns: none
+#
+# print out usage info for stf_jnl_times.
+#####################################################################
+sub out_usage
+{
+	die "usage: $Progname [-v] journalfile {journalfile} \
+\
+options: \
+-v \
+	Also print every stamped record inside a testcase, with its \
+	offset from the start of the testcase and from the record \
+	before it, in milliseconds.  Captured stdout and stderr lines \
+	are only stamped when the tests were run with STF_JNL_STAMP set. \
+";
+}
+
+#####################################################################
+# subroutine name: stamp
+# arg1: journal record
+#
+# returns: the gethrtime() stamp of the record, or undef
+#
+# Time of day records carry "HH:MM:SS ns", Msg records "pid ns" and
+# stamped stdout/stderr records the bare "ns".
+#####################################################################
+sub stamp
+{
+	my @f = split(/\|/, $_[0]);
+
+	return $1 if ( $_[0] =~ /\| \d\d:\d\d:\d\d (\d+) / );
+	return $1 if ( $f[0] eq "Msg" && $f[1] =~ /^\s*\d+ (\d+)\s*$/ );
+	return $1 if ( $f[0] =~ /^std(?:out|err)$/ &&
+	    $f[1] =~ /^\s*(\d+)\s*$/ );
+	return undef;
+}
+
+#####################################################################
+# subroutine name: wall
+# arg1: gethrtime() stamp
+#
+# returns: the stamp as wall clock time, when the journal has an anchor
+#####################################################################
+sub wall
+{
+	my ($sec, $frac);
+
+	return "" unless ( defined $anchor_hr );
+	$sec = $anchor_sec + ($_[0] - $anchor_hr) / 1000000000;
+	$frac = sprintf("%.6f", $sec - int($sec));
+	@tm = localtime(int($sec));
+	return sprintf("%02d:%02d:%02d%s", $tm[2], $tm[1], $tm[0],
+	    substr($frac, 1));
+}
+
+sub ms
+{
+	return sprintf("%.3f", $_[0] / 1000000);
+}
+
+$Progname = 'stf_jnl_times';
+
+use Getopt::Std;	# Std.pm is a standard perl module
+
+getopts("v");
+
+if ($#ARGV < 0) {
+	out_usage;
+	exit 1;
+}
+
+foreach $i (0 .. $#ARGV) {
+
+	$JNL_FILE = $ARGV[$i];
+
+##  A compressed journal is read through stf_jnl_ztail ##
+	open(JNL_FILE, $JNL_FILE) || die "\n$Progname: ERROR - Can't open journal file, $JNL_FILE.\n";
+	read(JNL_FILE, $magic, 2);
+	close(JNL_FILE);
+	if ( $magic eq "\x1f\x8b" ) {
+		open(JNL_FILE, "stf_jnl_ztail $JNL_FILE |") || die "\n$Progname: ERROR - Can't run stf_jnl_ztail on $JNL_FILE.\n";
+	} else {
+		open(JNL_FILE, $JNL_FILE) || die "\n$Progname: ERROR - Can't open journal file, $JNL_FILE.\n";
+	}
+
+	undef $anchor_hr;
+	undef $tc_start;
+
+	while (<JNL_FILE>) {
+		chomp;
+##  The first Start record ties gethrtime() to the wall clock ##
+		if ( /^Start\|.*\| (\d+)\.(\d{6}) (\d+) \|$/ ) {
+			if ( ! defined $anchor_hr ) {
+				$anchor_sec = $1 + $2 / 1000000;
+				$anchor_hr = $3;
+			}
+			next;
+		}
+		$ns = stamp($_);
+		next unless ( defined $ns );
+
+		if ( /^Test_Case_Start\|\s*\d+\s+(\S+)/ ) {
+			$tc_name = $1;
+			$tc_start = $prev = $ns;
+			printf("%s %s\n", wall($ns), $tc_name) if ( $opt_v );
+			next;
+		}
+		next unless ( defined $tc_start );
+
+		if ( /^Test_Case_End\|[^|]*\|\s*(\S+)/ ) {
+			printf("%s %10s ms  %-10s %s\n", wall($tc_start),
+			    ms($ns - $tc_start), $1, $tc_name);
+			undef $tc_start;
+			next;
+		}
+		if ( $opt_v ) {
+			printf("\t+%s ms (+%s ms)  %s\n", ms($ns - $tc_start),
+			    ms($ns - $prev), $_);
+		}
+		$prev = $ns;
+	}
+	close(JNL_FILE);
+}
@@ -0,0 +1,277 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ *
+ */
+
+
+/*
+ * stf_jnl_ztail - read a journal written with STF_JNL_COMPRESS
+ *
+ *	Usage: stf_jnl_ztail [-f] [-n lines] journal
+ *
+ *	options:
+ *	-f	 - follow the journal as it grows, like tail -f
+ *	-n lines - only write the last lines of what is there now
+ *
+ *	A compressed journal is a series of gzip members, one per flush,
+ *	so it can be read at any time; a member that is still being
+ *	written is picked up once the rest of it arrives.  A journal that
+ *	is not compressed is copied as it is.
+ */
+
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <zlib.h>
+
+#define	ZT_BUFSIZE	65536
+#define	ZT_FOLLOW_MS	500	/* poll interval when following */
+
+static char **ring;		/* the last -n lines seen */
+static int ring_size = 0;	/* 0 unless -n was given */
+static int ring_next = 0;
+static int ring_count = 0;
+static char *partial;		/* line that is still being collected */
+static size_t partial_len = 0;
+static size_t partial_size = 0;
+
+/* prototypes */
+static void usage();
+static void emit(const char *, size_t);
+static void collect(const char *, size_t);
+static void ring_flush(void);
+
+int
+main(int argc, char *argv[])
+{
+	extern int optind;
+	char *options = "fn:";
+	static unsigned char in[ZT_BUFSIZE], out[ZT_BUFSIZE];
+	z_stream zs;
+	ssize_t count;
+	size_t held = 0;	/* bytes read before plain was decided */
+	off_t offset = 0;
+	int follow = 0, plain = -1, in_member = 0;
+	int c, fd, ret;
+
+	while ((c = getopt(argc, argv, options)) != EOF) {
+		switch (c) {
+			case 'f':
+				follow = 1;
+				break;
+			case 'n':
+				if ((ring_size = atoi(optarg)) <= 0) {
+					usage();
+					exit(1);
+				}
+				break;
+			default:
+				usage();
+				exit(1);
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		exit(1);
+	}
+	if ((fd = open(argv[optind], O_RDONLY)) == -1) {
+		perror(argv[optind]);
+		exit(1);
+	}
+	if (ring_size > 0 && (ring = calloc(ring_size, sizeof (char *))) ==
+	    NULL) {
+		perror("stf_jnl_ztail: calloc");
+		exit(1);
+	}
+
+	(void) memset(&zs, 0, sizeof (zs));
+	if (inflateInit2(&zs, MAX_WBITS + 16) != Z_OK) {
+		(void) fprintf(stderr, "stf_jnl_ztail: inflateInit failed\n");
+		exit(1);
+	}
+
+	for (;;) {
+		if ((count = read(fd, in + held, sizeof (in) - held)) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("stf_jnl_ztail: read");
+			exit(1);
+		}
+		if (count == 0) {
+			/* caught up with the writers */
+			if (held > 0 && follow == 0) {
+				/* a lone 0x1f, too short to be gzip */
+				emit((char *)in, held);
+				held = 0;
+			}
+			ring_flush();
+			(void) fflush(stdout);
+			if (follow == 0)
+				break;
+			(void) poll(NULL, 0, ZT_FOLLOW_MS);
+			continue;
+		}
+		count += held;
+		held = 0;
+
+		/*
+		 * gzip members start with 0x1f 0x8b.  A journal caught
+		 * after its first byte is held until the second arrives.
+		 */
+		if (plain == -1) {
+			if (count < 2 && in[0] == 0x1f) {
+				held = count;
+				continue;
+			}
+			plain = (in[0] != 0x1f || in[1] != 0x8b);
+		}
+		if (plain) {
+			emit((char *)in, count);
+			offset += count;
+			continue;
+		}
+
+		zs.next_in = in;
+		zs.avail_in = count;
+		while (zs.avail_in > 0) {
+			in_member = 1;
+			zs.next_out = out;
+			zs.avail_out = sizeof (out);
+			ret = inflate(&zs, Z_NO_FLUSH);
+			emit((char *)out, sizeof (out) - zs.avail_out);
+			if (ret == Z_STREAM_END) {
+				/* the next flush starts a new member */
+				(void) inflateReset(&zs);
+				in_member = 0;
+			} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+				(void) fprintf(stderr,
+				    "stf_jnl_ztail: %s: corrupt near offset "
+				    "%lld: %s\n", argv[optind],
+				    (long long)(offset + count - zs.avail_in),
+				    zs.msg != NULL ? zs.msg : "?");
+				ring_flush();
+				exit(1);
+			}
+		}
+		offset += count;
+	}
+
+	if (in_member)
+		(void) fprintf(stderr,
+		    "stf_jnl_ztail: %s ends in an incomplete member\n",
+		    argv[optind]);
+	(void) inflateEnd(&zs);
+	return (0);
+}
+
+/* write out journal text, or keep its last lines for -n */
+static void
+emit(const char *p, size_t n)
+{
+	if (n == 0)
+		return;
+	if (ring_size == 0)
+		(void) fwrite(p, 1, n, stdout);
+	else
+		collect(p, n);
+}
+
+/* split text into lines for the -n ring */
+static void
+collect(const char *p, size_t n)
+{
+	const char *nl;
+	size_t len;
+
+	while (n > 0) {
+		nl = memchr(p, '\n', n);
+		len = (nl != NULL) ? nl - p + 1 : n;
+		if (partial_len + len + 1 > partial_size) {
+			partial_size = (partial_len + len + 1) * 2;
+			if ((partial = realloc(partial, partial_size)) ==
+			    NULL) {
+				perror("stf_jnl_ztail: realloc");
+				exit(1);
+			}
+		}
+		(void) memcpy(partial + partial_len, p, len);
+		partial_len += len;
+		partial[partial_len] = '\0';
+		p += len;
+		n -= len;
+
+		if (nl != NULL) {
+			free(ring[ring_next]);
+			if ((ring[ring_next] = strdup(partial)) == NULL) {
+				perror("stf_jnl_ztail: strdup");
+				exit(1);
+			}
+			ring_next = (ring_next + 1) % ring_size;
+			if (ring_count < ring_size)
+				++ring_count;
+			partial_len = 0;
+		}
+	}
+}
+
+/*
+ * Write the lines kept for -n, then stop keeping them: from here on,
+ * as with tail, everything new is written as it arrives.
+ */
+static void
+ring_flush(void)
+{
+	int i, first;
+
+	if (ring_size == 0)
+		return;
+	first = (ring_next - ring_count + ring_size) % ring_size;
+	for (i = 0; i < ring_count; i++) {
+		(void) fputs(ring[(first + i) % ring_size], stdout);
+		free(ring[(first + i) % ring_size]);
+	}
+	if (partial_len > 0)
+		(void) fwrite(partial, 1, partial_len, stdout);
+	free(ring);
+	free(partial);
+	ring_size = 0;
+}
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr,
+	"Usage: stf_jnl_ztail [-f] [-n lines] journal\n");
+	(void) fprintf(stderr,
+	"\noptions:\n");
+	(void) fprintf(stderr,
+	"\t-f\t - follow the journal as it grows\n");
+	(void) fprintf(stderr,
+	"\t-n lines - only write the last lines of the journal\n");
+}
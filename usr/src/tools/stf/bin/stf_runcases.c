@@ -0,0 +1,315 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ *
+ */
+
+/*
+ * stf_runcases - run the test cases of a directory
+ *
+ *	This does the work of the testcaseExtract -e loops in
+ *	stf_common.kshlib, without a shell eval, a listFilter subshell
+ *	and an export for every test case.  Each test case is still run
+ *	under stf_timeout and stf_jnl_context, or stf_supervise, with the
+ *	same arguments and environment, so the journal and the results
+ *	tree come out the same.
+ *
+ *	Usage: stf_runcases [options] limit
+ *
+ *	options:
+ *	-R file	- root test cases, run through $STF_GOSU
+ *	-U file	- user test cases
+ *	-d dir	- the directory's path relative to STF_SUITE
+ *	-b dir	- binary directory, appended to PATH
+ *	-l list	- only run test cases matching these patterns, or not
+ *		  matching them if the list starts with ~
+ *	-f	- run each test case under stf_supervise alone
+ *
+ *	limit	- time limit for each test case
+ *
+ *	Each line of a test case file is a test case name and the command
+ *	to run it.  A command the shell would do anything more with than
+ *	split into words is left to the shell: stf_runcases then exits 2
+ *	before running anything, and the caller runs the files itself.
+ */
+
+#include <stf_impl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#define	MAXWORDS	256
+#define	NOTNATIVE	2
+
+/* characters the shell gives a meaning to, besides white space */
+static const char shellchars[] = "$`'\"\\*?[]{}~#;&|<>()=!^";
+
+/* prototypes */
+static void usage();
+
+/*
+ * Split s in place into at most max - 1 words at blanks, tabs and
+ * newlines, leaving them in words[] followed by a NULL.  Return the
+ * number of words, or -1 if there are too many.
+ */
+static int
+split(char *s, char **words, int max)
+{
+	int n = 0;
+	char *word;
+
+	for (word = strtok(s, " \t\n"); word != NULL;
+	    word = strtok(NULL, " \t\n")) {
+		if (n == max - 1)
+			return (-1);
+		words[n++] = word;
+	}
+	words[n] = NULL;
+	return (n);
+}
+
+/*
+ * Return 1 if every line of file is a test case name and a command
+ * made of plain words, or there is no such file, 0 otherwise.  A file
+ * that can't be read is left to the shell too.
+ */
+static int
+plain(const char *file)
+{
+	FILE *fp;
+	char line[LINE_MAX];
+	char *words[MAXWORDS];
+	int ok = 1;
+
+	if (file == NULL)
+		return (1);
+	if ((fp = fopen(file, "r")) == NULL)
+		return (errno == ENOENT);
+
+	while (ok && fgets(line, sizeof (line), fp) != NULL) {
+		if (strchr(line, '\n') == NULL && !feof(fp))
+			ok = 0;		/* too long */
+		else if (strpbrk(line, shellchars) != NULL)
+			ok = 0;
+		else if (split(line, words, MAXWORDS) < 1)
+			ok = 0;		/* blank */
+	}
+	(void) fclose(fp);
+	return (ok);
+}
+
+/*
+ * Return 1 if the test case name matches the filter list, the way
+ * listFilter does, 0 otherwise.
+ */
+static int
+selected(const char *name, const char *list)
+{
+	char buf[LINE_MAX];
+	char *pattern;
+	int want = 1;
+
+	if (list == NULL || *list == '\0')
+		return (1);
+	if (*list == '~') {
+		want = 0;
+		++list;
+	}
+
+	(void) strlcpy(buf, list, sizeof (buf));
+	for (pattern = strtok(buf, " \t\n"); pattern != NULL;
+	    pattern = strtok(NULL, " \t\n")) {
+		if (fnmatch(pattern, name, 0) == 0)
+			return (want);
+	}
+	return (!want);
+}
+
+/*
+ * Run the test cases in file, each one as
+ *
+ *	[gosu] supervisor -n reldir/name limit [capturer] command
+ *
+ * with standard input from /dev/null.
+ */
+static void
+run(const char *file, const char *kind, char *gosu, const char *reldir,
+    const char *limit, const char *list, int fused)
+{
+	FILE *fp;
+	char line[LINE_MAX];
+	char gosubuf[PATH_MAX];
+	char name[PATH_MAX];
+	char *cmd[MAXWORDS];
+	char *args[2 * MAXWORDS + 8];	/* gosu, fixed words, command */
+	int ncmd, n, i, status;
+	pid_t pid;
+
+	if (file == NULL || (fp = fopen(file, "r")) == NULL)
+		return;
+	/*
+	 * The children share the file offset.  Close the file on exec
+	 * rather than with fclose(), which would seek it back over the
+	 * bytes still buffered here.
+	 */
+	(void) fcntl(fileno(fp), F_SETFD, FD_CLOEXEC);
+
+	while (fgets(line, sizeof (line), fp) != NULL) {
+		if ((ncmd = split(line, cmd, MAXWORDS)) < 1)
+			continue;
+		if (!selected(cmd[0], list))
+			continue;
+
+		(void) printf("Running %s test case:  %s | ", kind, cmd[0]);
+		(void) fflush(stdout);
+
+		n = 0;
+		if (gosu != NULL) {
+			(void) strlcpy(gosubuf, gosu, sizeof (gosubuf));
+			n = split(gosubuf, args, MAXWORDS);
+		}
+		(void) snprintf(name, sizeof (name), "%s/%s", reldir, cmd[0]);
+		args[n++] = fused ? "stf_supervise" : "stf_timeout";
+		args[n++] = "-n";
+		args[n++] = name;
+		args[n++] = (char *)limit;
+		if (!fused)
+			args[n++] = "stf_jnl_context";
+		for (i = 1; i < ncmd; i++)
+			args[n++] = cmd[i];
+		args[n] = NULL;
+
+		if ((pid = fork()) == -1) {
+			perror("stf_runcases: fork");
+			exit(1);
+		}
+		if (pid == 0) {
+			int fd = open("/dev/null", O_RDONLY);
+
+			if (fd != -1 && fd != 0) {
+				(void) dup2(fd, 0);
+				(void) close(fd);
+			}
+			(void) setenv("STF_CASENAME", cmd[0], 1);
+			(void) execvp(args[0], args);
+			perror(args[0]);
+			_exit(127);
+		}
+		while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+			;
+	}
+	(void) fclose(fp);
+}
+
+int
+main(int argc, char *argv[])
+{
+	extern int optind;
+	extern char *optarg;
+	char *options = "R:U:d:b:l:f";
+	char *rootfile = NULL;
+	char *userfile = NULL;
+	char *reldir = "";
+	char *bindir = NULL;
+	char *list = NULL;
+	char *gosu;
+	char gosubuf[PATH_MAX];
+	char *words[MAXWORDS];
+	char *path;
+	char *newpath;
+	int fused = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, options)) != EOF) {
+		switch (c) {
+
+			case 'R':
+				rootfile = optarg;
+				break;
+			case 'U':
+				userfile = optarg;
+				break;
+			case 'd':
+				reldir = optarg;
+				break;
+			case 'b':
+				bindir = optarg;
+				break;
+			case 'l':
+				list = optarg;
+				break;
+			case 'f':
+				fused = 1;
+				break;
+			default:
+				usage();
+				exit(1);
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		exit(1);
+	}
+
+	/* the shell splits these words, and globs them */
+	if (!plain(rootfile) || !plain(userfile) ||
+	    (list != NULL && strpbrk(list, "()@!+\\") != NULL))
+		exit(NOTNATIVE);
+
+	/* so does it STF_GOSU, which must fit before each command */
+	if ((gosu = getenv("STF_GOSU")) != NULL) {
+		if (strlcpy(gosubuf, gosu, sizeof (gosubuf)) >=
+		    sizeof (gosubuf) || split(gosubuf, words, MAXWORDS) < 0)
+			exit(NOTNATIVE);
+	}
+
+	if (bindir != NULL) {
+		if ((path = getenv("PATH")) == NULL)
+			path = "";
+		newpath = malloc(strlen(path) + strlen(bindir) + 2);
+		if (newpath == NULL) {
+			perror("stf_runcases: malloc");
+			exit(1);
+		}
+		(void) sprintf(newpath, "%s:%s", path, bindir);
+		(void) setenv("PATH", newpath, 1);
+	}
+
+	run(rootfile, "root", gosu, reldir, argv[optind], list, fused);
+	run(userfile, "user", NULL, reldir, argv[optind], list, fused);
+
+	return (0);
+}
+
+static void
+usage()
+{
+	(void) fprintf(stderr, "Usage: stf_runcases [-R rootfile] "
+	    "[-U userfile] [-d reldir] [-b bindir] [-l list] [-f] limit\n");
+}
@@ -0,0 +1,270 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ *
+ */
+
+
+/*
+ * stf_supervise - run a test case under a time limit, journal its output
+ *	and report start/stop
+ *
+ *	This does the work of "stf_timeout ... stf_jnl_context command"
+ *	in a single process.
+ *
+ * 	Usage: stf_supervise [options] limit command
+ *
+ *	options:
+ *	-n name	- name of testcase to use in journal
+ *	-q	- quiet mode, some journaling suppressed
+ *	-s	- suspend hung process instead of killing it
+ *
+ *	limit	- integer time limit in seconds or of the form 3h23m45s
+ *	command	- command line
+ */
+
+#include <stf_impl.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_pid = -1;
+
+/* stdout and jnl output pipe */
+static int pivec1[2];
+/* stderr pipe */
+static int pipe_err[2];
+
+/* set by goodbye(); the main loop does the killing */
+static volatile sig_atomic_t stopped = 0;
+
+/* prototypes */
+static void usage();
+
+/*
+ * Only async-signal-safe work here: note the signal and wake up
+ * stf_capture_run(), which main() is almost always blocked in.
+ */
+/*ARGSUSED*/
+
+static void
+goodbye(int signum)
+{
+	stopped = 1;
+	stf_capture_stop();
+}
+
+int
+main(int argc, char *argv[])
+{
+	extern int optind;
+	char **prgargs, *options = "sqn:";
+	char *timeoutarg;
+	int quiet = 0;		/* suppress (some) printing of jnl lines */
+	int suspend = 0;	/* set so that a hung process is not killed */
+	int timed_out = 0;
+	int result;
+	int child_pid, child_status = 0, c;
+	int tmp_status;
+	int child_fd;
+	pid_t mypid;
+	time_t duration;
+	hrtime_t end_time;
+	char *name = NULL;
+	char *tempname;
+	int nflag = 0;		/* use name for the testcase in jnl */
+
+	if (argc < 2) {
+		usage();
+		exit(1);
+	}
+
+	suspend = (getenv("STF_SUSPEND") != NULL);
+
+	while ((c = getopt(argc, argv, options)) != EOF) {
+		switch (c) {
+
+			case 's':
+				suspend = 1;
+				break;
+			case 'q':
+				quiet = 1;
+				break;
+			case 'n':
+				nflag = 1;
+				name = optarg;
+				break;
+		}
+	}
+	/* get timeout value */
+	timeoutarg = argv[optind];
+	stf_parse_timeout(timeoutarg, &duration);
+	++optind;
+
+	/* program name and args pointer */
+	if (optind < argc) {
+		prgargs = &(argv[optind]);
+		tempname = prgargs[0];
+	} else {
+		usage();
+		(void) fprintf(stderr, "	missing command name\n");
+		exit(1);
+	}
+
+	if (pipe(pivec1) == -1 || pipe(pipe_err) == -1) {
+		perror("supervise: pipe");
+		exit(1);
+	}
+	stf_capture_init(stf_jnl_open());
+
+	/* for timeout value */
+	end_time = gethrtime() + (duration * (hrtime_t)NANOSEC);
+	(void) signal(SIGHUP, goodbye);
+	(void) signal(SIGINT, goodbye);
+	(void) signal(SIGQUIT, goodbye);
+	(void) signal(SIGTERM, goodbye);
+
+	stf_child_watch_init();
+
+	if ((test_pid = fork1()) == 0) {	/* this is the child */
+		/*
+		 * Set the child to be the process group leader.
+		 * The session id is left the same.
+		 */
+		mypid = getpid();
+		(void) setpgid(mypid, mypid);
+		stf_child_watch_reset();
+		if (quiet == 0) {
+			if (nflag == 1)
+				prgargs[0] = name;
+			stf_jnl_testcase_start(prgargs);
+			if (nflag == 1)
+				prgargs[0] = tempname;
+		}
+
+		/* exec discards anything still in the journal buffer */
+		stf_jnl_flush();
+
+		(void) dup2(pivec1[1], 1);	/* stdout => pivec1[1] */
+		(void) dup2(pipe_err[1], 2);	/* stderr => pipe_err[1] */
+
+		closefrom(STDERR_FILENO + 1);
+
+		(void) execvp(prgargs[0], &prgargs[0]);
+		perror("supervise: exec failed");
+		(void) fprintf(stderr, "exec file is: %s\n", prgargs[0]);
+		exit(1);
+	}
+	if (test_pid == -1) {
+		perror("Fork failed");
+		exit(1);
+	}
+	(void) close(pivec1[1]);
+	(void) close(pipe_err[1]);
+
+	if ((child_fd = stf_child_watch(test_pid)) == -1) {
+		perror("supervise: child watch");
+		exit(1);
+	}
+
+	if ((result = stf_capture_run(pivec1[0], pipe_err[0], child_fd,
+	    test_pid, end_time)) == STF_CAPTURE_TIMEDOUT) {
+		timed_out = 1;
+		if (suspend == 0) {
+			(void) fprintf(stderr, "\nprocess %d - timed out\n",
+			    test_pid);
+			/* and the grandchild pids too */
+			stf_kill_group(test_pid);
+		} else {
+			(void) fprintf(stderr,
+		    "\nprocess %d - timed out, suspend flag set, not killed\n",
+			    test_pid);
+			/* keep journaling until someone deals with it */
+			result = stf_capture_run(pivec1[0], pipe_err[0],
+			    child_fd, test_pid, 0);
+		}
+	}
+	if (result == STF_CAPTURE_STOPPED || stopped) {
+		/* we were signalled: take the test down with us */
+		stf_kill_group(test_pid);
+		stf_capture_end(pivec1[0], pipe_err[0]);
+		exit(1);
+	}
+	stf_capture_end(pivec1[0], pipe_err[0]);
+
+	/* stf_kill_group() may already have reaped the child */
+	if ((child_pid = waitpid(test_pid, &child_status, 0)) == -1)
+		child_pid = test_pid;
+	else if (timed_out == 0)
+		/* get child pids too */
+		(void) kill(-test_pid, SIGKILL);
+
+	/*
+	 * stf_jnl_context passed a signalled test's wait status back as
+	 * its exit code; keep reporting it the same way.
+	 */
+	if (timed_out == 0 && WIFSIGNALED(child_status))
+		child_status = (child_status & 0xff) << 8;
+
+	/* A time out defaults to an exit status of 0, */
+	/* here we force a time out status, while retaining the sig */
+	if (timed_out == 1) {  /* fake a time_out status for time out */
+		tmp_status = child_status;
+		/* mask in an exit status, make sure it's set to zero first */
+		child_status = (tmp_status & 0xffff00ff) |
+		    (TIMED_OUT_INDEX << 8);
+	}
+
+	if (quiet == 0) {
+		if (nflag == 1)
+			prgargs[0] = name;
+		stf_jnl_testcase_end(name, child_pid, child_status);
+		if (nflag == 1)
+			prgargs[0] = tempname;
+	}
+	return (WEXITSTATUS(child_status));
+}
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr,
+	"Usage: supervise [options] limit command.\n");
+	(void) fprintf(stderr,
+	"\noptions:\n");
+	(void) fprintf(stderr,
+	"\t-n name\t - name of testcase to use in journal\n");
+	(void) fprintf(stderr,
+	"\t-q\t- quiet mode, some journaling suppressed\n");
+	(void) fprintf(stderr,
+	"\t-s\t- suspend hung process instead of killing it\n\n");
+	(void) fprintf(stderr,
+	"\tlimit\t- integer time limit in seconds or of the form 3h23m45s\n");
+	(void) fprintf(stderr,
+	"\tcommand\t- command line\n");
+}
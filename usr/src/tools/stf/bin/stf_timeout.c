@@ -57,42 +57,17 @@ static int timed_out;
 static int test_pid = -1;
 static int process_fd;
 
-static char process_file[32] = "/proc/";
-
-enum units {hours, minutes, seconds, none};
-
 /* prototypes */
 static void wake_up();
 static void usage();
 static int poll_process(hrtime_t timeout_end, int suspendflag);
-static void parse_timeout(char *, time_t *duration);
-static time_t parse_value(char **stringpp, enum units *value_units);
-
-static void
-clean_kill(int test_pid)
-{
-	int i, child_status;
-	if (test_pid > 0) {
-		(void) kill(-test_pid, SIGHUP);
-		for (i = 0; i < 10; i++) {
-			if (waitpid(test_pid, &child_status, WNOHANG)
-			    == test_pid) {
-				break;
-			}
-			(void) sleep(1);
-		}
-		(void) kill(-test_pid, SIGKILL);
-		(void) sleep(3);
-	}
-
-}
 
 /*ARGSUSED*/
 
 static void
 goodbye(int signum)
 {
-	if (test_pid > 0) clean_kill(test_pid);
+	if (test_pid > 0) stf_kill_group(test_pid);
 	exit(1);
 }
 
@@ -138,7 +113,7 @@ main(int argc, char *argv[])
 	}
 	/* get timeout value */
 	timeoutarg = argv[optind];
-	parse_timeout(timeoutarg, &duration);
+	stf_parse_timeout(timeoutarg, &duration);
 	++optind;
 
 	/* program name and args pointer */
@@ -159,6 +134,8 @@ main(int argc, char *argv[])
 	(void) signal(SIGQUIT, goodbye);
 	(void) signal(SIGTERM, goodbye);
 
+	stf_child_watch_init();
+
 	if ((test_pid = fork1()) == 0) {	/* this is the child */
 		/*
 		 * Set the child to be the process group leader.
@@ -166,6 +143,7 @@ main(int argc, char *argv[])
 		 */
 		mypid = getpid();
 		(void) setpgid(mypid, mypid);
+		stf_child_watch_reset();
 		if (quiet == 0) {
 			if (nflag == 1)
 				prgargs[0] = name;
@@ -174,6 +152,8 @@ main(int argc, char *argv[])
 				prgargs[0] = tempname;
 		}
 
+		/* exec discards anything still in the journal buffer */
+		stf_jnl_flush();
 		(void) execvp(prgargs[0], &prgargs[0]);
 		perror("timeout: exec failed");
 		(void) fprintf(stderr, "exec file is: %s\n", prgargs[0]);
@@ -183,12 +163,13 @@ main(int argc, char *argv[])
 		perror("Fork failed");
 		exit(1);
 	}
-	(void) sprintf(process_file, "%s%d", process_file, test_pid);
-	if ((process_fd = open(process_file, O_RDONLY, 0666)) == -1) {
-		perror("timeout: proc file open");
+	if ((process_fd = stf_child_watch(test_pid)) == -1) {
+		perror("timeout: child watch");
 		exit(1);
 	}
 
+	/* nothing is journaled while waiting, so nothing can be held */
+	stf_jnl_flush();
 	(void) poll_process(end_time, suspend);
 	child_pid = waitpid(test_pid, &child_status, 0);
 
@@ -213,27 +194,36 @@ main(int argc, char *argv[])
 
 /*
  * poll on the pipe and child process to see what to do next
+ *
+ * Sleeps until the child exits or the time limit is reached.
  */
 static int
 poll_process(hrtime_t timeout_end, int suspendflag)
 {
 	int pollval;
 	int polltimeout;
+	hrtime_t remaining;
 
 	pollfd_t pollfds;
 
 	pollfds.fd = process_fd;
-	pollfds.events = POLLPRI;
+	pollfds.events = stf_child_events(process_fd);
 
 	for (;;) {
-		if ((polltimeout = (int)((timeout_end - gethrtime()) /
-		    (hrtime_t)NANOSEC)) < 0) {
+		if ((remaining = timeout_end - gethrtime()) <= 0) {
 			pollval = 0;
 		} else {
-			pollval = poll(&pollfds, 1, polltimeout * 1000);
+			/* round up to the next msec, poll() takes an int */
+			remaining = (remaining + (NANOSEC / MILLISEC) - 1) /
+			    (NANOSEC / MILLISEC);
+			polltimeout = (remaining > INT_MAX) ? INT_MAX :
+			    (int)remaining;
+			pollval = poll(&pollfds, 1, polltimeout);
 		}
 		switch (pollval) {
 			case -1:
+				if (errno == EINTR)
+					continue;
 				/* error */
 				(void) fprintf(stderr,
 				    "poll failed, errno=%d (%s)\n", errno,
@@ -263,26 +253,21 @@ poll_process(hrtime_t timeout_end, int suspendflag)
 			default: /* event of interest */
 				break;
 		}
-		switch (pollfds.revents) {
-			case POLLPRI:
-			/* return for now, may want to check later */
-				(void) fprintf(stderr, "pollpri error\n");
-				return (0);
-			case POLLERR:
+		if (pollfds.revents & POLLERR) {
 			/* error */
-				perror("poll error:");
-				return (0);
-			case POLLHUP:
-			/* child finished */
-				/* get child pids too */
-				(void) kill(-test_pid, SIGKILL);
-				return (0);
-			case POLLNVAL:
+			perror("poll error:");
+			return (0);
+		}
+		if (pollfds.revents & POLLNVAL) {
 			/* may want to go into more detail later */
-				perror("poll fd val:");
-				return (0);
-			default:
-				break;
+			perror("poll fd val:");
+			return (0);
+		}
+		if (stf_child_exited(process_fd, test_pid)) {
+			/* child finished */
+			/* get child pids too */
+			(void) kill(-test_pid, SIGKILL);
+			return (0);
 		}
 	}
 }
@@ -292,7 +277,7 @@ wake_up(void)
 {
 	timed_out = 1;
 	(void) fprintf(stderr, "\nprocess %d - timed out\n", test_pid);
-	clean_kill(test_pid);	/* and the grandchild pids too */
+	stf_kill_group(test_pid);	/* and the grandchild pids too */
 }
 
 static void
@@ -313,90 +298,3 @@ usage(void)
 	(void) fprintf(stderr,
 	"\tcommand\t- command line\n");
 }
-
-/*
- * parse_timeout(limit_string, duration)
- *	parse the argument limit_string
- *	   <time>: do the command until <time> has passed
- *		<time> is of the form 3h23m45s
- *		if it's just a number the default is for
- *		seconds for backwards compatibility.
- */
-static void
-parse_timeout(char *limit_string, time_t *duration)
-{
-	char *value_string = limit_string;
-	time_t value;
-	enum units value_units;
-
-	*duration = (time_t)-1;
-
-	value = parse_value(&value_string, &value_units);
-	*duration = 0;
-	if (value_units == hours) {
-		*duration = 60 * 60 * value;
-		value = parse_value(&value_string, &value_units);
-	}
-	if (value_units == minutes) {
-		*duration += 60 * value;
-		value = parse_value(&value_string, &value_units);
-	}
-	if (value_units == seconds) {
-		*duration += value;
-		value = parse_value(&value_string, &value_units);
-	}
-	if (value_units == none) {	/* all processed */
-		*duration += value;	/* default to seconds */
-		if (*duration == 0) {
-			(void) fprintf(stderr,
-			    "duration <%s> is 0\n",
-			    limit_string);
-
-		}
-		return;
-	}
-	(void) fprintf(stderr, "time limit <%s> is bad\n", limit_string);
-}
-
-/*
- * parse_value(stringpp, value_units)
- *	Extract a value from the string, and return it.
- *	Move string pointer.  Set units of the value.
- */
-static time_t
-parse_value(char **stringpp, enum units *value_units)
-{
-	time_t value;
-	char *new_stringp;
-
-	errno = 0;	/* since we'll be checking it when perhaps no error */
-
-	/* the cast is valid */
-	value = (time_t)strtol(*stringpp, &new_stringp, 10);
-	if ((value == INT_MAX || value == INT_MIN) && errno == ERANGE) {
-		(void) fprintf(stderr, "limit <%s> exceeds maximum allowed"
-		    " value %u\n", *stringpp, INT_MAX);
-	}
-	switch (*new_stringp) {
-	case NULL:
-		*value_units = none;
-		break;
-	case 'h':
-		*value_units = hours;
-		new_stringp++;
-		break;
-	case 'm':
-		*value_units = minutes;
-		new_stringp++;
-		break;
-	case 's':
-		*value_units = seconds;
-		new_stringp++;
-		break;
-	default:
-		(void) fprintf(stderr, "bad limit value <%s>, unrecognized "
-		    "character %c\n", *stringpp, *new_stringp);
-	}
-	*stringpp = new_stringp;
-	return (value);
-}
@@ -35,6 +35,8 @@
 extern "C" {
 #endif
 
+#include <inttypes.h>
+
 /*
  *	Generally useful stuff...
  */
@@ -45,7 +47,12 @@ extern "C" {
  */
 typedef enum ht_option_bits {
 	hto_resize_implicit_bit /* = 0 */, /* Should resizes be implicit? */
-	hto_dups_allowed_bit	/* = 1 */  /* Are duplicates allowed?	*/
+	hto_dups_allowed_bit	/* = 1 */, /* Are duplicates allowed?	*/
+	hto_hash_wide_bit	/* = 2 */, /* Lane hash for long keys?	*/
+	hto_hash_legacy_bit	/* = 3 */, /* Original shift/xor hash?	*/
+	hto_open_addressing_bit	/* = 4 */, /* Open addressing table?	*/
+	hto_concurrent_bit	/* = 5 */, /* Lock free lookups?	*/
+	hto_mapped_bit		/* = 6 */  /* Mapped from a file?	*/
 } ht_option_bit_t;
 
 typedef enum ht_options {
@@ -55,7 +62,9 @@ typedef enum ht_options {
 	 *  from previous entries that hashed to the same bucket. Resizing
 	 *  can be done explicitly by the cleint calling ht_resize(), or
 	 *  implicitly. Implicit resizing only occurs when dangling has been
-	 *  disallowed and implicit resizing allowed
+	 *  disallowed and implicit resizing allowed. Either way, a chained
+	 *  table's entries move to the new size a few chains at a time with
+	 *  each insert and delete, rather than all at once.
 	 */
 	hto_resize_implicit	= _ht_bit_mask(hto_resize_implicit_bit),
 
@@ -63,10 +72,142 @@ typedef enum ht_options {
 	 *  Duplicate entries have identicle keys, but may have different data.
 	 *  Consequently, it may be perfectly legal to have such entries.
 	 */
-	hto_dups_allowed	= _ht_bit_mask(hto_dups_allowed_bit)
+	hto_dups_allowed	= _ht_bit_mask(hto_dups_allowed_bit),
+
+	/*
+	 *  Tables hash with ht_hash_mix() by default, and are sized to a power
+	 *  of two so the hash can be reduced to an index with a mask. Keys of
+	 *  more than a few dozen bytes (paths, long names) hash faster with
+	 *  ht_hash_wide(), which consumes 32 bytes per step.
+	 */
+	hto_hash_wide		= _ht_bit_mask(hto_hash_wide_bit),
+
+	/*
+	 *  The original ht_hash_bytes() hash. Tables using it keep the exact
+	 *  size requested and reduce with a modulo, since the low bits of
+	 *  that hash are poorly distributed. If both hash options are given,
+	 *  hto_hash_wide wins.
+	 */
+	hto_hash_legacy		= _ht_bit_mask(hto_hash_legacy_bit),
+
+	/*
+	 *  Store entries in a flat slot array probed in groups of eight, with
+	 *  one control byte per slot holding seven bits of the hash. A lookup
+	 *  compares eight control bytes at once and only touches the keys
+	 *  whose bits match. Keys of up to HT_INLINE_KEY bytes are copied
+	 *  into the slot, so the caller's key need not outlive the insert.
+	 *  The table grows by itself when it gets 7/8 full, whether or not
+	 *  hto_resize_implicit is given, and always uses ht_hash_mix() or
+	 *  ht_hash_wide().
+	 */
+	hto_open_addressing	= _ht_bit_mask(hto_open_addressing_bit),
+
+	/*
+	 *  An open addressing table (implied) whose lookups take no locks and
+	 *  store nothing to shared memory, so they scale with the number of
+	 *  reading threads. Lookups are validated against per-stripe change
+	 *  counts and retried if a writer changed the group they looked at.
+	 *  Writers lock one of 64 stripes, picked by the key's
+	 *  home group. Keys longer than HT_INLINE_KEY are copied, and the
+	 *  copies and replaced buffers are freed only once no lookup can
+	 *  still see them. Lookups don't update the table statistics.
+	 */
+	hto_concurrent		= _ht_bit_mask(hto_concurrent_bit),
+
+	/*
+	 *  Set on the read-only tables ht_map() makes of the files written by
+	 *  ht_save(), and ignored by ht_create(). Lookups and snapshots work
+	 *  as for any table, and return pointers into the mapped file.
+	 *  Inserts, deletes and resizes fail with EROFS.
+	 */
+	hto_mapped		= _ht_bit_mask(hto_mapped_bit)
 
 } ht_option_t;
 
+/*
+ *	Largest key stored in the slot itself by hto_open_addressing tables.
+ */
+#define	HT_INLINE_KEY		8
+
+/*
+ *	What a table knows about its own load, as handed to its resize
+ *	policy. Counts marked "window" cover the time since the last resize
+ *	(or since the table was created), so the policy sees how the table
+ *	behaves at its current size only.
+ */
+typedef struct ht_load {
+	size_t		numents;	/* Buckets or slots in the table. */
+	size_t		minents;	/* Size the table was created at. */
+	size_t		entries;	/* Keys in the table.		*/
+	ht_option_t	options;	/* Table options.		*/
+	u_longlong_t	probes;		/* Window: lookups.		*/
+	u_longlong_t	hits;		/* Window: lookups that hit.	*/
+	u_longlong_t	searchcount;	/* Window: chains searched.	*/
+	u_longlong_t	searchsum;	/* Window: sum of their depths.	*/
+	u_longlong_t	searchmax;	/* Window: deepest search.	*/
+	u_longlong_t	depthmax;	/* Window: deepest insert.	*/
+	u_longlong_t	updates;	/* Window: inserts and deletes.	*/
+
+} ht_load_t;
+
+/*
+ *	A resize policy looks at a table's load and answers with the number
+ *	of entries the table should have, or zero to leave it be.
+ */
+typedef size_t (*ht_threshold_t)(const ht_load_t *load);
+
+/*
+ *	A full width hash and a key comparison, as handed to ht_specialize().
+ *	The hash must spread its bits well: open addressing tables take the
+ *	slot from the high bits and seven bits of control byte from the low.
+ *	The comparison returns zero when the keys match, like bcmp().
+ */
+typedef uint64_t (*ht_hash_full_t)(const void *key, size_t keysize);
+typedef int (*ht_compare_t)(const void *key1,
+    const void *key2,
+    size_t keysize);
+
+/*
+ *	ht_save() asks an ht_datalen_t how many bytes of an entry's data to
+ *	write to the file. Without one, data is taken to be a string.
+ */
+typedef size_t (*ht_datalen_t)(const void *data);
+
+/*
+ *	A copy of a table's keys and data pointers, taken by ht_snapshot().
+ */
+typedef struct ht_snapshot ht_snapshot_t;
+
+/*
+ *	A snapshot of a table's statistics, as filled in by ht_stats(). The
+ *	counts run from the table's creation, and are taken while the table
+ *	is in use, so they needn't agree with each other exactly. A library
+ *	built with HT_NO_STATS leaves all but the sizes zero.
+ */
+typedef struct ht_average {
+	u_longlong_t	count;		/* Times recorded.		*/
+	u_longlong_t	sum;		/* Sum of the values recorded.	*/
+	u_longlong_t	maximum;	/* Largest value recorded.	*/
+
+} ht_average_t;
+
+typedef struct ht_stats {
+	size_t		numents;	/* Buckets or slots in the table. */
+	size_t		entries;	/* Keys in the table.		*/
+	size_t		freecount;	/* Entries on the free chain.	*/
+	u_longlong_t	deletes;	/* Attempted deletes.		*/
+	u_longlong_t	errors;		/* Errors returned.		*/
+	u_longlong_t	hits;		/* Lookups that hit.		*/
+	u_longlong_t	inserts;	/* Attempted inserts.		*/
+	u_longlong_t	probes;		/* Lookups.			*/
+	u_longlong_t	resizes;	/* Table resizes.		*/
+	u_longlong_t	slabs;		/* Slabs of entries allocated.	*/
+	ht_average_t	depth;		/* Chain depth at insert.	*/
+	ht_average_t	freechain;	/* Free chain length.		*/
+	ht_average_t	searches;	/* Depth searched by lookups.	*/
+
+} ht_stats_t;
+
 /*
  * int
  * ht_evaluate_threshold_default(size_t numents,
@@ -78,7 +219,9 @@ typedef enum ht_options {
  * Description
  *	A default function for evaluating whether or not a table needs to be
  *	resized due to inordinant searches of some depth. This default function
- *	alway answers false.
+ *	alway answers false. It's kept for old callers; tables are now
+ *	resized by an ht_threshold_t policy, ht_evaluate_threshold_adaptive()
+ *	unless ht_set_threshold() says otherwise.
  *
  * Parameters:
  * 	size_t numents
@@ -112,19 +255,94 @@ ht_evaluate_threshold_default(size_t numents,
     u_longlong_t searchsum);
 
 /*
- *  unsigned int
- *  ht_hash_compute(void *key, size_t keysize)
+ * size_t
+ * ht_evaluate_threshold_adaptive(const ht_load_t *load);
+ *
+ * Description
+ *	The resize policy tables start with. A table is doubled when it gets
+ *	too full for its kind: a chained table holding more keys than
+ *	buckets, or one whose searches run deep (on average, at the worst,
+ *	or because most lookups miss and walk whole chains) while it's more
+ *	than half full. Open addressing tables double themselves at 7/8 full,
+ *	but are doubled sooner here when lookups mostly miss or probe past
+ *	their first group. Once fewer than one bucket in eight (one slot in
+ *	sixteen) is in use, a table is shrunk to twice (four times) as many
+ *	as it holds, never below its created size. Growing leaves a table no
+ *	less than half as full as the shrink mark and shrinking leaves it
+ *	well short of the grow mark, so the two don't chase each other.
+ *
+ * Parameters:
+ *	const ht_load_t *load
+ *		Input - The table's load.
+ *
+ * Return value:
+ *	size_t	The size the table should be resized to, or zero if it's fine.
+ */
+size_t
+ht_evaluate_threshold_adaptive(const ht_load_t *load);
+
+/*
+ *  size_t
+ *  ht_hash_bytes(void *key, size_t keysize, size_t table_size)
  *
  *  Description:
- *	Compute a hash value based on the bytes passed as the key.
+ *	Compute a hash value based on the bytes passed as the key. This is
+ *	the original shift and xor hash, selected with hto_hash_legacy.
  *
  *  Paramaters:
+ *	void *key
+ *		Input - Pointer to the bytes of the key.
+ *
+ *	size_t keysize
+ *		Input - Number of bytes in the key.
+ *
+ *	size_t table_size
+ *		Input - Number of entries in the table.
  *
  *  Return value:
+ *	size_t	An index into the table, from 0 to table_size - 1.
  */
 size_t
 ht_hash_bytes(void *key, size_t keysize, size_t table_size);
 
+/*
+ *  size_t
+ *  ht_hash_mix(void *key, size_t keysize, size_t table_size)
+ *
+ *  Description:
+ *	Compute a hash value eight bytes at a time with a multiply and
+ *	rotate mixer, followed by a final avalanche so that every key byte
+ *	affects the low order bits. This is the default hash for new tables.
+ *
+ *  Paramaters:
+ *	See ht_hash_bytes().
+ *
+ *  Return value:
+ *	size_t	An index into the table, from 0 to table_size - 1. A power of
+ *		two table_size is reduced with a mask, any other with a modulo.
+ */
+size_t
+ht_hash_mix(void *key, size_t keysize, size_t table_size);
+
+/*
+ *  size_t
+ *  ht_hash_wide(void *key, size_t keysize, size_t table_size)
+ *
+ *  Description:
+ *	Compute a hash value over four independent 64 bit lanes, 32 bytes per
+ *	step. The lanes carry no dependency on each other, so the compiler
+ *	may keep them in vector registers. Keys shorter than 32 bytes are
+ *	passed to ht_hash_mix().
+ *
+ *  Paramaters:
+ *	See ht_hash_bytes().
+ *
+ *  Return value:
+ *	See ht_hash_mix().
+ */
+size_t
+ht_hash_wide(void *key, size_t keysize, size_t table_size);
+
 /*
  *  hashtable_t *
  *  ht_create(size_t numents, size_t keysize, unsigned int options);
@@ -136,7 +354,8 @@ ht_hash_bytes(void *key, size_t keysize, size_t table_size);
  *	size_t numents
  *		Input - Specifies the number of entries expected in the table
  *		when it's full. Room will be allocated for this many entries
- *		during table creation.
+ *		during table creation, rounded up to a power of two unless
+ *		hto_hash_legacy is given.
  *
  *	int keysize
  *		Input - Specifies the number of bytes in the key for table
@@ -182,7 +401,9 @@ ht_destroy(void *Eht);
  *
  *  Description:
  *	Resize the table to hold the number of entries specified. The size may
- *	increase or decrease.
+ *	increase or decrease. Chained tables take the new size at once and
+ *	move their entries over incrementally during later inserts and
+ *	deletes; a resize still under way is finished first.
  *
  *  Paramaters:
  *	hashtable_t *Eht
@@ -198,6 +419,107 @@ ht_destroy(void *Eht);
 int
 ht_resize(void *Eht, size_t numents);
 
+/*
+ *  int
+ *  ht_set_threshold(void *Eht, ht_threshold_t evaluate);
+ *
+ *  Description:
+ *	Replace the resize policy of a table. The policy is consulted every
+ *	so many inserts and deletes, and only if the table was created with
+ *	hto_resize_implicit.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Pointer to the table head.
+ *
+ *	ht_threshold_t evaluate
+ *		The new policy, or NULL for none. Tables start out with
+ *		ht_evaluate_threshold_adaptive().
+ *
+ *  Return value:
+ *	int	Zero.
+ */
+int
+ht_set_threshold(void *Eht, ht_threshold_t evaluate);
+
+/*
+ *  int
+ *  ht_specialize(void *Eht, ht_hash_full_t hash, ht_compare_t compare);
+ *
+ *  Description:
+ *	Replace the hash and key comparison of an open addressing table,
+ *	before any key has gone into it. Used by the typed tables of
+ *	hashtable_typed.h, so that the library places keys where their
+ *	inlined lookups will look for them.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input/Output - Pointer to the table head.
+ *
+ *	ht_hash_full_t hash
+ *		Input - The new hash.
+ *
+ *	ht_compare_t compare
+ *		Input - The new comparison.
+ *
+ *  Return value:
+ *	int	Zero, or -1 with errno set as follows:
+ *
+ *		EINVAL	22	Invalid argument
+ *				If the table isn't open addressing, or either
+ *				function pointer is NULL.
+ *
+ *		EBUSY	16	Device busy
+ *				If keys have already been inserted.
+ */
+int
+ht_specialize(void *Eht, ht_hash_full_t hash, ht_compare_t compare);
+
+/*
+ *  int
+ *  ht_stats(void *Eht, ht_stats_t *stats);
+ *
+ *  Description:
+ *	Take a snapshot of a table's statistics, for the caller to report or
+ *	export as it likes. The table isn't locked while it's taken.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input - Pointer to the table head.
+ *
+ *	ht_stats_t *stats
+ *		Output - Where the snapshot is put.
+ *
+ *  Return value:
+ *	int	Zero, or -1 with errno set to EINVAL if either pointer is NULL.
+ */
+int
+ht_stats(void *Eht, ht_stats_t *stats);
+
+/*
+ *  void
+ *  ht_stats_lookup(void *Eht, int depth, int hit);
+ *
+ *  Description:
+ *	Count a lookup made by the inlined code of hashtable_typed.h in the
+ *	table's statistics, as if ht_locate_key() had made it.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input/Output - Pointer to the table head.
+ *
+ *	int depth
+ *		Input - Number of groups probed past the first.
+ *
+ *	int hit
+ *		Input - Non-zero if the key was found.
+ *
+ *  Return value:
+ *	None.
+ */
+void
+ht_stats_lookup(void *Eht, int depth, int hit);
+
 /*
  *  void *
  *  ht_locate_key(hashtable_t *Eht, void *key);
@@ -227,6 +549,40 @@ ht_resize(void *Eht, size_t numents);
 void *
 ht_locate_key(void *Eht, void *key);
 
+/*
+ *  ssize_t
+ *  ht_locate_many(hashtable_t *Eht, size_t count, void **keys, void **data);
+ *
+ *  Description:
+ *	Locate each of count keys, as ht_locate_key() does, and store the
+ *	address of its data in the matching element of data. The keys are
+ *	worked on in small batches, so that the memory each search needs
+ *	is fetched for the whole batch before the first search starts. No
+ *	locks are held upon return from this function.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input - Pointer to the head of the hash table in which to
+ *		search for the keys passed.
+ *
+ *	size_t count
+ *		Input - Number of keys in keys, and of pointers in data.
+ *
+ *	void **keys
+ *		Input - Pointers to the bytes of each key to locate.
+ *
+ *	void **data
+ *		Output - For each key, a pointer to the data associated with
+ *		it, or NULL if there is no entry whose key matches it.
+ *
+ *  Return value:
+ *	ssize_t	The number of keys found. If the table can't be locked -1
+ *		will be returned and errno will be set by the locking
+ *		routines.
+ */
+ssize_t
+ht_locate_many(void *Eht, size_t count, void **keys, void **data);
+
 /*
  *  int
  *  ht_insert_key(hashtable_t *Eht, void *key, void *data);
@@ -266,6 +622,41 @@ ht_locate_key(void *Eht, void *key);
 int
 ht_insert_key(void *Eht, void *key, void *data);
 
+/*
+ *  ssize_t
+ *  ht_insert_many(hashtable_t *Eht, size_t count, void **keys, void **data);
+ *
+ *  Description:
+ *	Insert each of count keys with the matching element of data into
+ *	the hash table, as ht_insert_key() does. The keys are worked on in
+ *	small batches, so that the memory each insertion needs is fetched
+ *	for the whole batch before the first insertion starts.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input - Pointer to the head of the table into which to insert
+ *		the entries passed.
+ *
+ *	size_t count
+ *		Input - Number of keys in keys, and of pointers in data.
+ *
+ *	void **keys
+ *		Input - Pointers to the bytes of each key value used for
+ *		insertion.
+ *
+ *	void **data
+ *		Input - Pointers to the buffers containing the data
+ *		associated with each key.
+ *
+ *  Return value:
+ *	ssize_t	The number of entries inserted. Insertion stops at the first
+ *		key that can't be inserted, so a return less than count is
+ *		the index of that key, and errno will be set as it is by
+ *		ht_insert_key(). Every key before it will be in the table.
+ */
+ssize_t
+ht_insert_many(void *Eht, size_t count, void **keys, void **data);
+
 /*
  *  void *
  *  ht_delete_key(hashtable_t *Eht, void *key);
@@ -291,6 +682,131 @@ ht_insert_key(void *Eht, void *key, void *data);
 void *
 ht_delete_key(void *Eht, void *key);
 
+/*
+ *  ht_snapshot_t *
+ *  ht_snapshot(void *Eht);
+ *
+ *  Description:
+ *	Copy every key in the table, with its data pointer, for the caller
+ *	to walk with ht_snapshot_next(). The copy is taken with the table
+ *	locked against inserts and deletes, so it holds the table as it was
+ *	at one instant, and the table is free again once it's made. Keys
+ *	come out in no particular order.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input - Pointer to the table head.
+ *
+ *  Return value:
+ *	ht_snapshot_t * The snapshot, to be freed with ht_snapshot_free(), or
+ *		NULL with errno set if it couldn't be allocated or the table
+ *		couldn't be locked.
+ */
+ht_snapshot_t *
+ht_snapshot(void *Eht);
+
+/*
+ *  int
+ *  ht_snapshot_next(ht_snapshot_t *snap, void **key, void **data);
+ *
+ *  Description:
+ *	Step to the next entry of a snapshot.
+ *
+ *  Paramaters:
+ *	ht_snapshot_t *snap
+ *		Input/Output - The snapshot.
+ *
+ *	void **key
+ *		Output - The snapshot's copy of the entry's key, good until
+ *		the snapshot is freed.
+ *
+ *	void **data
+ *		Output - The entry's data pointer.
+ *
+ *  Return value:
+ *	int	Zero, or -1 with errno set to ENOENT once every entry has been
+ *		stepped past.
+ */
+int
+ht_snapshot_next(ht_snapshot_t *snap, void **key, void **data);
+
+/*
+ *  void
+ *  ht_snapshot_free(ht_snapshot_t *snap);
+ *
+ *  Description:
+ *	Free a snapshot and its copies of the keys.
+ *
+ *  Paramaters:
+ *	ht_snapshot_t *snap
+ *		Input - The snapshot.
+ *
+ *  Return value:
+ *	None.
+ */
+void
+ht_snapshot_free(ht_snapshot_t *snap);
+
+/*
+ *  int
+ *  ht_save(void *Eht, const char *path, ht_datalen_t datalen);
+ *
+ *  Description:
+ *	Write a snapshot of the table, keys and data both, to a file that
+ *	ht_map() can map back in as a read-only table. The file is laid out
+ *	as an open addressing table whatever the kind of table saved, and
+ *	holds offsets rather than pointers, so mapping it takes no rehashing
+ *	and no allocation per entry. It's written under a temporary name and
+ *	renamed into place, so a table still mapped from an older copy is
+ *	left alone. Only tables using the library's own hash and bcmp() can
+ *	be saved, and the file can only be mapped on machines of the same
+ *	byte order.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input - Pointer to the table head.
+ *
+ *	const char *path
+ *		Input - Name of the file to write.
+ *
+ *	ht_datalen_t datalen
+ *		Input - Gives the number of bytes of each entry's data to save,
+ *		or NULL if the data are all strings. NULL data is saved as
+ *		NULL.
+ *
+ *  Return value:
+ *	int	Zero, or -1 with errno set by the file system calls, or as
+ *		follows:
+ *
+ *		ENOTSUP	48	Operation not supported
+ *				If the table has been given its own hash or
+ *				comparison by ht_specialize().
+ */
+int
+ht_save(void *Eht, const char *path, ht_datalen_t datalen);
+
+/*
+ *  void *
+ *  ht_map(const char *path);
+ *
+ *  Description:
+ *	Map a file written by ht_save() as a read-only table, with the
+ *	hto_mapped option. Its data stay in the file: the pointers returned
+ *	by lookups point into the mapping, and must not be written through
+ *	or used after ht_destroy().
+ *
+ *  Paramaters:
+ *	const char *path
+ *		Input - Name of the file to map.
+ *
+ *  Return value:
+ *	void *	The table head, or NULL with errno set by the file system
+ *		calls, or to EINVAL if the file isn't one ht_save() wrote on a
+ *		machine like this one.
+ */
+void *
+ht_map(const char *path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,536 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright 2007 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#ifndef _HASHTABLE_DATA_H
+#define	_HASHTABLE_DATA_H
+
+/*
+ *	Hash table data definitions.
+ *
+ *	The following data and associate code presume that all keys and data
+ *	remain in storage outside of the table proper.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <hashtable.h>
+#include <inttypes.h>
+#include <string.h>
+#include <synch.h>
+
+/*
+ *	Hash table entry flags.
+ */
+typedef enum hte_flag_bits {
+	htef_occupied_bit /*	= 0 */,	/* Entry has a key.		*/
+	htef_lock_init_bit /*	= 1 */,	/* Lock has been initialized.	*/
+	htef_migrated_bit /*	= 2 */	/* Chain moved to a new table.	*/
+
+} hte_flag_bit_t;
+
+typedef enum hashtable_entry_flags {
+	/*
+	 * Hash table entries may be empty.
+	 */
+	htef_occupied		= _ht_bit_mask(htef_occupied_bit),
+
+	/*
+	 * Read/write locks in entries may or may not be usable.
+	 */
+	htef_lock_initialized	= _ht_bit_mask(htef_lock_init_bit),
+
+	/*
+	 * While a table is being resized, entries of the old table are
+	 * marked once their chains have moved to the new one.
+	 */
+	htef_migrated		= _ht_bit_mask(htef_migrated_bit)
+
+} hashtable_entry_flag_t;
+
+/*
+ *	Structure for a single entry in the hash table.
+ */
+typedef struct hashtable_entry {
+	rwlock_t		 rwlock; /* Lock for this entry.	*/
+	struct hashtable_entry	*next;	/* Next entry if chained.	*/
+	void			*key;	/* Pointer to the key.		*/
+	void			*data;	/* Pointer to the data.		*/
+	hashtable_entry_flag_t	flags;	/* Individual entry flags.	*/
+
+} hashtable_entry_t;
+
+/*
+ *	Table entries are allocated in slabs. Each slab has a pointer to the
+ *	next slab (actually the one previously allocated), and a pointer to
+ *	the entries in this slab. So, the slab strucure is actually the header
+ *	information for the slab. When the buffer gets allocated, the slab
+ *	header is created at the beginning of the buffer, then entries are
+ *	created following to fill the rest of the buffer.
+ *
+ *	+========================+
+ *	| *next			 |   \
+ *	+------------------------+    \
+ *	| *entry		 |      slab (structure) header.
+ *	+------------------------+    /
+ *	| entrycount		 |   /
+ *	+========================+
+ *	| entry [0]		 |
+ *	|  ...			 |
+ *	+------------------------+
+ *	| entry [1]		 |
+ *	|  ...			 |
+ *	+------------------------+
+ *	|  ...			 |
+ *	+------------------------+
+ *	| entry [entrycount - 1] |
+ *	|  ...			 |
+ *	+========================+
+ */
+typedef union hashtable_slab {
+	struct {
+		union hashtable_slab	*next;	/* @next slab.		*/
+		hashtable_entry_t	*entry;	/* @entries in slab.	*/
+		size_t			 entrycount;	/* # entries.	*/
+
+	}			header;		/* Union header.	*/
+	hashtable_entry_t	entries;	/* Room for entries.	*/
+
+} hashtable_slab_t;
+
+/*
+ *	A chained table is resized incrementally. ht_resize() hangs a new
+ *	table off the head and keeps the old one as the draining table. Each
+ *	insert and delete then moves the chain of its own key, plus up to
+ *	HT_MIGRATE_STEP more, from the draining table to the new one. Lookups
+ *	look in whichever table holds their key's chain. When every chain has
+ *	moved, the draining table is freed.
+ */
+#define	HT_MIGRATE_STEP	4		/* Chains moved per update. */
+
+/*
+ *	Free chain slabs are sized like the table, up to HT_FREE_SLAB_MAX
+ *	entries, so that refilling the free chain of a big table doesn't hold
+ *	up every other writer.
+ */
+#define	HT_FREE_SLAB_MAX 1024		/* Most entries per slab. */
+
+/*
+ *	With hto_resize_implicit, the resize policy is asked about the table
+ *	once every HT_EVAL_PERIOD inserts and deletes (a power of two).
+ */
+#define	HT_EVAL_PERIOD	64		/* Updates per evaluation. */
+
+/*
+ *	Open addressing tables (hto_open_addressing) keep all entries in one
+ *	buffer: the hashtable_oa_t header, the write stripes of a concurrent
+ *	table, capacity slots, then capacity control bytes. Slots are probed
+ *	in aligned groups of HT_OA_GROUP, and the control bytes of a group
+ *	are loaded and matched as a single 64 bit word.
+ *
+ *	A control byte is HT_OA_EMPTY, HT_OA_DELETED, HT_OA_BUSY, or the low
+ *	seven bits of the entry's hash. A probe sequence ends at the first
+ *	group that has an empty slot. Busy slots are being filled by a
+ *	concurrent writer, and are neither free nor matched.
+ */
+#define	HT_OA_GROUP	8		/* Slots per group.	*/
+#define	HT_OA_EMPTY	0x80		/* Ends a probe.	*/
+#define	HT_OA_DELETED	0xFE		/* Probes go on.	*/
+#define	HT_OA_BUSY	0xFF		/* Being filled.	*/
+
+#define	HT_CACHE_LINE	64		/* Bytes in a cache line. */
+#define	HT_OA_STRIPES	64		/* Write stripes.	*/
+
+typedef struct hashtable_oa_slot {
+	union {
+		void		*ptr;		/* Caller's key...	*/
+		unsigned char	 bytes[HT_INLINE_KEY]; /* ...or a copy.	*/
+
+	}			 key;
+	void			*data;		/* Caller's data.	*/
+
+} hashtable_oa_slot_t;
+
+/*
+ *	A concurrent table (hto_concurrent) hashes each group to a stripe. A
+ *	writer about to change an occupied slot bumps begin, and bumps end
+ *	when it's done. A reader notes end before looking at a group and
+ *	checks begin afterwards. If they differ, a writer got in the way and
+ *	the lookup is retried. Readers only ever read the stripe.
+ */
+typedef struct hashtable_oa_stripe {
+	volatile uint32_t	 begin;		/* Changes started.	*/
+	volatile uint32_t	 end;		/* Changes finished.	*/
+	char			 pad[HT_CACHE_LINE - 2 * sizeof (uint32_t)];
+
+} hashtable_oa_stripe_t;
+
+typedef struct hashtable_oa {
+	size_t			 capacity;	/* # slots, power of 2.	*/
+	volatile ulong_t	 used;		/* # occupied slots.	*/
+	volatile ulong_t	 tombs;		/* # deleted slots.	*/
+	hashtable_oa_stripe_t	*stripes;	/* Write stripes.	*/
+	hashtable_oa_slot_t	*slots;		/* Slots, then ctrl.	*/
+	unsigned char		*ctrl;		/* Control bytes.	*/
+
+} hashtable_oa_t;
+
+/*
+ *	The probe group helpers below are shared by libhashtable and the typed
+ *	tables of hashtable_typed.h, whose lookups are compiled into their
+ *	callers. HT_INLINE asks the compiler to inline them where it can.
+ */
+#if defined(__GNUC__) || \
+	(defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)
+#define	HT_INLINE	inline
+#elif defined(__SUNPRO_C)
+#define	HT_INLINE	__inline
+#else
+#define	HT_INLINE
+#endif
+
+/*
+ *	Byte masks for matching a group of open addressing control bytes.
+ */
+#define	HT_OA_LSBS	0x0101010101010101ULL
+#define	HT_OA_MSBS	0x8080808080808080ULL
+
+/*
+ *
+ *  static uint64_t
+ *  ht_oa_load(const unsigned char *ctrl)
+ *
+ *  Description:
+ *	Load the eight control bytes of a probe group as one word.
+ *
+ *  Paramaters:
+ *	const unsigned char *ctrl
+ *		Input - Pointer to the first control byte of the group.
+ *
+ *  Return value:
+ *	uint64_t The control bytes in native byte order.
+ *
+ */
+static HT_INLINE uint64_t
+ht_oa_load(const unsigned char *ctrl)
+{
+	/*
+	 * Locals...
+	 */
+	uint64_t	group;		/* Control bytes.	*/
+
+	(void) memcpy(&group, ctrl, sizeof (group));
+	return (group);
+
+} /* uint64_t ht_oa_load(const unsigned char *ctrl) {...} */
+
+/*
+ *
+ *  static uint64_t
+ *  ht_oa_match(uint64_t group, unsigned int tag)
+ *
+ *  Description:
+ *	Find the occupied slots of a group whose control byte equals the
+ *	tag passed. The zero byte test may also flag a byte next to a true
+ *	match, which only costs one extra key comparison.
+ *
+ *  Paramaters:
+ *	uint64_t group
+ *		Input - Control bytes as returned by ht_oa_load().
+ *
+ *	unsigned int tag
+ *		Input - Low seven bits of the hash being looked for.
+ *
+ *  Return value:
+ *	uint64_t The high bit of each candidate byte is set.
+ *
+ */
+static HT_INLINE uint64_t
+ht_oa_match(uint64_t group, unsigned int tag)
+{
+	/*
+	 * Locals...
+	 */
+	uint64_t	x;		/* Zero where tag matches.	*/
+
+	x = group ^ (HT_OA_LSBS * tag);
+	return ((x - HT_OA_LSBS) & ~x & ~group & HT_OA_MSBS);
+
+} /* uint64_t ht_oa_match(uint64_t group, unsigned int tag) {...} */
+
+/*
+ *
+ *  static int
+ *  ht_oa_index(uint64_t bit)
+ *
+ *  Description:
+ *	Turn one bit of a match mask into the slot offset within its group.
+ *
+ *  Paramaters:
+ *	uint64_t bit
+ *		Input - A single high bit of a byte from a match mask.
+ *
+ *  Return value:
+ *	int	Offset of the slot, from 0 to HT_OA_GROUP - 1.
+ *
+ */
+static HT_INLINE int
+ht_oa_index(uint64_t bit)
+{
+	/*
+	 * Locals...
+	 */
+	int	i;		/* Byte number from the bottom.	*/
+
+	for (i = 0; bit > 0x80; bit >>= 8) {
+		++i;
+
+	} /* for (i = 0; bit > 0x80; bit >>= 8) {...} */
+
+#ifdef _BIG_ENDIAN
+	return (HT_OA_GROUP - 1 - i);
+#else
+	return (i);
+#endif
+
+} /* int ht_oa_index(uint64_t bit) {...} */
+
+/*
+ *	ht_save() writes a table to a flat file that ht_map() maps back in as
+ *	a read-only table. The file is a hashtable_file_t header, capacity
+ *	control bytes and capacity hashtable_file_slot_t slots, laid out and
+ *	probed as in an open addressing table, then the keys too long for a
+ *	slot and the data, each on an HT_FILE_ALIGN boundary. Keys and data
+ *	are found by their offset from the start of the file, so a mapped
+ *	table works wherever it lands, with nothing to rehash or fix up.
+ *	The magic number is read in native byte order, so a file from a
+ *	machine of the other order is refused.
+ */
+#define	HT_FILE_MAGIC		0x48546231	/* "HTb1"		*/
+#define	HT_FILE_VERSION		1
+#define	HT_FILE_ALIGN		8		/* Offset alignment.	*/
+#define	HT_FILE_HASH_MIX	0		/* ht_hash_mix_full()	*/
+#define	HT_FILE_HASH_WIDE	1		/* ht_hash_wide_full()	*/
+
+#define	HT_FILE_ROUND(n) \
+	(((n) + HT_FILE_ALIGN - 1) & ~(size_t)(HT_FILE_ALIGN - 1))
+
+typedef struct hashtable_file {
+	uint32_t		 magic;		/* HT_FILE_MAGIC.	*/
+	uint32_t		 version;	/* HT_FILE_VERSION.	*/
+	uint32_t		 keysize;	/* Bytes per key.	*/
+	uint32_t		 hash;		/* HT_FILE_HASH_*.	*/
+	uint64_t		 capacity;	/* # slots, power of 2.	*/
+	uint64_t		 used;		/* # occupied slots.	*/
+	uint64_t		 ctrl;		/* Control byte offset.	*/
+	uint64_t		 slots;		/* Slot offset.		*/
+	uint64_t		 size;		/* Bytes in the file.	*/
+
+} hashtable_file_t;
+
+typedef struct hashtable_file_slot {
+	union {
+		uint64_t	 offset;	/* Offset of the key...	*/
+		unsigned char	 bytes[HT_INLINE_KEY]; /* ...or the key. */
+
+	}			 key;
+	uint64_t		 data;		/* Data offset, or 0.	*/
+
+} hashtable_file_slot_t;
+
+typedef struct hashtable_map {
+	const unsigned char	*base;		/* The mapped file.	*/
+	size_t			 size;		/* Bytes mapped.	*/
+	size_t			 capacity;	/* # slots.		*/
+	size_t			 used;		/* # occupied slots.	*/
+	const unsigned char	*ctrl;		/* Control bytes.	*/
+	const hashtable_file_slot_t *slots;	/* Slots.		*/
+
+} hashtable_map_t;
+
+/*
+ *	A snapshot is allocated in one piece: this header, count data
+ *	pointers, then count copies of the keys.
+ */
+struct ht_snapshot {
+	size_t			 count;		/* Entries held.	*/
+	size_t			 next;		/* Next to hand out.	*/
+	size_t			 keysize;	/* Bytes per key.	*/
+	void			**data;		/* Data pointers.	*/
+	unsigned char		*keys;		/* Key copies.		*/
+
+};
+
+/*
+ *	Memory a concurrent reader may still be looking at (a replaced slot
+ *	buffer, or the table's copy of a deleted key) is retired rather than
+ *	freed. Each reading thread owns a hashtable_epoch_reader_t, where it
+ *	posts the global epoch while it is inside a lookup. Retired memory is
+ *	tagged with the epoch it was retired in, and freed once no reader is
+ *	still posted at that epoch or earlier.
+ */
+#define	HT_EPOCH_READERS	256	/* Readers with a record. */
+
+typedef struct hashtable_epoch_reader {
+	volatile uint64_t	 epoch;		/* Epoch or 0 if idle.	*/
+	volatile uint32_t	 owner;		/* Non-zero if claimed.	*/
+	char			 pad[HT_CACHE_LINE - sizeof (uint64_t) -
+	    sizeof (uint32_t)];
+
+} hashtable_epoch_reader_t;
+
+typedef struct hashtable_limbo {
+	struct hashtable_limbo	*next;		/* Next retired buffer.	*/
+	void			*ptr;		/* Buffer to free.	*/
+	uint64_t		 epoch;		/* Epoch it retired in.	*/
+
+} hashtable_limbo_t;
+
+/*
+ *	Statistics are kept in HT_STAT_SHARDS shards per table, each on cache
+ *	lines of its own. A thread adds to the shard its thread id picks,
+ *	with atomics and no lock, so threads rarely share a line. The shards
+ *	are only summed when the statistics are read.
+ *
+ *	Building with HT_NO_STATS leaves them out altogether. Building with
+ *	HT_STATS_SAMPLE set to a power of two above one records the lookup
+ *	statistics (probes, hits and searches) for one lookup in that many,
+ *	scaled up to match.
+ */
+#define	HT_STAT_SHARDS	16		/* Shards, a power of 2. */
+
+#ifndef	HT_STATS_SAMPLE
+#define	HT_STATS_SAMPLE	1		/* Lookups per sample.	*/
+#endif
+
+typedef enum hashtable_stat {
+	hts_deletes,				/* Attempted deletes	*/
+	hts_errors,				/* # errors returned	*/
+	hts_hits,				/* Successful locates	*/
+	hts_inserts,				/* Attempted inserts	*/
+	hts_probes,				/* Locates.		*/
+	hts_resizes,				/* # table resizes	*/
+	hts_slabs,				/* Slab chain info.	*/
+	hts_count				/* # counters.		*/
+
+} hashtable_stat_t;
+
+typedef enum hashtable_avg {
+	hta_depth,				/* Chain depth info.	*/
+	hta_freechain,				/* Free chain info.	*/
+	hta_searches,				/* Chain searches.	*/
+	hta_count				/* # averages.		*/
+
+} hashtable_avg_t;
+
+typedef struct hashtable_average {
+	u_longlong_t	count;		/* # iterations.		*/
+	u_longlong_t	sum;		/* Sum of all counts.		*/
+	u_longlong_t	maximum;	/* Maximum chain depth.		*/
+
+} hashtable_average_t;
+
+typedef union hashtable_shard {
+	struct {
+		u_longlong_t		counter[hts_count];
+		hashtable_average_t	average[hta_count];
+		uint_t			tick;	/* Lookups, to sample.	*/
+
+	}			 s;
+	char			 pad[3 * HT_CACHE_LINE];
+
+} hashtable_shard_t;
+
+/*
+ *	Structure for the entire table of hash entries.
+ */
+typedef struct hashtable {
+	rwlock_t		 tablelock;	/* Lock for the whole table. */
+	rwlock_t		 freelock;	/* Lock for the free chain.  */
+	mutex_t			 resizemutex;	/* Lock for resizing.	*/
+	int			 keysize;	/* Byte size of an entry. */
+	ht_option_t		 options;	/* Table options.	*/
+	hashtable_slab_t	*draining;	/* Table being resized.	*/
+	size_t			 drain_next;	/* Next chain to move.	*/
+	size_t			 drain_left;	/* Chains left to move.	*/
+	hashtable_slab_t	*slabs;		/* Slabs of entries.	*/
+	hashtable_slab_t	*table;		/* The table itself.	*/
+	hashtable_entry_t	*freechain;	/* Free chain entries.	*/
+	size_t			 freecount;	/* Free chain length.	*/
+
+	/*
+	 * Pointer to the default hash computation function.
+	 */
+	size_t			(* hash_compute)(void *key,
+	    size_t keysize,
+	    size_t table_size);
+
+	/*
+	 * Pointer to the key comparison function. Caller supplied.
+	 */
+	int			(* key_compare)(const void *key1,
+	    const void *key2,
+	    size_t keysize);
+
+	/*
+	 * Pointer to the function for evaluating resize thresholds, and what
+	 * it's fed besides the statistics.
+	 */
+	ht_threshold_t		 threshold_evaluate;
+	size_t			 minents;	/* Size at creation.	*/
+	volatile ulong_t	 entries;	/* Keys in the table.	*/
+	volatile ulong_t	 updates;	/* Inserts and deletes.	*/
+
+	struct {			/* Counts at the last resize.	*/
+		u_longlong_t		probes;
+		u_longlong_t		hits;
+		u_longlong_t		searchcount;
+		u_longlong_t		searchsum;
+		ulong_t			updates;
+
+	} window;
+
+	/*
+	 * Pointer to the unreduced hash for open addressing tables, which
+	 * need the high bits for the slot and the low bits for the control
+	 * byte.
+	 */
+	uint64_t		(* hash_full)(const void *key, size_t keysize);
+
+	hashtable_oa_t	* volatile oa;		/* Open addressing table. */
+	mutex_t			*stripelock;	/* Concurrent writers.	*/
+
+	hashtable_shard_t	*stats;		/* HT_STAT_SHARDS shards. */
+	hashtable_map_t		*map;		/* File, for hto_mapped. */
+
+} hashtable_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HASHTABLE_DATA_H */
@@ -0,0 +1,241 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright 2007 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#ifndef _HASHTABLE_TYPED_H
+#define	_HASHTABLE_TYPED_H
+
+/*
+ *	Typed hash tables.
+ *
+ *	HT_TYPED_DECLARE(name, type, hash_fn, equal_fn) generates a front end
+ *	for tables whose keys are all of one fixed size type, like thread_t:
+ *
+ *	    void *name_create(size_t numents, ht_option_t options);
+ *	    void *name_locate(void *Eht, type key);
+ *	    int	  name_insert(void *Eht, const type *key, void *data);
+ *	    void *name_delete(void *Eht, const type *key);
+ *
+ *	They behave like ht_create(), ht_locate_key(), ht_insert_key() and
+ *	ht_delete_key(), and the tables they make are ordinary open
+ *	addressing tables (hto_open_addressing is implied) to be destroyed,
+ *	resized and measured with the library calls. Only name_locate() is
+ *	compiled into its caller: it walks the probe groups itself, with the
+ *	key size fixed and the hash and comparison inlined, so a lookup
+ *	makes no indirect calls. Inserts and deletes go to the library,
+ *	which is given the same hash and comparison by ht_specialize().
+ *
+ *	hash_fn(k) takes a key by value and returns a well mixed uint64_t;
+ *	HT_TYPED_HASH_INT() does for integer keys. equal_fn(a, b) is non-zero
+ *	when two keys match; HT_TYPED_EQUAL() compares with ==. Either may
+ *	be a macro.
+ *
+ *	hto_concurrent isn't supported, since its lookups need the epochs
+ *	kept inside the library. Keys of up to HT_INLINE_KEY bytes are
+ *	copied into the table; longer ones must outlive their entries.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <synch.h>
+
+#include <hashtable.h>
+#include <hashtable_data.h>
+
+#define	HT_TYPED_HASH_INT(k)	ht_typed_mix((uint64_t)(k))
+#define	HT_TYPED_EQUAL(a, b)	((a) == (b))
+
+/*
+ *
+ *  static uint64_t
+ *  ht_typed_mix(uint64_t x)
+ *
+ *  Description:
+ *	Avalanche an integer key so that every bit of it reaches both the
+ *	control byte and the slot number.
+ *
+ *  Paramaters:
+ *	uint64_t x
+ *		Input - The key, widened.
+ *
+ *  Return value:
+ *	uint64_t The mixed hash.
+ *
+ */
+static HT_INLINE uint64_t
+ht_typed_mix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDULL;
+	x ^= x >> 33;
+	x *= 0xC4CEB9FE1A85EC53ULL;
+	x ^= x >> 33;
+
+	return (x);
+
+} /* uint64_t ht_typed_mix(uint64_t x) {...} */
+
+#define	HT_TYPED_DECLARE(name, type, hash_fn, equal_fn) \
+ \
+static HT_INLINE uint64_t \
+name##_hash_full(const void *key, size_t keysize) \
+{ \
+	type	k;			/* Aligned copy of the key.	*/ \
+ \
+	(void) memcpy(&k, key, sizeof (k)); \
+	return (hash_fn(k)); \
+ \
+} \
+ \
+static HT_INLINE int \
+name##_compare(const void *key1, const void *key2, size_t keysize) \
+{ \
+	type	k1;			/* Aligned copy of key1.	*/ \
+	type	k2;			/* Aligned copy of key2.	*/ \
+ \
+	(void) memcpy(&k1, key1, sizeof (k1)); \
+	(void) memcpy(&k2, key2, sizeof (k2)); \
+	return (equal_fn(k1, k2) ? 0 : 1); \
+ \
+} \
+ \
+static HT_INLINE void * \
+name##_create(size_t numents, ht_option_t options) \
+{ \
+	void	*ht;			/* New table.			*/ \
+	int	 err;			/* Saved errno.			*/ \
+ \
+	if (options & hto_concurrent) { \
+		errno = EINVAL; \
+		return ((void *)NULL); \
+ \
+	} \
+ \
+	ht = ht_create(numents, sizeof (type), \
+	    options | hto_open_addressing); \
+	if (ht != (void *)NULL && \
+	    ht_specialize(ht, name##_hash_full, name##_compare) != 0) { \
+		err = errno; \
+		(void) ht_destroy(ht); \
+		errno = err; \
+		return ((void *)NULL); \
+ \
+	} \
+ \
+	return (ht); \
+ \
+} \
+ \
+static HT_INLINE void * \
+name##_locate(void *Eht, type key) \
+{ \
+	hashtable_t	*ht = (hashtable_t *)Eht; \
+	hashtable_oa_t	*oa;			/* Slot buffer.		*/ \
+	hashtable_oa_slot_t *slot;		/* Slot compared.	*/ \
+	uint64_t	 hash = hash_fn(key);	/* Full hash.		*/ \
+	uint64_t	 group;			/* Group control bytes.	*/ \
+	uint64_t	 match;			/* Candidate slots.	*/ \
+	size_t		 gmask;			/* Group number mask.	*/ \
+	size_t		 g;			/* Group being probed.	*/ \
+	size_t		 step;			/* Probe step.		*/ \
+	void		*data = NULL;		/* Data to return.	*/ \
+	int		 depth = -1;		/* Groups probed.	*/ \
+	type		 k;			/* Key in the slot.	*/ \
+ \
+	if (errno = rw_rdlock(&ht->tablelock)) { \
+		return ((void *)NULL); \
+ \
+	} \
+ \
+	oa	= ht->oa; \
+	gmask	= oa->capacity / HT_OA_GROUP - 1; \
+	g	= (size_t)(hash >> 7) & gmask; \
+	for (step = 0; step <= gmask && depth < 0; \
+	    g = (g + ++step) & gmask) { \
+		group = ht_oa_load(&oa->ctrl[g * HT_OA_GROUP]); \
+ \
+		for (match = ht_oa_match(group, (unsigned int)hash & 0x7F); \
+		    match != 0; \
+		    match &= match - 1) { \
+ \
+			slot = &oa->slots[g * HT_OA_GROUP + \
+			    ht_oa_index(match & (0 - match))]; \
+			(void) memcpy(&k, \
+			    (sizeof (type) <= HT_INLINE_KEY ? \
+			    (void *)slot->key.bytes : slot->key.ptr), \
+			    sizeof (k)); \
+			if (equal_fn(k, key)) { \
+				data	= slot->data; \
+				depth	= (int)step; \
+				break; \
+ \
+			} \
+ \
+		} \
+ \
+		if (depth < 0 && (group & ~(group << 6) & HT_OA_MSBS)) { \
+			break; \
+ \
+		} \
+ \
+	} \
+ \
+	(void) rw_unlock(&ht->tablelock); \
+ \
+	if (depth < 0) { \
+		ht_stats_lookup(ht, (int)step, 0); \
+		errno = ENOENT; \
+		return ((void *)NULL); \
+ \
+	} \
+ \
+	ht_stats_lookup(ht, depth, 1); \
+	return (data); \
+ \
+} \
+ \
+static HT_INLINE int \
+name##_insert(void *Eht, const type *key, void *data) \
+{ \
+	return (ht_insert_key(Eht, (void *)key, data)); \
+ \
+} \
+ \
+static HT_INLINE void * \
+name##_delete(void *Eht, const type *key) \
+{ \
+	return (ht_delete_key(Eht, (void *)key)); \
+ \
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HASHTABLE_TYPED_H */
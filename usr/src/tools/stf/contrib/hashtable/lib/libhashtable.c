@@ -24,136 +24,231 @@
  * Use is subject to license terms.
  */
 
+#include <atomic.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <note.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <synch.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread.h>
+#include <unistd.h>
+#ifndef	__GNUC__
+#include <sun_prefetch.h>
+#endif
 
 #include <hashtable.h>
 
-#include "hashtable_data.h"
+#include <hashtable_data.h>
 
 /* LINTLIBRARY */
 
 /*
- * static int
- * ht_counter_init(hashtable_counter_t *counter);
+ * Multipliers and rotates for the mixing hashes. The multipliers are odd
+ * 64 bit constants with well spread bits, the same ones used by xxHash.
+ */
+#define	HT_PRIME1	0x9E3779B185EBCA87ULL
+#define	HT_PRIME2	0xC2B2AE3D27D4EB4FULL
+#define	HT_PRIME3	0x165667B19E3779F9ULL
+#define	HT_PRIME4	0x85EBCA77C2B2AE63ULL
+#define	HT_PRIME5	0x27D4EB2F165667C5ULL
+
+#define	HT_ROTL64(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+/*
+ * One accumulation step: fold a 64 bit word of key into a lane.
+ */
+#define	HT_ROUND(acc, w) \
+	(HT_ROTL64((acc) + (w) * HT_PRIME2, 31) * HT_PRIME1)
+
+/*
+ * Marks for ht_evaluate_threshold_adaptive(): windows with fewer samples
+ * than this prove nothing, chains searched this deep on average call for
+ * more buckets, and so does any chain this much deeper than the log of
+ * the table size.
+ */
+#define	HT_POLICY_SAMPLES	64
+#define	HT_POLICY_SEARCH	2
+#define	HT_POLICY_DEPTH		8
+
+/*
+ * ht_locate_many() and ht_insert_many() work through their keys HT_BATCH
+ * at a time: all of them hashed and the lines they land on prefetched
+ * first, then each one resolved, so the cache misses overlap.
+ */
+#define	HT_BATCH		16
+
+#ifdef	__GNUC__
+#define	HT_PREFETCH(addr)	__builtin_prefetch(addr)
+#else
+#define	HT_PREFETCH(addr)	sun_prefetch_read_many((void *)(addr))
+#endif
+
+/*
+ * Epoch based reclaiming for concurrent tables. Lookups post the epoch
+ * they started in; buffers that lookups may still be reading wait on the
+ * limbo list until every posted epoch is newer than theirs.
+ */
+#pragma align HT_CACHE_LINE(ht_readers)
+static hashtable_epoch_reader_t	ht_readers[HT_EPOCH_READERS];
+static volatile uint64_t	ht_epoch = 1;
+static volatile uint32_t	ht_epoch_overflow = 0;
+static hashtable_limbo_t	*ht_limbo = NULL;
+static mutex_t			ht_limbo_lock = DEFAULTMUTEX;
+static thread_key_t		ht_reader_key;
+static volatile int		ht_reader_key_made = 0;
+static mutex_t			ht_reader_key_lock = DEFAULTMUTEX;
+
+static void ht_epoch_release(void *);
+
+#ifndef	HT_NO_STATS
+/*
+ * static hashtable_shard_t *
+ * ht_shard(hashtable_t *ht);
  *
  * Description:
- *	Initialize a hashtable statistic counter.
+ *	Find the calling thread's statistics shard. Threads are spread over
+ *	the shards by their ids; two that share one just share its cache
+ *	lines, the counts are right either way.
  *
  * Parameters:
- *	hashtable_counter_t *counter
- *		Input/Output - A pointer to a counter to be intialized.
+ *	hashtable_t *ht
+ *		Input - Pointer to the hash table head.
  *
  * Return value:
- *	int	Upon successful initialization of the counter value and its
- *		associated lock a zero value will be returned. If the lock
- *		could not be initialized, then the return value from lock
- *		initialization will be returned (See mutex_init for details).
+ *	hashtable_shard_t *	The caller's shard.
  */
-static int
-ht_counter_init(hashtable_counter_t *counter)
+static hashtable_shard_t *
+ht_shard(hashtable_t *ht)
 {
-	counter->value	= 0;
-	return (mutex_init(&counter->mutex, USYNC_THREAD, NULL));
+	return (&ht->stats[thr_self() & (HT_STAT_SHARDS - 1)]);
 
-} /* static int ht_counter_init(hashtable_counter_t *counter) {...} */
+} /* hashtable_shard_t *ht_shard(hashtable_t *ht) {...} */
 
 /*
- * static int
- * ht_counter_add(hashtable_counter_t *counter, longlong_t delta);
+ * static void
+ * ht_maximum(u_longlong_t *maximum, u_longlong_t current);
  *
  * Description:
- *	Sum the delta to the counter value atomically.
+ *	Raise a shard's maximum to current, if current is larger.
  *
  * Parameters:
- *	hashtable_counter_t *counter
- *		Input/Output - A pointer to a counter to be adjusted by the
- *		value of the delta passed.
+ *	u_longlong_t *maximum
+ *		Input/Output - The maximum to raise.
  *
- *	longlong_t delta
- *		Input - Amount by which to adjust the counter value.
+ *	u_longlong_t current
+ *		Input - The value just recorded.
  *
  * Return value:
- *	int	If the lock could be obtained, then zero will be returned.
- *		If the lock could not be fetched, then a non-zero value will
- *		be returned and errno will be set.
+ *	None.
  */
-static int
-ht_counter_add(hashtable_counter_t *counter, longlong_t delta)
+static void
+ht_maximum(u_longlong_t *maximum, u_longlong_t current)
 {
 	/*
-	 * Fetch the lock first.
+	 * Locals...
 	 */
-	if (errno = mutex_lock(&counter->mutex)) {
-		return (-2);
+	u_longlong_t	 seen;		/* Maximum before the swap.	*/
 
-	} /* if (errno = mutex_lock(&counter->mutex)) {...} */
+	while (current > (seen = *(volatile u_longlong_t *)maximum) &&
+	    atomic_cas_64((uint64_t *)maximum, seen, current) != seen) {
+		continue;
 
-	/*
-	 * Increment the value.
-	 */
-	counter->value += delta;
+	} /* while (current > (seen = *maximum) && ...) {...} */
 
-	/*
-	 * Give up the lock.
-	 */
-	if (errno = mutex_unlock(&counter->mutex)) {
-		return (-2);
+} /* void ht_maximum(u_longlong_t *maximum, u_longlong_t current) {...} */
+#endif
+
+/*
+ * static int
+ * ht_stats_init(hashtable_t *ht);
+ *
+ * Description:
+ *	Allocate and zero a table's statistics shards.
+ *
+ * Parameters:
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the hash table head.
+ *
+ * Return value:
+ *	int	Zero once the shards are allocated, or -1 with errno set if
+ *		they couldn't be.
+ */
+static int
+ht_stats_init(hashtable_t *ht)
+{
+	ht->stats = (hashtable_shard_t *)NULL;
 
-	} /* if (errno = mutex_unlock(&counter->mutex)) {...} */
+#ifndef	HT_NO_STATS
+	ht->stats = (hashtable_shard_t *)memalign(HT_CACHE_LINE,
+	    HT_STAT_SHARDS * sizeof (*ht->stats));
+	if (ht->stats == (hashtable_shard_t *)NULL) {
+		return (-1);
+
+	} /* if (ht->stats == (hashtable_shard_t *)NULL) {...} */
+
+	(void) memset(ht->stats, 0, HT_STAT_SHARDS * sizeof (*ht->stats));
+#endif
 
-	/*
-	 * All done, and it worked...
-	 */
 	return (0);
 
-} /* int ht_counter_add(... *counter, longlong_t delta) {...} */
+} /* static int ht_stats_init(hashtable_t *ht) {...} */
 
 /*
  * static int
- * ht_average_init(hashtable_average_t *average);
+ * ht_counter_add(hashtable_t *ht, hashtable_stat_t stat, longlong_t delta);
  *
  * Description:
- *	Initialize a hashtable average structure.
+ *	Sum the delta to a counter in the caller's shard atomically.
  *
  * Parameters:
- *	hashtable_average_t *average
- *		Input/Output - A pointer to an average structure to be
- *		initialized.
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the hash table head.
+ *
+ *	hashtable_stat_t stat
+ *		Input - The counter to be adjusted.
+ *
+ *	longlong_t delta
+ *		Input - Amount by which to adjust the counter value. Zero
+ *		(an unsampled lookup) leaves the shard alone.
  *
  * Return value:
- *	int	Upon successully setting the values for the average and
- *		initializing the lock a zero value will be returned. If the
- *		lock could not be intialized, the the error value from lock
- *		initialization will be returned (See mutex_init for details).
+ *	int	Zero. Counting can't fail.
  */
 static int
-ht_average_init(hashtable_average_t *average)
+ht_counter_add(hashtable_t *ht, hashtable_stat_t stat, longlong_t delta)
 {
-	average->count		=
-	    average->sum	=
-	    average->current	=
-	    average->maximum	= 0;
+#ifndef	HT_NO_STATS
+	if (delta != 0) {
+		atomic_add_64(&ht_shard(ht)->s.counter[stat], delta);
 
-	return (mutex_init(&average->mutex, USYNC_THREAD, NULL));
+	} /* if (delta != 0) {...} */
+#endif
 
-} /* static int ht_average_init(hashtable_average_t *average) {...} */
+	return (0);
+
+} /* int ht_counter_add(hashtable_t *ht, ..., longlong_t delta) {...} */
 
 /*
  * static int
- * ht_average_update(hashtable_average_t *average, current);
+ * ht_average_update(hashtable_t *ht, hashtable_avg_t avg,
+ *     longlong_t count, longlong_t sum, longlong_t maximum);
  *
  * Description:
  *	Update the values used for computing averages.
  *
  * Parameters:
- *	hashtable_average_t *average
- *		Input/Output - A pointer to an average structure to be updated
- *		with the current value passed.
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the hash table head.
+ *
+ *	hashtable_avg_t avg
+ *		Input - The average to be updated.
  *
  *	longlong_t count
  *		Input - Count to be added to the average count.
@@ -161,123 +256,234 @@ ht_average_init(hashtable_average_t *average)
  *	longlong_t sum
  *		Input - Sum to be added to the average sum.
  *
- *	longlogn_t current
- *		Input - Current value to be stored in average.
- *
  *	longlong_t maximum
- *		Input - The larger of this paramater value, the maximum
- *		in the average, and the current will be stored in the
- *		average.
+ *		Input - The larger of this paramater value and the maximum
+ *		in the average will be stored in the average.
  *
  * Return value
- *	int	If the lock could be obtained, then zero will be returned. If
- *		the lock could not be obtained, then a non-zero value will be
- *		returned.
+ *	int	Zero. Counting can't fail.
  */
 static int
-ht_average_update(hashtable_average_t *average,
+ht_average_update(hashtable_t *ht,
+    hashtable_avg_t avg,
     longlong_t count,
     longlong_t sum,
-    longlong_t current,
     longlong_t maximum)
 {
+#ifndef	HT_NO_STATS
 	/*
-	 * Fetch the lock...
-	 */
-	if (mutex_lock(&average->mutex)) {
-		return (-2);
-
-	} /* if (mutex_lock(&average->mutex)) {...} */
-
-	/*
-	 * Stash the current value, check for a maximum, increment the count,
-	 * and increase the sum by current.
-	 */
-	average->current = current;
-	average->count	+= count;
-	average->sum	+= sum;
-	if (maximum > average->maximum) {
-		average->maximum = maximum;
-
-	} /* if (maximum > average->maximum) {...} */
-	if (current > average->maximum) {
-		average->maximum = current;
-
-	} /* if (current > average->maximum) {...} */
-
-	/*
-	 * Give back the lock and blow!
+	 * Locals...
 	 */
-	if (mutex_unlock(&average->mutex)) {
-		return (-2);
+	hashtable_average_t	*average = &ht_shard(ht)->s.average[avg];
 
-	} /* if (mutex_unlock(average->mutex)) {...} */
+	atomic_add_64(&average->count, count);
+	atomic_add_64(&average->sum, sum);
+	ht_maximum(&average->maximum, maximum);
+#endif
 
-	/*
-	 * All done, and it seemed to work.
-	 */
 	return (0);
 
-} /* int ht_average_update(hashtable_average_t *average, current) {...} */
+} /* int ht_average_update(hashtable_t *ht, hashtable_avg_t avg, ...) {...} */
 
 /*
  * static int
- * ht_average_increment(hashtable_average_t *average, current);
+ * ht_average_increment(hashtable_t *ht, hashtable_avg_t avg,
+ *     longlong_t current);
  *
  * Description:
  *	Increment the counter in the average and increase the sum by the
  *	current value passed.
  *
  * Parameters:
- *	hashtable_average_t *average
- *		Input/Output - Pointer to the average structure to be updated.
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the hash table head.
+ *
+ *	hashtable_avg_t avg
+ *		Input - The average to be updated.
  *
  *	longlong_t current
  *		Input - Current value to be added to the average.
  *
  * Return value:
- *	int	If the lock could be fetched, then zero will be returned. If
- *		the lock could not be fetched, then a non-zero value will be
- *		returned and errno will be set.
+ *	int	Zero. Counting can't fail.
  */
 static int
-ht_average_increment(hashtable_average_t *average, longlong_t current)
+ht_average_increment(hashtable_t *ht, hashtable_avg_t avg, longlong_t current)
 {
-	/*
-	 * Fetch the lock...
-	 */
-	if (mutex_lock(&average->mutex)) {
-		return (-2);
+	return (ht_average_update(ht, avg, 1, current, current));
 
-	} /* if (mutex_lock(&average->mutex)) {...} */
+} /* int ht_average_increment(hashtable_t *ht, ..., current) {...} */
 
-	/*
-	 * Save the current, increment the count, add the sum, and check
-	 * the maximum.
-	 */
-	average->current = current;
-	++average->count;
-	average->sum	+= current;
-	if (current > average->maximum) {
-		average->maximum = current;
+/*
+ * static int
+ * ht_average_add(hashtable_t *ht, hashtable_avg_t avg, longlong_t current,
+ *     uint_t weight);
+ *
+ * Description:
+ *	Add current to an average on behalf of weight lookups, the weight
+ *	ht_sample() gave the lookup.
+ *
+ * Parameters:
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the hash table head.
+ *
+ *	hashtable_avg_t avg
+ *		Input - The average to be updated.
+ *
+ *	longlong_t current
+ *		Input - Current value to be added to the average.
+ *
+ *	uint_t weight
+ *		Input - Lookups this one stands for, zero if it's unsampled.
+ *
+ * Return value:
+ *	int	Zero. Counting can't fail.
+ */
+static int
+ht_average_add(hashtable_t *ht,
+    hashtable_avg_t avg,
+    longlong_t current,
+    uint_t weight)
+{
+	if (weight == 0) {
+		return (0);
+
+	} /* if (weight == 0) {...} */
+
+	return (ht_average_update(ht, avg, weight, current * weight, current));
+
+} /* int ht_average_add(hashtable_t *ht, ..., uint_t weight) {...} */
+
+/*
+ * static uint_t
+ * ht_sample(hashtable_t *ht);
+ *
+ * Description:
+ *	Decide whether a lookup about to start is one HT_STATS_SAMPLE
+ *	records. The tick is per shard and not atomic; a lost tick only
+ *	moves the next sample along a little.
+ *
+ * Parameters:
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the hash table head.
+ *
+ * Return value:
+ *	uint_t	The number of lookups this one stands for in the statistics:
+ *		HT_STATS_SAMPLE, or zero if it isn't recorded.
+ */
+static uint_t
+ht_sample(hashtable_t *ht)
+{
+#if	!defined(HT_NO_STATS) && HT_STATS_SAMPLE > 1
+	return ((++ht_shard(ht)->s.tick & (HT_STATS_SAMPLE - 1)) == 0 ?
+	    HT_STATS_SAMPLE : 0);
+#else
+	return (1);
+#endif
 
-	} /* if (current > average->maximum) {...} */
+} /* uint_t ht_sample(hashtable_t *ht) {...} */
 
+/*
+ * static void
+ * ht_stats_sum(hashtable_t *ht, ht_stats_t *stats);
+ *
+ * Description:
+ *	Add up the shards of a table's statistics. The sizes in stats are
+ *	left for the caller.
+ *
+ * Parameters:
+ *	hashtable_t *ht
+ *		Input - Pointer to the hash table head.
+ *
+ *	ht_stats_t *stats
+ *		Output - The summed counters and averages.
+ *
+ * Return value:
+ *	None.
+ */
+static void
+ht_stats_sum(hashtable_t *ht, ht_stats_t *stats)
+{
 	/*
-	 * Give back the lock and blow!
+	 * Locals...
 	 */
-	if (mutex_unlock(&average->mutex)) {
-		return (-2);
+	u_longlong_t		 counter[hts_count];
+	ht_average_t		 average[hta_count];
+	int			 i;	/* Shard.			*/
+	int			 j;	/* Counter or average.		*/
+
+	(void) memset(counter, 0, sizeof (counter));
+	(void) memset(average, 0, sizeof (average));
+
+#ifndef	HT_NO_STATS
+	for (i = 0; i < HT_STAT_SHARDS; ++i) {
+		for (j = 0; j < hts_count; ++j) {
+			counter[j] += ht->stats[i].s.counter[j];
+
+		} /* for (j = 0; j < hts_count; ++j) {...} */
 
-	} /* if (mutex_unlock(average->mutex)) {...} */
+		for (j = 0; j < hta_count; ++j) {
+			average[j].count += ht->stats[i].s.average[j].count;
+			average[j].sum	 += ht->stats[i].s.average[j].sum;
+			if (average[j].maximum <
+			    ht->stats[i].s.average[j].maximum) {
 
+				average[j].maximum =
+				    ht->stats[i].s.average[j].maximum;
+
+			} /* if (average[j].maximum < ...) {...} */
+
+		} /* for (j = 0; j < hta_count; ++j) {...} */
+
+	} /* for (i = 0; i < HT_STAT_SHARDS; ++i) {...} */
+#endif
+
+	stats->deletes		= counter[hts_deletes];
+	stats->errors		= counter[hts_errors];
+	stats->hits		= counter[hts_hits];
+	stats->inserts		= counter[hts_inserts];
+	stats->probes		= counter[hts_probes];
+	stats->resizes		= counter[hts_resizes];
+	stats->slabs		= counter[hts_slabs];
+	stats->depth		= average[hta_depth];
+	stats->freechain	= average[hta_freechain];
+	stats->searches		= average[hta_searches];
+
+} /* void ht_stats_sum(hashtable_t *ht, ht_stats_t *stats) {...} */
+
+/*
+ * static void
+ * ht_stats_reset_maximum(hashtable_t *ht, hashtable_avg_t avg);
+ *
+ * Description:
+ *	Start an average's maximum over from zero in every shard.
+ *
+ * Parameters:
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the hash table head.
+ *
+ *	hashtable_avg_t avg
+ *		Input - The average whose maximum is reset.
+ *
+ * Return value:
+ *	None.
+ */
+static void
+ht_stats_reset_maximum(hashtable_t *ht, hashtable_avg_t avg)
+{
+#ifndef	HT_NO_STATS
 	/*
-	 * All done, and it seemed to work.
+	 * Locals...
 	 */
-	return (0);
+	int			 i;	/* Shard.			*/
+
+	for (i = 0; i < HT_STAT_SHARDS; ++i) {
+		ht->stats[i].s.average[avg].maximum = 0;
 
+	} /* for (i = 0; i < HT_STAT_SHARDS; ++i) {...} */
+#endif
 
-} /* int ht_average_increment(... *average, longlong_t current) {...} */
+} /* void ht_stats_reset_maximum(hashtable_t *ht, hashtable_avg_t avg) {...} */
 
 /*
  * int
@@ -339,6 +545,133 @@ ht_evaluate_threshold_default(size_t numents,
 
 } /* int ht_evaluate_threshold_default(...) {...} */
 
+/*
+ * size_t
+ * ht_evaluate_threshold_adaptive(const ht_load_t *load);
+ *
+ * Description
+ *	The resize policy tables start out with. See hashtable.h.
+ *
+ * Parameters:
+ *	const ht_load_t *load
+ *		Input - The table's load.
+ *
+ * Return value:
+ *	size_t	The size the table should be resized to, or zero if it's fine.
+ */
+size_t
+ht_evaluate_threshold_adaptive(const ht_load_t *load)
+{
+	/*
+	 * Locals...
+	 */
+	size_t		n = load->numents;	/* Current size.	*/
+	size_t		e = load->entries;	/* Keys held.		*/
+	u_longlong_t	misses;			/* Window: misses.	*/
+	u_longlong_t	worst;			/* Deepest allowed.	*/
+	size_t		i;			/* Log of n counter.	*/
+	int		deep;			/* Searches run deep?	*/
+
+	misses = (load->probes > load->hits ? load->probes - load->hits : 0);
+
+	/*
+	 * Most lookups missing? Then most walk a whole chain or probe
+	 * sequence, and the table is better off a little emptier.
+	 */
+	deep = (load->probes >= HT_POLICY_SAMPLES && misses * 2 > load->probes);
+
+	if (load->options & hto_open_addressing) {
+		/*
+		 * Probe depths count whole groups past the first.
+		 */
+		deep = deep || (load->searchcount >= HT_POLICY_SAMPLES &&
+		    load->searchsum * 4 > load->searchcount);
+
+		if (e * 4 > n * 3 && deep) {
+			return (n * 2);
+
+		} /* if (e * 4 > n * 3 && deep) {...} */
+
+		if (e * 16 < n && n > load->minents) {
+			return (e * 4 < load->minents ? load->minents : e * 4);
+
+		} /* if (e * 16 < n && n > load->minents) {...} */
+
+		return (0);
+
+	} /* if (load->options & hto_open_addressing) {...} */
+
+	/*
+	 * The longest chain of a big table runs past the average however
+	 * good the hash is, by about the log of the table size, so that's
+	 * allowed for before the maximum counts. And a deep chain in a
+	 * mostly empty table is the hash's fault, which more buckets won't
+	 * fix.
+	 */
+	for (worst = HT_POLICY_DEPTH, i = n; i > 1; i >>= 1) {
+		++worst;
+
+	} /* for (worst = HT_POLICY_DEPTH, i = n; i > 1; i >>= 1) {...} */
+
+	deep = (deep && e * 4 > n * 3) ||
+	    (load->searchcount >= HT_POLICY_SAMPLES &&
+	    load->searchsum > load->searchcount * HT_POLICY_SEARCH) ||
+	    load->searchmax > worst ||
+	    load->depthmax > worst;
+
+	if (e > n || (e * 2 > n && deep)) {
+		return (n * 2);
+
+	} /* if (e > n || (e * 2 > n && deep)) {...} */
+
+	/*
+	 * Shrink in one go: a chained table drains a bucket at a time, and
+	 * won't start another resize until it's done.
+	 */
+	if (e * 8 < n && n > load->minents) {
+		return (e * 2 < load->minents ? load->minents : e * 2);
+
+	} /* if (e * 8 < n && n > load->minents) {...} */
+
+	return (0);
+
+} /* size_t ht_evaluate_threshold_adaptive(const ht_load_t *load) {...} */
+
+/*
+ * static void
+ * ht_window_reset(hashtable_t *ht);
+ *
+ * Description:
+ *	Start a new window of statistics for the resize policy, after the
+ *	table has changed size. The maximum depths are reset with it.
+ *
+ * Parameters:
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the hash table head.
+ *
+ * Return value:
+ *	None.
+ */
+static void
+ht_window_reset(hashtable_t *ht)
+{
+	/*
+	 * Locals...
+	 */
+	ht_stats_t	 stats;		/* Counts so far.		*/
+
+	ht_stats_sum(ht, &stats);
+	ht->window.probes	= stats.probes;
+	ht->window.hits		= stats.hits;
+	ht->window.searchcount	= stats.searches.count;
+	ht->window.searchsum	= stats.searches.sum;
+	ht->window.updates	= ht->updates;
+
+	ht_stats_reset_maximum(ht, hta_searches);
+	ht_stats_reset_maximum(ht, hta_depth);
+
+} /* void ht_window_reset(hashtable_t *ht) {...} */
+
 /*
  *
  *  static int
@@ -519,6 +852,7 @@ ht_create_slab(size_t numents)
 	 * Point to the first entry in the slab. It's immediately following
 	 * the slab header itself.
 	 */
+	slab->header.next	= (hashtable_slab_t *)NULL;
 	slab->header.entry	= (hashtable_entry_t *)&slab[1];
 	slab->header.entrycount	= numents;
 
@@ -590,15 +924,26 @@ ht_destroy_slab(hashtable_slab_t *slab)
 
 /*
  *
- *  unsigned int
- *  ht_hash_compute(void *key, size_t keysize)
+ *  size_t
+ *  ht_hash_bytes(void *key, size_t keysize, size_t table_size)
  *
  *  Description:
- *	Compute a hash value based on the bytes passed as the key.
+ *	Compute a hash value based on the bytes passed as the key. Only the
+ *	last few bytes of a long key survive the shifting, so this hash is
+ *	kept for tables created with hto_hash_legacy.
  *
  *  Paramaters:
+ *	void *key
+ *		Input - Pointer to the bytes of the key.
+ *
+ *	size_t keysize
+ *		Input - Number of bytes in the key.
+ *
+ *	size_t table_size
+ *		Input - Number of entries in the table.
  *
  *  Return value:
+ *	size_t	An index into the table, from 0 to table_size - 1.
  *
  */
 size_t
@@ -631,287 +976,2619 @@ ht_hash_bytes(void *key, size_t keysize, size_t table_size)
 	 */
 	return (hash_value);
 
-} /* unsigned int hash_compute(void *key) */
+} /* size_t ht_hash_bytes(void *key, ...) {...} */
 
 /*
  *
- *  hashtable_t *
- *  ht_create(size_t numents, size_t keysize, unsigned int options);
+ *  static size_t
+ *  ht_hash_reduce(uint64_t hash, size_t table_size)
  *
  *  Description:
- *	Allocate sufficient memory for a hash table with numents entries.
+ *	Reduce a 64 bit hash to an index into the table. Tables are sized to
+ *	a power of two, so this is normally a mask. Callers of the public
+ *	hash functions may pass any size, which falls back to a modulo.
  *
  *  Paramaters:
- *	size_t numents
- *		Input - Specifies the number of entries expected in the table
- *		when it's full. Room will be allocated for this many entries
- *		during table creation.
+ *	uint64_t hash
+ *		Input - A fully mixed hash value.
  *
- *	int keysize
- *		Input - Specifies the number of bytes in the key for table
- *		entries.
+ *	size_t table_size
+ *		Input - Number of entries in the table.
  *
- *	unsigned int options
- *		Input - Options for table mainteance. See the definition for
- *		ht_option_t in hashtable.h for details.
+ *  Return value:
+ *	size_t	An index into the table, from 0 to table_size - 1.
+ *
+ */
+static size_t
+ht_hash_reduce(uint64_t hash, size_t table_size)
+{
+	if ((table_size & (table_size - 1)) == 0) {
+		return ((size_t)hash & (table_size - 1));
+
+	} /* if ((table_size & (table_size - 1)) == 0) {...} */
+
+	return ((size_t)(hash % table_size));
+
+} /* size_t ht_hash_reduce(uint64_t hash, size_t table_size) {...} */
+
+/*
+ *
+ *  static uint64_t
+ *  ht_hash_tail(uint64_t hash, const unsigned char *sample, size_t len)
+ *
+ *  Description:
+ *	Fold the remaining bytes of a key into a hash eight, then four, then
+ *	one byte at a time, and avalanche the result so every input bit
+ *	reaches the low order bits that ht_hash_reduce() keeps.
+ *
+ *  Paramaters:
+ *	uint64_t hash
+ *		Input - Hash accumulated so far.
+ *
+ *	const unsigned char *sample
+ *		Input - Pointer to the bytes of the key left to hash.
+ *
+ *	size_t len
+ *		Input - Number of bytes left to hash.
  *
  *  Return value:
- *	hashtable_t * If a table head and entries were successfully allocated,
- *		then the address of the table head is returned. If any failures
- *		occur, then NULL will be returned.
+ *	uint64_t The fully mixed hash value.
  *
  */
-void *
-ht_create(size_t numents, size_t keysize, ht_option_t options)
+static uint64_t
+ht_hash_tail(uint64_t hash, const unsigned char *sample, size_t len)
 {
 	/*
 	 * Locals...
 	 */
-	hashtable_t	*ht;	/* Hash table being created.		*/
+	uint64_t	word;		/* Eight bytes of key.	*/
+	uint32_t	half;		/* Four bytes of key.	*/
 
 	/*
-	 * Don't get bamboozled by a zero entry table.
+	 * Keys need not be aligned, so words are copied out of the key.
+	 * The compiler turns a fixed size memcpy() into a plain load.
 	 */
-	if (! numents > 0) {
-		errno = EINVAL;
-		return ((hashtable_slab_t *)NULL);
+	for (; len >= sizeof (word); len -= sizeof (word)) {
+		(void) memcpy(&word, sample, sizeof (word));
+		sample	+= sizeof (word);
+		hash	^= HT_ROUND(0, word);
+		hash	 = HT_ROTL64(hash, 27) * HT_PRIME1 + HT_PRIME4;
 
-	} /* if (! numents > 0) {...} */
+	} /* for (; len >= sizeof (word); ...) {...} */
+
+	if (len >= sizeof (half)) {
+		(void) memcpy(&half, sample, sizeof (half));
+		sample	+= sizeof (half);
+		len	-= sizeof (half);
+		hash	^= (uint64_t)half * HT_PRIME1;
+		hash	 = HT_ROTL64(hash, 23) * HT_PRIME2 + HT_PRIME3;
+
+	} /* if (len >= sizeof (half)) {...} */
+
+	for (; len > 0; --len) {
+		hash	^= (uint64_t)*sample++ * HT_PRIME5;
+		hash	 = HT_ROTL64(hash, 11) * HT_PRIME1;
+
+	} /* for (; len > 0; --len) {...} */
 
 	/*
-	 *  Allocate the table head, save the options and keysize.
+	 * Avalanche.
 	 */
-	ht = (hashtable_t *)malloc(sizeof (*ht));
+	hash	^= hash >> 33;
+	hash	*= HT_PRIME2;
+	hash	^= hash >> 29;
+	hash	*= HT_PRIME3;
+	hash	^= hash >> 32;
+
+	return (hash);
+
+} /* uint64_t ht_hash_tail(uint64_t hash, ...) {...} */
+
+/*
+ *
+ *  static uint64_t
+ *  ht_hash_mix_full(const void *key, size_t keysize)
+ *
+ *  Description:
+ *	Compute a hash value eight bytes at a time with a multiply and
+ *	rotate mixer. Small fixed size keys such as thread ids cost a single
+ *	round plus the avalanche.
+ *
+ *  Paramaters:
+ *	const void *key
+ *		Input - Pointer to the bytes of the key.
+ *
+ *	size_t keysize
+ *		Input - Number of bytes in the key.
+ *
+ *  Return value:
+ *	uint64_t The fully mixed hash value.
+ *
+ */
+static uint64_t
+ht_hash_mix_full(const void *key, size_t keysize)
+{
+	return (ht_hash_tail(HT_PRIME5 + keysize,
+	    (const unsigned char *)key,
+	    keysize));
+
+} /* uint64_t ht_hash_mix_full(const void *key, ...) {...} */
+
+/*
+ *
+ *  size_t
+ *  ht_hash_mix(void *key, size_t keysize, size_t table_size)
+ *
+ *  Description:
+ *	Compute a table index with ht_hash_mix_full().
+ *
+ *  Paramaters:
+ *	See ht_hash_bytes().
+ *
+ *  Return value:
+ *	size_t	An index into the table, from 0 to table_size - 1.
+ *
+ */
+size_t
+ht_hash_mix(void *key, size_t keysize, size_t table_size)
+{
+	return (ht_hash_reduce(ht_hash_mix_full(key, keysize), table_size));
+
+} /* size_t ht_hash_mix(void *key, ...) {...} */
+
+/*
+ *
+ *  static uint64_t
+ *  ht_hash_wide_full(const void *key, size_t keysize)
+ *
+ *  Description:
+ *	Compute a hash value over four independent lanes, 32 bytes per step,
+ *	then merge the lanes and finish the tail with ht_hash_tail(). None of
+ *	the lanes depends on another, so the multiplies overlap in the
+ *	pipeline or run side by side in vector registers.
+ *
+ *  Paramaters:
+ *	See ht_hash_mix_full().
+ *
+ *  Return value:
+ *	uint64_t The fully mixed hash value.
+ *
+ */
+static uint64_t
+ht_hash_wide_full(const void *key, size_t keysize)
+{
+	/*
+	 * Locals...
+	 */
+	const unsigned char	*sample;	/* Sample of the key.	*/
+	uint64_t		 lane[4];	/* Lane accumulators.	*/
+	uint64_t		 word[4];	/* One step of key.	*/
+	uint64_t		 hash;		/* Merged lanes.	*/
+	size_t			 len;		/* Bytes left to hash.	*/
+	int			 i;		/* Lane index.		*/
+
+	/*
+	 * Short keys don't fill a single step.
+	 */
+	if (keysize < sizeof (word)) {
+		return (ht_hash_mix_full(key, keysize));
+
+	} /* if (keysize < sizeof (word)) {...} */
+
+	lane[0]	= HT_PRIME1 + HT_PRIME2;
+	lane[1]	= HT_PRIME2;
+	lane[2]	= 0;
+	lane[3]	= 0 - HT_PRIME1;
+
+	sample	= (const unsigned char *)key;
+	for (len = keysize; len >= sizeof (word); len -= sizeof (word)) {
+		(void) memcpy(word, sample, sizeof (word));
+		sample += sizeof (word);
+
+		for (i = 0; i < 4; ++i) {
+			lane[i] = HT_ROUND(lane[i], word[i]);
+
+		} /* for (i = 0; i < 4; ++i) {...} */
+
+	} /* for (len = keysize; len >= sizeof (word); ...) {...} */
+
+	/*
+	 * Merge the lanes.
+	 */
+	hash	= HT_ROTL64(lane[0], 1) + HT_ROTL64(lane[1], 7) +
+	    HT_ROTL64(lane[2], 12) + HT_ROTL64(lane[3], 18);
+
+	for (i = 0; i < 4; ++i) {
+		hash	^= HT_ROUND(0, lane[i]);
+		hash	 = hash * HT_PRIME1 + HT_PRIME4;
+
+	} /* for (i = 0; i < 4; ++i) {...} */
+
+	return (ht_hash_tail(hash + keysize, sample, len));
+
+} /* uint64_t ht_hash_wide_full(const void *key, ...) {...} */
+
+/*
+ *
+ *  size_t
+ *  ht_hash_wide(void *key, size_t keysize, size_t table_size)
+ *
+ *  Description:
+ *	Compute a table index with ht_hash_wide_full().
+ *
+ *  Paramaters:
+ *	See ht_hash_bytes().
+ *
+ *  Return value:
+ *	size_t	An index into the table, from 0 to table_size - 1.
+ *
+ */
+size_t
+ht_hash_wide(void *key, size_t keysize, size_t table_size)
+{
+	return (ht_hash_reduce(ht_hash_wide_full(key, keysize), table_size));
+
+} /* size_t ht_hash_wide(void *key, ...) {...} */
+
+/*
+ *
+ *  static size_t
+ *  ht_size_pow2(size_t numents)
+ *
+ *  Description:
+ *	Round a table size up to the next power of two.
+ *
+ *  Paramaters:
+ *	size_t numents
+ *		Input - Number of entries requested.
+ *
+ *  Return value:
+ *	size_t	The smallest power of two not less than numents, or zero if
+ *		there is no such size_t.
+ *
+ */
+static size_t
+ht_size_pow2(size_t numents)
+{
+	/*
+	 * Locals...
+	 */
+	size_t	size;		/* Size to return.	*/
+
+	for (size = 1; size != 0 && size < numents; size <<= 1) {
+		continue;
+
+	} /* for (size = 1; size != 0 && size < numents; ...) {...} */
+
+	return (size);
+
+} /* size_t ht_size_pow2(size_t numents) {...} */
+
+/*
+ *
+ *  static hashtable_epoch_reader_t *
+ *  ht_epoch_enter(void)
+ *
+ *  Description:
+ *	Post the calling thread as a reader in the current epoch. Threads
+ *	claim a reader record the first time through and keep it until they
+ *	exit. If all HT_EPOCH_READERS records are taken, the thread counts
+ *	itself in ht_epoch_overflow instead, which holds off all reclaiming
+ *	until it leaves.
+ *
+ *  Paramaters:
+ *	None.
+ *
+ *  Return value:
+ *	hashtable_epoch_reader_t * The caller's record, or NULL if it was
+ *		counted as an overflow reader. Either way, pass it to
+ *		ht_epoch_exit() when the lookup is over.
+ *
+ */
+static hashtable_epoch_reader_t *
+ht_epoch_enter(void)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_epoch_reader_t	*reader = NULL;	/* Thread's record. */
+	int				 i;	/* Record number.	*/
+
+	/*
+	 * Create the key for the records on first use.
+	 */
+	if (! ht_reader_key_made) {
+		(void) mutex_lock(&ht_reader_key_lock);
+		if (! ht_reader_key_made &&
+		    thr_keycreate(&ht_reader_key, ht_epoch_release) == 0) {
+
+			membar_producer();
+			ht_reader_key_made = 1;
+
+		} /* if (! ht_reader_key_made && ...) {...} */
+		(void) mutex_unlock(&ht_reader_key_lock);
+
+	} /* if (! ht_reader_key_made) {...} */
+
+	if (ht_reader_key_made) {
+		(void) thr_getspecific(ht_reader_key, (void **)&reader);
+
+		for (i = 0; reader == NULL && i < HT_EPOCH_READERS; ++i) {
+			if (ht_readers[i].owner == 0 &&
+			    atomic_cas_32(&ht_readers[i].owner, 0, 1) == 0) {
+
+				reader = &ht_readers[i];
+				(void) thr_setspecific(ht_reader_key, reader);
+
+			} /* if (ht_readers[i].owner == 0 && ...) {...} */
+
+		} /* for (i = 0; reader == NULL && ...; ++i) {...} */
+
+	} /* if (ht_reader_key_made) {...} */
+
+	if (reader != NULL) {
+		reader->epoch = ht_epoch;
+
+	} else /* if (reader == NULL) */ {
+		atomic_inc_32(&ht_epoch_overflow);
+
+	} /* if (reader != NULL) {...} else {...} */
+
+	/*
+	 * The post must be visible before anything in the table is read.
+	 */
+	membar_enter();
+	return (reader);
+
+} /* hashtable_epoch_reader_t *ht_epoch_enter(void) {...} */
+
+/*
+ *
+ *  static void
+ *  ht_epoch_exit(hashtable_epoch_reader_t *reader)
+ *
+ *  Description:
+ *	Take the calling thread out of the epoch it entered.
+ *
+ *  Paramaters:
+ *	hashtable_epoch_reader_t *reader
+ *		Input - The record returned by ht_epoch_enter().
+ *
+ *  Return value:
+ *	None.
+ *
+ */
+static void
+ht_epoch_exit(hashtable_epoch_reader_t *reader)
+{
+	membar_exit();
+	if (reader != NULL) {
+		reader->epoch = 0;
+
+	} else /* if (reader == NULL) */ {
+		atomic_dec_32(&ht_epoch_overflow);
+
+	} /* if (reader != NULL) {...} else {...} */
+
+} /* void ht_epoch_exit(hashtable_epoch_reader_t *reader) {...} */
+
+/*
+ *
+ *  static void
+ *  ht_epoch_release(void *reader)
+ *
+ *  Description:
+ *	Give a reader record back when its thread exits.
+ *
+ *  Paramaters:
+ *	void *reader
+ *		Input - The thread's hashtable_epoch_reader_t.
+ *
+ *  Return value:
+ *	None.
+ *
+ */
+static void
+ht_epoch_release(void *reader)
+{
+	((hashtable_epoch_reader_t *)reader)->epoch = 0;
+	membar_exit();
+	((hashtable_epoch_reader_t *)reader)->owner = 0;
+
+} /* void ht_epoch_release(void *reader) {...} */
+
+/*
+ *
+ *  static void
+ *  ht_epoch_retire(void *ptr)
+ *
+ *  Description:
+ *	Free a buffer that concurrent readers may still be looking at, once
+ *	they have all moved on. The buffer must already be unreachable from
+ *	the table. It joins the limbo list tagged with the current epoch,
+ *	the epoch is advanced, and everything on the list older than the
+ *	oldest posted reader is freed.
+ *
+ *  Paramaters:
+ *	void *ptr
+ *		Input - The buffer to free.
+ *
+ *  Return value:
+ *	None.
+ *
+ */
+static void
+ht_epoch_retire(void *ptr)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_limbo_t	*limbo;	/* Entry for ptr.		*/
+	hashtable_limbo_t	**prev;	/* Link to the entry.		*/
+	uint64_t		 oldest; /* Oldest posted epoch.	*/
+	uint64_t		 epoch;	/* A posted epoch.		*/
+	int			 i;	/* Reader record number.	*/
+
+	(void) mutex_lock(&ht_limbo_lock);
+
+	/*
+	 * No room to remember it? Then wait it out right here.
+	 */
+	if ((limbo = (hashtable_limbo_t *)malloc(sizeof (*limbo))) == NULL) {
+		epoch = ht_epoch;
+		atomic_inc_64(&ht_epoch);
+		membar_enter();
+
+		for (i = 0; i < HT_EPOCH_READERS; ++i) {
+			while (ht_epoch_overflow != 0 ||
+			    ((oldest = ht_readers[i].epoch) != 0 &&
+			    oldest <= epoch)) {
+
+				(void) yield();
+
+			} /* while (ht_epoch_overflow != 0 || ...) {...} */
+
+		} /* for (i = 0; i < HT_EPOCH_READERS; ++i) {...} */
+
+		(void) free(ptr);
+		(void) mutex_unlock(&ht_limbo_lock);
+		return;
+
+	} /* if ((limbo = ...malloc(sizeof (*limbo))) == NULL) {...} */
+
+	limbo->ptr	= ptr;
+	limbo->epoch	= ht_epoch;
+	limbo->next	= ht_limbo;
+	ht_limbo	= limbo;
+
+	/*
+	 * Readers who show up from here on see the new epoch, and can't
+	 * find anything retired up to now.
+	 */
+	atomic_inc_64(&ht_epoch);
+	membar_enter();
+
+	if (ht_epoch_overflow != 0) {
+		(void) mutex_unlock(&ht_limbo_lock);
+		return;
+
+	} /* if (ht_epoch_overflow != 0) {...} */
+
+	oldest = UINT64_MAX;
+	for (i = 0; i < HT_EPOCH_READERS; ++i) {
+		if ((epoch = ht_readers[i].epoch) != 0 && epoch < oldest) {
+			oldest = epoch;
+
+		} /* if ((epoch = ht_readers[i].epoch) != 0 && ...) {...} */
+
+	} /* for (i = 0; i < HT_EPOCH_READERS; ++i) {...} */
+
+	for (prev = &ht_limbo; (limbo = *prev) != NULL; ) {
+		if (limbo->epoch < oldest) {
+			*prev = limbo->next;
+			(void) free(limbo->ptr);
+			(void) free(limbo);
+
+		} else /* if (limbo->epoch >= oldest) */ {
+			prev = &limbo->next;
+
+		} /* if (limbo->epoch < oldest) {...} else {...} */
+
+	} /* for (prev = &ht_limbo; (limbo = *prev) != NULL; ) {...} */
+
+	(void) mutex_unlock(&ht_limbo_lock);
+
+} /* void ht_epoch_retire(void *ptr) {...} */
+
+/*
+ *
+ *  static void *
+ *  ht_oa_key(hashtable_t *ht, hashtable_oa_slot_t *slot)
+ *
+ *  Description:
+ *	Find the key of an occupied slot.
+ *
+ *  Paramaters:
+ *	hashtable_t *ht
+ *		Input - Pointer to the table head.
+ *
+ *	hashtable_oa_slot_t *slot
+ *		Input - Pointer to the slot.
+ *
+ *  Return value:
+ *	void *	The copy in the slot for small keys, otherwise the caller's
+ *		key (or the table's copy of it, in a concurrent table).
+ *
+ */
+static void *
+ht_oa_key(hashtable_t *ht, hashtable_oa_slot_t *slot)
+{
+	return (ht->keysize <= HT_INLINE_KEY ?
+	    (void *)slot->key.bytes :
+	    slot->key.ptr);
+
+} /* void *ht_oa_key(hashtable_t *ht, ...) {...} */
+
+/*
+ *
+ *  static size_t
+ *  ht_oa_find(hashtable_t *ht, hashtable_oa_t *oa, void *key,
+ *	uint64_t hash, int *depth)
+ *
+ *  Description:
+ *	Walk the probe sequence for a hash looking for the key passed. Groups
+ *	are visited in triangular steps, which covers every group of a power
+ *	of two table. The walk stops at the first group with an empty slot.
+ *	The caller must keep the table from changing under it, or, for a
+ *	concurrent table, hold the stripe lock of the key's home group.
+ *
+ *  Paramaters:
+ *	hashtable_t *ht
+ *		Input - Pointer to the table head.
+ *
+ *	hashtable_oa_t *oa
+ *		Input - The table's slot buffer.
+ *
+ *	void *key
+ *		Input - Pointer to the bytes of the key to find.
+ *
+ *	uint64_t hash
+ *		Input - Full hash of the key.
+ *
+ *	int *depth
+ *		Output - Number of groups probed past the first.
+ *
+ *  Return value:
+ *	size_t	The slot holding the key, or the table capacity if it isn't
+ *		there.
+ *
+ */
+static size_t
+ht_oa_find(hashtable_t *ht,
+    hashtable_oa_t *oa,
+    void *key,
+    uint64_t hash,
+    int *depth)
+{
+	/*
+	 * Locals...
+	 */
+	size_t		 gmask;		/* Group number mask.	*/
+	size_t		 g;		/* Group being probed.	*/
+	size_t		 i;		/* Slot being compared.	*/
+	size_t		 step;		/* Probe step.		*/
+	uint64_t	 group;		/* Group control bytes.	*/
+	uint64_t	 match;		/* Candidate slots.	*/
+
+	gmask	= oa->capacity / HT_OA_GROUP - 1;
+	g	= (size_t)(hash >> 7) & gmask;
+	for (step = 0; step <= gmask; g = (g + ++step) & gmask) {
+		group = ht_oa_load(&oa->ctrl[g * HT_OA_GROUP]);
+
+		for (match = ht_oa_match(group, (unsigned int)hash & 0x7F);
+		    match != 0;
+		    match &= match - 1) {
+
+			i = g * HT_OA_GROUP + ht_oa_index(match & (0 - match));
+			if ((*(ht->key_compare))(ht_oa_key(ht, &oa->slots[i]),
+			    key,
+			    ht->keysize) == 0) {
+
+				*depth = (int)step;
+				return (i);
+
+			} /* if ((*(ht->key_compare))(...) == 0) {...} */
+
+		} /* for (match = ht_oa_match(...); ...) {...} */
+
+		/*
+		 * An empty slot means the key was never pushed past here.
+		 */
+		if (group & ~(group << 6) & HT_OA_MSBS) {
+			break;
+
+		} /* if (group & ~(group << 6) & HT_OA_MSBS) {...} */
+
+	} /* for (step = 0; step <= gmask; ...) {...} */
+
+	*depth = (int)step;
+	return (oa->capacity);
+
+} /* size_t ht_oa_find(hashtable_t *ht, ...) {...} */
+
+/*
+ *
+ *  static size_t
+ *  ht_oa_place(hashtable_oa_t *oa, uint64_t hash, int *depth)
+ *
+ *  Description:
+ *	Walk the probe sequence for a hash to the first empty or deleted
+ *	slot. The table is never more than 7/8 occupied or deleted, so one
+ *	is always found. In a concurrent table the slot must still be
+ *	claimed, since another writer may have found it too.
+ *
+ *  Paramaters:
+ *	hashtable_oa_t *oa
+ *		Input - The table's slot buffer.
+ *
+ *	uint64_t hash
+ *		Input - Full hash of the key to place.
+ *
+ *	int *depth
+ *		Output - Number of groups probed past the first.
+ *
+ *  Return value:
+ *	size_t	The free slot.
+ *
+ */
+static size_t
+ht_oa_place(hashtable_oa_t *oa, uint64_t hash, int *depth)
+{
+	/*
+	 * Locals...
+	 */
+	size_t		 gmask;		/* Group number mask.	*/
+	size_t		 g;		/* Group being probed.	*/
+	size_t		 step;		/* Probe step.		*/
+	uint64_t	 group;		/* Group control bytes.	*/
+	uint64_t	 avail;		/* Free slots.		*/
+
+	/*
+	 * Empty and deleted slots have the high bit set and the low bit
+	 * clear. Busy slots have both set.
+	 */
+	gmask	= oa->capacity / HT_OA_GROUP - 1;
+	g	= (size_t)(hash >> 7) & gmask;
+	for (step = 0; ; g = (g + ++step) & gmask) {
+		group = ht_oa_load(&oa->ctrl[g * HT_OA_GROUP]);
+		if ((avail = group & ~(group << 7) & HT_OA_MSBS) != 0) {
+			break;
+
+		} /* if ((avail = ...) != 0) {...} */
+
+	} /* for (step = 0; ; ...) {...} */
+
+	*depth = (int)step;
+	return (g * HT_OA_GROUP + ht_oa_index(avail & (0 - avail)));
+
+} /* size_t ht_oa_place(hashtable_oa_t *oa, uint64_t hash, ...) {...} */
+
+/*
+ *
+ *  static void
+ *  ht_oa_prefetch(hashtable_t *ht, hashtable_oa_t *oa, uint64_t hash)
+ *
+ *  Description:
+ *	Start loading the home group of a hash: its control bytes, its
+ *	slots and, for a concurrent table, its stripe.
+ *
+ *  Paramaters:
+ *	hashtable_t *ht
+ *		Input - Pointer to the hash table head.
+ *
+ *	hashtable_oa_t *oa
+ *		Input - The table's slot buffer.
+ *
+ *	uint64_t hash
+ *		Input - Full hash of a key.
+ *
+ *  Return value:
+ *	None.
+ *
+ */
+static void
+ht_oa_prefetch(hashtable_t *ht, hashtable_oa_t *oa, uint64_t hash)
+{
+	/*
+	 * Locals...
+	 */
+	size_t		 g;		/* Home group.		*/
+
+	g = (size_t)(hash >> 7) & (oa->capacity / HT_OA_GROUP - 1);
+	HT_PREFETCH(&oa->ctrl[g * HT_OA_GROUP]);
+	HT_PREFETCH(&oa->slots[g * HT_OA_GROUP]);
+	HT_PREFETCH(&oa->slots[g * HT_OA_GROUP + HT_OA_GROUP / 2]);
+	if (ht->options & hto_concurrent) {
+		HT_PREFETCH(&oa->stripes[g & (HT_OA_STRIPES - 1)]);
+
+	} /* if (ht->options & hto_concurrent) {...} */
+
+} /* void ht_oa_prefetch(hashtable_t *ht, ...) {...} */
+
+/*
+ *
+ *  static int
+ *  ht_oa_rehash(hashtable_t *ht, size_t numents)
+ *
+ *  Description:
+ *	Move every entry of an open addressing table into a new buffer of
+ *	at least numents slots, dropping the deleted slots on the way. The
+ *	new size is a power of two, at least one group, and big enough to
+ *	keep the current entries under 7/8 full. The caller must hold the
+ *	table lock for writing, or own the table outright.
+ *
+ *	The new buffer is published with a single store. The old one is
+ *	freed at once, unless the table is concurrent: then its stripes are
+ *	left looking busy so that lookups still in it retry in the new one,
+ *	and it is retired.
+ *
+ *  Paramaters:
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the table head.
+ *
+ *	size_t numents
+ *		Input - Number of slots wanted.
+ *
+ *  Return value:
+ *	int	Zero if the table was rebuilt. If no memory could be had, -1
+ *		is returned, errno is set and the table is left as it was.
+ *
+ */
+static int
+ht_oa_rehash(hashtable_t *ht, size_t numents)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_oa_t		*old = ht->oa;	/* Buffer being replaced. */
+	hashtable_oa_t		*oa;		/* New buffer.		*/
+	hashtable_oa_slot_t	*slot;		/* Slot being moved.	*/
+	uint64_t		 hash;		/* Hash of its key.	*/
+	size_t			 capacity;	/* New number of slots.	*/
+	size_t			 nstripes;	/* Number of stripes.	*/
+	size_t			 used;		/* Entries to move.	*/
+	size_t			 n;		/* Old slot.		*/
+	size_t			 i;		/* New slot.		*/
+	int			 depth;		/* Unused probe depth.	*/
+
+	used = (old != NULL ? old->used : 0);
+	if (numents < used + used / 7 + 1) {
+		numents = used + used / 7 + 1;
+
+	} /* if (numents < used + used / 7 + 1) {...} */
+
+	if (numents < HT_OA_GROUP) {
+		numents = HT_OA_GROUP;
+
+	} /* if (numents < HT_OA_GROUP) {...} */
+
+	nstripes = (ht->options & hto_concurrent ? HT_OA_STRIPES : 0);
+	if ((capacity = ht_size_pow2(numents)) == 0 ||
+	    capacity > (SIZE_MAX - sizeof (*oa) -
+	    nstripes * sizeof (*oa->stripes)) / (sizeof (*slot) + 1)) {
+
+		errno = ENOMEM;
+		return (-1);
+
+	} /* if ((capacity = ht_size_pow2(numents)) == 0 || ...) {...} */
+
+	/*
+	 * One buffer for the header, stripes, slots and control bytes.
+	 */
+	oa = (hashtable_oa_t *)malloc(sizeof (*oa) +
+	    nstripes * sizeof (*oa->stripes) +
+	    capacity * (sizeof (*slot) + 1));
+
+	if (oa == (hashtable_oa_t *)NULL) {
+		return (-1);
+
+	} /* if (oa == (hashtable_oa_t *)NULL) {...} */
+
+	oa->capacity	= capacity;
+	oa->used	= 0;
+	oa->tombs	= 0;
+	oa->stripes	= (hashtable_oa_stripe_t *)&oa[1];
+	oa->slots	= (hashtable_oa_slot_t *)&oa->stripes[nstripes];
+	oa->ctrl	= (unsigned char *)&oa->slots[capacity];
+	(void) memset(oa->stripes, 0, nstripes * sizeof (*oa->stripes));
+	(void) memset(oa->ctrl, HT_OA_EMPTY, capacity);
+
+	/*
+	 * Move the occupied slots over. The slot, inline key and all, is
+	 * copied whole.
+	 */
+	for (n = 0; old != NULL && n < old->capacity; ++n) {
+		if (old->ctrl[n] & 0x80) {
+			continue;
+
+		} /* if (old->ctrl[n] & 0x80) {...} */
+
+		slot = &old->slots[n];
+		hash = (*(ht->hash_full))(ht_oa_key(ht, slot), ht->keysize);
+
+		i = ht_oa_place(oa, hash, &depth);
+		oa->slots[i]	= *slot;
+		oa->ctrl[i]	= (unsigned char)(hash & 0x7F);
+		++oa->used;
+
+	} /* for (n = 0; old != NULL && n < old->capacity; ++n) {...} */
+
+	/*
+	 * Publish the new buffer, then get rid of the old one.
+	 */
+	membar_producer();
+	ht->oa = oa;
+	ht_window_reset(ht);
+
+	if (old != NULL && nstripes != 0) {
+		for (n = 0; n < nstripes; ++n) {
+			atomic_inc_32(&old->stripes[n].begin);
+
+		} /* for (n = 0; n < nstripes; ++n) {...} */
+
+		ht_epoch_retire(old);
+
+	} else /* if (old == NULL || nstripes == 0) */ {
+		(void) free(old);
+
+	} /* if (old != NULL && nstripes != 0) {...} else {...} */
+
+	return (0);
+
+} /* int ht_oa_rehash(hashtable_t *ht, size_t numents) {...} */
+
+/*
+ *
+ *  static void *
+ *  ht_oa_locate_key(hashtable_t *ht, void *key)
+ *
+ *  Description:
+ *	ht_locate_key() for open addressing tables. Lookups share the table
+ *	lock for reading and take no other locks.
+ *
+ *  Paramaters:
+ *	See ht_locate_key().
+ *
+ *  Return value:
+ *	See ht_locate_key().
+ *
+ */
+static void *
+ht_oa_locate_key(hashtable_t *ht, void *key)
+{
+	/*
+	 * Locals...
+	 */
+	size_t	 i;		/* Slot holding the key.	*/
+	size_t	 capacity;	/* Slots in the table.		*/
+	void	*data;		/* Data to return.		*/
+	int	 depth;		/* Groups probed.		*/
+	uint_t	 weight;	/* Lookup sample weight.	*/
+	int	 ret;		/* Just a return value.		*/
+
+	weight = ht_sample(ht);
+	(void) ht_counter_add(ht, hts_probes, weight);
+
+	if (errno = rw_rdlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		return ((void *)NULL);
+
+	} /* if (errno = rw_rdlock(&ht->tablelock)) {...} */
+
+	i = ht_oa_find(ht,
+	    ht->oa,
+	    key,
+	    (*(ht->hash_full))(key, ht->keysize),
+	    &depth);
+
+	capacity = ht->oa->capacity;
+	data = (i < capacity ? ht->oa->slots[i].data : (void *)NULL);
+
+	if (ret = rw_unlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		errno = ret;
+		return ((void *)NULL);
+
+	} /* if (ret = rw_unlock(&ht->tablelock)) {...} */
+
+	(void) ht_average_add(ht, hta_searches, depth, weight);
+	if (i == capacity) {
+		errno = ENOENT;
+		return ((void *)NULL);
+
+	} /* if (i == capacity) {...} */
+
+	(void) ht_counter_add(ht, hts_hits, weight);
+	return (data);
+
+} /* void *ht_oa_locate_key(hashtable_t *ht, void *key) {...} */
+
+/*
+ *
+ *  static int
+ *  ht_oa_insert_key_(hashtable_t *ht, void *key, uint64_t hash, void *data)
+ *
+ *  Description:
+ *	ht_insert_key() for open addressing tables, with the table lock
+ *	already held for writing. The table is rebuilt before an insert
+ *	would leave it more than 7/8 occupied or deleted: at twice the size
+ *	if more than half the slots are in use, otherwise at the same size
+ *	to clear out deleted slots.
+ *
+ *  Paramaters:
+ *	uint64_t hash
+ *		Input - Full hash of the key.
+ *
+ *	Otherwise see ht_insert_key().
+ *
+ *  Return value:
+ *	See ht_insert_key().
+ *
+ */
+static int
+ht_oa_insert_key_(hashtable_t *ht, void *key, uint64_t hash, void *data)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_oa_t		*oa;		/* Slot buffer.		*/
+	hashtable_oa_slot_t	*slot;		/* Slot to fill.	*/
+	size_t			 i;		/* Slot number.		*/
+	int			 depth;		/* Groups probed.	*/
+	uint_t			 weight;	/* Sample weight.	*/
+
+	(void) ht_counter_add(ht, hts_inserts, 1);
+
+	weight = ht_sample(ht);
+	(void) ht_counter_add(ht, hts_probes, weight);
+	oa = ht->oa;
+
+	/*
+	 * Check for a duplicate if they're not allowed.
+	 */
+	if (! (ht->options & hto_dups_allowed)) {
+		i = ht_oa_find(ht, oa, key, hash, &depth);
+		(void) ht_average_add(ht, hta_searches, depth, weight);
+
+		if (i < oa->capacity) {
+			(void) ht_counter_add(ht, hts_hits, weight);
+			errno = EEXIST;
+			return (-1);
+
+		} /* if (i < oa->capacity) {...} */
+
+	} /* if (! (ht->options & hto_dups_allowed)) {...} */
+
+	/*
+	 * Make room if this one would fill the table past 7/8.
+	 */
+	if ((oa->used + oa->tombs + 1) * 8 > oa->capacity * 7) {
+		if (ht_oa_rehash(ht, (oa->used + 1) * 2 > oa->capacity ?
+		    oa->capacity * 2 :
+		    oa->capacity)) {
+
+			(void) ht_counter_add(ht, hts_errors, 1);
+			return (-1);
+
+		} /* if (ht_oa_rehash(ht, ...)) {...} */
+
+		(void) ht_counter_add(ht, hts_resizes, 1);
+		oa = ht->oa;
+
+	} /* if ((oa->used + oa->tombs + 1) * 8 > oa->capacity * 7) {...} */
+
+	/*
+	 * Fill the first free slot on the probe sequence.
+	 */
+	i = ht_oa_place(oa, hash, &depth);
+	if (oa->ctrl[i] == HT_OA_DELETED) {
+		--oa->tombs;
+
+	} /* if (oa->ctrl[i] == HT_OA_DELETED) {...} */
+
+	slot = &oa->slots[i];
+	if (ht->keysize <= HT_INLINE_KEY) {
+		(void) memcpy(slot->key.bytes, key, ht->keysize);
+
+	} else /* if (ht->keysize > HT_INLINE_KEY) */ {
+		slot->key.ptr = key;
+
+	} /* if (ht->keysize <= HT_INLINE_KEY) {...} else {...} */
+
+	slot->data	= data;
+	oa->ctrl[i]	= (unsigned char)(hash & 0x7F);
+	++oa->used;
+
+	(void) ht_average_increment(ht, hta_depth, depth);
+	return (0);
+
+} /* int ht_oa_insert_key_(hashtable_t *ht, void *key, ...) {...} */
+
+/*
+ *
+ *  static int
+ *  ht_oa_insert_key(hashtable_t *ht, void *key, uint64_t hash, void *data)
+ *
+ *  Description:
+ *	ht_insert_key() for open addressing tables: ht_oa_insert_key_()
+ *	under the table lock.
+ *
+ *  Paramaters:
+ *	See ht_oa_insert_key_().
+ *
+ *  Return value:
+ *	See ht_insert_key().
+ *
+ */
+static int
+ht_oa_insert_key(hashtable_t *ht, void *key, uint64_t hash, void *data)
+{
+	/*
+	 * Locals...
+	 */
+	int			 iret;		/* Insert return value.	*/
+	int			 ret;		/* Just a return value.	*/
+
+	if (errno = rw_wrlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		return (-2);
+
+	} /* if (errno = rw_wrlock(&ht->tablelock)) {...} */
+
+	iret = ht_oa_insert_key_(ht, key, hash, data);
+
+	if (ret = rw_unlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		errno = ret;
+		return (-2);
+
+	} /* if (ret = rw_unlock(&ht->tablelock)) {...} */
+
+	return (iret);
+
+} /* int ht_oa_insert_key(hashtable_t *ht, void *key, ...) {...} */
+
+/*
+ *
+ *  static void *
+ *  ht_oa_delete_key(hashtable_t *ht, void *key)
+ *
+ *  Description:
+ *	ht_delete_key() for open addressing tables. A slot whose group still
+ *	has an empty slot can't be part of anyone's probe sequence, so it is
+ *	made empty again; otherwise it is marked deleted.
+ *
+ *  Paramaters:
+ *	See ht_delete_key().
+ *
+ *  Return value:
+ *	See ht_delete_key().
+ *
+ */
+static void *
+ht_oa_delete_key(hashtable_t *ht, void *key)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_oa_t	*oa;		/* Slot buffer.			*/
+	uint64_t	 group;		/* Control bytes of the group.	*/
+	size_t		 i;		/* Slot holding the key.	*/
+	void		*data;		/* Data to return.		*/
+	int		 depth;		/* Groups probed.		*/
+	int		 ret;		/* Just a return value.		*/
+
+	(void) ht_counter_add(ht, hts_deletes, 1);
+
+	if (errno = rw_wrlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		return ((void *)NULL);
+
+	} /* if (errno = rw_wrlock(&ht->tablelock)) {...} */
+
+	oa	= ht->oa;
+	i	= ht_oa_find(ht,
+	    oa,
+	    key,
+	    (*(ht->hash_full))(key, ht->keysize),
+	    &depth);
+
+	if (i == oa->capacity) {
+		(void) rw_unlock(&ht->tablelock);
+		errno = ENOENT;
+		return ((void *)NULL);
+
+	} /* if (i == oa->capacity) {...} */
+
+	data	= oa->slots[i].data;
+	group	= ht_oa_load(&oa->ctrl[i & ~(size_t)(HT_OA_GROUP - 1)]);
+	if (group & ~(group << 6) & HT_OA_MSBS) {
+		oa->ctrl[i] = HT_OA_EMPTY;
+
+	} else /* if (! (group & ...)) */ {
+		oa->ctrl[i] = HT_OA_DELETED;
+		++oa->tombs;
+
+	} /* if (group & ~(group << 6) & HT_OA_MSBS) {...} else {...} */
+
+	--oa->used;
+
+	if (ret = rw_unlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		errno = ret;
+		return ((void *)NULL);
+
+	} /* if (ret = rw_unlock(&ht->tablelock)) {...} */
+
+	return (data);
+
+} /* void *ht_oa_delete_key(hashtable_t *ht, void *key) {...} */
+
+/*
+ *
+ *  static void *
+ *  ht_cc_lookup(hashtable_t *ht, void *key, uint64_t hash)
+ *
+ *  Description:
+ *	ht_locate_key() for concurrent tables, from inside an epoch the
+ *	caller has entered. No locks are taken and
+ *	nothing shared is written. Each group is read between a look at its
+ *	stripe's end count and a look at its begin count; if a writer
+ *	changed a slot of the stripe in between, the lookup starts over,
+ *	picking up a new buffer if the table was rebuilt. Inserts don't
+ *	trouble lookups: a slot's key and data are stored before its control
+ *	byte says it's occupied.
+ *
+ *  Paramaters:
+ *	See ht_locate_key().
+ *
+ *  Return value:
+ *	See ht_locate_key().
+ *
+ */
+static void *
+ht_cc_lookup(hashtable_t *ht, void *key, uint64_t hash)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_oa_stripe_t	*stripe;	/* Stripe of a group.	*/
+	hashtable_oa_t		*oa;		/* Slot buffer.		*/
+	uint64_t		 group;		/* Group control bytes.	*/
+	uint64_t		 match;		/* Candidate slots.	*/
+	uint32_t		 end;		/* Stripe end count.	*/
+	size_t			 gmask;		/* Group number mask.	*/
+	size_t			 g;		/* Group being probed.	*/
+	size_t			 i;		/* Slot being compared.	*/
+	size_t			 step;		/* Probe step.		*/
+	void			*data;		/* Data to return.	*/
+	int			 found;		/* Key matched?		*/
+
+retry:
+	oa	= ht->oa;
+	membar_consumer();
+
+	gmask	= oa->capacity / HT_OA_GROUP - 1;
+	g	= (size_t)(hash >> 7) & gmask;
+	for (step = 0; step <= gmask; g = (g + ++step) & gmask) {
+		stripe	= &oa->stripes[g & (HT_OA_STRIPES - 1)];
+		end	= stripe->end;
+		membar_consumer();
+
+		group	= ht_oa_load(&oa->ctrl[g * HT_OA_GROUP]);
+		found	= 0;
+		data	= NULL;
+		membar_consumer();
+
+		for (match = ht_oa_match(group, (unsigned int)hash & 0x7F);
+		    match != 0;
+		    match &= match - 1) {
+
+			i = g * HT_OA_GROUP + ht_oa_index(match & (0 - match));
+			if ((*(ht->key_compare))(ht_oa_key(ht, &oa->slots[i]),
+			    key,
+			    ht->keysize) == 0) {
+
+				data	= oa->slots[i].data;
+				found	= 1;
+				break;
+
+			} /* if ((*(ht->key_compare))(...) == 0) {...} */
+
+		} /* for (match = ht_oa_match(...); ...) {...} */
+
+		membar_consumer();
+		if (stripe->begin != end) {
+			goto retry;
+
+		} /* if (stripe->begin != end) {...} */
+
+		if (found) {
+			return (data);
+
+		} /* if (found) {...} */
+
+		if (group & ~(group << 6) & HT_OA_MSBS) {
+			break;
+
+		} /* if (group & ~(group << 6) & HT_OA_MSBS) {...} */
+
+	} /* for (step = 0; step <= gmask; ...) {...} */
+
+	errno = ENOENT;
+	return ((void *)NULL);
+
+} /* void *ht_cc_lookup(hashtable_t *ht, void *key, uint64_t hash) {...} */
+
+/*
+ *
+ *  static void *
+ *  ht_cc_locate_key(hashtable_t *ht, void *key)
+ *
+ *  Description:
+ *	ht_locate_key() for concurrent tables: ht_cc_lookup() inside an
+ *	epoch, so that nothing it looks at is freed under it.
+ *
+ *  Paramaters:
+ *	See ht_locate_key().
+ *
+ *  Return value:
+ *	See ht_locate_key().
+ *
+ */
+static void *
+ht_cc_locate_key(hashtable_t *ht, void *key)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_epoch_reader_t *reader;	/* Epoch record.	*/
+	void			*data;		/* Data to return.	*/
+
+	reader	= ht_epoch_enter();
+	data	= ht_cc_lookup(ht, key, (*(ht->hash_full))(key, ht->keysize));
+	ht_epoch_exit(reader);
+
+	return (data);
+
+} /* void *ht_cc_locate_key(hashtable_t *ht, void *key) {...} */
+
+/*
+ *
+ *  static int
+ *  ht_cc_insert_key(hashtable_t *ht, void *key, uint64_t hash, void *data)
+ *
+ *  Description:
+ *	ht_insert_key() for concurrent tables. Writers share the table lock
+ *	for reading, so only a rebuild shuts them out, and lock the stripe of
+ *	the key's home group. Writers of the same key thus take turns, and
+ *	the duplicate check can't be raced. Writers of different keys may
+ *	still reach for the same free slot, so a slot is claimed by swapping
+ *	its control byte to HT_OA_BUSY, filled, and then given its tag.
+ *
+ *  Paramaters:
+ *	uint64_t hash
+ *		Input - Full hash of the key.
+ *
+ *	Otherwise see ht_insert_key().
+ *
+ *  Return value:
+ *	See ht_insert_key().
+ *
+ */
+static int
+ht_cc_insert_key(hashtable_t *ht, void *key, uint64_t hash, void *data)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_oa_t		*oa;		/* Slot buffer.		*/
+	hashtable_oa_slot_t	*slot;		/* Slot to fill.	*/
+	mutex_t			*lock;		/* Home stripe lock.	*/
+	void			*copy;		/* Copy of a long key.	*/
+	unsigned char		 ctrl;		/* Free slot's control.	*/
+	size_t			 i;		/* Slot number.		*/
+	int			 depth;		/* Groups probed.	*/
+	uint_t			 weight;	/* Sample weight.	*/
+	int			 ret;		/* Just a return value.	*/
+
+	(void) ht_counter_add(ht, hts_inserts, 1);
+
+	/*
+	 * Long keys are copied, so lookups never chase a pointer the caller
+	 * might free.
+	 */
+	copy = NULL;
+	if (ht->keysize > HT_INLINE_KEY) {
+		if ((copy = malloc(ht->keysize)) == NULL) {
+			(void) ht_counter_add(ht, hts_errors, 1);
+			return (-1);
+
+		} /* if ((copy = malloc(ht->keysize)) == NULL) {...} */
+
+		(void) memcpy(copy, key, ht->keysize);
+
+	} /* if (ht->keysize > HT_INLINE_KEY) {...} */
+
+	for (;;) {
+		if (errno = rw_rdlock(&ht->tablelock)) {
+			(void) ht_counter_add(ht, hts_errors, 1);
+			(void) free(copy);
+			return (-2);
+
+		} /* if (errno = rw_rdlock(&ht->tablelock)) {...} */
+
+		oa	= ht->oa;
+		lock	= &ht->stripelock[(hash >> 7) &
+		    (oa->capacity / HT_OA_GROUP - 1) & (HT_OA_STRIPES - 1)];
+		(void) mutex_lock(lock);
+
+		if ((oa->used + oa->tombs + 1) * 8 <= oa->capacity * 7) {
+			break;
+
+		} /* if ((oa->used + oa->tombs + 1) * 8 <= ...) {...} */
+
+		/*
+		 * Full. Let go, and rebuild it with the table to myself,
+		 * unless someone else beat me to it.
+		 */
+		(void) mutex_unlock(lock);
+		(void) rw_unlock(&ht->tablelock);
+
+		if (errno = rw_wrlock(&ht->tablelock)) {
+			(void) ht_counter_add(ht, hts_errors, 1);
+			(void) free(copy);
+			return (-2);
+
+		} /* if (errno = rw_wrlock(&ht->tablelock)) {...} */
+
+		oa = ht->oa;
+		if ((oa->used + oa->tombs + 1) * 8 > oa->capacity * 7) {
+			if (ht_oa_rehash(ht, (oa->used + 1) * 2 > oa->capacity ?
+			    oa->capacity * 2 :
+			    oa->capacity)) {
+
+				(void) ht_counter_add(ht, hts_errors, 1);
+				(void) rw_unlock(&ht->tablelock);
+				(void) free(copy);
+				return (-1);
+
+			} /* if (ht_oa_rehash(ht, ...)) {...} */
+
+			(void) ht_counter_add(ht, hts_resizes, 1);
+
+		} /* if ((oa->used + oa->tombs + 1) * 8 > ...) {...} */
+
+		(void) rw_unlock(&ht->tablelock);
+
+	} /* for (;;) {...} */
+
+	weight = ht_sample(ht);
+	(void) ht_counter_add(ht, hts_probes, weight);
+
+	/*
+	 * Check for a duplicate if they're not allowed.
+	 */
+	if (! (ht->options & hto_dups_allowed)) {
+		i = ht_oa_find(ht, oa, key, hash, &depth);
+		(void) ht_average_add(ht, hta_searches, depth, weight);
+
+		if (i < oa->capacity) {
+			(void) ht_counter_add(ht, hts_hits, weight);
+			(void) mutex_unlock(lock);
+			(void) rw_unlock(&ht->tablelock);
+			(void) free(copy);
+			errno = EEXIST;
+			return (-1);
+
+		} /* if (i < oa->capacity) {...} */
+
+	} /* if (! (ht->options & hto_dups_allowed)) {...} */
+
+	/*
+	 * Claim a free slot.
+	 */
+	do {
+		i	= ht_oa_place(oa, hash, &depth);
+		ctrl	= oa->ctrl[i];
+
+	} while ((ctrl != HT_OA_EMPTY && ctrl != HT_OA_DELETED) ||
+	    atomic_cas_8(&oa->ctrl[i], ctrl, HT_OA_BUSY) != ctrl);
+
+	slot = &oa->slots[i];
+	if (copy == NULL) {
+		(void) memcpy(slot->key.bytes, key, ht->keysize);
+
+	} else /* if (copy != NULL) */ {
+		slot->key.ptr = copy;
+
+	} /* if (copy == NULL) {...} else {...} */
+
+	slot->data = data;
+	membar_producer();
+	oa->ctrl[i] = (unsigned char)(hash & 0x7F);
+
+	atomic_inc_ulong(&oa->used);
+	if (ctrl == HT_OA_DELETED) {
+		atomic_dec_ulong(&oa->tombs);
+
+	} /* if (ctrl == HT_OA_DELETED) {...} */
+
+	(void) ht_average_increment(ht, hta_depth, depth);
+
+	(void) mutex_unlock(lock);
+	if (ret = rw_unlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		errno = ret;
+		return (-2);
+
+	} /* if (ret = rw_unlock(&ht->tablelock)) {...} */
+
+	return (0);
+
+} /* int ht_cc_insert_key(hashtable_t *ht, void *key, ...) {...} */
+
+/*
+ *
+ *  static void *
+ *  ht_cc_delete_key(hashtable_t *ht, void *key)
+ *
+ *  Description:
+ *	ht_delete_key() for concurrent tables. Locking is as for inserts.
+ *	The slot is always marked deleted, since other writers may be
+ *	claiming empty slots in the same group, and the change is bracketed
+ *	by the stripe counts so that lookups looking at it retry. A copied
+ *	key is retired.
+ *
+ *  Paramaters:
+ *	See ht_delete_key().
+ *
+ *  Return value:
+ *	See ht_delete_key().
+ *
+ */
+static void *
+ht_cc_delete_key(hashtable_t *ht, void *key)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_oa_t		*oa;		/* Slot buffer.		*/
+	hashtable_oa_stripe_t	*stripe;	/* Slot's stripe.	*/
+	mutex_t			*lock;		/* Home stripe lock.	*/
+	uint64_t		 hash;		/* Hash of the key.	*/
+	size_t			 i;		/* Slot holding the key. */
+	void			*data;		/* Data to return.	*/
+	void			*copy;		/* Copy of a long key.	*/
+	int			 depth;		/* Groups probed.	*/
+	int			 ret;		/* Just a return value.	*/
+
+	(void) ht_counter_add(ht, hts_deletes, 1);
+	hash = (*(ht->hash_full))(key, ht->keysize);
+
+	if (errno = rw_rdlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		return ((void *)NULL);
+
+	} /* if (errno = rw_rdlock(&ht->tablelock)) {...} */
+
+	oa	= ht->oa;
+	lock	= &ht->stripelock[(hash >> 7) &
+	    (oa->capacity / HT_OA_GROUP - 1) & (HT_OA_STRIPES - 1)];
+	(void) mutex_lock(lock);
+
+	if ((i = ht_oa_find(ht, oa, key, hash, &depth)) == oa->capacity) {
+		(void) mutex_unlock(lock);
+		(void) rw_unlock(&ht->tablelock);
+		errno = ENOENT;
+		return ((void *)NULL);
+
+	} /* if ((i = ht_oa_find(...)) == oa->capacity) {...} */
+
+	stripe	= &oa->stripes[(i / HT_OA_GROUP) & (HT_OA_STRIPES - 1)];
+	data	= oa->slots[i].data;
+	copy	= (ht->keysize > HT_INLINE_KEY ? oa->slots[i].key.ptr : NULL);
+
+	atomic_inc_32(&stripe->begin);
+	membar_producer();
+	oa->ctrl[i] = HT_OA_DELETED;
+	membar_producer();
+	atomic_inc_32(&stripe->end);
+
+	atomic_dec_ulong(&oa->used);
+	atomic_inc_ulong(&oa->tombs);
+
+	(void) mutex_unlock(lock);
+	if (ret = rw_unlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		errno = ret;
+		return ((void *)NULL);
+
+	} /* if (ret = rw_unlock(&ht->tablelock)) {...} */
+
+	if (copy != NULL) {
+		ht_epoch_retire(copy);
+
+	} /* if (copy != NULL) {...} */
+
+	return (data);
+
+} /* void *ht_cc_delete_key(hashtable_t *ht, void *key) {...} */
+
+/*
+ *
+ *  static void *
+ *  ht_map_key(hashtable_t *ht, const hashtable_file_slot_t *slot)
+ *
+ *  Description:
+ *	Find the key of an occupied slot of a mapped table.
+ *
+ *  Paramaters:
+ *	hashtable_t *ht
+ *		Input - Pointer to the table head.
+ *
+ *	const hashtable_file_slot_t *slot
+ *		Input - Pointer to the slot.
+ *
+ *  Return value:
+ *	void *	The key in the slot for small keys, otherwise the key's place
+ *		in the file.
+ *
+ */
+static void *
+ht_map_key(hashtable_t *ht, const hashtable_file_slot_t *slot)
+{
+	return (ht->keysize <= HT_INLINE_KEY ?
+	    (void *)slot->key.bytes :
+	    (void *)(ht->map->base + slot->key.offset));
+
+} /* void *ht_map_key(hashtable_t *ht, ...) {...} */
+
+/*
+ *
+ *  static void *
+ *  ht_map_data(hashtable_t *ht, const hashtable_file_slot_t *slot)
+ *
+ *  Description:
+ *	Find the data of an occupied slot of a mapped table.
+ *
+ *  Paramaters:
+ *	See ht_map_key().
+ *
+ *  Return value:
+ *	void *	The data's place in the file, or NULL if NULL was saved.
+ *
+ */
+static void *
+ht_map_data(hashtable_t *ht, const hashtable_file_slot_t *slot)
+{
+	return (slot->data == 0 ?
+	    (void *)NULL :
+	    (void *)(ht->map->base + slot->data));
+
+} /* void *ht_map_data(hashtable_t *ht, ...) {...} */
+
+/*
+ *
+ *  static size_t
+ *  ht_map_find(hashtable_t *ht, void *key, uint64_t hash, int *depth)
+ *
+ *  Description:
+ *	ht_oa_find() for a mapped table. Nothing changes a mapped table, so
+ *	no lock is needed.
+ *
+ *  Paramaters:
+ *	hashtable_t *ht
+ *		Input - Pointer to the table head.
+ *
+ *	void *key
+ *		Input - Pointer to the bytes of the key to find.
+ *
+ *	uint64_t hash
+ *		Input - Full hash of the key.
+ *
+ *	int *depth
+ *		Output - Number of groups probed past the first.
+ *
+ *  Return value:
+ *	size_t	The slot holding the key, or the table capacity if it isn't
+ *		there.
+ *
+ */
+static size_t
+ht_map_find(hashtable_t *ht, void *key, uint64_t hash, int *depth)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_map_t	*map = ht->map;	/* The mapped file.	*/
+	size_t		 gmask;		/* Group number mask.	*/
+	size_t		 g;		/* Group being probed.	*/
+	size_t		 i;		/* Slot being compared.	*/
+	size_t		 step;		/* Probe step.		*/
+	uint64_t	 group;		/* Group control bytes.	*/
+	uint64_t	 match;		/* Candidate slots.	*/
+
+	gmask	= map->capacity / HT_OA_GROUP - 1;
+	g	= (size_t)(hash >> 7) & gmask;
+	for (step = 0; step <= gmask; g = (g + ++step) & gmask) {
+		group = ht_oa_load(&map->ctrl[g * HT_OA_GROUP]);
+
+		for (match = ht_oa_match(group, (unsigned int)hash & 0x7F);
+		    match != 0;
+		    match &= match - 1) {
+
+			i = g * HT_OA_GROUP + ht_oa_index(match & (0 - match));
+			if ((*(ht->key_compare))(ht_map_key(ht, &map->slots[i]),
+			    key,
+			    ht->keysize) == 0) {
+
+				*depth = (int)step;
+				return (i);
+
+			} /* if ((*(ht->key_compare))(...) == 0) {...} */
+
+		} /* for (match = ht_oa_match(...); ...) {...} */
+
+		if (group & ~(group << 6) & HT_OA_MSBS) {
+			break;
+
+		} /* if (group & ~(group << 6) & HT_OA_MSBS) {...} */
+
+	} /* for (step = 0; step <= gmask; ...) {...} */
+
+	*depth = (int)step;
+	return (map->capacity);
+
+} /* size_t ht_map_find(hashtable_t *ht, ...) {...} */
+
+/*
+ *
+ *  static void *
+ *  ht_map_locate_key(hashtable_t *ht, void *key)
+ *
+ *  Description:
+ *	ht_locate_key() for a mapped table.
+ *
+ *  Paramaters:
+ *	hashtable_t *ht
+ *		Input - Pointer to the table head.
+ *
+ *	void *key
+ *		Input - Pointer to the bytes of the key to locate.
+ *
+ *  Return value:
+ *	See ht_locate_key().
+ *
+ */
+static void *
+ht_map_locate_key(hashtable_t *ht, void *key)
+{
+	/*
+	 * Locals...
+	 */
+	size_t	 i;		/* Slot holding the key.	*/
+	int	 depth;		/* Groups probed.		*/
+	uint_t	 weight;	/* Lookup sample weight.	*/
+
+	weight = ht_sample(ht);
+	(void) ht_counter_add(ht, hts_probes, weight);
+
+	i = ht_map_find(ht, key, (*(ht->hash_full))(key, ht->keysize), &depth);
+	(void) ht_average_add(ht, hta_searches, depth, weight);
+
+	if (i == ht->map->capacity) {
+		errno = ENOENT;
+		return ((void *)NULL);
+
+	} /* if (i == ht->map->capacity) {...} */
+
+	(void) ht_counter_add(ht, hts_hits, weight);
+	return (ht_map_data(ht, &ht->map->slots[i]));
+
+} /* void *ht_map_locate_key(hashtable_t *ht, void *key) {...} */
+
+/*
+ *
+ *  static size_t
+ *  ht_snapshot_walk(hashtable_t *ht, ht_snapshot_t *snap)
+ *
+ *  Description:
+ *	Visit every entry of a table, copying each into the snapshot if
+ *	there is one, or just counting them if not. A chained table being
+ *	resized has entries in the chains of the draining table that haven't
+ *	moved yet as well as in the new table. The caller must keep the
+ *	table from changing until the walk is done.
+ *
+ *  Paramaters:
+ *	hashtable_t *ht
+ *		Input - Pointer to the table head.
+ *
+ *	ht_snapshot_t *snap
+ *		Output - The snapshot to fill in, with room for every entry,
+ *		or NULL.
+ *
+ *  Return value:
+ *	size_t	The number of entries in the table.
+ *
+ */
+static size_t
+ht_snapshot_walk(hashtable_t *ht, ht_snapshot_t *snap)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_slab_t	*slab[2];	/* Draining, then new.	*/
+	hashtable_entry_t	*hte;		/* Entry on a chain.	*/
+	const unsigned char	*ctrl;		/* Control bytes.	*/
+	size_t			 capacity;	/* Slots or buckets.	*/
+	size_t			 count = 0;	/* Entries found.	*/
+	size_t			 i;		/* Slot or bucket.	*/
+	int			 s;		/* Slab number.		*/
+	void			*key;		/* Entry's key.		*/
+	void			*data;		/* Entry's data.	*/
+
+	/*
+	 * Open addressing tables, mapped or not: every slot whose control
+	 * byte has the high bit clear.
+	 */
+	if (ht->options & hto_open_addressing) {
+		ctrl	 = (ht->options & hto_mapped ?
+		    ht->map->ctrl :
+		    ht->oa->ctrl);
+		capacity = (ht->options & hto_mapped ?
+		    ht->map->capacity :
+		    ht->oa->capacity);
+
+		for (i = 0; i < capacity; ++i) {
+			if (ctrl[i] & 0x80) {
+				continue;
+
+			} /* if (ctrl[i] & 0x80) {...} */
+
+			if (snap != (ht_snapshot_t *)NULL) {
+				if (ht->options & hto_mapped) {
+					key	= ht_map_key(ht,
+					    &ht->map->slots[i]);
+					data	= ht_map_data(ht,
+					    &ht->map->slots[i]);
+
+				} else /* if (! (... & hto_mapped)) */ {
+					key	= ht_oa_key(ht,
+					    &ht->oa->slots[i]);
+					data	= ht->oa->slots[i].data;
+
+				} /* if (... & hto_mapped) {...} else {...} */
+
+				(void) memcpy(&snap->keys[count * ht->keysize],
+				    key,
+				    ht->keysize);
+				snap->data[count] = data;
+
+			} /* if (snap != (ht_snapshot_t *)NULL) {...} */
+
+			++count;
+
+		} /* for (i = 0; i < capacity; ++i) {...} */
+
+		return (count);
+
+	} /* if (ht->options & hto_open_addressing) {...} */
+
+	slab[0]	= ht->draining;
+	slab[1]	= ht->table;
+	for (s = 0; s < 2; ++s) {
+		if (slab[s] == (hashtable_slab_t *)NULL) {
+			continue;
+
+		} /* if (slab[s] == (hashtable_slab_t *)NULL) {...} */
+
+		for (i = 0; i < slab[s]->header.entrycount; ++i) {
+			hte = &slab[s]->header.entry[i];
+			if (! (hte->flags & htef_occupied) ||
+			    (hte->flags & htef_migrated)) {
+				continue;
+
+			} /* if (! (hte->flags & htef_occupied) || ...) {...} */
+
+			for (; hte != (hashtable_entry_t *)NULL;
+			    hte = hte->next) {
+
+				if (snap != (ht_snapshot_t *)NULL) {
+					(void) memcpy(&snap->keys[count *
+					    ht->keysize],
+					    hte->key,
+					    ht->keysize);
+					snap->data[count] = hte->data;
+
+				} /* if (snap != NULL) {...} */
+
+				++count;
+
+			} /* for (; hte != NULL; hte = hte->next) {...} */
+
+		} /* for (i = 0; i < ...entrycount; ++i) {...} */
+
+	} /* for (s = 0; s < 2; ++s) {...} */
+
+	return (count);
+
+} /* size_t ht_snapshot_walk(hashtable_t *ht, ht_snapshot_t *snap) {...} */
+
+/*
+ *
+ *  static void
+ *  ht_oa_destroy(hashtable_t *ht)
+ *
+ *  Description:
+ *	Free the slot buffer of an open addressing table, along with the
+ *	copied keys and stripe locks of a concurrent one. The buffer itself
+ *	is retired rather than freed if the table is concurrent, in case a
+ *	lookup is still finishing up in it.
+ *
+ *  Paramaters:
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the table head.
+ *
+ *  Return value:
+ *	None.
+ *
+ */
+static void
+ht_oa_destroy(hashtable_t *ht)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_oa_t	*oa = ht->oa;	/* Buffer being freed.	*/
+	size_t		 n;		/* Slot number.		*/
+
+	ht->oa = (hashtable_oa_t *)NULL;
+	if (! (ht->options & hto_concurrent)) {
+		(void) free(oa);
+		return;
+
+	} /* if (! (ht->options & hto_concurrent)) {...} */
+
+	for (n = 0; ht->keysize > HT_INLINE_KEY && n < oa->capacity; ++n) {
+		if (! (oa->ctrl[n] & 0x80)) {
+			(void) free(oa->slots[n].key.ptr);
+
+		} /* if (! (oa->ctrl[n] & 0x80)) {...} */
+
+	} /* for (n = 0; ht->keysize > HT_INLINE_KEY && ...; ++n) {...} */
+
+	for (n = 0; n < HT_OA_STRIPES; ++n) {
+		(void) mutex_destroy(&ht->stripelock[n]);
+
+	} /* for (n = 0; n < HT_OA_STRIPES; ++n) {...} */
+
+	(void) free(ht->stripelock);
+	ht->stripelock = (mutex_t *)NULL;
+	ht_epoch_retire(oa);
+
+} /* void ht_oa_destroy(hashtable_t *ht) {...} */
+
+/*
+ *
+ *  hashtable_t *
+ *  ht_create(size_t numents, size_t keysize, unsigned int options);
+ *
+ *  Description:
+ *	Allocate sufficient memory for a hash table with numents entries.
+ *
+ *  Paramaters:
+ *	size_t numents
+ *		Input - Specifies the number of entries expected in the table
+ *		when it's full. Room will be allocated for this many entries
+ *		during table creation, rounded up to a power of two unless
+ *		hto_hash_legacy is given.
+ *
+ *	int keysize
+ *		Input - Specifies the number of bytes in the key for table
+ *		entries.
+ *
+ *	unsigned int options
+ *		Input - Options for table mainteance. See the definition for
+ *		ht_option_t in hashtable.h for details.
+ *
+ *  Return value:
+ *	hashtable_t * If a table head and entries were successfully allocated,
+ *		then the address of the table head is returned. If any failures
+ *		occur, then NULL will be returned.
+ *
+ */
+void *
+ht_create(size_t numents, size_t keysize, ht_option_t options)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_t	*ht;	/* Hash table being created.		*/
+	int		 i;	/* Stripe lock number.			*/
+
+	/*
+	 * Don't get bamboozled by a zero entry table.
+	 */
+	if (! numents > 0) {
+		errno = EINVAL;
+		return ((hashtable_slab_t *)NULL);
+
+	} /* if (! numents > 0) {...} */
+
+	/*
+	 * Only ht_map() makes mapped tables.
+	 */
+	options &= ~hto_mapped;
+
+	/*
+	 * Only open addressing tables can be read concurrently.
+	 */
+	if (options & hto_concurrent) {
+		options |= hto_open_addressing;
+
+	} /* if (options & hto_concurrent) {...} */
+
+	/*
+	 * Everything but the legacy hash reduces with a mask, so the table
+	 * gets rounded up to a power of two.
+	 */
+	if ((options & hto_hash_wide) || ! (options & hto_hash_legacy)) {
+		if ((numents = ht_size_pow2(numents)) == 0) {
+			errno = EINVAL;
+			return ((void *)NULL);
+
+		} /* if ((numents = ht_size_pow2(numents)) == 0) {...} */
+
+	} /* if ((options & hto_hash_wide) || ...) {...} */
+
+	/*
+	 *  Allocate the table head, save the options and keysize.
+	 */
+	ht = (hashtable_t *)malloc(sizeof (*ht));
 	if (ht == (hashtable_t *)NULL) {
 		return ((void *)ht);
 
 	} /* if ((void *)ht == (void *)NULL) {...} */
 	ht->keysize		= keysize;
 	ht->options		= options;
-	ht->threshold_evaluate	= ht_evaluate_threshold_default;
-	ht->hash_compute	= ht_hash_bytes;
+	ht->threshold_evaluate	= ht_evaluate_threshold_adaptive;
+	ht->minents		= numents;
+	ht->entries		=
+	    ht->updates		= 0;
+	ht->window.probes	=
+	    ht->window.hits	=
+	    ht->window.searchcount =
+	    ht->window.searchsum = 0;
+	ht->window.updates	= 0;
 	ht->key_compare		= bcmp;
 	ht->freechain		= (hashtable_entry_t *)NULL;
+	ht->freecount		= 0;
+
+	/*
+	 * Pick the hash for this table.
+	 */
+	if (options & hto_hash_wide) {
+		ht->hash_compute = ht_hash_wide;
+
+	} else if (options & hto_hash_legacy) {
+		ht->hash_compute = ht_hash_bytes;
+
+	} else /* if (! (options & (hto_hash_wide | ...))) */ {
+		ht->hash_compute = ht_hash_mix;
+
+	} /* if (options & hto_hash_wide) {...} else ... {...} */
+
+	ht->hash_full	= (options & hto_hash_wide ?
+	    ht_hash_wide_full :
+	    ht_hash_mix_full);
+
+	ht->oa			= (hashtable_oa_t *)NULL;
+	ht->map			= (hashtable_map_t *)NULL;
+	ht->stripelock		= (mutex_t *)NULL;
+	ht->draining		= (hashtable_slab_t *)NULL;
+	ht->drain_next		=
+	    ht->drain_left	= 0;
 
 	/*
 	 * Start the stats collection...
 	 */
-	if (ht_average_init(&ht->stats.depth)	  ||
-	    ht_average_init(&ht->stats.freechain) ||
-	    ht_average_init(&ht->stats.searches)) {
+	if (ht_stats_init(ht)) {
+		(void) free(ht);
+		return ((void *)NULL);
+
+	} /* if (ht_stats_init(ht)) {...} */
+
+	/*
+	 * Initialize the locks for the table and the free chain.
+	 */
+	if (rwlock_init(&ht->tablelock, USYNC_THREAD, NULL)) {
+		(void) free(ht->stats);
+		(void) free(ht);
+		return ((void *)NULL);
+
+	} /* if (rwlock_init(&ht->tablelock, USYNC_THREAD, NULL)) {...} */
+
+	if (rwlock_init(&ht->freelock, USYNC_THREAD, NULL)) {
+		(void) free(ht->stats);
+		(void) free(ht);
+		return ((void *)NULL);
+
+	} /* if (rwlock_init(&ht->freelock, USYNC_THREAD, NULL)) {...} */
+
+	if (mutex_init(&ht->resizemutex, USYNC_THREAD, NULL)) {
+		(void) free(ht->stats);
+		(void) free(ht);
+		return ((void *)NULL);
+
+	} /* if (mutex_init(&...resizemutex, USYNC_THREAD, NULL)) {...} */
+
+	/*
+	 * Open addressing tables have no slabs, just the one buffer.
+	 */
+	if (options & hto_open_addressing) {
+		ht->slabs =
+		    ht->table = (hashtable_slab_t *)NULL;
+
+		/*
+		 * Concurrent writers lock a stripe of the table.
+		 */
+		if (options & hto_concurrent) {
+			ht->stripelock = (mutex_t *)malloc(HT_OA_STRIPES *
+			    sizeof (*ht->stripelock));
+
+			if (ht->stripelock == (mutex_t *)NULL) {
+				(void) free(ht->stats);
+				(void) free(ht);
+				return ((void *)NULL);
+
+			} /* if (ht->stripelock == (mutex_t *)NULL) {...} */
+
+			for (i = 0; i < HT_OA_STRIPES; ++i) {
+				(void) mutex_init(&ht->stripelock[i],
+				    USYNC_THREAD,
+				    NULL);
+
+			} /* for (i = 0; i < HT_OA_STRIPES; ++i) {...} */
+
+		} /* if (options & hto_concurrent) {...} */
+
+		if (ht_oa_rehash(ht, numents)) {
+			(void) free(ht->stripelock);
+			(void) free(ht->stats);
+			(void) free(ht);
+			return ((void *)NULL);
+
+		} /* if (ht_oa_rehash(ht, numents)) {...} */
+
+		ht->minents = ht->oa->capacity;
+
+		return ((void *)ht);
+
+	} /* if (options & hto_open_addressing) {...} */
+
+	/*
+	 * Allocate a slab with enough room for numents entries. The first
+	 * slab is also the table (until a resize).
+	 */
+	ht->slabs = ht_create_slab(numents);
+	ht->table = ht->slabs;
+
+	if (ht->table != (hashtable_slab_t *)NULL) {
+		(void) ht_counter_add(ht, hts_slabs, 1);
+
+	} else /* if (ht->table == (hashtable_slab_t *)NULL) */ {
+		(void) free(ht->stats);
 		(void) free(ht);
 		return ((void *)NULL);
 
-	} /* if (ht_average_init(&ht->depth) || ...) {...} */
+	} /* if (ht->table != (hashtable_entry_t *)NULL) {...} else {...} */
+
+	/*
+	 * Guess it all worked.
+	 */
+	return ((void *)ht);
+
+} /* hashtable_t *ht_create(int numents, unsigned int options) {...} */
+
+/*
+ * static int
+ * ht_free_get(hashtable_t *ht, hashtable_entry_t **hte);
+ *
+ * Description:
+ *	Take an entry off the free chain, first hanging another slab of
+ *	entries on the chain if it's empty.
+ *
+ * Parameters:
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the hash table head.
+ *
+ *	hashtable_entry_t **hte
+ *		Output - Pointer to a place to store the address of the entry.
+ *		Its next pointer will be NULL.
+ *
+ * Return value:
+ *	int	Zero if an entry was taken. If no more entries could be
+ *		allocated, -1 is returned. If the free chain lock couldn't be
+ *		taken, -2 is returned and errno is set.
+ *
+ */
+static int
+ht_free_get(hashtable_t *ht, hashtable_entry_t **hte)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_entry_t	*ohte;	/* Entry taken.			*/
+	hashtable_slab_t	*slab;	/* For new free chain allocation. */
+	int			 ret;	/* Just a return value.		*/
+
+	/*
+	 * Take the free chain lock.
+	 */
+	if (ret = rw_wrlock(&ht->freelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		errno = (errno ? errno : ret);
+		return (-2);
+
+	} /* if (rw_wrlock(&ht->freelock)) {...} */
+
+	/*
+	 * If there's nothing to take from the free chain. Make some more.
+	 */
+	while ((ohte = ht->freechain) == (hashtable_entry_t *)NULL) {
+		/*
+		 * Allocate a slab the same size as the table itself, within
+		 * reason.
+		 */
+		slab = ht_create_slab(
+		    ht->table->header.entrycount < HT_FREE_SLAB_MAX ?
+		    ht->table->header.entrycount :
+		    HT_FREE_SLAB_MAX);
+		if (slab == (hashtable_slab_t *)NULL) {
+
+			/*
+			 * Couldn't create any more free entries.
+			 */
+			(void) rw_unlock(&ht->freelock);
+			(void) ht_counter_add(ht, hts_errors, 1);
+			return (-1);
+
+		} /* if (slab == (hashtable_slab_t *)NULL) {...} */
+
+		/*
+		 * Put the slab on the list of slabs.
+		 */
+		(void) ht_counter_add(ht, hts_slabs, 1);
+		slab->header.next	= ht->slabs;
+		ht->slabs		= slab;
+
+		/*
+		 * Dangle all the entries from the free chain.
+		 */
+		ohte = &slab->header.entry[slab->header.entrycount];
+		while (ohte-- != slab->header.entry) {
+			ohte->next	= ht->freechain;
+			ht->freechain	= ohte;
+
+		} /* while (--ohte != &slab->header.entry [...]) {...} */
 
-	if (ht_counter_init(&ht->stats.deletes)	  ||
-	    ht_counter_init(&ht->stats.errors)	  ||
-	    ht_counter_init(&ht->stats.hits)	  ||
-	    ht_counter_init(&ht->stats.inserts)	  ||
-	    ht_counter_init(&ht->stats.probes)	  ||
-	    ht_counter_init(&ht->stats.resizes)	  ||
-	    ht_counter_init(&ht->stats.slabs)) {
-		(void) free(ht);
-		return ((void *)NULL);
+		/*
+		 * Update the free chain stats.
+		 */
+		ht->freecount += slab->header.entrycount;
+		(void) ht_average_update(ht, hta_freechain,
+		    1,	/* Added them all at once. */
+		    slab->header.entrycount,
+		    ht->freecount);
 
-	} /* if (ht_counter_init(&ht->deletes) || ...) {...} */
+	} /* while ((ohte = ht->freechain) == (... *)NULL) {...} */
 
 	/*
-	 * Initialize the locks for the table and the free chain.
+	 * Take ohte off the free chain.
 	 */
-	if (rwlock_init(&ht->tablelock, USYNC_THREAD, NULL)) {
-		(void) free(ht);
-		return ((void *)NULL);
-
-	} /* if (rwlock_init(&ht->tablelock, USYNC_THREAD, NULL)) {...} */
+	ht->freechain	= ohte->next;
+	ohte->next	= (hashtable_entry_t *)NULL;
+	(void) ht_average_increment(ht, hta_freechain, --ht->freecount);
 
-	if (rwlock_init(&ht->freelock, USYNC_THREAD, NULL)) {
-		(void) free(ht);
-		return ((void *)NULL);
+	/*
+	 * Put the free chain lock back.
+	 */
+	if (ret = rw_unlock(&ht->freelock)) {
+		/*
+		 * What should I do here? Returning would orphan the entry.
+		 * Just muddle forward.
+		 */
+		(void) ht_counter_add(ht, hts_errors, 1);
+		errno = (errno ? errno : ret);
 
-	} /* if (rwlock_init(&ht->freelock, USYNC_THREAD, NULL)) {...} */
+	} /* if (rw_unlock(&ht->freelock)) {...} */
 
-	if (mutex_init(&ht->resizemutex, USYNC_THREAD, NULL)) {
-		(void) free(ht);
-		return ((void *)NULL);
+	*hte = ohte;
+	return (0);
 
-	} /* if (mutex_init(&...resizemutex, USYNC_THREAD, NULL)) {...} */
+} /* int ht_free_get(hashtable_t *ht, hashtable_entry_t **hte) {...} */
 
+/*
+ * static hashtable_entry_t *
+ * ht_bucket(hashtable_t *ht, void *key);
+ *
+ * Description:
+ *	Find the table entry heading the chain for a key. While the table is
+ *	being resized, that's in the draining table until the chain has been
+ *	moved, and in the new table after. The caller must hold the table
+ *	lock.
+ *
+ * Parameters:
+ *	hashtable_t *ht
+ *		Input - Pointer to the hash table head.
+ *
+ *	void *key
+ *		Input - Pointer to the bytes of the key.
+ *
+ * Return value:
+ *	hashtable_entry_t * The entry heading the key's chain. It isn't
+ *		locked.
+ *
+ */
+static hashtable_entry_t *
+ht_bucket(hashtable_t *ht, void *key)
+{
 	/*
-	 * Allocate a slab with enough room for numents entries. The first
-	 * slab is also the table (until a resize).
+	 * Locals...
 	 */
-	ht->slabs = ht_create_slab(numents);
-	ht->table = ht->slabs;
+	hashtable_entry_t	*hte;	/* Head of the key's old chain.	*/
 
-	if (ht->table != (hashtable_slab_t *)NULL) {
-		(void) ht_counter_add(&ht->stats.slabs, 1);
+	if (ht->draining != (hashtable_slab_t *)NULL) {
+		hte = &ht->draining->header.entry[(*(ht->hash_compute))(key,
+		    ht->keysize,
+		    ht->draining->header.entrycount)];
 
-	} else /* if (ht->table == (hashtable_slab_t *)NULL) */ {
-		(void) free(ht);
-		return ((void *)NULL);
+		if (! (hte->flags & htef_migrated)) {
+			return (hte);
 
-	} /* if (ht->table != (hashtable_entry_t *)NULL) {...} else {...} */
+		} /* if (! (hte->flags & htef_migrated)) {...} */
 
-	/*
-	 * Guess it all worked.
-	 */
-	return ((void *)ht);
+	} /* if (ht->draining != (hashtable_slab_t *)NULL) {...} */
 
-} /* hashtable_t *ht_create(int numents, unsigned int options) {...} */
+	return (&ht->table->header.entry[(*(ht->hash_compute))(key,
+	    ht->keysize,
+	    ht->table->header.entrycount)]);
+
+} /* hashtable_entry_t *ht_bucket(hashtable_t *ht, void *key) {...} */
 
 /*
  * static int
- * ht_sweep(hashtable_t *ht);
+ * ht_migrate_chain(hashtable_t *ht, hashtable_entry_t *hte);
  *
  * Description:
- *	Sweep a hash table of all references. This only guarantees that no one
- *	was holding any locks for a period. ht->table must be made unavailable
- *	to others before calling ht_sweep(). Otherwise someone else may follow
- *	the broom through the table and no guarantees can be made that the
- *	table is free of leaseholders.
+ *	Move the chain headed by an entry of the draining table to the new
+ *	table. The caller must hold the table lock for writing, so that no
+ *	one else can start down the chain. Anyone already on it is waited
+ *	out by write locking each entry in turn, the same way a probe walks
+ *	it.
+ *
+ *	Entries on the chain are relinked onto the chains of the new table
+ *	rather than copied, so at most one free entry is needed: for the key
+ *	held by the head itself. That one is taken before anything moves,
+ *	so a failure leaves the chain where it was.
  *
  * Parameters:
  *	hashtable_t *ht
- *		Input - Pointer to a hash table head which has been made
- *		unavailable to anyone else before this call.
+ *		Input/Output - Pointer to the hash table head.
+ *
+ *	hashtable_entry_t *hte
+ *		Input/Output - The head of the chain, in the draining table.
  *
  * Return value:
- *	int	If all locks could be held temporarily, then a zero value will
- *		be returned. If any of the locks fails, a non-zero value as
- *		returned from rw_*lock() will be returned.
+ *	int	Zero if the chain was moved. Otherwise, -1 if no free entry
+ *		could be had, or -2 if a lock failed, with errno set.
  *
  */
 static int
-ht_sweep(hashtable_t *ht)
+ht_migrate_chain(hashtable_t *ht, hashtable_entry_t *hte)
 {
-
 	/*
 	 * Locals...
 	 */
-	hashtable_entry_t	*hte;	/* Pointer to a single entry.	*/
-	hashtable_entry_t	*chte;	/* Pointer to a chained entry.	*/
-	hashtable_entry_t	*ehte;	/* Pointer to end of the table.	*/
-	int			ret;	/* Just a return value.		*/
+	hashtable_entry_t	*chte;	/* Chained entry.		*/
+	hashtable_entry_t	*phte;	/* Previous chained entry.	*/
+	hashtable_entry_t	*dhte;	/* Destination table entry.	*/
+	hashtable_entry_t	*moving; /* Entries left to move.	*/
+	hashtable_entry_t	*freed;	/* Entries no longer needed.	*/
+	size_t			 count;	/* How many of them.		*/
+	int			 ret;	/* Just a return value.		*/
 
 	/*
-	 * To sweep any stale pointers of the table the following sequence
-	 * must be followed:
-	 *
-	 * 1 -	The head must be write locked momentarily to ensure that noone
-	 *	still has a read lock on it. This will gaurantee that the only
-	 *	stale pointers will be of table entries since the lock on the
-	 *	table head is only released after an entry of interest in the
-	 *	table has been locked in some fashion.
-	 *
-	 * 2 -	Every entry in the table must be write locked momentarily
-	 *	following the same sequence as a table probe. This will sweep
-	 *	any remaining stale pointers of the old table, because to
-	 *	have gotten each lock means no other thread has ANY locks on
-	 *	entries. There will be no more stale pointers into the old
-	 *	table.
-	 *
-	 * This algorhythm only works if the table is no longer accessible to
-	 * any thread outside of the one calling this routine.
+	 * Wait out anyone on the chain. The head stays locked, everything
+	 * else is just passed through.
 	 */
+	if (ret = rw_wrlock(&hte->rwlock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		errno = ret;
+		return (-2);
+
+	} /* if (ret = rw_wrlock(&hte->rwlock)) {...} */
+
+	for (phte = hte; (chte = phte->next) != NULL; phte = chte) {
+		(void) rw_wrlock(&chte->rwlock);
+		if (phte != hte) {
+			(void) rw_unlock(&phte->rwlock);
+
+		} /* if (phte != hte) {...} */
+
+	} /* for (phte = hte; (chte = phte->next) != NULL; ...) {...} */
+
+	if (phte != hte) {
+		(void) rw_unlock(&phte->rwlock);
+
+	} /* if (phte != hte) {...} */
 
 	/*
-	 * Lock the table head.
+	 * Gather up the keys to move: the chain, plus a free entry holding
+	 * the head's key.
 	 */
-	if (ret = rw_wrlock(&ht->tablelock)) {
-
-		/*
-		 * Ugh! I couldn't even get the first lock!
-		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
-		return (ret);
+	moving = hte->next;
+	if (hte->flags & htef_occupied) {
+		if (ret = ht_free_get(ht, &chte)) {
+			(void) rw_unlock(&hte->rwlock);
+			return (ret);
 
-	} /* if (rw_wrlock(&ht->tablelock)) {...} */
+		} /* if (ret = ht_free_get(ht, &chte)) {...} */
 
-	if (ret = rw_unlock(&ht->tablelock)) {
+		chte->key	= hte->key;
+		chte->data	= hte->data;
+		chte->flags    |= htef_occupied;
+		chte->next	= moving;
+		moving		= chte;
 
-		/*
-		 * Ditto.
-		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
-		return (ret);
+	} /* if (hte->flags & htef_occupied) {...} */
 
-	} /* if (rw_unlock(&ht->tablelock)) {...} */
+	/*
+	 * Empty the old chain for good.
+	 */
+	hte->flags	= (hte->flags & ~htef_occupied) | htef_migrated;
+	hte->next	= (hashtable_entry_t *)NULL;
 
 	/*
-	 * Time to sweep the table. Fetch write locks on EVERY entry for a
-	 * bit following the chains... The order through the table itself is
-	 * important.
+	 * Hang each entry in the new table: in the table proper if that
+	 * slot's free, otherwise just behind it on its chain.
 	 */
-	ehte = &ht->table->header.entry[ht->table->header.entrycount - 1];
-	for (hte = ht->table->header.entry; hte <= ehte; ++hte) {
+	freed = (hashtable_entry_t *)NULL;
+	while ((chte = moving) != (hashtable_entry_t *)NULL) {
+		moving = chte->next;
 
-		/*
-		 * Get the write lock on this entry.
-		 */
-		if ((hte->flags & htef_lock_initialized) &&
-		    (ret = rw_wrlock(&hte->rwlock))) {
+		dhte = &ht->table->header.entry[(*(ht->hash_compute))(
+		    chte->key,
+		    ht->keysize,
+		    ht->table->header.entrycount)];
 
+		if (ret = rw_wrlock(&dhte->rwlock)) {
 			/*
-			 * Crap! This is a bad place to bail!
+			 * Just count the error and stumble on.
 			 */
-			(void) ht_counter_add(&ht->stats.errors, 1);
-			return (ret);
+			(void) ht_counter_add(ht, hts_errors, 1);
 
-		} /* if (rw_wrlock(&hte->rwlock)) {...} */
+		} /* if (ret = rw_wrlock(&dhte->rwlock)) {...} */
 
-		if ((hte->flags & htef_lock_initialized) &&
-		    (ret = rw_unlock(&hte->rwlock))) {
+		if (! (dhte->flags & htef_occupied)) {
+			dhte->key	= chte->key;
+			dhte->data	= chte->data;
+			dhte->flags    |= htef_occupied;
 
-			/*
-			 * I can't quit now!
-			 */
-			(void) ht_counter_add(&ht->stats.errors, 1);
-			return (ret);
+			chte->flags    &= ~htef_occupied;
+			chte->next	= freed;
+			freed		= chte;
 
-		} /* if (rw_unlock(&hte->rwlock)) {...} */
+		} else /* if (dhte->flags & htef_occupied) */ {
+			chte->next	= dhte->next;
+			dhte->next	= chte;
 
-		/*
-		 * Walk the chain and do the same...
-		 */
-		chte = hte;
-		while ((chte = chte->next) != (hashtable_entry_t *)NULL) {
+		} /* if (! (dhte->flags & htef_occupied)) {...} else {...} */
+
+		if (ret == 0) {
+			(void) rw_unlock(&dhte->rwlock);
 
+		} /* if (ret == 0) {...} */
+
+	} /* while ((chte = moving) != (hashtable_entry_t *)NULL) {...} */
+
+	/*
+	 * No one will lock the head again, so its lock goes now rather than
+	 * all at once when the draining table is freed.
+	 */
+	(void) rw_unlock(&hte->rwlock);
+	if (rwlock_destroy(&hte->rwlock) == 0) {
+		hte->flags &= ~htef_lock_initialized;
+
+	} /* if (rwlock_destroy(&hte->rwlock) == 0) {...} */
+
+	/*
+	 * Give back the entries that weren't needed.
+	 */
+	if (freed != (hashtable_entry_t *)NULL) {
+		if (ret = rw_wrlock(&ht->freelock)) {
 			/*
-			 * Get the write lock on this entry.
+			 * They'll leak until the table is destroyed, since
+			 * they're still on the slab chain.
 			 */
-			if ((hte->flags & htef_lock_initialized) &&
-			    (ret = rw_wrlock(&chte->rwlock))) {
+			(void) ht_counter_add(ht, hts_errors, 1);
 
-				/*
-				 * Crap! I can't quit here!
-				 */
-				(void) ht_counter_add(&ht->stats.errors, 1);
-				return (ret);
+		} else /* if (ret == 0) */ {
+			for (chte = freed, count = 1; chte->next != NULL;
+			    ++count) {
+				chte = chte->next;
+
+			} /* for (chte = freed, ...; chte->next != NULL; ...) */
 
-			} /* if (rw_wrlock(&chte->rwlock)) {...} */
+			chte->next	= ht->freechain;
+			ht->freechain	= freed;
+			ht->freecount  += count;
+			(void) rw_unlock(&ht->freelock);
 
-			if ((hte->flags & htef_lock_initialized) &&
-			    (ret = rw_unlock(&hte->rwlock))) {
+		} /* if (ret = rw_wrlock(&ht->freelock)) {...} else {...} */
 
-				/*
-				 * Again, I don't dare stop now!
-				 */
-				(void) ht_counter_add(&ht->stats.errors, 1);
+	} /* if (freed != (hashtable_entry_t *)NULL) {...} */
+
+	--ht->drain_left;
+	return (0);
+
+} /* int ht_migrate_chain(hashtable_t *ht, hashtable_entry_t *hte) {...} */
+
+/*
+ * static int
+ * ht_free_draining(hashtable_t *ht);
+ *
+ * Description:
+ *	Take the draining table off the slab chain and free it. Heads whose
+ *	chains have moved already gave up their locks, so only the rest are
+ *	destroyed here; once the resize is done, that's none of them. The
+ *	caller must hold the table lock for writing.
+ *
+ * Parameters:
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the hash table head.
+ *
+ * Return value:
+ *	int	Zero if the table was freed. If the free chain lock couldn't
+ *		be had, -2 is returned with errno set and the table is left.
+ *
+ */
+static int
+ht_free_draining(hashtable_t *ht)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_slab_t	*slab = ht->draining; /* Table to free.	*/
+	hashtable_slab_t	**slabs; /* Link to the draining table.	*/
+	size_t			 i;	/* Entry number.		*/
+	int			 ret;	/* Just a return value.		*/
+
+	if (ret = rw_wrlock(&ht->freelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		errno = ret;
+		return (-2);
+
+	} /* if (ret = rw_wrlock(&ht->freelock)) {...} */
+
+	for (slabs = &ht->slabs; *slabs != slab; ) {
+		slabs = &(*slabs)->header.next;
+
+	} /* for (slabs = &ht->slabs; *slabs != slab; ) {...} */
+
+	*slabs = slab->header.next;
+	(void) rw_unlock(&ht->freelock);
+
+	for (i = 0; ht->drain_left > 0 && i < slab->header.entrycount; ++i) {
+		if (! (slab->header.entry[i].flags & htef_migrated)) {
+			(void) rwlock_destroy(&slab->header.entry[i].rwlock);
+			--ht->drain_left;
+
+		} /* if (! (...flags & htef_migrated)) {...} */
+
+	} /* for (i = 0; ht->drain_left > 0 && ...; ++i) {...} */
+
+	(void) free(slab);
+	ht->draining = (hashtable_slab_t *)NULL;
+	return (0);
+
+} /* int ht_free_draining(hashtable_t *ht) {...} */
+
+/*
+ * static int
+ * ht_migrate(hashtable_t *ht, void *key, size_t count);
+ *
+ * Description:
+ *	Make progress on a resize. The chain for the key passed is moved to
+ *	the new table, if it hasn't been already, and then up to count more
+ *	chains in table order. Once the last chain has moved, the draining
+ *	table is freed. The caller must hold the table lock for writing.
+ *
+ * Parameters:
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the hash table head.
+ *
+ *	void *key
+ *		Input - Optional (NULL) - The key about to be inserted or
+ *		deleted.
+ *
+ *	size_t count
+ *		Input - The number of other chains to move.
+ *
+ * Return value:
+ *	int	Zero if all went well. Otherwise, the return value from
+ *		ht_migrate_chain().
+ *
+ */
+static int
+ht_migrate(hashtable_t *ht, void *key, size_t count)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_entry_t	*hte;	/* Head of a chain to move.	*/
+	int			 ret;	/* Just a return value.		*/
+
+	if (ht->draining == (hashtable_slab_t *)NULL) {
+		return (0);
+
+	} /* if (ht->draining == (hashtable_slab_t *)NULL) {...} */
+
+	/*
+	 * The key's chain first, so the caller only has the new table to
+	 * look at.
+	 */
+	if (key != NULL) {
+		hte = ht_bucket(ht, key);
+		if (hte >= ht->draining->header.entry &&
+		    hte < &ht->draining->header.entry[
+		    ht->draining->header.entrycount] &&
+		    (ret = ht_migrate_chain(ht, hte))) {
+
+			return (ret);
+
+		} /* if (hte >= ht->draining->header.entry && ...) {...} */
+
+	} /* if (key != NULL) {...} */
+
+	while (count > 0 && ht->drain_left > 0) {
+		hte = &ht->draining->header.entry[ht->drain_next];
+		if (! (hte->flags & htef_migrated)) {
+			if (ret = ht_migrate_chain(ht, hte)) {
 				return (ret);
 
-			} /* if (rw_unlock(&hte->rwlock)) {...} */
+			} /* if (ret = ht_migrate_chain(ht, hte)) {...} */
+
+			--count;
 
-		} /* while ((chte  = hte->next) != (... *)NULL) {...} */
+		} /* if (! (hte->flags & htef_migrated)) {...} */
+
+		++ht->drain_next;
+
+	} /* while (count > 0 && ht->drain_left > 0) {...} */
+
+	if (ht->drain_left > 0) {
+		return (0);
 
-	} /* for (; hte != ht->table->header.entry; --hte) {...} */
+	} /* if (ht->drain_left > 0) {...} */
 
 	/*
-	 * The sweep worked!
+	 * All moved. No one can reach the draining table any more.
 	 */
-	return (ret);
+	return (ht_free_draining(ht));
 
-} /* int ht_sweep(hashtable_t *ht) {...} */
+} /* int ht_migrate(hashtable_t *ht, void *key, size_t count) {...} */
 
 /*
  *
@@ -943,6 +3620,18 @@ ht_destroy(void *Eht)
 	hashtable_slab_t	*hts;	/* Pointer to a slab.		*/
 	int			 ret;	/* Just a return value.		*/
 
+	/*
+	 * A mapped table has no locks or entries, only its file mapping.
+	 */
+	if (ht->options & hto_mapped) {
+		(void) munmap((void *)ht->map->base, ht->map->size);
+		(void) free(ht->map);
+		(void) free(ht->stats);
+		(void) free(ht);
+		return (0);
+
+	} /* if (ht->options & hto_mapped) {...} */
+
 	/*
 	 * Destroy the lock in each entry, then the lock for the table.
 	 */
@@ -950,30 +3639,20 @@ ht_destroy(void *Eht)
 		/*
 		 * We're screwed. There should be a lock here!
 		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		return (-2);
 
 	} /* if (rw_wrlock(&ht->tablelock)) {...} */
 
 	/*
-	 * If there are "old" tables hanging around, try to destroy them first.
+	 * A resize still under way leaves a draining table, partly torn down.
 	 */
-	if ((ht->old != (hashtable_t *)NULL) &&
-	    ((ret = ht_destroy(ht->old)) != 0)) {
-
-		/*
-		 * Well, that didn't seem to work. Leave the old stuff around
-		 * and bail!
-		 */
+	if (ht->draining != (hashtable_slab_t *)NULL &&
+	    (ret = ht_free_draining(ht))) {
 		(void) rw_unlock(&ht->tablelock);
 		return (ret);
 
-	} /* if (ht->old != (hashtable_t *)NULL) {...} */
-
-	/*
-	 * No more old tables...
-	 */
-	ht->old = (hashtable_t *)NULL;
+	} /* if (ht->draining != (hashtable_slab_t *)NULL && ...) {...} */
 
 	/*
 	 * Destroy all the slabs.
@@ -989,81 +3668,32 @@ ht_destroy(void *Eht)
 			 */
 			hts->header.next	= ht->slabs;
 			ht->slabs		= hts;
-			(void) ht_counter_add(&ht->stats.errors, 1);
+			(void) ht_counter_add(ht, hts_errors, 1);
 			(void) rw_unlock(&ht->tablelock);
 			return (ret);
 
-		} /* if (ht_destroy_slab(hts)) {...} */
-
-		/*
-		 * If this slab is also the table, then clear the table
-		 * pointer.
-		 */
-		if (ht->table == hts) {
-			ht->table = (hashtable_slab_t *)NULL;
-
-		} /* if (ht->table == hts) {...} */
-
-	} /* while ((hts = ht->header.slabs) != (... *)NULL) {...} */
-
-	/*
-	 * Destroy all the locks, except the table lock itself.
-	 */
-	errno = 0;
-	if (ret = mutex_destroy(&ht->stats.probes.mutex)) {
-		errno = (errno ? errno : ret);
-		(void) ht_counter_add(&ht->stats.errors, 1);
-
-	} /* if (mutex_destroy(&...mutex)) {...} */
-
-	if (ret = mutex_destroy(&ht->stats.hits.mutex)) {
-		errno = (errno ? errno : ret);
-		(void) ht_counter_add(&ht->stats.errors, 1);
-
-	} /* if (mutex_destroy(&...hits.mutex)) {...} */
-
-	if (ret = mutex_destroy(&ht->stats.searches.mutex)) {
-		errno = (errno ? errno : ret);
-		(void) ht_counter_add(&ht->stats.errors, 1);
-
-	} /* if (mutex_destroy(&...searches.mutex)) {...} */
-
-	if (ret = mutex_destroy(&ht->stats.resizes.mutex)) {
-		errno = (errno ? errno : ret);
-		(void) ht_counter_add(&ht->stats.errors, 1);
-
-	} /* if (mutex_destroy(&...resizes.mutex)) {...} */
-
-	if (ret = mutex_destroy(&ht->stats.inserts.mutex)) {
-		errno = (errno ? errno : ret);
-		(void) ht_counter_add(&ht->stats.errors, 1);
-
-	} /* if (mutex_destroy(&h...inserts.mutex)) {...} */
-
-	if (ret = mutex_destroy(&ht->stats.deletes.mutex)) {
-		errno = (errno ? errno : ret);
-		(void) ht_counter_add(&ht->stats.errors, 1);
-
-	} /* if (mutex_destroy(&...deletes.mutex)) {...} */
-
-	if (ret = mutex_destroy(&ht->stats.depth.mutex)) {
-		errno = (errno ? errno : ret);
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		} /* if (ht_destroy_slab(hts)) {...} */
 
-	} /* if (mutex_destroy(&..s.depth.mutex)) {...} */
+		/*
+		 * If this slab is also the table, then clear the table
+		 * pointer.
+		 */
+		if (ht->table == hts) {
+			ht->table = (hashtable_slab_t *)NULL;
 
-	if (ret = mutex_destroy(&ht->stats.freechain.mutex)) {
-		errno = (errno ? errno : ret);
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		} /* if (ht->table == hts) {...} */
 
-	} /* if (mutex_destroy(&...freechain.mutex)) {...} */
+	} /* while ((hts = ht->header.slabs) != (... *)NULL) {...} */
 
-	if (ret = mutex_destroy(&ht->stats.slabs.mutex)) {
-		errno = (errno ? errno : ret);
-		(void) ht_counter_add(&ht->stats.errors, 1);
+	/*
+	 * Open addressing tables have their one buffer instead.
+	 */
+	if (ht->oa != (hashtable_oa_t *)NULL) {
+		ht_oa_destroy(ht);
 
-	} /* if (mutex_destroy(&...slabs.mutex)) {...} */
+	} /* if (ht->oa != (hashtable_oa_t *)NULL) {...} */
 
+	errno = 0;
 
 	/*
 	 * Put back the table lock.
@@ -1074,7 +3704,7 @@ ht_destroy(void *Eht)
 		 * Bad deal! But no known possibility for recovery.
 		 */
 		errno = (errno ? errno : ret);
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		return (-2);
 
 	} /* if (rw_unlock(&ht->tablelock)) {...} */
@@ -1088,23 +3718,15 @@ ht_destroy(void *Eht)
 		 * Again, we're screwed. There should be a valid lock here!
 		 */
 		errno = (errno ? errno : ret);
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		return (-2);
 
 	} /* if (rwlock_destroy(&ht->tablelock)) {...} */
 
 	/*
-	 * Error counter done last just for fun!
+	 * Statistics done last, as the errors above still count.
 	 */
-	if (ret = mutex_destroy(&ht->stats.errors.mutex)) {
-
-		/*
-		 * Not place to record this, but I can tell the caller.
-		 */
-		errno = (errno ? errno : ret);
-		return (-2);
-
-	} /* if (mutex_destroy(&...errors.mutex)) {...} */
+	(void) free(ht->stats);
 
 	/*
 	 * So, release the table head...
@@ -1116,315 +3738,532 @@ ht_destroy(void *Eht)
 
 /*
  *
- *  int
- *  ht_resize(hashtable_t *Eht, size_t numents);
+ *  static int
+ *  ht_resize_(hashtable_t *ht, size_t numents, int implicit);
  *
  *  Description:
- *	Resize the table to hold the number of entries specified. The size may
- *	increase or decrease.
+ *	Start moving a chained table to a new table of numents entries.
+ *	Only the new table is allocated and the first few chains moved here,
+ *	the rest follow a few at a time with later inserts and deletes (see
+ *	ht_migrate()). If a resize is already under way, it's finished off
+ *	first.
  *
  *  Paramaters:
- *	hashtable_t *Eht
- *		Pointer to the table head of the hash table to resize.
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the table head.
  *
  *	size_t numents
- *		New size in hash entries of the table.
+ *		Input - New size in hash entries of the table.
+ *
+ *	int implicit
+ *		Input - Non-zero if the table asked for this itself. Then
+ *		nothing is done if a resize is already under way, so no one
+ *		insert ever pays for more than a few chains.
  *
  *  Return value:
- *	int	If resize succeeds, the zero will be returned. Otherwise a
- *		non-zero value will be returned.
+ *	See ht_resize().
+ *
  */
-int
-ht_resize(void *Eht, size_t numents)
+static int
+ht_resize_(hashtable_t *ht, size_t numents, int implicit)
 {
 	/*
 	 * Locals...
 	 */
-	hashtable_t		*ht = (hashtable_t *)Eht;
-	hashtable_t		*nht;	/* New, bigger, better.		*/
-	hashtable_entry_t	*hte;	/* Pointer to an entry.		*/
-	hashtable_entry_t	*chte;	/* Chained entry.		*/
-	hashtable_slab_t	*slabs;	/* For swapping pointers.	*/
+	hashtable_slab_t	*slab;	/* The new table.		*/
 	int			 ret;	/* Just a return value.		*/
-	int			 fret;	/* free unlock return value.	*/
-	int			 tret;	/* table unlock return value.	*/
-	int			 sret;	/* sweep return value.		*/
+
+	if ((ht->options & hto_hash_wide) ||
+	    ! (ht->options & hto_hash_legacy)) {
+		if ((numents = ht_size_pow2(numents)) == 0) {
+			errno = EINVAL;
+			return (-1);
+
+		} /* if ((numents = ht_size_pow2(numents)) == 0) {...} */
+
+	} else if (numents == 0) {
+		errno = EINVAL;
+		return (-1);
+
+	} /* if ((ht->options & hto_hash_wide) || ...) {...} else ... */
 
 	/*
-	 * Only one resize may progress at a time!
+	 * Only one resize may progress at a time! A resize the table asked
+	 * for itself just gives way.
 	 */
-	if (errno = mutex_lock(&ht->resizemutex)) {
-		/*
-		 * That didn't work at all!
-		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+	if (errno = (implicit ?
+	    mutex_trylock(&ht->resizemutex) :
+	    mutex_lock(&ht->resizemutex))) {
+
+		if (implicit && errno == EBUSY) {
+			return (0);
+
+		} /* if (implicit && errno == EBUSY) {...} */
+
+		(void) ht_counter_add(ht, hts_errors, 1);
 		return (-2);
 
-	} /* if (errno = mutex_lock(ht->resizemutex)) {...} */
+	} /* if (errno = (implicit ? ...)) {...} */
 
 	/*
-	 * Insert and delete lock the table for writing just long enough to
-	 * lock	individual entries, then surrender the table lock. So...
-	 * I can read lock old table -- No one gets in for write access
+	 * Build the new table before locking anyone out.
 	 */
-	if (errno = rw_rdlock(&ht->tablelock)) {
-		/*
-		 * That didn't work at all!
-		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+	if ((slab = ht_create_slab(numents)) == (hashtable_slab_t *)NULL) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		(void) mutex_unlock(&ht->resizemutex);
+		return (-1);
+
+	} /* if ((slab = ht_create_slab(numents)) == ...) {...} */
+
+	if (errno = rw_wrlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		(void) ht_destroy_slab(slab);
 		(void) mutex_unlock(&ht->resizemutex);
 		return (-2);
 
-	} /* if (rw_rdlock (&ht->tablelock)) {...} */
+	} /* if (errno = rw_wrlock(&ht->tablelock)) {...} */
 
 	/*
-	 * Create a whole new table without implicit resize, just to keep
-	 * life simple. We don't wanna recurse while resizing the table...
-	 * Whadathot? That makes my head hurt. So, I won't allow it.
+	 * Finish off the last resize, unless that's more than I'm allowed.
 	 */
-	nht = ht_create(numents,
-	    ht->keysize,
-	    ht->options & ~hto_resize_implicit);
+	if (ht->draining != (hashtable_slab_t *)NULL) {
+		ret = 0;
+		if (! implicit) {
+			ret = ht_migrate(ht, NULL, ht->drain_left);
+
+		} /* if (! implicit) {...} */
+
+		if (ret != 0 || ht->draining != (hashtable_slab_t *)NULL) {
+			(void) rw_unlock(&ht->tablelock);
+			(void) ht_destroy_slab(slab);
+			(void) mutex_unlock(&ht->resizemutex);
+			return (ret);
+
+		} /* if (ret != 0 || ...) {...} */
 
-	if (nht == (hashtable_t *)NULL) {
-		(void) ht_counter_add(&ht->stats.errors, 1);
+	} /* if (ht->draining != (hashtable_slab_t *)NULL) {...} */
+
+	/*
+	 * The new table goes on the slab chain, and the current one starts
+	 * draining into it.
+	 */
+	if (errno = rw_wrlock(&ht->freelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
 		(void) rw_unlock(&ht->tablelock);
+		(void) ht_destroy_slab(slab);
 		(void) mutex_unlock(&ht->resizemutex);
-		return (-1);
+		return (-2);
+
+	} /* if (errno = rw_wrlock(&ht->freelock)) {...} */
+
+	slab->header.next	= ht->slabs;
+	ht->slabs		= slab;
+	(void) rw_unlock(&ht->freelock);
+
+	(void) ht_counter_add(ht, hts_slabs, 1);
+	(void) ht_counter_add(ht, hts_resizes, 1);
+
+	ht->draining	= ht->table;
+	ht->drain_next	= 0;
+	ht->drain_left	= ht->table->header.entrycount;
+	ht->table	= slab;
+	ht_window_reset(ht);
+
+	ret = ht_migrate(ht, NULL, HT_MIGRATE_STEP);
+
+	if (errno = rw_unlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		ret = -2;
+
+	} /* if (errno = rw_unlock(&ht->tablelock)) {...} */
+
+	if (errno = mutex_unlock(&ht->resizemutex)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		ret = -2;
+
+	} /* if (errno = mutex_unlock(&ht->resizemutex)) {...} */
 
-	} /* if (newslab == (hashtable_slab_t *)NULL) {...} */
+	return (ret);
+
+} /* int ht_resize_(hashtable_t *ht, size_t numents, int implicit) {...} */
 
+/*
+ *
+ *  int
+ *  ht_resize(hashtable_t *Eht, size_t numents);
+ *
+ *  Description:
+ *	Resize the table to hold the number of entries specified. The size may
+ *	increase or decrease. A chained table switches to the new size at
+ *	once, but its entries move over a few chains at a time as the table
+ *	is updated, so no one caller waits on the whole table. An open
+ *	addressing table is rebuilt in one go.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Pointer to the table head of the hash table to resize.
+ *
+ *	size_t numents
+ *		New size in hash entries of the table.
+ *
+ *  Return value:
+ *	int	If resize succeeds, the zero will be returned. Otherwise a
+ *		non-zero value will be returned.
+ */
+int
+ht_resize(void *Eht, size_t numents)
+{
 	/*
-	 * Put this table on the "old" chain so I can find it later.
+	 * Locals...
 	 */
-	nht->old	= ht->old;
-	ht->old		= nht;
+	hashtable_t		*ht = (hashtable_t *)Eht;
+	int			 ret;	/* Just a return value.		*/
+	int			 tret;	/* table unlock return value.	*/
+
+	if (ht->options & hto_mapped) {
+		errno = EROFS;
+		return (-1);
+
+	} /* if (ht->options & hto_mapped) {...} */
 
 	/*
-	 * Populate new table from existing table entries while reads continue
-	 * to use old table during this process.
+	 * Open addressing tables are rebuilt in place with the table locked.
 	 */
-	hte = &ht->table->header.entry[ht->table->header.entrycount];
-	while (hte-- != ht->table->header.entry) {
+	if (ht->options & hto_open_addressing) {
+		if (errno = rw_wrlock(&ht->tablelock)) {
+			(void) ht_counter_add(ht, hts_errors, 1);
+			return (-2);
 
-		/*
-		 * Put this entry in the new table.
-		 */
-		if ((hte->flags & htef_occupied) &&
-		    (ht_insert_key(nht, hte->key, hte->data))) {
+		} /* if (errno = rw_wrlock(&ht->tablelock)) {...} */
 
-			/*
-			 * Couldn't populate the new table for some reason!
-			 */
-			(void) ht_counter_add(&ht->stats.errors, 1);
-			if (ht_destroy(nht) == 0) {
-				ht->old = (hashtable_t *)NULL;
+		if ((ret = ht_oa_rehash(ht, numents)) != 0) {
+			(void) ht_counter_add(ht, hts_errors, 1);
 
-			} /* if (ht_destroy(nht) == 0) {...} */
+		} else /* if (ret == 0) */ {
+			(void) ht_counter_add(ht, hts_resizes, 1);
 
-			(void) rw_unlock(&ht->tablelock);
-			(void) mutex_unlock(&ht->resizemutex);
-			return (-1);
+		} /* if ((ret = ht_oa_rehash(ht, numents)) != 0) {...} */
 
-		} /* if (ht_insert_key_(ht, hte->key, hte->data)) {...} */
+		if (tret = rw_unlock(&ht->tablelock)) {
+			(void) ht_counter_add(ht, hts_errors, 1);
+			errno = tret;
+			return (-2);
 
-		/*
-		 * Walk the chain and put each entry in the new table.
-		 */
-		chte = hte;
-		while ((chte  = chte->next) != (hashtable_entry_t *)NULL) {
+		} /* if (tret = rw_unlock(&ht->tablelock)) {...} */
 
-			/*
-			 * Put this entry in the new table.
-			 */
-			if (ht_insert_key(nht, chte->key, chte->data)) {
+		return (ret);
 
-				/*
-				 * Couldn't populate the new table for some
-				 * reason!
-				 */
-				(void) ht_counter_add(&ht->stats.errors, 1);
-				if (ht_destroy(nht) == 0) {
-					ht->old = (hashtable_t *)NULL;
+	} /* if (ht->options & hto_open_addressing) {...} */
 
-				} /* if (ht_destroy(nht) == 0) {...} */
-				(void) rw_unlock(&ht->tablelock);
-				(void) mutex_unlock(&ht->resizemutex);
-				return (-1);
+	return (ht_resize_(ht, numents, 0));
 
-			} /* if (ht_insert_key(nht, ...)) {...} */
+} /* int ht_resize(void *Eht, size_t numents) {...} */
 
-		} /* while ((chte  = hte->next) != (... *)NULL) {...} */
+/*
+ *
+ *  int
+ *  ht_set_threshold(hashtable_t *Eht, ht_threshold_t evaluate);
+ *
+ *  Description:
+ *	Replace the resize policy of a table.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Pointer to the table head.
+ *
+ *	ht_threshold_t evaluate
+ *		The new policy, or NULL for none.
+ *
+ *  Return value:
+ *	int	Zero.
+ */
+int
+ht_set_threshold(void *Eht, ht_threshold_t evaluate)
+{
+	((hashtable_t *)Eht)->threshold_evaluate = evaluate;
+	return (0);
 
-	} /* for (; hte != ht->table->header.entry; --hte) {...} */
+} /* int ht_set_threshold(void *Eht, ht_threshold_t evaluate) {...} */
 
+/*
+ *
+ *  int
+ *  ht_specialize(hashtable_t *Eht, ht_hash_full_t hash, ht_compare_t compare);
+ *
+ *  Description:
+ *	Replace the hash and key comparison of an empty open addressing
+ *	table. This is how the typed tables of hashtable_typed.h make the
+ *	library hash and compare their keys the same way their own inlined
+ *	lookups do.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input/Output - Pointer to the table head.
+ *
+ *	ht_hash_full_t hash
+ *		Input - The new hash.
+ *
+ *	ht_compare_t compare
+ *		Input - The new comparison.
+ *
+ *  Return value:
+ *	int	Zero, or -1 with errno set to EINVAL if the table isn't open
+ *		addressing or a pointer is NULL, or EBUSY if the table has
+ *		ever held a key since it was last resized.
+ */
+int
+ht_specialize(void *Eht, ht_hash_full_t hash, ht_compare_t compare)
+{
 	/*
-	 * Gotta have the free lock to manupilate the slab or free chains.
+	 * Locals...
 	 */
-	if (ret = rw_wrlock(&ht->freelock)) {
+	hashtable_t	*ht = (hashtable_t *)Eht;
+	int		 ret;		/* Just a return value.		*/
 
-		/*
-		 * Ouch!
-		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
-		if (ht_destroy(nht) == 0) {
-			ht->old = (hashtable_t *)NULL;
+	if (ht == (hashtable_t *)NULL ||
+	    hash == (ht_hash_full_t)NULL ||
+	    compare == (ht_compare_t)NULL ||
+	    ! (ht->options & hto_open_addressing) ||
+	    (ht->options & hto_mapped)) {
 
-		} /* if (ht_destroy(nht) == 0) {...} */
+		errno = EINVAL;
+		return (-1);
 
+	} /* if (ht == (hashtable_t *)NULL || ...) {...} */
+
+	if (ret = rw_wrlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
 		errno = ret;
-		(void) rw_unlock(&ht->tablelock);
-		(void) mutex_unlock(&ht->resizemutex);
-		return (-2);
+		return (-1);
 
-	} /* if (rw_wrlock(&ht->freelock)) {...} */
+	} /* if (ret = rw_wrlock(&ht->tablelock)) {...} */
 
 	/*
-	 * Swap slab lists.
+	 * Keys already placed by the old hash couldn't be found by the new.
 	 */
-	slabs		= ht->slabs;
-	ht->slabs	= nht->slabs;
-	nht->slabs	= slabs;
+	if (ht->oa->used + ht->oa->tombs != 0) {
+		(void) rw_unlock(&ht->tablelock);
+		errno = EBUSY;
+		return (-1);
 
-	/*
-	 * Swap the free chains.
-	 */
-	hte		= ht->freechain;
-	ht->freechain	= nht->freechain;
-	nht->freechain	= hte;
+	} /* if (ht->oa->used + ht->oa->tombs != 0) {...} */
+
+	ht->hash_full	= hash;
+	ht->key_compare	= compare;
+
+	(void) rw_unlock(&ht->tablelock);
+	return (0);
 
+} /* int ht_specialize(void *Eht, ht_hash_full_t hash, ...) {...} */
+
+/*
+ *
+ *  int
+ *  ht_stats(void *Eht, ht_stats_t *stats);
+ *
+ *  Description:
+ *	Take a snapshot of a table's statistics. The shards are summed
+ *	without stopping the threads adding to them.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input - Pointer to the table head.
+ *
+ *	ht_stats_t *stats
+ *		Output - Where the snapshot is put.
+ *
+ *  Return value:
+ *	int	Zero, or -1 with errno set if either pointer is NULL or the
+ *		table lock couldn't be had.
+ */
+int
+ht_stats(void *Eht, ht_stats_t *stats)
+{
 	/*
-	 * Swap the table pointers themselves so everyone starts using the
-	 * new table.
+	 * Locals...
 	 */
-	slabs		= ht->table;
-	ht->table	= nht->table;
-	nht->table	= slabs;
+	hashtable_t		*ht = (hashtable_t *)Eht;
+	int			 ret;	/* Just a return value.		*/
+
+	if (ht == (hashtable_t *)NULL || stats == (ht_stats_t *)NULL) {
+		errno = EINVAL;
+		return (-1);
+
+	} /* if (ht == (hashtable_t *)NULL || ...) {...} */
 
 	/*
-	 * Accumulate stats from the two tables. All of the counters simply
-	 * get added together.
+	 * A mapped table never changes size.
 	 */
-	(void) ht_counter_add(&ht->stats.probes,  nht->stats.probes.value);
-	(void) ht_counter_add(&ht->stats.hits,    nht->stats.hits.value);
-	(void) ht_counter_add(&ht->stats.errors,  nht->stats.errors.value);
-	(void) ht_counter_add(&ht->stats.resizes, nht->stats.resizes.value);
-	(void) ht_counter_add(&ht->stats.inserts, nht->stats.inserts.value);
-	(void) ht_counter_add(&ht->stats.deletes, nht->stats.deletes.value);
+	if (ht->options & hto_mapped) {
+		stats->numents		= ht->map->capacity;
+		stats->entries		= ht->map->used;
+		stats->freecount	= 0;
+		ht_stats_sum(ht, stats);
+		return (0);
+
+	} /* if (ht->options & hto_mapped) {...} */
 
 	/*
-	 * Averages, need to be accumulated... Counts get summed, maximums
-	 * get MAX'd, and current gets saved.
+	 * The sizes need the table lock, so an open addressing buffer
+	 * isn't freed from under them.
 	 */
-	(void) ht_average_update(&ht->stats.searches,
-	    nht->stats.searches.count,
-	    nht->stats.searches.sum,
-	    nht->stats.searches.current,
-	    nht->stats.searches.maximum);
+	if (ret = rw_rdlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		errno = ret;
+		return (-1);
 
-	(void) ht_average_update(&ht->stats.depth,
-	    nht->stats.depth.count,
-	    nht->stats.depth.sum,
-	    nht->stats.depth.current,
-	    nht->stats.depth.maximum);
+	} /* if (ret = rw_rdlock(&ht->tablelock)) {...} */
 
-	(void) ht_average_update(&ht->stats.freechain,
-	    nht->stats.freechain.count,
-	    nht->stats.freechain.sum,
-	    nht->stats.freechain.current,
-	    nht->stats.freechain.maximum);
+	if (ht->options & hto_open_addressing) {
+		stats->numents	= ht->oa->capacity;
+		stats->entries	= ht->oa->used;
 
-	/*
-	 * Done messin' with the free and slab chains.
-	 */
-	if (fret = rw_unlock(&ht->freelock)) {
+	} else /* if (! (ht->options & hto_open_addressing)) */ {
+		stats->numents	= ht->table->header.entrycount;
+		stats->entries	= ht->entries;
 
-		/*
-		 * I don't dare stop now!
-		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+	} /* if (ht->options & hto_open_addressing) {...} else {...} */
 
-	} /* if (rw_unlock(&ht->freelock)) {...} */
+	stats->freecount = ht->freecount;
+
+	(void) rw_unlock(&ht->tablelock);
+
+	ht_stats_sum(ht, stats);
+	return (0);
+
+} /* int ht_stats(void *Eht, ht_stats_t *stats) {...} */
 
+/*
+ *
+ *  void
+ *  ht_stats_lookup(hashtable_t *Eht, int depth, int hit);
+ *
+ *  Description:
+ *	Record a lookup made outside the library, by the typed tables of
+ *	hashtable_typed.h, in the table's statistics.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input/Output - Pointer to the table head.
+ *
+ *	int depth
+ *		Input - Number of groups probed past the first.
+ *
+ *	int hit
+ *		Input - Non-zero if the key was found.
+ *
+ *  Return value:
+ *	None.
+ */
+void
+ht_stats_lookup(void *Eht, int depth, int hit)
+{
 	/*
-	 * Copacetic. Everyone will now use the new table. In fact, readers
-	 * are already using it. Give up the lock and let writers in for a bit.
+	 * Locals...
 	 */
-	if (tret = rw_unlock(&ht->tablelock)) {
+	hashtable_t	*ht = (hashtable_t *)Eht;
+	uint_t		 weight;	/* Lookup sample weight.	*/
 
-		/*
-		 * Ouch! If I couldn't give up the lock then I probably won't
-		 * be able to take it again later...
-		 * But I can't bail here. Just count the error and stumble on.
-		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+	weight = ht_sample(ht);
+	(void) ht_counter_add(ht, hts_probes, weight);
+	(void) ht_average_add(ht, hta_searches, depth, weight);
+	if (hit) {
+		(void) ht_counter_add(ht, hts_hits, weight);
 
-	} /* if (rw_unlock(&ht->tablelock)) {...} */
+	} /* if (hit) {...} */
 
+} /* void ht_stats_lookup(void *Eht, int depth, int hit) {...} */
+
+/*
+ *
+ *  static void
+ *  ht_evaluate(hashtable_t *ht);
+ *
+ *  Description:
+ *	Count an insert or delete, and every HT_EVAL_PERIOD of them ask the
+ *	table's resize policy whether it's time for a new size. Tables
+ *	without hto_resize_implicit, or without a policy, are left alone.
+ *	A failed resize is counted with the table errors, but doesn't fail
+ *	the insert or delete that set it off; the table is still usable.
+ *
+ *  Paramaters:
+ *	hashtable_t *ht
+ *		Input/Output - Pointer to the table head.
+ *
+ *  Return value:
+ *	None.
+ */
+static void
+ht_evaluate(hashtable_t *ht)
+{
 	/*
-	 * Sweep the old table.
+	 * Locals...
 	 */
-	if (sret = ht_sweep(nht)) {
+	ht_threshold_t	 evaluate = ht->threshold_evaluate;
+	ht_load_t	 load;		/* What the policy gets to see.	*/
+	ht_stats_t	 stats;		/* Counts so far.		*/
+	size_t		 numents;	/* The size it asks for.	*/
 
-		/*
-		 * Couldn't even sweep the old table!
-		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+	if (! (ht->options & hto_resize_implicit) ||
+	    evaluate == NULL ||
+	    (atomic_inc_ulong_nv(&ht->updates) & (HT_EVAL_PERIOD - 1))) {
+		return;
 
-	} /* if (ht_sweep(nht)) {...} */
+	} /* if (! (ht->options & hto_resize_implicit) || ...) {...} */
 
 	/*
-	 * Cleaned and swept. Destroy the old table.
+	 * The table lock keeps an open addressing buffer from being freed
+	 * while it's looked at.
 	 */
-	if (tret == 0 &&
-	    sret == 0 &&
-	    ht_destroy(nht) == 0) {
+	if (rw_rdlock(&ht->tablelock)) {
+		(void) ht_counter_add(ht, hts_errors, 1);
+		return;
 
-		/*
-		 * Swept and destroyed!
-		 */
-		ht->old = (hashtable_t *)NULL;
+	} /* if (rw_rdlock(&ht->tablelock)) {...} */
+
+	if (ht->options & hto_open_addressing) {
+		load.numents	= ht->oa->capacity;
+		load.entries	= ht->oa->used;
+
+	} else /* if (! (ht->options & hto_open_addressing)) */ {
+		load.numents	= ht->table->header.entrycount;
+		load.entries	= ht->entries;
+
+	} /* if (ht->options & hto_open_addressing) {...} else {...} */
+
+	load.minents	= ht->minents;
+	load.options	= ht->options;
+	ht_stats_sum(ht, &stats);
+	load.probes	= stats.probes - ht->window.probes;
+	load.hits	= stats.hits - ht->window.hits;
+	load.searchcount = stats.searches.count - ht->window.searchcount;
+	load.searchsum	= stats.searches.sum - ht->window.searchsum;
+	load.searchmax	= stats.searches.maximum;
+	load.depthmax	= stats.depth.maximum;
+	load.updates	= ht->updates - ht->window.updates;
 
-	} else {
-		/*
-		 * Couldn't destroy it? Count the error and stumble on.
-		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+	(void) rw_unlock(&ht->tablelock);
 
-	} /* if (tret == 0 && ... && ht_destroy(nht) == 0) {...} else {...} */
+	if ((numents = (*evaluate)(&load)) == 0 || numents == load.numents) {
+		return;
 
-	/*
-	 * Give back the resize mutex, and it's time to leave.
-	 */
-	if (ret = mutex_unlock(&ht->resizemutex)) {
-		/*
-		 * Couldn't give back the mutex lock?
-		 * Just count the error and stumble on...
-		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+	} /* if ((numents = (*evaluate)(&load)) == 0 || ...) {...} */
 
-	} /* if (ret = mutex_unlock(&ht->resizemutex)) {...} */
+	if ((ht->options & hto_open_addressing ?
+	    ht_resize(ht, numents) :
+	    ht_resize_(ht, numents, 1)) != 0) {
 
-	/*
-	 * Set errno based on the return values of the various unlock
-	 * functions.
-	 */
-	errno =
-	    (fret != 0 ? fret :	(tret != 0 ? tret : (sret != 0 ? sret : ret)));
+		(void) ht_counter_add(ht, hts_errors, 1);
 
-	/*
-	 * All done... new table is already in use, and old table has been
-	 * swept and destroyed.
-	 */
-	ret = (fret != 0 || tret != 0 || ret != 0 ? -2 : (sret != 0 ? -1 : 0));
-	return (ret);
+	} /* if ((... ? ht_resize(...) : ht_resize_(...)) != 0) {...} */
 
-} /* int ht_resize(void *Eht, size_t numents) {...} */
+} /* void ht_evaluate(hashtable_t *ht) {...} */
 
 /*
  *
  *  static hashtable_entry_t *
  *  ht_locate_entry_(hashtable_t *ht,
+ *		      hashtable_entry_t *head,
  *		      void *key,
  *		      hashtable_entry_t **previous,
  *		      hashtable_entry_t **base);
@@ -1441,6 +4280,10 @@ ht_resize(void *Eht, size_t numents)
  *		Input - Pointer to the head of the hash table in which to
  *		search for the key passed.
  *
+ *	hashtable_entry_t *head
+ *		Input - Optional (NULL) - The head of the key's chain, if the
+ *		caller already knows it from ht_bucket().
+ *
  *	void *key
  *		Input - Pointer to the bytes of the key to locate.
  *
@@ -1467,6 +4310,7 @@ ht_resize(void *Eht, size_t numents)
  */
 static hashtable_entry_t *
 ht_locate_entry_(hashtable_t *ht,
+    hashtable_entry_t *head,
     void *key,
     int (*lockfunc)(rwlock_t *rwlock),
     hashtable_entry_t **previous)
@@ -1474,31 +4318,26 @@ ht_locate_entry_(hashtable_t *ht,
 	/*
 	 * Locals...
 	 */
-	size_t			 hash_index;	/* Index for new entry.	*/
 	hashtable_entry_t	*dhte;	/* Destination hash table entry. */
 	hashtable_entry_t	*phte;	/* 'previous' hash table entry.	*/
 	hashtable_entry_t	*pphte;	/* previous 'previous' entry.	*/
 	int			 depth;	/* Search depth.		*/
+	uint_t			 weight; /* Lookup sample weight.	*/
 	int			 ret;	/* Just a return value.		*/
 
 	/*
 	 * Keep some stats to pay the rent.
 	 */
-	(void) ht_counter_add(&ht->stats.probes, 1);
-
-	/*
-	 * Compute the hash value, then start checking the table.
-	 */
-	hash_index = (*(ht->hash_compute))(key,
-	    ht->keysize,
-	    ht->table->header.entrycount);
+	weight = ht_sample(ht);
+	(void) ht_counter_add(ht, hts_probes, weight);
 
 	/*
-	 * Figure out the hash table index and read lock the entry.
+	 * Find the key's chain, in the draining table if it hasn't moved
+	 * yet, and lock its head.
 	 */
-	dhte = &ht->table->header.entry [hash_index];
+	dhte = (head != (hashtable_entry_t *)NULL ? head : ht_bucket(ht, key));
 	if ((*lockfunc)(&dhte->rwlock)) {
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		return ((hashtable_entry_t *)NULL);
 
 	} /* if ((*lockfunc)(&dhte->rwlock)) {...} */
@@ -1536,8 +4375,7 @@ ht_locate_entry_(hashtable_t *ht,
 			} /* if (phte != (hashtable_entry_t *)NULL) {...} */
 
 			(void) rw_unlock(&phte->rwlock);
-			(void) ht_average_increment(&ht->stats.searches,
-			    depth);
+			(void) ht_average_add(ht, hta_searches, depth, weight);
 
 			return ((hashtable_entry_t *)NULL);
 
@@ -1558,10 +4396,9 @@ ht_locate_entry_(hashtable_t *ht,
 			} /* if (phte != (hashtable_entry_t *)NULL) {...} */
 
 			(void) rw_unlock(&phte->rwlock);
-			(void) ht_average_increment(&ht->stats.searches,
-			    depth);
+			(void) ht_average_add(ht, hta_searches, depth, weight);
 
-			(void) ht_counter_add(&ht->stats.errors, 1);
+			(void) ht_counter_add(ht, hts_errors, 1);
 			return ((hashtable_entry_t *)NULL);
 
 		} /* if ((*lockfunc)(&dhte->rwlock)) {...} */
@@ -1578,11 +4415,10 @@ ht_locate_entry_(hashtable_t *ht,
 				 */
 				(void) rw_unlock(&phte->rwlock);
 				(void) rw_unlock(&dhte->rwlock);
-				(void) ht_average_increment(
-					&ht->stats.searches,
-					    depth);
+				(void) ht_average_add(ht, hta_searches, depth,
+				    weight);
 
-				(void) ht_counter_add(&ht->stats.errors, 1);
+				(void) ht_counter_add(ht, hts_errors, 1);
 				errno = ret;
 				return ((hashtable_entry_t *)NULL);
 
@@ -1595,8 +4431,8 @@ ht_locate_entry_(hashtable_t *ht,
 	/*
 	 * Update the stats.
 	 */
-	(void) ht_average_increment(&ht->stats.searches, depth);
-	(void) ht_counter_add(&ht->stats.hits, 1);
+	(void) ht_average_add(ht, hta_searches, depth, weight);
+	(void) ht_counter_add(ht, hts_hits, weight);
 
 	/*
 	 * If the caller was interested in the previous entry as well, then
@@ -1620,7 +4456,7 @@ ht_locate_entry_(hashtable_t *ht,
 				 * can.
 				 */
 				(void) rw_unlock(&dhte->rwlock);
-				(void) ht_counter_add(&ht->stats.errors, 1);
+				(void) ht_counter_add(ht, hts_errors, 1);
 				errno = ret;
 				return ((hashtable_entry_t *)NULL);
 
@@ -1671,12 +4507,13 @@ ht_locate_entry(hashtable_t *ht, void *key)
 	 * Take the table lock for reading.
 	 */
 	if (errno = rw_rdlock(&ht->tablelock)) {
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		return ((void *)NULL);
 
 	} /* if (rw_rdlock (&ht->tablelock)) {...} */
 
 	hte = ht_locate_entry_(ht,
+	    (hashtable_entry_t *)NULL,
 	    key,
 	    rw_rdlock,
 	    (hashtable_entry_t **)NULL);
@@ -1695,7 +4532,7 @@ ht_locate_entry(hashtable_t *ht, void *key)
 
 		} /* if (hte != (hashtable_entry_t *)NULL) {...} */
 
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		errno = ret;
 		return ((void *)NULL);
 
@@ -1746,6 +4583,21 @@ ht_locate_key(void *Eht, void *key)
 	void			*data;
 	int			 ret;
 
+	if (ht->options & hto_mapped) {
+		return (ht_map_locate_key(ht, key));
+
+	} /* if (ht->options & hto_mapped) {...} */
+
+	if (ht->options & hto_concurrent) {
+		return (ht_cc_locate_key(ht, key));
+
+	} /* if (ht->options & hto_concurrent) {...} */
+
+	if (ht->options & hto_open_addressing) {
+		return (ht_oa_locate_key(ht, key));
+
+	} /* if (ht->options & hto_open_addressing) {...} */
+
 	/*
 	 * Ask big brother for the answer.
 	 */
@@ -1764,7 +4616,7 @@ ht_locate_key(void *Eht, void *key)
 	 * Give up the lock on the entry.
 	 */
 	if (ret = rw_unlock(&hte->rwlock)) {
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		errno = ret;
 		return ((void *)NULL);
 
@@ -1777,6 +4629,223 @@ ht_locate_key(void *Eht, void *key)
 
 } /* void *ht_locate_key(hashtable_t *ht, void *key) {...} */
 
+/*
+ *
+ *  ssize_t
+ *  ht_locate_many(void *Eht, size_t count, void **keys, void **data);
+ *
+ *  Description:
+ *	Locate a batch of keys, as ht_locate_key() would one at a time. The
+ *	keys are taken HT_BATCH at a time: each is hashed and the lines its
+ *	search starts on are prefetched before any of them is looked at, and
+ *	the table lock is taken once for them all.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input - Pointer to the head of the hash table in which to
+ *		search for the keys passed.
+ *
+ *	size_t count
+ *		Input - Number of keys.
+ *
+ *	void **keys
+ *		Input - Pointers to the bytes of each key to locate.
+ *
+ *	void **data
+ *		Output - The data of each key, or NULL if it isn't in the
+ *		table.
+ *
+ *  Return value:
+ *	ssize_t	The number of keys found. If a lock couldn't be had, -1 is
+ *		returned with errno set, and data is filled in only for the
+ *		keys before the batch that failed.
+ */
+ssize_t
+ht_locate_many(void *Eht, size_t count, void **keys, void **data)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_t		*ht = (hashtable_t *)Eht;
+	hashtable_epoch_reader_t *reader; /* Concurrent epoch record.	*/
+	hashtable_entry_t	*hte[HT_BATCH]; /* Chain heads.		*/
+	uint64_t		 hash[HT_BATCH]; /* Full hashes.	*/
+	hashtable_oa_t		*oa;	/* Slot buffer.			*/
+	size_t			 base;	/* First key of the batch.	*/
+	size_t			 n;	/* Keys in the batch.		*/
+	size_t			 i;	/* Key in the batch.		*/
+	size_t			 slot;	/* Slot holding a key.		*/
+	ssize_t			 found = 0; /* Keys found.		*/
+	int			 depth;	/* Groups probed.		*/
+	uint_t			 weight; /* Lookup sample weight.	*/
+	int			 ret;	/* Just a return value.		*/
+
+	for (base = 0; base < count; base += n) {
+		n = (count - base < HT_BATCH ? count - base : HT_BATCH);
+
+		/*
+		 * Concurrent tables need no lock, only an epoch.
+		 */
+		if (ht->options & hto_concurrent) {
+			reader	= ht_epoch_enter();
+			oa	= ht->oa;
+			membar_consumer();
+
+			for (i = 0; i < n; ++i) {
+				hash[i] = (*(ht->hash_full))(keys[base + i],
+				    ht->keysize);
+				ht_oa_prefetch(ht, oa, hash[i]);
+
+			} /* for (i = 0; i < n; ++i) {...} */
+
+			for (i = 0; i < n; ++i) {
+				errno = 0;
+				data[base + i] = ht_cc_lookup(ht,
+				    keys[base + i],
+				    hash[i]);
+				if (errno != ENOENT) {
+					++found;
+
+				} /* if (errno != ENOENT) {...} */
+
+			} /* for (i = 0; i < n; ++i) {...} */
+
+			ht_epoch_exit(reader);
+			continue;
+
+		} /* if (ht->options & hto_concurrent) {...} */
+
+		/*
+		 * Mapped tables never change, so need no lock at all.
+		 */
+		if (ht->options & hto_mapped) {
+			for (i = 0; i < n; ++i) {
+				hash[i] = (*(ht->hash_full))(keys[base + i],
+				    ht->keysize);
+				slot = ((size_t)(hash[i] >> 7) &
+				    (ht->map->capacity / HT_OA_GROUP - 1)) *
+				    HT_OA_GROUP;
+				HT_PREFETCH(&ht->map->ctrl[slot]);
+				HT_PREFETCH(&ht->map->slots[slot]);
+
+			} /* for (i = 0; i < n; ++i) {...} */
+
+			for (i = 0; i < n; ++i) {
+				weight = ht_sample(ht);
+				(void) ht_counter_add(ht, hts_probes, weight);
+
+				slot = ht_map_find(ht, keys[base + i], hash[i],
+				    &depth);
+				(void) ht_average_add(ht, hta_searches, depth,
+				    weight);
+
+				if (slot == ht->map->capacity) {
+					data[base + i] = NULL;
+					continue;
+
+				} /* if (slot == ht->map->capacity) {...} */
+
+				(void) ht_counter_add(ht, hts_hits, weight);
+				data[base + i] = ht_map_data(ht,
+				    &ht->map->slots[slot]);
+				++found;
+
+			} /* for (i = 0; i < n; ++i) {...} */
+
+			continue;
+
+		} /* if (ht->options & hto_mapped) {...} */
+
+		if (errno = rw_rdlock(&ht->tablelock)) {
+			(void) ht_counter_add(ht, hts_errors, 1);
+			return (-1);
+
+		} /* if (errno = rw_rdlock(&ht->tablelock)) {...} */
+
+		if (ht->options & hto_open_addressing) {
+			oa = ht->oa;
+			for (i = 0; i < n; ++i) {
+				hash[i] = (*(ht->hash_full))(keys[base + i],
+				    ht->keysize);
+				ht_oa_prefetch(ht, oa, hash[i]);
+
+			} /* for (i = 0; i < n; ++i) {...} */
+
+			for (i = 0; i < n; ++i) {
+				weight = ht_sample(ht);
+				(void) ht_counter_add(ht, hts_probes, weight);
+
+				slot = ht_oa_find(ht, oa, keys[base + i],
+				    hash[i], &depth);
+				(void) ht_average_add(ht, hta_searches, depth,
+				    weight);
+
+				if (slot == oa->capacity) {
+					data[base + i] = NULL;
+					continue;
+
+				} /* if (slot == oa->capacity) {...} */
+
+				(void) ht_counter_add(ht, hts_hits, weight);
+				data[base + i] = oa->slots[slot].data;
+				++found;
+
+			} /* for (i = 0; i < n; ++i) {...} */
+
+		} else /* if (! (ht->options & hto_open_addressing)) */ {
+			for (i = 0; i < n; ++i) {
+				hte[i] = ht_bucket(ht, keys[base + i]);
+				HT_PREFETCH(hte[i]);
+
+			} /* for (i = 0; i < n; ++i) {...} */
+
+			for (i = 0; i < n; ++i) {
+				hte[i] = ht_locate_entry_(ht,
+				    hte[i],
+				    keys[base + i],
+				    rw_rdlock,
+				    (hashtable_entry_t **)NULL);
+
+				if (hte[i] == (hashtable_entry_t *)NULL) {
+					data[base + i] = NULL;
+					if (errno == ENOENT) {
+						continue;
+
+					} /* if (errno == ENOENT) {...} */
+
+					(void) rw_unlock(&ht->tablelock);
+					return (-1);
+
+				} /* if (hte[i] == NULL) {...} */
+
+				data[base + i] = hte[i]->data;
+				++found;
+				if (ret = rw_unlock(&hte[i]->rwlock)) {
+					(void) ht_counter_add(ht, hts_errors,
+					    1);
+					(void) rw_unlock(&ht->tablelock);
+					errno = ret;
+					return (-1);
+
+				} /* if (ret = rw_unlock(...)) {...} */
+
+			} /* for (i = 0; i < n; ++i) {...} */
+
+		} /* if (ht->options & hto_open_addressing) {...} else {...} */
+
+		if (ret = rw_unlock(&ht->tablelock)) {
+			(void) ht_counter_add(ht, hts_errors, 1);
+			errno = ret;
+			return (-1);
+
+		} /* if (ret = rw_unlock(&ht->tablelock)) {...} */
+
+	} /* for (base = 0; base < count; base += n) {...} */
+
+	return (found);
+
+} /* ssize_t ht_locate_many(void *Eht, size_t count, ...) {...} */
+
 /*
  *
  *  int
@@ -1826,29 +4895,62 @@ ht_insert_key(void *Eht, void *key, void *data)
 	size_t			 hash_index;	/* Index for new entry.	*/
 	hashtable_entry_t	*dhte;	/* Destination hash table entry. */
 	hashtable_entry_t	*ohte;	/* Outside table entry.		*/
-	hashtable_slab_t	*slab;	/* For new free chain allocation. */
 	u_longlong_t		 depth;	/* Chain depth.			*/
+	uint64_t		 hash;	/* Full hash, open addressing.	*/
+	uint_t			 weight; /* Lookup sample weight.	*/
 	int			 ret;	/* Just a return value.		*/
 
+	if (ht->options & hto_mapped) {
+		errno = EROFS;
+		return (-1);
+
+	} /* if (ht->options & hto_mapped) {...} */
+
+	if (ht->options & hto_open_addressing) {
+		hash = (*(ht->hash_full))(key, ht->keysize);
+		ret = (ht->options & hto_concurrent ?
+		    ht_cc_insert_key(ht, key, hash, data) :
+		    ht_oa_insert_key(ht, key, hash, data));
+
+		if (ret == 0) {
+			ht_evaluate(ht);
+
+		} /* if (ret == 0) {...} */
+
+		return (ret);
+
+	} /* if (ht->options & hto_open_addressing) {...} */
+
 	/*
 	 * Keep some stats to pay the rent.
 	 */
-	(void) ht_counter_add(&ht->stats.inserts, 1);
+	(void) ht_counter_add(ht, hts_inserts, 1);
 
 	/*
 	 * Take the table lock for writing just so no one moves it around
 	 * while we're working here.
 	 */
 	if (errno = rw_wrlock(&ht->tablelock)) {
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		return (-2);
 
 	} /* if (rw_rdlock(&ht->tablelock)) {...} */
 
+	/*
+	 * Move this key's chain along with a few others if the table's
+	 * being resized. That leaves only the new table to look at.
+	 */
+	if (ret = ht_migrate(ht, key, HT_MIGRATE_STEP)) {
+		(void) rw_unlock(&ht->tablelock);
+		return (ret);
+
+	} /* if (ret = ht_migrate(ht, key, HT_MIGRATE_STEP)) {...} */
+
 	/*
 	 * Keep some stats to pay the rent.
 	 */
-	(void) ht_counter_add(&ht->stats.probes, 1);
+	weight = ht_sample(ht);
+	(void) ht_counter_add(ht, hts_probes, weight);
 
 	/*
 	 * Compute hash value and look for an opening...
@@ -1867,7 +4969,7 @@ ht_insert_key(void *Eht, void *key, void *data)
 		 * Just count the error and stumble on.
 		 */
 		(void) rw_unlock(&ht->tablelock);
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		errno = ret;
 		return (-2);
 
@@ -1884,7 +4986,7 @@ ht_insert_key(void *Eht, void *key, void *data)
 		 * Screwed!
 		 */
 		(void) rw_unlock(&dhte->rwlock);
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		errno = ret;
 		return (-2);
 
@@ -1900,6 +5002,7 @@ ht_insert_key(void *Eht, void *key, void *data)
 		dhte->flags    |= htef_occupied;
 		dhte->key	= key;
 		dhte->data	= data;
+		atomic_inc_ulong(&ht->entries);
 
 		if (ret = rw_unlock(&dhte->rwlock)) {
 
@@ -1908,7 +5011,7 @@ ht_insert_key(void *Eht, void *key, void *data)
 			 * been inserted, but I couldn't release the
 			 * lock? Tell the user there was an error.
 			 */
-			(void) ht_counter_add(&ht->stats.errors, 1);
+			(void) ht_counter_add(ht, hts_errors, 1);
 			errno = ret;
 			return (-2);
 
@@ -1917,6 +5020,7 @@ ht_insert_key(void *Eht, void *key, void *data)
 		/*
 		 * This one's in the table and I'm out 'o here!
 		 */
+		ht_evaluate(ht);
 		return (0);
 
 	} /* if ( ! (dhte->flags & htef_occupied)) {...} */
@@ -1941,15 +5045,14 @@ ht_insert_key(void *Eht, void *key, void *data)
 			 * only got here because dups are not allowed -- so we
 			 * had to search to make sure there wasn't one.
 			 */
-			(void) ht_average_increment(&ht->stats.searches,
-			    depth);
+			(void) ht_average_add(ht, hta_searches, depth, weight);
 
 			/*
 			 * We got a hit!
 			 *
 			 * Keep some stats to pay the rent.
 			 */
-			(void) ht_counter_add(&ht->stats.hits, 1);
+			(void) ht_counter_add(ht, hts_hits, weight);
 
 			/*
 			 * Set the error indicating that a duplicate
@@ -1965,7 +5068,7 @@ ht_insert_key(void *Eht, void *key, void *data)
 				 * allowed indication. Something BIGGER
 				 * is broken!
 				 */
-				(void) ht_counter_add(&ht->stats.errors, 1);
+				(void) ht_counter_add(ht, hts_errors, 1);
 				errno = ret;
 				return (-2);
 
@@ -1989,7 +5092,7 @@ ht_insert_key(void *Eht, void *key, void *data)
 	 */
 	if (! (ht->options & hto_dups_allowed)) {
 
-		(void) ht_average_increment(&ht->stats.searches, depth);
+		(void) ht_average_add(ht, hta_searches, depth, weight);
 
 	} /* if (! (ht->options & hto_dups_allowed)) {...} */
 
@@ -2002,159 +5105,239 @@ ht_insert_key(void *Eht, void *key, void *data)
 	 * is empty, allocate another slab of free ones.
 	 */
 
+	if (ret = ht_free_get(ht, &ohte)) {
+		(void) rw_unlock(&dhte->rwlock);
+		return (ret);
+
+	} /* if (ret = ht_free_get(ht, &ohte)) {...} */
+
 	/*
-	 * Take the free chain lock.
+	 * Copy the information into the entry to keep with the table
+	 * and mark it as occupied.
 	 */
-	if (ret = rw_wrlock(&ht->freelock)) {
+	ohte->flags    |= htef_occupied;
+	ohte->key	= key;
+	ohte->data	= data;
 
+	/*
+	 * Put this entry at the beginning of the chain, and we're
+	 * outa here!
+	 */
+	ohte->next = dhte->next;
+	dhte->next = ohte;
+	atomic_inc_ulong(&ht->entries);
+
+	/*
+	 * Update the chain depth stats.
+	 */
+	(void) ht_average_increment(ht, hta_depth, depth);
+
+	/*
+	 * Free the locks and we're outa here!
+	 */
+	if (ret = rw_unlock(&dhte->rwlock)) {
 		/*
-		 * Couldn't get the lock. Just leave the entry where it is.
+		 * Dilema! The entry could be inserted, but I couldn't
+		 * unlock the entry... We're screwed, the entry has
+		 * been hosed.  What should I tell the caller? For now
+		 * return the error to the caller.
 		 */
-		(void) rw_unlock(&dhte->rwlock);
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		errno = (errno ? errno : ret);
 		return (-2);
 
-	} /* if (rw_wrlock(&ht->freelock)) {...} */
+	} /* if (rw_unlock(&dhte->rwlock)) {...} */
 
 	/*
-	 * If there's nothing to take from the free chain. Make some more.
+	 * Okay, we're safe. The entry is in the table. Now, did we just cross
+	 * the threshold requiring the table to resize?
 	 */
-	while ((ohte = ht->freechain) == (hashtable_entry_t *)NULL) {
-		/*
-		 * Allocate a slab the same size as the table itself.
-		 */
-		slab = ht_create_slab(ht->table->header.entrycount);
-		if (slab == (hashtable_slab_t *)NULL) {
+	ht_evaluate(ht);
 
-			/*
-			 * Couldn't create any more free entries.
-			 */
-			(void) rw_unlock(&ht->freelock);
-			(void) rw_unlock(&dhte->rwlock);
-			(void) ht_counter_add(&ht->stats.errors, 1);
-			return (-1);
+	/*
+	 * All done...
+	 */
+	return (0);
 
-		} /* if (slab == (hashtable_slab_t *)NULL) {...} */
+} /* int ht_insert_key(hashtable_t *ht, void *key, void *data) {...} */
 
-		/*
-		 * Put the slab on the list of slabs.
-		 */
-		(void) ht_counter_add(&ht->stats.slabs, 1);
-		slab->header.next	= ht->slabs;
-		ht->slabs		= slab;
+/*
+ *
+ *  ssize_t
+ *  ht_insert_many(void *Eht, size_t count, void **keys, void **data);
+ *
+ *  Description:
+ *	Insert a batch of keys and their data, as ht_insert_key() would one
+ *	at a time. The keys are taken HT_BATCH at a time and hashed, and
+ *	the lines each one's insert starts on are prefetched, before any of
+ *	them goes in. An open addressing table is locked once for a batch;
+ *	other tables are locked per key, since a chained insert may have to
+ *	move chains or resize the table.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input - Pointer to the head of the table into which to insert
+ *		the keys passed.
+ *
+ *	size_t count
+ *		Input - Number of keys.
+ *
+ *	void **keys
+ *		Input - Pointers to the bytes of each key.
+ *
+ *	void **data
+ *		Input - The data to go with each key.
+ *
+ *  Return value:
+ *	ssize_t	The number of keys inserted. Inserting stops at the first key
+ *		that fails, so if that's less than count, keys[return value]
+ *		is the one that failed and errno is set as ht_insert_key()
+ *		sets it. The keys before it are all in the table.
+ */
+ssize_t
+ht_insert_many(void *Eht, size_t count, void **keys, void **data)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_t		*ht = (hashtable_t *)Eht;
+	hashtable_epoch_reader_t *reader; /* Concurrent epoch record.	*/
+	hashtable_entry_t	*hte;	/* Chain head.			*/
+	uint64_t		 hash[HT_BATCH]; /* Full hashes.	*/
+	hashtable_oa_t		*oa;	/* Slot buffer.			*/
+	size_t			 base;	/* First key of the batch.	*/
+	size_t			 n;	/* Keys in the batch.		*/
+	size_t			 i;	/* Key in the batch.		*/
+	size_t			 j;	/* Key inserted.		*/
+	int			 iret = 0; /* Insert return value.	*/
+	int			 ret;	/* Just a return value.		*/
 
-		/*
-		 * Dangle all the entries from the free chain.
-		 */
-		ohte = &slab->header.entry[slab->header.entrycount];
-		while (ohte-- != slab->header.entry) {
-			ohte->next	= ht->freechain;
-			ht->freechain	= ohte;
+	if (ht->options & hto_mapped) {
+		errno = EROFS;
+		return (0);
 
-		} /* while (--ohte != &slab->header.entry [...]) {...} */
+	} /* if (ht->options & hto_mapped) {...} */
+
+	for (base = 0; base < count; base += n) {
+		n = (count - base < HT_BATCH ? count - base : HT_BATCH);
 
 		/*
-		 * Update the free chain stats.
+		 * Chained tables only have their chain heads prefetched.
+		 * Their hash depends on the table size, which may change
+		 * between one insert and the next.
 		 */
-		(void) ht_average_update(&ht->stats.freechain,
-		    1,	/* Added them all at once. */
-		    slab->header.entrycount,
-		    ht->stats.freechain.current + slab->header.entrycount,
-		    ht->stats.freechain.current + slab->header.entrycount);
+		if (! (ht->options & hto_open_addressing)) {
+			if (errno = rw_rdlock(&ht->tablelock)) {
+				(void) ht_counter_add(ht, hts_errors, 1);
+				return ((ssize_t)base);
 
-	} /* while ((ohte = ht->freechain) == (... *)NULL) {...} */
+			} /* if (errno = rw_rdlock(&ht->tablelock)) {...} */
 
-	/*
-	 * Take ohte off the free chain.
-	 */
-	ht->freechain	= ohte->next;
-	ohte->next	= (hashtable_entry_t *)NULL;
-	(void) ht_average_increment(&ht->stats.freechain,
-	    ht->stats.freechain.current - 1);
+			for (i = 0; i < n; ++i) {
+				hte = ht_bucket(ht, keys[base + i]);
+				HT_PREFETCH(hte);
+
+			} /* for (i = 0; i < n; ++i) {...} */
+
+			(void) rw_unlock(&ht->tablelock);
+
+			for (i = 0; i < n; ++i) {
+				if (ht_insert_key(ht, keys[base + i],
+				    data[base + i])) {
+
+					return ((ssize_t)(base + i));
+
+				} /* if (ht_insert_key(ht, ...)) {...} */
+
+			} /* for (i = 0; i < n; ++i) {...} */
+
+			continue;
+
+		} /* if (! (ht->options & hto_open_addressing)) {...} */
 
-	/*
-	 * Put the free chain lock back.
-	 */
-	if (ret = rw_unlock(&ht->freelock)) {
 		/*
-		 * What should I do here? Returning would orphan the entry.
-		 * Just muddle forward.
+		 * Concurrent tables lock their stripes per key; the epoch
+		 * just keeps the buffer being prefetched around.
 		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
-		errno = (errno ? errno : ret);
+		if (ht->options & hto_concurrent) {
+			reader	= ht_epoch_enter();
+			oa	= ht->oa;
+			membar_consumer();
 
-	} /* if (rw_unlock(&ht->freelock)) {...} */
+			for (i = 0; i < n; ++i) {
+				hash[i] = (*(ht->hash_full))(keys[base + i],
+				    ht->keysize);
+				ht_oa_prefetch(ht, oa, hash[i]);
 
-	/*
-	 * Copy the information into the entry to keep with the table
-	 * and mark it as occupied.
-	 */
-	ohte->flags    |= htef_occupied;
-	ohte->key	= key;
-	ohte->data	= data;
+			} /* for (i = 0; i < n; ++i) {...} */
 
-	/*
-	 * Put this entry at the beginning of the chain, and we're
-	 * outa here!
-	 */
-	ohte->next = dhte->next;
-	dhte->next = ohte;
+			ht_epoch_exit(reader);
+
+			for (i = 0; i < n; ++i) {
+				if (ht_cc_insert_key(ht, keys[base + i],
+				    hash[i], data[base + i])) {
+
+					return ((ssize_t)(base + i));
+
+				} /* if (ht_cc_insert_key(ht, ...)) {...} */
+
+				ht_evaluate(ht);
+
+			} /* for (i = 0; i < n; ++i) {...} */
+
+			continue;
+
+		} /* if (ht->options & hto_concurrent) {...} */
+
+		if (errno = rw_wrlock(&ht->tablelock)) {
+			(void) ht_counter_add(ht, hts_errors, 1);
+			return ((ssize_t)base);
+
+		} /* if (errno = rw_wrlock(&ht->tablelock)) {...} */
+
+		oa = ht->oa;
+		for (i = 0; i < n; ++i) {
+			hash[i] = (*(ht->hash_full))(keys[base + i],
+			    ht->keysize);
+			ht_oa_prefetch(ht, oa, hash[i]);
+
+		} /* for (i = 0; i < n; ++i) {...} */
+
+		for (i = 0; i < n; ++i) {
+			if (iret = ht_oa_insert_key_(ht, keys[base + i],
+			    hash[i], data[base + i])) {
+
+				break;
 
-	/*
-	 * Update the chain depth stats.
-	 */
-	(void) ht_average_increment(&ht->stats.depth, depth);
+			} /* if (iret = ht_oa_insert_key_(ht, ...)) {...} */
 
-	/*
-	 * Free the locks and we're outa here!
-	 */
-	if (ret = rw_unlock(&dhte->rwlock)) {
-		/*
-		 * Dilema! The entry could be inserted, but I couldn't
-		 * unlock the entry... We're screwed, the entry has
-		 * been hosed.  What should I tell the caller? For now
-		 * return the error to the caller.
-		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
-		errno = (errno ? errno : ret);
-		return (-2);
+		} /* for (i = 0; i < n; ++i) {...} */
 
-	} /* if (rw_unlock(&dhte->rwlock)) {...} */
+		if (ret = rw_unlock(&ht->tablelock)) {
+			(void) ht_counter_add(ht, hts_errors, 1);
+			errno = ret;
+			iret = -2;
 
-	/*
-	 * Okay, we're safe. The entry is in the table. Now, did we just cross
-	 * the threshold requiring the table to resize?
-	 */
-	if ((ht->options & hto_resize_implicit) &&
-	    (ht->threshold_evaluate != NULL)) {
+		} /* if (ret = rw_unlock(&ht->tablelock)) {...} */
 
 		/*
-		 * Okay, I'm allowed to perform implicit resizes, and i have
-		 * a pointer to a funtion. Call it to see if a resize should be
-		 * done now.
+		 * The resize policy wants the table lock to itself.
 		 */
+		for (j = 0; j < i; ++j) {
+			ht_evaluate(ht);
 
-		ret = (*(ht->threshold_evaluate))(ht->table->header.entrycount,
-		    ht->stats.depth.count,
-		    ht->stats.depth.sum,
-		    ht->stats.searches.count,
-		    ht->stats.searches.sum);
+		} /* for (j = 0; j < i; ++j) {...} */
 
-		if (ret != 0) {
-			return (ht_resize(ht,
-			    ht->table->header.entrycount * 2));
+		if (iret != 0) {
+			return ((ssize_t)(base + i));
 
-		} /* if (ret != 0) {...} */
+		} /* if (iret != 0) {...} */
 
-	} /* if ((ht->options & hto_resize_implicit) && ...) {...} */
+	} /* for (base = 0; base < count; base += n) {...} */
 
-	/*
-	 * All done...
-	 */
-	return (0);
+	return ((ssize_t)count);
 
-} /* int ht_insert_key(hashtable_t *ht, void *key, void *data) {...} */
+} /* ssize_t ht_insert_many(void *Eht, size_t count, ...) {...} */
 
 /*
  *
@@ -2191,25 +5374,57 @@ ht_delete_key(void *Eht, void *key)
 	int			 ret;	/* Just a return value.		*/
 	int			 fret;	/* Free chain lock return.	*/
 	int			 pret;	/* Previous entry lock return.	*/
+	void			*data;	/* Data of the deleted entry.	*/
+
+	if (ht->options & hto_mapped) {
+		errno = EROFS;
+		return ((void *)NULL);
+
+	} /* if (ht->options & hto_mapped) {...} */
+
+	if (ht->options & hto_open_addressing) {
+		data = (ht->options & hto_concurrent ?
+		    ht_cc_delete_key(ht, key) :
+		    ht_oa_delete_key(ht, key));
+
+		if (data != NULL) {
+			ht_evaluate(ht);
+
+		} /* if (data != NULL) {...} */
+
+		return (data);
+
+	} /* if (ht->options & hto_open_addressing) {...} */
 
 	/*
 	 * Keep some stats.
 	 */
-	(void) ht_counter_add(&ht->stats.deletes, 1);
+	(void) ht_counter_add(ht, hts_deletes, 1);
 
 	/*
 	 * Take the table lock for writing.
 	 */
 	if (errno = rw_wrlock(&ht->tablelock)) {
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		return ((void *)NULL);
 
 	} /* if (rw_wrlock(&ht->tablelock)) {...} */
 
+	/*
+	 * Move this key's chain along with a few others if the table's
+	 * being resized.
+	 */
+	if (ht_migrate(ht, key, HT_MIGRATE_STEP)) {
+		(void) rw_unlock(&ht->tablelock);
+		return ((void *)NULL);
+
+	} /* if (ht_migrate(ht, key, HT_MIGRATE_STEP)) {...} */
+
 	/*
 	 * Locate the entry with this key.
 	 */
-	dhte = ht_locate_entry_(ht, key, rw_wrlock, &phte);
+	dhte = ht_locate_entry_(ht, (hashtable_entry_t *)NULL, key, rw_wrlock,
+	    &phte);
 
 	/*
 	 * If I got an entry, it's locked. If I didn't find an entry there's
@@ -2238,13 +5453,18 @@ ht_delete_key(void *Eht, void *key)
 		/*
 		 * Yes, so release the lock on the entry and bail!
 		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		(void) rw_unlock(&dhte->rwlock);
 		errno = ret;
 		return ((void *)NULL);
 
 	} /* if (ret != 0) {...} */
 
+	/*
+	 * Remember the data being deleted before the entry gets reused.
+	 */
+	data = dhte->data;
+
 	/*
 	 * Is this entry on a chain or in the table proper?
 	 */
@@ -2257,10 +5477,20 @@ ht_delete_key(void *Eht, void *key)
 		if (dhte->next == (hashtable_entry_t *)NULL) {
 
 			/*
-			 * Just mark this one an unoccupied.
+			 * Just mark this one an unoccupied and give back the
+			 * lock ht_locate_entry_() took for me.
 			 */
 			dhte->flags &= ~htef_occupied;
-			return (dhte->data);
+			atomic_dec_ulong(&ht->entries);
+			if (ret = rw_unlock(&dhte->rwlock)) {
+				(void) ht_counter_add(ht, hts_errors, 1);
+				errno = ret;
+				return ((void *)NULL);
+
+			} /* if (ret = rw_unlock(&dhte->rwlock)) {...} */
+
+			ht_evaluate(ht);
+			return (data);
 
 		} /* if (dhte->next == (hashtable_entry_t *)NULL) {...} */
 
@@ -2276,7 +5506,7 @@ ht_delete_key(void *Eht, void *key)
 			 * Ouch! Couldn't lock the entry.
 			 */
 			(void) rw_unlock(&phte->rwlock);
-			(void) ht_counter_add(&ht->stats.errors, 1);
+			(void) ht_counter_add(ht, hts_errors, 1);
 			errno = ret;
 			return ((void *)NULL);
 
@@ -2302,6 +5532,7 @@ ht_delete_key(void *Eht, void *key)
 	 * Mark the entry as empty, but leave it on the chain for a bit...
 	 */
 	dhte->flags	&= ~htef_occupied;
+	atomic_dec_ulong(&ht->entries);
 
 	/*
 	 * Get a write lock on the free chain so I can put this one on the
@@ -2314,7 +5545,7 @@ ht_delete_key(void *Eht, void *key)
 		 */
 		(void) rw_unlock(&phte->rwlock);
 		(void) rw_unlock(&dhte->rwlock);
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 		errno = ret;
 		return ((void *)NULL);
 
@@ -2326,6 +5557,7 @@ ht_delete_key(void *Eht, void *key)
 	phte->next	= dhte->next;	/* Out of the free chain.	*/
 	dhte->next	= ht->freechain; /* Pick up free chain head.	*/
 	ht->freechain	= dhte;		/* Point free chain here.	*/
+	++ht->freecount;
 
 	/*
 	 * Just need to put back the locks... for the free chain...
@@ -2335,7 +5567,7 @@ ht_delete_key(void *Eht, void *key)
 		/*
 		 * Ouch! How could this fail?
 		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 
 	} /* if (fret = rw_unlock(&ht->freelock)) {...} */
 
@@ -2347,7 +5579,7 @@ ht_delete_key(void *Eht, void *key)
 		/*
 		 * Could not put back the lock?
 		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 
 	} /* if (pret = rw_unlock(&phte->rwlock)) {...} */
 
@@ -2359,7 +5591,7 @@ ht_delete_key(void *Eht, void *key)
 		/*
 		 * The work's been done, but the entry seems to have problems!
 		 */
-		(void) ht_counter_add(&ht->stats.errors, 1);
+		(void) ht_counter_add(ht, hts_errors, 1);
 
 	} /* if (rw_unlock(&dhte->rwlock)) {...} */
 
@@ -2379,6 +5611,519 @@ ht_delete_key(void *Eht, void *key)
 	/*
 	 * All done.
 	 */
-	return (errno ? (void *)NULL : dhte->data);
+	if (errno) {
+		return ((void *)NULL);
+
+	} /* if (errno) {...} */
+
+	ht_evaluate(ht);
+	return (data);
 
 } /* int ht_delete_key(hashtable_t *ht, void *key) {...} */
+
+/*
+ *
+ *  ht_snapshot_t *
+ *  ht_snapshot(hashtable_t *Eht);
+ *
+ *  Description:
+ *	Copy the keys and data pointers of a table. The table lock is held
+ *	for writing while they're counted and copied, which keeps out every
+ *	insert and delete, even the stripe locked ones of a concurrent
+ *	table. A mapped table never changes, so it isn't locked at all.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input - Pointer to the table head.
+ *
+ *  Return value:
+ *	ht_snapshot_t * The snapshot, or NULL with errno set.
+ */
+ht_snapshot_t *
+ht_snapshot(void *Eht)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_t	*ht = (hashtable_t *)Eht;
+	ht_snapshot_t	*snap;		/* Snapshot to return.		*/
+	size_t		 count;		/* Entries in the table.	*/
+	int		 ret;		/* Just a return value.		*/
+
+	if (! (ht->options & hto_mapped) &&
+	    (ret = rw_wrlock(&ht->tablelock))) {
+
+		(void) ht_counter_add(ht, hts_errors, 1);
+		errno = ret;
+		return ((ht_snapshot_t *)NULL);
+
+	} /* if (! (ht->options & hto_mapped) && ...) {...} */
+
+	count	= ht_snapshot_walk(ht, (ht_snapshot_t *)NULL);
+	snap	= (ht_snapshot_t *)malloc(sizeof (*snap) +
+	    count * sizeof (void *) +
+	    count * ht->keysize);
+
+	if (snap != (ht_snapshot_t *)NULL) {
+		snap->count	= count;
+		snap->next	= 0;
+		snap->keysize	= ht->keysize;
+		snap->data	= (void **)&snap[1];
+		snap->keys	= (unsigned char *)&snap->data[count];
+		(void) ht_snapshot_walk(ht, snap);
+
+	} /* if (snap != (ht_snapshot_t *)NULL) {...} */
+
+	if (! (ht->options & hto_mapped) &&
+	    (ret = rw_unlock(&ht->tablelock))) {
+
+		(void) ht_counter_add(ht, hts_errors, 1);
+		(void) free(snap);
+		errno = ret;
+		return ((ht_snapshot_t *)NULL);
+
+	} /* if (! (ht->options & hto_mapped) && ...) {...} */
+
+	return (snap);
+
+} /* ht_snapshot_t *ht_snapshot(void *Eht) {...} */
+
+/*
+ *
+ *  int
+ *  ht_snapshot_next(ht_snapshot_t *snap, void **key, void **data);
+ *
+ *  Description:
+ *	Hand out the next entry of a snapshot.
+ *
+ *  Paramaters:
+ *	ht_snapshot_t *snap
+ *		Input/Output - The snapshot.
+ *
+ *	void **key
+ *		Output - The snapshot's copy of the key.
+ *
+ *	void **data
+ *		Output - The data pointer.
+ *
+ *  Return value:
+ *	int	Zero, or -1 with errno set to ENOENT at the end.
+ */
+int
+ht_snapshot_next(ht_snapshot_t *snap, void **key, void **data)
+{
+	if (snap->next >= snap->count) {
+		errno = ENOENT;
+		return (-1);
+
+	} /* if (snap->next >= snap->count) {...} */
+
+	*key	= &snap->keys[snap->next * snap->keysize];
+	*data	= snap->data[snap->next];
+	++snap->next;
+
+	return (0);
+
+} /* int ht_snapshot_next(ht_snapshot_t *snap, ...) {...} */
+
+/*
+ *
+ *  void
+ *  ht_snapshot_free(ht_snapshot_t *snap);
+ *
+ *  Description:
+ *	Free a snapshot.
+ *
+ *  Paramaters:
+ *	ht_snapshot_t *snap
+ *		Input - The snapshot.
+ *
+ *  Return value:
+ *	None.
+ */
+void
+ht_snapshot_free(ht_snapshot_t *snap)
+{
+	(void) free(snap);
+
+} /* void ht_snapshot_free(ht_snapshot_t *snap) {...} */
+
+/*
+ *
+ *  static int
+ *  ht_save_write(const char *path, const unsigned char *image, size_t size)
+ *
+ *  Description:
+ *	Write a file image under a temporary name, then rename it to path,
+ *	so that the file at path is always whole.
+ *
+ *  Paramaters:
+ *	const char *path
+ *		Input - Name of the file.
+ *
+ *	const unsigned char *image
+ *		Input - Bytes to write.
+ *
+ *	size_t size
+ *		Input - Number of bytes.
+ *
+ *  Return value:
+ *	int	Zero, or -1 with errno set.
+ *
+ */
+static int
+ht_save_write(const char *path, const unsigned char *image, size_t size)
+{
+	/*
+	 * Locals...
+	 */
+	char	*tmp;		/* Temporary name.		*/
+	size_t	 done;		/* Bytes written so far.	*/
+	ssize_t	 n;		/* Bytes from one write().	*/
+	int	 fd;		/* The temporary file.		*/
+	int	 err;		/* Saved errno.			*/
+
+	if ((tmp = (char *)malloc(strlen(path) + 32)) == (char *)NULL) {
+		return (-1);
+
+	} /* if ((tmp = (char *)malloc(...)) == NULL) {...} */
+
+	(void) sprintf(tmp, "%s.%ld", path, (long)getpid());
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		err = errno;
+		(void) free(tmp);
+		errno = err;
+		return (-1);
+
+	} /* if ((fd = open(tmp, ...)) < 0) {...} */
+
+	for (done = 0; done < size; done += n) {
+		if ((n = write(fd, image + done, size - done)) < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+
+			} /* if (errno == EINTR) {...} */
+
+			break;
+
+		} /* if ((n = write(fd, ...)) < 0) {...} */
+
+	} /* for (done = 0; done < size; done += n) {...} */
+
+	err = errno;
+	if (close(fd) != 0 && done == size) {
+		err = errno;
+		done = 0;
+
+	} /* if (close(fd) != 0 && done == size) {...} */
+
+	if (done < size || rename(tmp, path) != 0) {
+		err = (done < size ? err : errno);
+		(void) unlink(tmp);
+		(void) free(tmp);
+		errno = err;
+		return (-1);
+
+	} /* if (done < size || rename(tmp, path) != 0) {...} */
+
+	(void) free(tmp);
+	return (0);
+
+} /* int ht_save_write(const char *path, ...) {...} */
+
+/*
+ *
+ *  int
+ *  ht_save(hashtable_t *Eht, const char *path, ht_datalen_t datalen);
+ *
+ *  Description:
+ *	Write a table to a file for ht_map(). A snapshot is taken, so the
+ *	table is only locked while it's copied. Its entries are then placed
+ *	in a new open addressing image with room to keep the slots no more
+ *	than 3/4 full, so lookups in the mapped table stay short, and the
+ *	image written out.
+ *
+ *  Paramaters:
+ *	hashtable_t *Eht
+ *		Input - Pointer to the table head.
+ *
+ *	const char *path
+ *		Input - Name of the file to write.
+ *
+ *	ht_datalen_t datalen
+ *		Input - Gives the bytes of each entry's data to save, or NULL
+ *		for strings.
+ *
+ *  Return value:
+ *	int	Zero, or -1 with errno set.
+ */
+int
+ht_save(void *Eht, const char *path, ht_datalen_t datalen)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_t		*ht = (hashtable_t *)Eht;
+	ht_snapshot_t		*snap;		/* The entries.		*/
+	hashtable_file_t	*file;		/* File header.		*/
+	hashtable_file_slot_t	*slots;		/* File slots.		*/
+	hashtable_oa_t		 oa;		/* For ht_oa_place().	*/
+	unsigned char		*image;		/* The file's bytes.	*/
+	unsigned char		*key;		/* Entry's key.		*/
+	size_t			 capacity;	/* # slots.		*/
+	size_t			 size;		/* Bytes in the file.	*/
+	size_t			 off;		/* Next free offset.	*/
+	size_t			 len;		/* Bytes of data.	*/
+	size_t			 n;		/* Entry number.	*/
+	size_t			 i;		/* Slot number.		*/
+	uint64_t		 hash;		/* Key's full hash.	*/
+	int			 depth;		/* Groups probed.	*/
+	int			 ret;		/* Just a return value.	*/
+
+	/*
+	 * The file names its hash, so it has to be one of ours.
+	 */
+	if ((ht->hash_full != ht_hash_mix_full &&
+	    ht->hash_full != ht_hash_wide_full) ||
+	    ht->key_compare != bcmp) {
+
+		errno = ENOTSUP;
+		return (-1);
+
+	} /* if ((ht->hash_full != ht_hash_mix_full && ...) || ...) {...} */
+
+	if ((snap = ht_snapshot(ht)) == (ht_snapshot_t *)NULL) {
+		return (-1);
+
+	} /* if ((snap = ht_snapshot(ht)) == NULL) {...} */
+
+	capacity = ht_size_pow2(snap->count + snap->count / 3 + 1);
+	if (capacity < HT_OA_GROUP) {
+		capacity = HT_OA_GROUP;
+
+	} /* if (capacity < HT_OA_GROUP) {...} */
+
+	/*
+	 * Size the image: header, control bytes, slots, then the long keys
+	 * and the data.
+	 */
+	size = HT_FILE_ROUND(sizeof (*file)) +
+	    capacity +
+	    capacity * sizeof (*slots);
+
+	for (n = 0; n < snap->count; ++n) {
+		if (ht->keysize > HT_INLINE_KEY) {
+			size += HT_FILE_ROUND(ht->keysize);
+
+		} /* if (ht->keysize > HT_INLINE_KEY) {...} */
+
+		if (snap->data[n] != NULL) {
+			len = (datalen != (ht_datalen_t)NULL ?
+			    (*datalen)(snap->data[n]) :
+			    strlen((char *)snap->data[n]) + 1);
+			size += HT_FILE_ROUND(len);
+
+		} /* if (snap->data[n] != NULL) {...} */
+
+	} /* for (n = 0; n < snap->count; ++n) {...} */
+
+	if ((image = (unsigned char *)calloc(1, size)) == NULL) {
+		ht_snapshot_free(snap);
+		return (-1);
+
+	} /* if ((image = (unsigned char *)calloc(1, size)) == NULL) {...} */
+
+	file		= (hashtable_file_t *)image;
+	file->magic	= HT_FILE_MAGIC;
+	file->version	= HT_FILE_VERSION;
+	file->keysize	= ht->keysize;
+	file->hash	= (ht->hash_full == ht_hash_wide_full ?
+	    HT_FILE_HASH_WIDE :
+	    HT_FILE_HASH_MIX);
+	file->capacity	= capacity;
+	file->used	= snap->count;
+	file->ctrl	= HT_FILE_ROUND(sizeof (*file));
+	file->slots	= file->ctrl + capacity;
+	file->size	= size;
+
+	oa.capacity	= capacity;
+	oa.ctrl		= image + file->ctrl;
+	slots		= (hashtable_file_slot_t *)(image + file->slots);
+	off		= file->slots + capacity * sizeof (*slots);
+	(void) memset(oa.ctrl, HT_OA_EMPTY, capacity);
+
+	/*
+	 * Place each entry as an insert into an open addressing table would.
+	 */
+	for (n = 0; n < snap->count; ++n) {
+		key	= &snap->keys[n * ht->keysize];
+		hash	= (*(ht->hash_full))(key, ht->keysize);
+		i	= ht_oa_place(&oa, hash, &depth);
+		oa.ctrl[i] = (unsigned char)(hash & 0x7F);
+
+		if (ht->keysize <= HT_INLINE_KEY) {
+			(void) memcpy(slots[i].key.bytes, key, ht->keysize);
+
+		} else /* if (ht->keysize > HT_INLINE_KEY) */ {
+			slots[i].key.offset = off;
+			(void) memcpy(image + off, key, ht->keysize);
+			off += HT_FILE_ROUND(ht->keysize);
+
+		} /* if (ht->keysize <= HT_INLINE_KEY) {...} else {...} */
+
+		if (snap->data[n] != NULL) {
+			len = (datalen != (ht_datalen_t)NULL ?
+			    (*datalen)(snap->data[n]) :
+			    strlen((char *)snap->data[n]) + 1);
+			slots[i].data = off;
+			(void) memcpy(image + off, snap->data[n], len);
+			off += HT_FILE_ROUND(len);
+
+		} /* if (snap->data[n] != NULL) {...} */
+
+	} /* for (n = 0; n < snap->count; ++n) {...} */
+
+	ht_snapshot_free(snap);
+
+	ret = ht_save_write(path, image, size);
+	(void) free(image);
+
+	return (ret);
+
+} /* int ht_save(void *Eht, const char *path, ...) {...} */
+
+/*
+ *
+ *  void *
+ *  ht_map(const char *path);
+ *
+ *  Description:
+ *	Map a file written by ht_save() as a read-only table. After the
+ *	header is checked against the file, the table head is all there is
+ *	to build.
+ *
+ *  Paramaters:
+ *	const char *path
+ *		Input - Name of the file.
+ *
+ *  Return value:
+ *	void *	The table head, or NULL with errno set.
+ */
+void *
+ht_map(const char *path)
+{
+	/*
+	 * Locals...
+	 */
+	hashtable_t		*ht;		/* Table being made.	*/
+	hashtable_map_t		*map;		/* Its mapping.		*/
+	const hashtable_file_t	*file;		/* File header.		*/
+	struct stat		 st;		/* File size.		*/
+	void			*base;		/* Where it's mapped.	*/
+	int			 fd;		/* The file.		*/
+	int			 err;		/* Saved errno.		*/
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return ((void *)NULL);
+
+	} /* if ((fd = open(path, O_RDONLY)) < 0) {...} */
+
+	if (fstat(fd, &st) != 0) {
+		err = errno;
+		(void) close(fd);
+		errno = err;
+		return ((void *)NULL);
+
+	} /* if (fstat(fd, &st) != 0) {...} */
+
+	if (st.st_size < (off_t)sizeof (*file)) {
+		(void) close(fd);
+		errno = EINVAL;
+		return ((void *)NULL);
+
+	} /* if (st.st_size < (off_t)sizeof (*file)) {...} */
+
+	base = mmap((void *)NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+	    fd, 0);
+	err = errno;
+	(void) close(fd);
+	if (base == MAP_FAILED) {
+		errno = err;
+		return ((void *)NULL);
+
+	} /* if (base == MAP_FAILED) {...} */
+
+	/*
+	 * Make sure the file is one of ours, whole, and from a machine that
+	 * lays it out the same way.
+	 */
+	file = (const hashtable_file_t *)base;
+	if (file->magic != HT_FILE_MAGIC ||
+	    file->version != HT_FILE_VERSION ||
+	    file->size != (uint64_t)st.st_size ||
+	    file->keysize == 0 ||
+	    file->hash > HT_FILE_HASH_WIDE ||
+	    file->capacity < HT_OA_GROUP ||
+	    (file->capacity & (file->capacity - 1)) != 0 ||
+	    file->used >= file->capacity ||
+	    file->ctrl < sizeof (*file) ||
+	    file->slots != file->ctrl + file->capacity ||
+	    file->slots % HT_FILE_ALIGN != 0 ||
+	    file->slots + file->capacity * sizeof (hashtable_file_slot_t) >
+	    file->size) {
+
+		(void) munmap(base, (size_t)st.st_size);
+		errno = EINVAL;
+		return ((void *)NULL);
+
+	} /* if (file->magic != HT_FILE_MAGIC || ...) {...} */
+
+	ht	= (hashtable_t *)malloc(sizeof (*ht));
+	map	= (hashtable_map_t *)malloc(sizeof (*map));
+	if (ht == (hashtable_t *)NULL || map == (hashtable_map_t *)NULL) {
+		(void) free(ht);
+		(void) free(map);
+		(void) munmap(base, (size_t)st.st_size);
+		errno = ENOMEM;
+		return ((void *)NULL);
+
+	} /* if (ht == NULL || map == NULL) {...} */
+
+	map->base	= (const unsigned char *)base;
+	map->size	= (size_t)st.st_size;
+	map->capacity	= file->capacity;
+	map->used	= file->used;
+	map->ctrl	= map->base + file->ctrl;
+	map->slots	= (const hashtable_file_slot_t *)(map->base +
+	    file->slots);
+
+	/*
+	 * Only the fields a mapped table looks at need be set.
+	 */
+	(void) memset(ht, 0, sizeof (*ht));
+	ht->keysize	= file->keysize;
+	ht->options	= hto_open_addressing | hto_mapped;
+	ht->minents	= map->capacity;
+	ht->entries	= map->used;
+	ht->key_compare	= bcmp;
+	ht->hash_compute = (file->hash == HT_FILE_HASH_WIDE ?
+	    ht_hash_wide :
+	    ht_hash_mix);
+	ht->hash_full	= (file->hash == HT_FILE_HASH_WIDE ?
+	    ht_hash_wide_full :
+	    ht_hash_mix_full);
+	ht->map		= map;
+
+	if (ht_stats_init(ht)) {
+		(void) free(ht);
+		(void) free(map);
+		(void) munmap(base, (size_t)st.st_size);
+		errno = ENOMEM;
+		return ((void *)NULL);
+
+	} /* if (ht_stats_init(ht)) {...} */
+
+	return ((void *)ht);
+
+} /* void *ht_map(const char *path) {...} */
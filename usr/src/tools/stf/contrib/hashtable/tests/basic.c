@@ -61,11 +61,16 @@ static const char usage[] = {
 " Usage:\n"
 "	basic	[-create <numents> <keysize> <options>]\n"
 "		[-resize <numents>]\n"
+"		[-stats]\n"
 "		[-destroy]\n"
 "		[-insert <key> <data>]\n"
 "		[-delete <key>]\n"
 "		[-file <filename>]\n"
 "		[-ignore [<count>]]\n"
+"		[-batch <count>]\n"
+"		[-save <filename>]\n"
+"		[-map <filename>]\n"
+"		[-snapshot]\n"
 "\n"
 "	Where;\n"
 "		-create <numents> <keysize> <options>\n"
@@ -76,6 +81,11 @@ static const char usage[] = {
 "		-resize <numents>\n"
 "			resizes the table to have <numents> entries.\n"
 "\n"
+"		-stats\n"
+"			prints the table statistics from ht_stats(). It\n"
+"			fails if they count any errors, or more hits than\n"
+"			lookups.\n"
+"\n"
 "		-destroy\n"
 "			destroys the table.\n"
 "\n"
@@ -104,6 +114,25 @@ static const char usage[] = {
 "			processing following commands. This command may\n"
 "			be peppered within any string of commands.\n"
 "\n"
+"		-batch <count>\n"
+"			inserts <count> keys of its own with\n"
+"			ht_insert_many(), locates them and as many absent\n"
+"			keys with ht_locate_many(), and deletes them again.\n"
+"			<count> must fit in <keysize> - 1 decimal digits.\n"
+"\n"
+"		-save <filename>\n"
+"			saves the table to <filename> with ht_save().\n"
+"\n"
+"		-map <filename>\n"
+"			maps a table saved in <filename> with ht_map().\n"
+"			It replaces the current table, which should have\n"
+"			been destroyed first.\n"
+"\n"
+"		-snapshot\n"
+"			takes an ht_snapshot() of the table and checks\n"
+"			that each of its entries can be located, and that\n"
+"			it holds as many entries as ht_stats() counts.\n"
+"\n"
 "		-verbose <level>\n"
 "			Sets the verbosity to <level>. The higher the\n"
 "			number, the more progress message get printed.\n"
@@ -125,19 +154,25 @@ static const char usage[] = {
  */
 typedef enum keyword_numbers {
 	k_min_			= 0,
-	k_create		= k_min_,
-	k_delete	/*	= 1	*/,
-	k_destroy	/*	= 2	*/,
-	k_file		/*	= 3	*/,
-	k_ignore	/*	= 4	*/,
-	k_insert	/*	= 5	*/,
-	k_locate	/*	= 6	*/,
-	k_resize	/*	= 7	*/,
-	k_verbose	/*	= 8	*/,
+	k_batch			= k_min_,
+	k_create	/*	= 1	*/,
+	k_delete	/*	= 2	*/,
+	k_destroy	/*	= 3	*/,
+	k_file		/*	= 4	*/,
+	k_ignore	/*	= 5	*/,
+	k_insert	/*	= 6	*/,
+	k_locate	/*	= 7	*/,
+	k_map		/*	= 8	*/,
+	k_resize	/*	= 9	*/,
+	k_save		/*	= 10	*/,
+	k_snapshot	/*	= 11	*/,
+	k_stats		/*	= 12	*/,
+	k_verbose	/*	= 13	*/,
 	k_max_
 } keyword_t;
 
 static const char *keywords[] = {
+	"-batch",
 	"-create",
 	"-delete",
 	"-destroy",
@@ -145,7 +180,11 @@ static const char *keywords[] = {
 	"-ignore",
 	"-insert",
 	"-locate",
+	"-map",
 	"-resize",
+	"-save",
+	"-snapshot",
+	"-stats",
 	"-verbose",
 	(char *)NULL
 };
@@ -400,6 +439,163 @@ keyword_locate(const char *table[], int entries, char *keyword)
 
 } /* static int keyword_locate(char *table[], ..., char *keyword) {...} */
 
+/*
+ * static int
+ * batch_check(void *ht, int keysize, ht_option_t options, int count);
+ *
+ * Description:
+ *	Run count keys of its own through ht_insert_many(), ht_locate_many()
+ *	and ht_delete_key(), checking each result against the scalar calls'
+ *	contract. The keys start with a '~' so that they can't collide with
+ *	those from the command files, and they are all deleted again before
+ *	returning, so that the table is left as it was found.
+ *
+ * Parameters:
+ *	void *ht
+ *		Input - The table to check.
+ *
+ *	int keysize
+ *		Input - The table's key size.
+ *
+ *	ht_option_t options
+ *		Input - The table's options.
+ *
+ *	int count
+ *		Input - The number of keys to use.
+ *
+ * Return value:
+ *	int	EXIT_SUCCESS if every check passed, else EXIT_FAILURE.
+ */
+static int
+batch_check(void *ht, int keysize, ht_option_t options, int count)
+{
+	/*
+	 * Locals...
+	 */
+	char	 *buf;		/* Keys, keysize + 1 bytes apart.	*/
+	void	**keys;		/* Present and absent keys, by turns.	*/
+	void	**data;		/* Data located.			*/
+	ssize_t	  n;		/* Return from the batch calls.		*/
+	int	  limit;	/* Keys the key size can tell apart.	*/
+	int	  i;		/* Key number.				*/
+	int	  ret = EXIT_FAILURE;
+
+	for (limit = 1, i = 1; i < keysize && limit < count; ++i) {
+		limit *= 10;
+
+	} /* for (limit = 1, i = 1; ...) {...} */
+
+	if (count < 1 || keysize < 2 || limit < count) {
+		em("**** Error: -batch %d won't fit %d byte keys.\n",
+		    count,
+		    keysize);
+
+		return (EXIT_FAILURE);
+
+	} /* if (count < 1 || keysize < 2 || ...) {...} */
+
+	buf	= (char *)malloc((size_t)count * 2 * (keysize + 1));
+	keys	= (void **)malloc((size_t)count * 2 * sizeof (void *));
+	data	= (void **)malloc((size_t)count * 2 * sizeof (void *));
+	if (buf == NULL || keys == NULL || data == NULL) {
+		em("**** Error: malloc() failed for %d keys.\n", count);
+		goto out;
+
+	} /* if (buf == NULL || keys == NULL || data == NULL) {...} */
+
+	/*
+	 * Even keys get inserted, odd ones never do.
+	 */
+	for (i = 0; i < count * 2; ++i) {
+		keys[i] = &buf[(size_t)i * (keysize + 1)];
+		(void) sprintf(keys[i], "%c%0*d",
+		    (i & 1 ? '^' : '~'),
+		    keysize - 1,
+		    i / 2);
+
+	} /* for (i = 0; i < count * 2; ++i) {...} */
+
+	for (i = 0; i < count; ++i) {
+		keys[i] = keys[i * 2];
+		data[i] = keys[i * 2 + 1];
+
+	} /* for (i = 0; i < count; ++i) {...} */
+
+	(void) memcpy(&keys[count], data, (size_t)count * sizeof (void *));
+
+	if ((n = ht_insert_many(ht, count, keys, keys)) != count) {
+		em("**** Error: ht_insert_many(%d) returned %ld, ",
+		    count,
+		    (long)n);
+		em("errno = %d - %s\n", errno, strerror(errno));
+		goto out;
+
+	} /* if ((n = ht_insert_many(...)) != count) {...} */
+
+	if ((n = ht_locate_many(ht, count * 2, keys, data)) != count) {
+		em("**** Error: ht_locate_many(%d) found %ld of %d keys.\n",
+		    count * 2,
+		    (long)n,
+		    count);
+		goto out;
+
+	} /* if ((n = ht_locate_many(...)) != count) {...} */
+
+	for (i = 0; i < count * 2; ++i) {
+		if (data[i] != (i < count ? keys[i] : NULL)) {
+			em("**** Error: ht_locate_many() returned %p for ",
+			    data[i]);
+			em("key \"%s\".\n", (char *)keys[i]);
+			goto out;
+
+		} /* if (data[i] != (i < count ? keys[i] : NULL)) {...} */
+
+	} /* for (i = 0; i < count * 2; ++i) {...} */
+
+	/*
+	 * Without hto_dups_allowed, the first key must stop a second batch.
+	 */
+	if (! (options & hto_dups_allowed) &&
+	    ((n = ht_insert_many(ht, count, keys, keys)) != 0 ||
+	    errno != EEXIST)) {
+
+		em("**** Error: ht_insert_many(%d) of duplicates ", count);
+		em("returned %ld, errno = %d - %s\n",
+		    (long)n,
+		    errno,
+		    strerror(errno));
+		goto out;
+
+	} /* if (! (options & hto_dups_allowed) && ...) {...} */
+
+	for (i = 0; i < count; ++i) {
+		if (ht_delete_key(ht, keys[i]) != keys[i]) {
+			em("**** Error: ht_delete_key(\"%s\") failed, ",
+			    (char *)keys[i]);
+			em("errno = %d - %s\n", errno, strerror(errno));
+			goto out;
+
+		} /* if (ht_delete_key(ht, keys[i]) != keys[i]) {...} */
+
+	} /* for (i = 0; i < count; ++i) {...} */
+
+	if ((n = ht_locate_many(ht, count, keys, data)) != 0) {
+		em("**** Error: ht_locate_many() found %ld deleted keys.\n",
+		    (long)n);
+		goto out;
+
+	} /* if ((n = ht_locate_many(ht, count, keys, data)) != 0) {...} */
+
+	ret = EXIT_SUCCESS;
+
+out:
+	free(data);
+	free(keys);
+	free(buf);
+	return (ret);
+
+} /* static int batch_check(void *ht, int keysize, ...) {...} */
+
 int
 main(int argc, char *argv[])
 {
@@ -432,6 +628,9 @@ main(int argc, char *argv[])
 	char	**fargvt;		/* Current token in argv list.	*/
 	char	**fargv2;		/* For resizing.		*/
 	char	*ft;			/* Token in line.		*/
+	ht_stats_t stats;		/* Table statistics.		*/
+	ht_snapshot_t *snap;		/* Snapshot of the table.	*/
+	size_t	 snapcount;		/* Entries in the snapshot.	*/
 	struct	 inserted_data {
 		struct	 inserted_data	*next;
 		char			*key;
@@ -463,6 +662,28 @@ main(int argc, char *argv[])
 	last_keyword = k_max_;
 	while (*++argv != (char *)NULL) {
 		switch (this_keyword = keyword_locate(keywords, kc, *argv)) {
+		case k_batch: {
+			if (*++argv == (char *)NULL) {
+				em("**** Error: Missing required parameter ");
+				em("<count>\n");
+				return (EXIT_FAILURE);
+
+			} /* if (*++argv == (char *)NULL) {...} */
+			numents = atoi(*argv);
+			info((this_keyword != last_keyword ? -1 : 0),
+			    "batch_check(ht, %d)\n",
+			    numents);
+
+			if (batch_check(ht, keysize, options, numents) !=
+			    EXIT_SUCCESS) {
+
+				return (EXIT_FAILURE);
+
+			} /* if (batch_check(ht, ...) != EXIT_SUCCESS) {...} */
+
+			break;
+
+		} /* case k_batch: {...} */
 		case k_create: {
 			/*
 			 * -create <numents>
@@ -888,6 +1109,30 @@ main(int argc, char *argv[])
 			break;
 
 		} /* case k_locate: {...} */
+		case k_map: {
+			if (*++argv == (char *)NULL) {
+				em("**** Error: Missing required parameters ");
+				em("<filename>\n");
+				return (EXIT_FAILURE);
+
+			} /* if (*++argv == (char *)NULL) {...} */
+			info((this_keyword != last_keyword ? -1 : 0),
+			    "ht_map(\"%s\")\n",
+			    *argv);
+
+			if ((ht = ht_map(*argv)) == (void *)NULL) {
+				em("**** Error: ht_map(\"%s\") ", *argv);
+				em("returned NULL, errno = %d - %s\n",
+				    errno,
+				    strerror(errno));
+
+				return (EXIT_FAILURE);
+
+			} /* if ((ht = ht_map(*argv)) == (void *)NULL) {...} */
+
+			break;
+
+		} /* case k_map: {...} */
 		case k_resize: {
 			if (*++argv == (char *)NULL) {
 				em("**** Error: Missing required parameters ");
@@ -915,6 +1160,117 @@ main(int argc, char *argv[])
 			break;
 
 		} /* case k_resize: {...} */
+		case k_save: {
+			if (*++argv == (char *)NULL) {
+				em("**** Error: Missing required parameters ");
+				em("<filename>\n");
+				return (EXIT_FAILURE);
+
+			} /* if (*++argv == (char *)NULL) {...} */
+			info((this_keyword != last_keyword ? -1 : 0),
+			    "ht_save(ht, \"%s\", NULL)\n",
+			    *argv);
+
+			if (ret = ht_save(ht, *argv, NULL)) {
+				em("**** Error: ht_save(ht, \"%s\") ", *argv);
+				em("returned %d - errno = %d - %s\n",
+				    ret,
+				    errno,
+				    strerror(errno));
+
+				return (EXIT_FAILURE);
+
+			} /* if (ret = ht_save(ht, *argv, NULL)) {...} */
+
+			break;
+
+		} /* case k_save: {...} */
+		case k_snapshot: {
+			info((this_keyword != last_keyword ? -1 : 0),
+			    "ht_snapshot(ht)\n");
+
+			if ((snap = ht_snapshot(ht)) == (ht_snapshot_t *)NULL) {
+				em("**** Error: ht_snapshot(ht) returned ");
+				em("NULL, errno = %d - %s\n",
+				    errno,
+				    strerror(errno));
+
+				return (EXIT_FAILURE);
+
+			} /* if ((snap = ht_snapshot(ht)) == NULL) {...} */
+
+			for (snapcount = 0;
+			    ht_snapshot_next(snap, (void **)&key,
+			    (void **)&data) == 0;
+			    ++snapcount) {
+
+				if (ht_locate_key(ht, key) != data) {
+					em("**** Error: Snapshot entry %lu ",
+					    (ulong_t)snapcount);
+					em("doesn't match the table.\n");
+					ht_snapshot_free(snap);
+					return (EXIT_FAILURE);
+
+				} /* if (ht_locate_key(ht, key) != ...) {...} */
+
+			} /* for (snapcount = 0; ...) {...} */
+
+			ht_snapshot_free(snap);
+
+			if (ht_stats(ht, &stats) ||
+			    stats.entries != snapcount) {
+
+				em("**** Error: Snapshot holds %lu entries, ",
+				    (ulong_t)snapcount);
+				em("ht_stats() counts %lu.\n",
+				    (ulong_t)stats.entries);
+
+				return (EXIT_FAILURE);
+
+			} /* if (ht_stats(ht, &stats) || ...) {...} */
+
+			break;
+
+		} /* case k_snapshot: {...} */
+		case k_stats: {
+			if (ret = ht_stats(ht, &stats)) {
+				em("**** Error: ht_stats(ht, &stats) returned");
+				em("%d - errno = %d - %s\n",
+				    ret,
+				    errno,
+				    strerror(errno));
+
+				return (EXIT_FAILURE);
+
+			} /* if (ret = ht_stats(ht, &stats)) {...} */
+
+			info((this_keyword != last_keyword ? -1 : 0),
+			    "ht_stats(ht): %lu of %lu entries, %llu lookups, "
+			    "%llu hits, %llu inserts, %llu deletes, "
+			    "%llu resizes, %llu errors\n",
+			    (ulong_t)stats.entries,
+			    (ulong_t)stats.numents,
+			    stats.probes,
+			    stats.hits,
+			    stats.inserts,
+			    stats.deletes,
+			    stats.resizes,
+			    stats.errors);
+
+			if (stats.errors != 0 || stats.hits > stats.probes) {
+				em("**** Error: ht_stats(ht) counted %llu ",
+				    stats.errors);
+				em("errors and %llu hits in %llu lookups.\n",
+				    stats.hits,
+				    stats.probes);
+
+				return (EXIT_FAILURE);
+
+			} /* if (stats.errors != 0 || ...) {...} */
+
+			break;
+
+		} /* case k_stats: {...} */
 		case k_verbose: {
 			if (*++argv == (char *)NULL) {
 				em("**** Error: Missing required parameter ");
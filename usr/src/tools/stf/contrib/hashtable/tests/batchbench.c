@@ -0,0 +1,276 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright 2007 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <hashtable.h>
+
+static const char usage[] =
+"\n"
+"Usage:	batchbench [<entries> [<lookups> [<batch> [<keysize>]]]]\n"
+"\n"
+"Where:\n"
+"	<entries>	is the number of keys loaded into each table. Make it\n"
+"			big enough that the table won't fit in the cache,\n"
+"			or there is nothing for prefetching to hide.\n"
+"			(Default 1000000.)\n"
+"	<lookups>	is the number of lookups made each way.\n"
+"			(Default 4000000.)\n"
+"	<batch>		is the number of keys passed to each call of\n"
+"			ht_locate_many() and ht_insert_many().\n"
+"			(Default 64.)\n"
+"	<keysize>	is the size of the keys, from 4 bytes up.\n"
+"			(Default 8.)\n"
+"\n"
+"Output:\n"
+"	Two lines per table kind, one for inserts and one for lookups,\n"
+"	giving the rate of the scalar and batched calls and the speedup of\n"
+"	the batched ones.\n"
+"\n";
+
+/*
+ * The kinds of table measured.
+ */
+static const struct {
+	const char	*name;
+	ht_option_t	 options;
+} kinds[] = {
+	{ "chained",		0			},
+	{ "open addressing",	hto_open_addressing	},
+	{ "concurrent",		hto_concurrent		},
+};
+
+#define	NKINDS	(sizeof (kinds) / sizeof (kinds[0]))
+
+static char		*keys;		/* Loaded keys, keysize apart.	*/
+static int		 keysize;	/* Bytes per key.		*/
+
+/*
+ *
+ *  static void
+ *  make_key(char *key, unsigned int n)
+ *
+ *  Description:
+ *	Fill in key number n: its number up front, padding behind.
+ *
+ */
+static void
+make_key(char *key, unsigned int n)
+{
+	(void) memset(key, 'k', keysize);
+	(void) memcpy(key, &n, sizeof (n));
+
+} /* void make_key(char *key, unsigned int n) {...} */
+
+/*
+ *
+ *  static void *
+ *  load(ht_option_t options, int entries, void **vkeys, int batch)
+ *
+ *  Description:
+ *	Create a table sized for entries keys and load them, one at a time
+ *	if batch is zero, else batch at a time. Each key is its own data.
+ *	Returns the table, or NULL if any step failed.
+ *
+ */
+static void *
+load(ht_option_t options, int entries, void **vkeys, int batch)
+{
+	/*
+	 * Locals...
+	 */
+	void		*ht;		/* New table.		*/
+	int		 n;		/* Keys this call.	*/
+	int		 i;		/* Key number.		*/
+
+	if ((ht = ht_create(entries, keysize, options)) == NULL) {
+		return (NULL);
+
+	} /* if ((ht = ht_create(...)) == NULL) {...} */
+
+	for (i = 0; i < entries; i += n) {
+		if (batch == 0) {
+			n = 1;
+			if (ht_insert_key(ht, vkeys[i], vkeys[i]) != 0) {
+				break;
+
+			} /* if (ht_insert_key(ht, ...) != 0) {...} */
+
+			continue;
+
+		} /* if (batch == 0) {...} */
+
+		n = (entries - i < batch ? entries - i : batch);
+		if (ht_insert_many(ht, n, &vkeys[i], &vkeys[i]) != n) {
+			break;
+
+		} /* if (ht_insert_many(ht, ...) != n) {...} */
+
+	} /* for (i = 0; i < entries; i += n) {...} */
+
+	if (i < entries) {
+		(void) ht_destroy(ht);
+		return (NULL);
+
+	} /* if (i < entries) {...} */
+
+	return (ht);
+
+} /* void *load(ht_option_t options, ...) {...} */
+
+int
+main(int argc, char *argv[])
+{
+	void		*ht;		/* Table being measured.	*/
+	void		**vkeys;	/* Pointers to the keys.	*/
+	void		**order;	/* Keys in lookup order.	*/
+	void		**data;		/* Data located.		*/
+	hrtime_t	 start;		/* Start of a run.		*/
+	double		 scalar;	/* Scalar calls per second.	*/
+	double		 batched;	/* Batched calls per second.	*/
+	unsigned int	 x = 1;		/* Pseudo random state.		*/
+	long		 bad;		/* Misses and errors.		*/
+	int		 entries;	/* Number of loaded keys.	*/
+	int		 lookups;	/* Lookups each way.		*/
+	int		 batch;		/* Keys per batched call.	*/
+	int		 n;		/* Keys this call.		*/
+	int		 k;		/* Table kind.			*/
+	int		 i;		/* Key or lookup number.	*/
+	int		 ret = EXIT_SUCCESS;
+
+	entries		= (argc > 1 ? atoi(argv[1]) : 1000000);
+	lookups		= (argc > 2 ? atoi(argv[2]) : 4000000);
+	batch		= (argc > 3 ? atoi(argv[3]) : 64);
+	keysize		= (argc > 4 ? atoi(argv[4]) : 8);
+
+	if (entries < 1 || lookups < 1 || batch < 1 ||
+	    keysize < (int)sizeof (unsigned int)) {
+		(void) fprintf(stderr, usage);
+		return (EXIT_FAILURE);
+
+	} /* if (entries < 1 || ...) {...} */
+
+	keys	= (char *)malloc((size_t)entries * keysize);
+	vkeys	= (void **)malloc((size_t)entries * sizeof (void *));
+	order	= (void **)malloc((size_t)lookups * sizeof (void *));
+	data	= (void **)malloc((size_t)batch * sizeof (void *));
+	if (keys == NULL || vkeys == NULL || order == NULL || data == NULL) {
+		(void) perror("malloc");
+		return (EXIT_FAILURE);
+
+	} /* if (keys == NULL || ...) {...} */
+
+	for (i = 0; i < entries; ++i) {
+		vkeys[i] = &keys[(size_t)i * keysize];
+		make_key(vkeys[i], i);
+
+	} /* for (i = 0; i < entries; ++i) {...} */
+
+	/*
+	 * Both ways look up the same keys in the same pseudo random order,
+	 * so that neither gets more help from the cache than the other.
+	 */
+	for (i = 0; i < lookups; ++i) {
+		x = x * 1103515245U + 12345U;
+		order[i] = vkeys[(x >> 8) % entries];
+
+	} /* for (i = 0; i < lookups; ++i) {...} */
+
+	(void) printf("%-16s %-8s %14s %14s %8s\n",
+	    "table", "call", "scalar/sec", "batched/sec", "speedup");
+
+	for (k = 0; k < NKINDS; ++k) {
+		/*
+		 * Inserts: load a fresh table each way.
+		 */
+		start = gethrtime();
+		if ((ht = load(kinds[k].options, entries, vkeys, 0)) == NULL) {
+			(void) perror("ht_insert_key");
+			return (EXIT_FAILURE);
+
+		} /* if ((ht = load(...)) == NULL) {...} */
+
+		scalar = (double)entries * 1e9 / (double)(gethrtime() - start);
+		(void) ht_destroy(ht);
+
+		start = gethrtime();
+		if ((ht = load(kinds[k].options, entries, vkeys, batch)) ==
+		    NULL) {
+
+			(void) perror("ht_insert_many");
+			return (EXIT_FAILURE);
+
+		} /* if ((ht = load(...)) == NULL) {...} */
+
+		batched = (double)entries * 1e9 / (double)(gethrtime() - start);
+		(void) printf("%-16s %-8s %14.0f %14.0f %8.2f\n",
+		    kinds[k].name, "insert", scalar, batched, batched / scalar);
+
+		/*
+		 * Lookups, in the table loaded in batches.
+		 */
+		bad	= 0;
+		start	= gethrtime();
+		for (i = 0; i < lookups; ++i) {
+			if (ht_locate_key(ht, order[i]) != order[i]) {
+				++bad;
+
+			} /* if (ht_locate_key(ht, ...) != order[i]) {...} */
+
+		} /* for (i = 0; i < lookups; ++i) {...} */
+
+		scalar = (double)lookups * 1e9 / (double)(gethrtime() - start);
+
+		start = gethrtime();
+		for (i = 0; i < lookups; i += n) {
+			n = (lookups - i < batch ? lookups - i : batch);
+			bad += n - ht_locate_many(ht, n, &order[i], data);
+
+		} /* for (i = 0; i < lookups; i += n) {...} */
+
+		batched = (double)lookups * 1e9 / (double)(gethrtime() - start);
+		(void) printf("%-16s %-8s %14.0f %14.0f %8.2f\n",
+		    kinds[k].name, "locate", scalar, batched, batched / scalar);
+
+		if (bad != 0) {
+			(void) fprintf(stderr, "%s: %ld failed lookups\n",
+			    kinds[k].name, bad);
+			ret = EXIT_FAILURE;
+
+		} /* if (bad != 0) {...} */
+
+		(void) ht_destroy(ht);
+
+	} /* for (k = 0; k < NKINDS; ++k) {...} */
+
+	return (ret);
+
+} /* int main(int argc, char *argv[]) {...} */
@@ -54,12 +54,12 @@ main(int argc, char *argv[])
 {
 	int	 i;
 	int	 j;
+	int	 t;
 	int	 width;
 	int	 max;
 	char	 fmt[100];
 	char	*prefix;
 	char	*suffix;
-	int	*seed;
 	int	*value;
 
 	if (argc < 4) {
@@ -72,12 +72,6 @@ main(int argc, char *argv[])
 	max	= atoi(*++argv);
 	suffix	= *++argv;
 
-	seed	= (int *)malloc(max * sizeof (int));
-	if (seed == (int *)NULL) {
-		return (EXIT_FAILURE);
-
-	} /* if (seed == (int *)NULL) {...} */
-
 	value	= (int *)malloc(max * sizeof (int));
 	if (value == (int *)NULL) {
 		return (EXIT_FAILURE);
@@ -85,22 +79,22 @@ main(int argc, char *argv[])
 	} /* if (value == (int *)NULL) {...} */
 
 	for (i = 0; i < max; ++i) {
-		seed[i] = i;
+		value[i] = i;
 
 	} /* for (i = 0; i < max; ++i) {...} */
 
+	/*
+	 * Shuffle in place (Fisher-Yates): swap each value with one at or
+	 * below it, chosen at random.
+	 */
 	(void) srandom(time((time_t *)NULL));
-	for (i = max - 1; i >= 0; --i) {
-		j = random() % (i + 1);
-		value[i] = seed[j];
-		if (j < max - 1) {
-			(void) memmove(&seed[j],
-			    &seed[j + 1],
-			    sizeof (int) * (max - j));
-
-		} /* if (j < max - 1) {...} */
+	for (i = max - 1; i > 0; --i) {
+		j		= random() % (i + 1);
+		t		= value[i];
+		value[i]	= value[j];
+		value[j]	= t;
 
-	} /* for (i = max; i > 0 ; --i) {...} */
+	} /* for (i = max - 1; i > 0; --i) {...} */
 
 	for (width = 0, i = max - 1; i; i /= 10) {
 		++width;
@@ -0,0 +1,937 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright 2007 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include <inttypes.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <thread.h>
+#include <unistd.h>
+
+#include <hashtable.h>
+
+static const char usage[] =
+"\n"
+"Usage:	htbench [-b <backends>] [-w <workloads>] [-r <reads>]\n"
+"		[-t <threads>] [-k <keysizes>] [-n <entries>] [-o <ops>]\n"
+"		[-s <skew>]\n"
+"\n"
+"Where:\n"
+"	<backends>	is a comma separated list of the kinds of table to\n"
+"			measure: chained, resizing (chained with\n"
+"			hto_resize_implicit), open and concurrent.\n"
+"			(Default all of them.)\n"
+"	<workloads>	is a comma separated list of the key workloads:\n"
+"			uniform	 - keys chosen at random.\n"
+"			zipf	 - keys chosen with a Zipfian skew.\n"
+"			sequential - each thread walks the keys in order.\n"
+"			collide	 - keys chosen at random from keys that\n"
+"				   ht_hash_mix() sends to one bucket in\n"
+"				   every 64, and which share the low six\n"
+"				   bits of their open addressing tags.\n"
+"			(Default all of them.)\n"
+"	<reads>		is a comma separated list of the percentages of\n"
+"			operations that are lookups, from 0 to 100. The\n"
+"			rest either insert or delete one of the thread's\n"
+"			own keys. (Default 100,90,50,0.)\n"
+"	<threads>	is a comma separated list of thread counts.\n"
+"			(Default 1, 2, 4, ... up to the number of online\n"
+"			processors.)\n"
+"	<keysizes>	is a comma separated list of key sizes, from 4 to\n"
+"			256 bytes. (Default 4,16,64,256.)\n"
+"	<entries>	is the number of keys loaded into each table.\n"
+"			(Default 100000.)\n"
+"	<ops>		is the number of operations each thread makes.\n"
+"			(Default 1000000.)\n"
+"	<skew>		is the exponent of the Zipfian workload.\n"
+"			(Default 0.99.)\n"
+"\n"
+"Output:\n"
+"	A header line, then one line of comma separated values for every\n"
+"	combination of the above:\n"
+"\n"
+"	backend, workload, keysize, threads, reads\n"
+"		the run's parameters.\n"
+"	ops, ops_per_sec\n"
+"		the operations made by all threads, and their rate.\n"
+"	p50_ns, p99_ns\n"
+"		latency percentiles, from one operation in every 8.\n"
+"	bytes_per_entry\n"
+"		heap the loaded table takes per key, from mallinfo().\n"
+"	numents, entries\n"
+"		the table's size and keys once the run is over.\n"
+"	search_avg, search_max, depth_avg, depth_max\n"
+"		the library's lookup search depth and chain depth at\n"
+"		insert, from ht_stats(). Concurrent tables don't count\n"
+"		their lookups.\n"
+"	misses, errors\n"
+"		lookups that missed, and failed or wrong operations.\n"
+"		Lookups only miss keys their thread's own writes deleted.\n"
+"\n"
+"	The exit status is non-zero if any run counts errors.\n"
+"\n";
+
+/*
+ * Longest list given to an option.
+ */
+#define	HTB_LIST	32
+
+/*
+ * One operation in every HTB_SAMPLE is timed.
+ */
+#define	HTB_SAMPLE	8
+
+/*
+ * Collide keys hash to one bucket in every HTB_COLLIDE.
+ */
+#define	HTB_COLLIDE	64
+
+/*
+ * Latency histogram: values below 16ns get a bin each, then each power of
+ * two is split into 8 bins.
+ */
+#define	HTB_BINS	(16 + 60 * 8)
+
+/*
+ * Largest key.
+ */
+#define	HTB_MAXKEY	256
+
+typedef struct htb_name {
+	const char	*name;
+	int		 value;
+
+} htb_name_t;
+
+typedef enum htb_workload {
+	hw_uniform,
+	hw_zipf,
+	hw_sequential,
+	hw_collide
+
+} htb_workload_t;
+
+static const htb_name_t backends[] = {
+	{ "chained",	0			},
+	{ "resizing",	hto_resize_implicit	},
+	{ "open",	hto_open_addressing	},
+	{ "concurrent",	hto_concurrent		},
+};
+
+static const htb_name_t workloads[] = {
+	{ "uniform",	hw_uniform		},
+	{ "zipf",	hw_zipf			},
+	{ "sequential",	hw_sequential		},
+	{ "collide",	hw_collide		},
+};
+
+#define	NAMES(n)	(sizeof (n) / sizeof (n[0]))
+
+/*
+ * Each thread's counts, kept apart so the threads don't share cache lines.
+ */
+typedef struct htb_worker {
+	thread_t	 tid;		/* Thread id.			*/
+	int		 id;		/* Thread number.		*/
+	u_longlong_t	 misses;	/* Lookups that missed.		*/
+	u_longlong_t	 errors;	/* Failed operations.		*/
+	u_longlong_t	 hist[HTB_BINS]; /* Latency histogram.		*/
+	char		 pad[64];	/* Keep off the next worker.	*/
+
+} htb_worker_t;
+
+/*
+ * Shared by all threads of a run.
+ */
+static void		*ht;		/* Table being measured.	*/
+static char		*keys;		/* The keys, keysize apart.	*/
+static unsigned char	*present;	/* Which keys are in the table.	*/
+static double		*zipf_cdf;	/* Zipfian distribution.	*/
+static unsigned int	*zipf_key;	/* Key of each Zipfian rank.	*/
+static int		 entries;	/* Number of keys.		*/
+static int		 ops;		/* Operations per thread.	*/
+static int		 keysize;	/* Bytes per key.		*/
+static int		 threads;	/* Threads this run.		*/
+static int		 reads;		/* Percentage of lookups.	*/
+static htb_workload_t	 workload;	/* Key workload this run.	*/
+static volatile int	 go;		/* Threads may start?		*/
+
+/*
+ *
+ *  static int
+ *  parse_list(char *arg, const htb_name_t *names, size_t count, int *list)
+ *
+ *  Description:
+ *	Parse a comma separated list of names, or of numbers if names is
+ *	NULL, into list.
+ *
+ *  Return value:
+ *	int	The number of values in list, or zero if one isn't known or
+ *		there are more than HTB_LIST.
+ *
+ */
+static int
+parse_list(char *arg, const htb_name_t *names, size_t count, int *list)
+{
+	/*
+	 * Locals...
+	 */
+	char	*item;		/* One item of the list.	*/
+	char	*last;		/* strtok_r() state.		*/
+	size_t	 i;		/* Name number.			*/
+	int	 n = 0;		/* Values parsed.		*/
+
+	for (item = strtok_r(arg, ",", &last);
+	    item != (char *)NULL;
+	    item = strtok_r((char *)NULL, ",", &last)) {
+
+		if (n == HTB_LIST) {
+			return (0);
+
+		} /* if (n == HTB_LIST) {...} */
+
+		if (names == (const htb_name_t *)NULL) {
+			list[n++] = atoi(item);
+			continue;
+
+		} /* if (names == (const htb_name_t *)NULL) {...} */
+
+		for (i = 0; i < count; ++i) {
+			if (strcmp(item, names[i].name) == 0) {
+				break;
+
+			} /* if (strcmp(item, names[i].name) == 0) {...} */
+
+		} /* for (i = 0; i < count; ++i) {...} */
+
+		if (i == count) {
+			(void) fprintf(stderr, "htbench: unknown name \"%s\"\n",
+			    item);
+			return (0);
+
+		} /* if (i == count) {...} */
+
+		list[n++] = (int)i;
+
+	} /* for (item = strtok_r(arg, ",", &last); ...) {...} */
+
+	return (n);
+
+} /* int parse_list(char *arg, ...) {...} */
+
+/*
+ *
+ *  static uint64_t
+ *  random64(uint64_t *x)
+ *
+ *  Description:
+ *	A xorshift generator, cheap enough not to show in the timings, and
+ *	with a state per thread.
+ *
+ */
+static uint64_t
+random64(uint64_t *x)
+{
+	*x ^= *x >> 12;
+	*x ^= *x << 25;
+	*x ^= *x >> 27;
+
+	return (*x * 2685821657736338717ULL);
+
+} /* uint64_t random64(uint64_t *x) {...} */
+
+/*
+ *
+ *  static void
+ *  make_key(char *key, unsigned int n)
+ *
+ *  Description:
+ *	Fill in key n: its number up front, padding behind. Four byte keys
+ *	hold the number and nothing else.
+ *
+ */
+static void
+make_key(char *key, unsigned int n)
+{
+	(void) memset(key, 'k', keysize);
+	(void) memcpy(key, &n, sizeof (n));
+
+} /* void make_key(char *key, unsigned int n) {...} */
+
+/*
+ *
+ *  static int
+ *  make_keys(void)
+ *
+ *  Description:
+ *	Make the keys for this keysize and workload. Collide keys are found
+ *	by trying key numbers until enough of them hash to bucket zero of a
+ *	table HTB_COLLIDE entries long; any larger power of two table puts
+ *	them all in one bucket of every HTB_COLLIDE.
+ *
+ *  Return value:
+ *	int	Zero, or -1 if memory runs out.
+ *
+ */
+static int
+make_keys(void)
+{
+	/*
+	 * Locals...
+	 */
+	unsigned int	 n;		/* Key number.		*/
+	int		 i;		/* Key index.		*/
+
+	(void) free(keys);
+	if ((keys = (char *)malloc((size_t)entries * keysize)) == NULL) {
+		return (-1);
+
+	} /* if ((keys = (char *)malloc(...)) == NULL) {...} */
+
+	for (i = 0, n = 0; i < entries; ++n) {
+		make_key(&keys[(size_t)i * keysize], n);
+		if (workload != hw_collide ||
+		    ht_hash_mix(&keys[(size_t)i * keysize], keysize,
+		    HTB_COLLIDE) == 0) {
+
+			++i;
+
+		} /* if (workload != hw_collide || ...) {...} */
+
+	} /* for (i = 0, n = 0; i < entries; ++n) {...} */
+
+	return (0);
+
+} /* int make_keys(void) {...} */
+
+/*
+ *
+ *  static int
+ *  make_zipf(double skew)
+ *
+ *  Description:
+ *	Build the cumulative distribution of a Zipfian workload over the
+ *	keys, and shuffle which key gets which rank so that the popular
+ *	keys aren't simply the first ones loaded.
+ *
+ *  Return value:
+ *	int	Zero, or -1 if memory runs out.
+ *
+ */
+static int
+make_zipf(double skew)
+{
+	/*
+	 * Locals...
+	 */
+	uint64_t	 x = 88172645463325252ULL; /* Shuffle state.	*/
+	double		 sum = 0;	/* Running total.		*/
+	unsigned int	 t;		/* Swap space.			*/
+	int		 i;		/* Rank.			*/
+	int		 j;		/* Rank to swap with.		*/
+
+	zipf_cdf = (double *)malloc(entries * sizeof (*zipf_cdf));
+	zipf_key = (unsigned int *)malloc(entries * sizeof (*zipf_key));
+	if (zipf_cdf == NULL || zipf_key == NULL) {
+		return (-1);
+
+	} /* if (zipf_cdf == NULL || zipf_key == NULL) {...} */
+
+	for (i = 0; i < entries; ++i) {
+		sum		+= 1.0 / pow((double)(i + 1), skew);
+		zipf_cdf[i]	 = sum;
+		zipf_key[i]	 = i;
+
+	} /* for (i = 0; i < entries; ++i) {...} */
+
+	for (i = 0; i < entries; ++i) {
+		zipf_cdf[i] /= sum;
+
+	} /* for (i = 0; i < entries; ++i) {...} */
+
+	for (i = entries - 1; i > 0; --i) {
+		j		= (int)(random64(&x) % (i + 1));
+		t		= zipf_key[i];
+		zipf_key[i]	= zipf_key[j];
+		zipf_key[j]	= t;
+
+	} /* for (i = entries - 1; i > 0; --i) {...} */
+
+	return (0);
+
+} /* int make_zipf(double skew) {...} */
+
+/*
+ *
+ *  static int
+ *  next_key(htb_worker_t *w, uint64_t *x, int i)
+ *
+ *  Description:
+ *	Pick the key for a thread's i'th operation.
+ *
+ */
+static int
+next_key(htb_worker_t *w, uint64_t *x, int i)
+{
+	/*
+	 * Locals...
+	 */
+	double	 u;		/* Uniform in [0, 1).	*/
+	int	 lo;		/* Binary search bounds.	*/
+	int	 hi;
+	int	 mid;
+
+	switch (workload) {
+	case hw_sequential:
+		return ((int)(((size_t)w->id * (entries / threads) + i) %
+		    entries));
+
+	case hw_zipf:
+		u	= (double)(random64(x) >> 11) / 9007199254740992.0;
+		lo	= 0;
+		hi	= entries - 1;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (zipf_cdf[mid] < u) {
+				lo = mid + 1;
+
+			} else /* if (zipf_cdf[mid] >= u) */ {
+				hi = mid;
+
+			} /* if (zipf_cdf[mid] < u) {...} else {...} */
+
+		} /* while (lo < hi) {...} */
+
+		return ((int)zipf_key[lo]);
+
+	default:
+		return ((int)(random64(x) % entries));
+
+	} /* switch (workload) {...} */
+
+} /* int next_key(htb_worker_t *w, uint64_t *x, int i) {...} */
+
+/*
+ *
+ *  static int
+ *  latency_bin(hrtime_t ns)
+ *
+ *  Description:
+ *	Find the histogram bin of a latency.
+ *
+ */
+static int
+latency_bin(hrtime_t ns)
+{
+	/*
+	 * Locals...
+	 */
+	int	 e;		/* Highest bit set.	*/
+
+	if (ns < 16) {
+		return (ns < 0 ? 0 : (int)ns);
+
+	} /* if (ns < 16) {...} */
+
+	for (e = 4; e < 63 && (ns >> (e + 1)) != 0; ++e) {
+		continue;
+
+	} /* for (e = 4; ...) {...} */
+
+	return (16 + (e - 4) * 8 + (int)((ns >> (e - 3)) & 7));
+
+} /* int latency_bin(hrtime_t ns) {...} */
+
+/*
+ *
+ *  static hrtime_t
+ *  latency_value(int bin)
+ *
+ *  Description:
+ *	The smallest latency that falls in a histogram bin.
+ *
+ */
+static hrtime_t
+latency_value(int bin)
+{
+	if (bin < 16) {
+		return ((hrtime_t)bin);
+
+	} /* if (bin < 16) {...} */
+
+	return ((hrtime_t)(8 + (bin - 16) % 8) << ((bin - 16) / 8 + 1));
+
+} /* hrtime_t latency_value(int bin) {...} */
+
+/*
+ *
+ *  static void *
+ *  worker(void *arg)
+ *
+ *  Description:
+ *	Make a thread's operations. Lookups may be of any key. Writes are
+ *	only made to the thread's own keys, every threads'th one, so the
+ *	thread always knows whether to insert or delete.
+ *
+ */
+static void *
+worker(void *arg)
+{
+	/*
+	 * Locals...
+	 */
+	htb_worker_t	*w = (htb_worker_t *)arg;
+	uint64_t	 x;		/* Random state.		*/
+	hrtime_t	 start = 0;	/* Start of a timed operation.	*/
+	char		*key;		/* Key of the operation.	*/
+	void		*data;		/* What the table returned.	*/
+	int		 i;		/* Operation number.		*/
+	int		 k;		/* Key number.			*/
+
+	x = ((uint64_t)w->id + 1) * 0x9E3779B97F4A7C15ULL;
+	while (! go) {
+		continue;
+
+	} /* while (! go) {...} */
+
+	for (i = 0; i < ops; ++i) {
+		k = next_key(w, &x, i);
+		if (i % HTB_SAMPLE == 0) {
+			start = gethrtime();
+
+		} /* if (i % HTB_SAMPLE == 0) {...} */
+
+		if ((int)(random64(&x) % 100) < reads) {
+			key = &keys[(size_t)k * keysize];
+			if ((data = ht_locate_key(ht, key)) == NULL) {
+				++w->misses;
+
+			} else if (data != key) {
+				++w->errors;
+
+			} /* if ((data = ...) == NULL) {...} else ... {...} */
+
+		} else /* if (write) */ {
+			k = k - k % threads + w->id;
+			if (k >= entries) {
+				k -= threads;
+
+			} /* if (k >= entries) {...} */
+
+			key = &keys[(size_t)k * keysize];
+			if (present[k]) {
+				if (ht_delete_key(ht, key) != key) {
+					++w->errors;
+
+				} /* if (ht_delete_key(ht, key) != key) {...} */
+
+			} else if (ht_insert_key(ht, key, key) != 0) {
+				++w->errors;
+
+			} /* if (present[k]) {...} else ... {...} */
+
+			present[k] = ! present[k];
+
+		} /* if (lookup) {...} else {...} */
+
+		if (i % HTB_SAMPLE == 0) {
+			++w->hist[latency_bin(gethrtime() - start)];
+
+		} /* if (i % HTB_SAMPLE == 0) {...} */
+
+	} /* for (i = 0; i < ops; ++i) {...} */
+
+	return ((void *)NULL);
+
+} /* void *worker(void *arg) {...} */
+
+/*
+ *
+ *  static size_t
+ *  heap_used(void)
+ *
+ *  Description:
+ *	Bytes of heap in use, small blocks and large.
+ *
+ */
+static size_t
+heap_used(void)
+{
+	/*
+	 * Locals...
+	 */
+	struct mallinfo	 mi = mallinfo();
+
+	return ((size_t)mi.uordblks + (size_t)mi.hblkhd);
+
+} /* size_t heap_used(void) {...} */
+
+/*
+ *
+ *  static int
+ *  run(int backend, htb_worker_t *w)
+ *
+ *  Description:
+ *	Load a new table of the given kind with every key, make one run of
+ *	operations against it and print the results.
+ *
+ *  Return value:
+ *	int	Non-zero if the run counted errors.
+ *
+ */
+static int
+run(int backend, htb_worker_t *w)
+{
+	/*
+	 * Locals...
+	 */
+	ht_stats_t	 stats;		/* Library statistics.		*/
+	u_longlong_t	 hist[HTB_BINS]; /* All threads' latencies.	*/
+	u_longlong_t	 samples = 0;	/* Latencies recorded.		*/
+	u_longlong_t	 seen;		/* Latencies counted so far.	*/
+	u_longlong_t	 misses = 0;	/* Lookups that missed.		*/
+	u_longlong_t	 errors = 0;	/* Failed operations.		*/
+	hrtime_t	 p50 = 0;	/* Median latency.		*/
+	hrtime_t	 p99 = 0;	/* 99th percentile latency.	*/
+	hrtime_t	 start;		/* Start of the run.		*/
+	double		 elapsed;	/* Seconds the run took.	*/
+	size_t		 heap;		/* Heap before the table.	*/
+	int		 i;		/* Key, thread or bin number.	*/
+	int		 j;		/* Bin number.			*/
+
+	heap = heap_used();
+	if ((ht = ht_create((backends[backend].value & hto_resize_implicit ?
+	    8 :
+	    entries),
+	    keysize,
+	    backends[backend].value)) == NULL) {
+
+		(void) perror("ht_create");
+		return (1);
+
+	} /* if ((ht = ht_create(...)) == NULL) {...} */
+
+	for (i = 0; i < entries; ++i) {
+		if (ht_insert_key(ht, &keys[(size_t)i * keysize],
+		    &keys[(size_t)i * keysize]) != 0) {
+
+			++errors;
+
+		} /* if (ht_insert_key(ht, ...) != 0) {...} */
+
+		present[i] = 1;
+
+	} /* for (i = 0; i < entries; ++i) {...} */
+
+	heap = heap_used() - heap;
+
+	(void) memset(w, 0, threads * sizeof (*w));
+	go = 0;
+	for (i = 0; i < threads; ++i) {
+		w[i].id = i;
+		(void) thr_create(NULL, 0, worker, &w[i], THR_BOUND,
+		    &w[i].tid);
+
+	} /* for (i = 0; i < threads; ++i) {...} */
+
+	start	= gethrtime();
+	go	= 1;
+	for (i = 0; i < threads; ++i) {
+		(void) thr_join(w[i].tid, NULL, NULL);
+
+	} /* for (i = 0; i < threads; ++i) {...} */
+
+	elapsed = (double)(gethrtime() - start) / 1e9;
+
+	(void) memset(hist, 0, sizeof (hist));
+	for (i = 0; i < threads; ++i) {
+		for (j = 0; j < HTB_BINS; ++j) {
+			hist[j]	+= w[i].hist[j];
+			samples	+= w[i].hist[j];
+
+		} /* for (j = 0; j < HTB_BINS; ++j) {...} */
+
+		misses += w[i].misses;
+		errors += w[i].errors;
+
+	} /* for (i = 0; i < threads; ++i) {...} */
+
+	for (i = 0, seen = 0; i < HTB_BINS; ++i) {
+		seen += hist[i];
+		if (p50 == 0 && seen * 2 >= samples) {
+			p50 = latency_value(i);
+
+		} /* if (p50 == 0 && seen * 2 >= samples) {...} */
+
+		if (p99 == 0 && seen * 100 >= samples * 99) {
+			p99 = latency_value(i);
+
+		} /* if (p99 == 0 && ...) {...} */
+
+	} /* for (i = 0, seen = 0; i < HTB_BINS; ++i) {...} */
+
+	/*
+	 * Every lookup of a key no thread writes should hit.
+	 */
+	if (reads == 100 && misses != 0) {
+		errors += misses;
+
+	} /* if (reads == 100 && misses != 0) {...} */
+
+	(void) memset(&stats, 0, sizeof (stats));
+	if (ht_stats(ht, &stats) != 0) {
+		++errors;
+
+	} /* if (ht_stats(ht, &stats) != 0) {...} */
+
+	(void) printf("%s,%s,%d,%d,%d,%llu,%.0f,%lld,%lld,%.1f,"
+	    "%lu,%lu,%.3f,%llu,%.3f,%llu,%llu,%llu\n",
+	    backends[backend].name,
+	    workloads[workload].name,
+	    keysize,
+	    threads,
+	    reads,
+	    (u_longlong_t)ops * threads,
+	    (double)ops * threads / elapsed,
+	    (long long)p50,
+	    (long long)p99,
+	    (double)heap / entries,
+	    (ulong_t)stats.numents,
+	    (ulong_t)stats.entries,
+	    (stats.searches.count ?
+	    (double)stats.searches.sum / stats.searches.count :
+	    0.0),
+	    stats.searches.maximum,
+	    (stats.depth.count ?
+	    (double)stats.depth.sum / stats.depth.count :
+	    0.0),
+	    stats.depth.maximum,
+	    misses,
+	    errors);
+	(void) fflush(stdout);
+
+	(void) ht_destroy(ht);
+
+	return (errors != 0);
+
+} /* int run(int backend, htb_worker_t *w) {...} */
+
+int
+main(int argc, char *argv[])
+{
+	/*
+	 * Locals...
+	 */
+	int		 blist[HTB_LIST];	/* Backends.		*/
+	int		 wlist[HTB_LIST];	/* Workloads.		*/
+	int		 rlist[HTB_LIST];	/* Read percentages.	*/
+	int		 tlist[HTB_LIST];	/* Thread counts.	*/
+	int		 klist[HTB_LIST];	/* Key sizes.		*/
+	int		 bn;			/* Backends listed.	*/
+	int		 wn;			/* Workloads listed.	*/
+	int		 rn;			/* Reads listed.	*/
+	int		 tn = -1;		/* Threads listed.	*/
+	int		 kn;			/* Key sizes listed.	*/
+	int		 maxthreads = 1;	/* Most threads.	*/
+	int		 b, wl, r, t, k;	/* List indices.	*/
+	int		 c;			/* Option letter.	*/
+	int		 ncpu;			/* Online processors.	*/
+	double		 skew = 0.99;		/* Zipfian exponent.	*/
+	htb_worker_t	*w;			/* Thread records.	*/
+	int		 ret = EXIT_SUCCESS;
+
+	for (bn = 0; bn < (int)NAMES(backends); ++bn) {
+		blist[bn] = bn;
+
+	} /* for (bn = 0; bn < (int)NAMES(backends); ++bn) {...} */
+
+	for (wn = 0; wn < (int)NAMES(workloads); ++wn) {
+		wlist[wn] = wn;
+
+	} /* for (wn = 0; wn < (int)NAMES(workloads); ++wn) {...} */
+
+	rn = 4;
+	rlist[0] = 100;
+	rlist[1] = 90;
+	rlist[2] = 50;
+	rlist[3] = 0;
+
+	kn = 4;
+	klist[0] = 4;
+	klist[1] = 16;
+	klist[2] = 64;
+	klist[3] = 256;
+
+	entries	= 100000;
+	ops	= 1000000;
+
+	while ((c = getopt(argc, argv, "b:w:r:t:k:n:o:s:")) != EOF) {
+		switch (c) {
+		case 'b':
+			bn = parse_list(optarg, backends, NAMES(backends),
+			    blist);
+			break;
+
+		case 'w':
+			wn = parse_list(optarg, workloads, NAMES(workloads),
+			    wlist);
+			break;
+
+		case 'r':
+			rn = parse_list(optarg, NULL, 0, rlist);
+			break;
+
+		case 't':
+			tn = parse_list(optarg, NULL, 0, tlist);
+			break;
+
+		case 'k':
+			kn = parse_list(optarg, NULL, 0, klist);
+			break;
+
+		case 'n':
+			entries = atoi(optarg);
+			break;
+
+		case 'o':
+			ops = atoi(optarg);
+			break;
+
+		case 's':
+			skew = atof(optarg);
+			break;
+
+		default:
+			(void) fprintf(stderr, usage);
+			return (EXIT_FAILURE);
+
+		} /* switch (c) {...} */
+
+	} /* while ((c = getopt(...)) != EOF) {...} */
+
+	/*
+	 * By default double the threads up to the number of processors.
+	 */
+	if (tn == -1) {
+		ncpu = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		for (t = 1; t < ncpu && tn < HTB_LIST - 1; t *= 2) {
+			tlist[tn++] = t;
+
+		} /* for (t = 1; t < ncpu && ...; t *= 2) {...} */
+
+		tlist[tn++] = (ncpu > 1 ? ncpu : 1);
+
+	} /* if (tn == -1) {...} */
+
+	for (t = 0; t < tn; ++t) {
+		if (tlist[t] > maxthreads) {
+			maxthreads = tlist[t];
+
+		} /* if (tlist[t] > maxthreads) {...} */
+
+		if (tlist[t] < 1 || tlist[t] > entries) {
+			tn = 0;
+
+		} /* if (tlist[t] < 1 || tlist[t] > entries) {...} */
+
+	} /* for (t = 0; t < tn; ++t) {...} */
+
+	for (r = 0; r < rn; ++r) {
+		if (rlist[r] < 0 || rlist[r] > 100) {
+			rn = 0;
+
+		} /* if (rlist[r] < 0 || rlist[r] > 100) {...} */
+
+	} /* for (r = 0; r < rn; ++r) {...} */
+
+	for (k = 0; k < kn; ++k) {
+		if (klist[k] < (int)sizeof (unsigned int) ||
+		    klist[k] > HTB_MAXKEY) {
+
+			kn = 0;
+
+		} /* if (klist[k] < (int)sizeof (unsigned int) || ...) {...} */
+
+	} /* for (k = 0; k < kn; ++k) {...} */
+
+	if (bn == 0 || wn == 0 || rn == 0 || tn == 0 || kn == 0 ||
+	    entries < 1 || ops < 1 || skew <= 0 || optind != argc) {
+
+		(void) fprintf(stderr, usage);
+		return (EXIT_FAILURE);
+
+	} /* if (bn == 0 || ...) {...} */
+
+	present	= (unsigned char *)malloc(entries);
+	w	= (htb_worker_t *)malloc(maxthreads * sizeof (*w));
+	if (present == NULL || w == NULL || make_zipf(skew) != 0) {
+		(void) perror("malloc");
+		return (EXIT_FAILURE);
+
+	} /* if (present == NULL || ...) {...} */
+
+	(void) thr_setconcurrency(maxthreads);
+	(void) printf("backend,workload,keysize,threads,reads,ops,"
+	    "ops_per_sec,p50_ns,p99_ns,bytes_per_entry,numents,entries,"
+	    "search_avg,search_max,depth_avg,depth_max,misses,errors\n");
+
+	for (k = 0; k < kn; ++k) {
+		keysize = klist[k];
+		for (wl = 0; wl < wn; ++wl) {
+			workload = (htb_workload_t)wlist[wl];
+			if (make_keys() != 0) {
+				(void) perror("malloc");
+				return (EXIT_FAILURE);
+
+			} /* if (make_keys() != 0) {...} */
+
+			for (b = 0; b < bn; ++b) {
+				for (t = 0; t < tn; ++t) {
+					threads = tlist[t];
+					for (r = 0; r < rn; ++r) {
+						reads = rlist[r];
+						if (run(blist[b], w) != 0) {
+							ret = EXIT_FAILURE;
+
+						} /* if (run(...) != 0) {...} */
+
+					} /* for (r = 0; r < rn; ++r) {...} */
+
+				} /* for (t = 0; t < tn; ++t) {...} */
+
+			} /* for (b = 0; b < bn; ++b) {...} */
+
+		} /* for (wl = 0; wl < wn; ++wl) {...} */
+
+	} /* for (k = 0; k < kn; ++k) {...} */
+
+	return (ret);
+
+} /* int main(int argc, char *argv[]) {...} */
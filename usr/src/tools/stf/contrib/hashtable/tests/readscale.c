@@ -0,0 +1,314 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright 2007 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <thread.h>
+#include <unistd.h>
+
+#include <hashtable.h>
+
+static const char usage[] =
+"\n"
+"Usage:	readscale [<entries> [<lookups> [<threads> [<writers> [<keysize>]]]]]\n"
+"\n"
+"Where:\n"
+"	<entries>	is the number of keys loaded into each table.\n"
+"			(Default 100000.)\n"
+"	<lookups>	is the number of lookups each reader makes.\n"
+"			(Default 1000000.)\n"
+"	<threads>	is the most reader threads to run. Runs are made\n"
+"			with 1, 2, 4, ... readers up to this many.\n"
+"			(Default the number of online processors.)\n"
+"	<writers>	is the number of threads inserting and deleting\n"
+"			keys of their own while the readers run.\n"
+"			(Default 0.)\n"
+"	<keysize>	is the size of the keys, from 4 bytes up.\n"
+"			(Default 8.)\n"
+"\n"
+"Output:\n"
+"	One line per table kind and reader count, giving the total lookup\n"
+"	rate and its speedup over a single reader of the same kind.\n"
+"\n";
+
+/*
+ * The kinds of table measured.
+ */
+static const struct {
+	const char	*name;
+	ht_option_t	 options;
+} kinds[] = {
+	{ "chained",		0			},
+	{ "open addressing",	hto_open_addressing	},
+	{ "concurrent",		hto_concurrent		},
+};
+
+#define	NKINDS	(sizeof (kinds) / sizeof (kinds[0]))
+
+/*
+ * Shared by all threads of a run.
+ */
+static void		*ht;		/* Table being measured.	*/
+static char		*keys;		/* Loaded keys, keysize apart.	*/
+static int		 entries;	/* Number of loaded keys.	*/
+static int		 lookups;	/* Lookups per reader.		*/
+static int		 keysize;	/* Bytes per key.		*/
+static volatile int	 done;		/* Readers finished?		*/
+
+/*
+ *
+ *  static void
+ *  make_key(char *key, unsigned int n)
+ *
+ *  Description:
+ *	Fill in key number n: its number up front, padding behind.
+ *
+ */
+static void
+make_key(char *key, unsigned int n)
+{
+	(void) memset(key, 'k', keysize);
+	(void) memcpy(key, &n, sizeof (n));
+
+} /* void make_key(char *key, unsigned int n) {...} */
+
+/*
+ *
+ *  static void *
+ *  reader(void *arg)
+ *
+ *  Description:
+ *	Look up loaded keys in a pseudo random order. Every key must be
+ *	found with its own data.
+ *
+ */
+static void *
+reader(void *arg)
+{
+	/*
+	 * Locals...
+	 */
+	unsigned int	 x = (unsigned int)(uintptr_t)arg * 2654435761U + 1;
+	unsigned int	 n;		/* Key number.		*/
+	int		 i;		/* Lookup number.	*/
+	long		 misses = 0;	/* Lookups that failed.	*/
+
+	for (i = 0; i < lookups; ++i) {
+		x = x * 1103515245U + 12345U;
+		n = (x >> 8) % entries;
+		if (ht_locate_key(ht, &keys[(size_t)n * keysize]) !=
+		    &keys[(size_t)n * keysize]) {
+
+			++misses;
+
+		} /* if (ht_locate_key(ht, ...) != ...) {...} */
+
+	} /* for (i = 0; i < lookups; ++i) {...} */
+
+	return ((void *)misses);
+
+} /* void *reader(void *arg) {...} */
+
+/*
+ *
+ *  static void *
+ *  writer(void *arg)
+ *
+ *  Description:
+ *	Insert and delete keys outside the loaded range until the readers
+ *	are done, so that lookups run against a table that's changing.
+ *
+ */
+static void *
+writer(void *arg)
+{
+	/*
+	 * Locals...
+	 */
+	unsigned int	 base;		/* First key of ours.	*/
+	unsigned int	 n;		/* Key number.		*/
+	char		*key;		/* Key being churned.	*/
+	long		 errors = 0;	/* Failed operations.	*/
+
+	if ((key = (char *)malloc(keysize)) == NULL) {
+		return ((void *)1);
+
+	} /* if ((key = (char *)malloc(keysize)) == NULL) {...} */
+
+	base = entries + (unsigned int)(uintptr_t)arg * 1024;
+	for (n = 0; ! done; n = (n + 1) % 1024) {
+		make_key(key, base + n);
+		if (ht_insert_key(ht, key, key) != 0 ||
+		    ht_delete_key(ht, key) != key) {
+
+			++errors;
+
+		} /* if (ht_insert_key(ht, key, key) != 0 || ...) {...} */
+
+	} /* for (n = 0; ! done; n = (n + 1) % 1024) {...} */
+
+	(void) free(key);
+	return ((void *)errors);
+
+} /* void *writer(void *arg) {...} */
+
+int
+main(int argc, char *argv[])
+{
+	thread_t	*tids;		/* Thread ids.			*/
+	hrtime_t	 start;		/* Start of a run.		*/
+	double		 rate;		/* Lookups per second.		*/
+	double		 base;		/* Single reader rate.		*/
+	void		*status;	/* Thread return value.		*/
+	long		 bad;		/* Misses and errors.		*/
+	int		 maxthreads;	/* Most readers.		*/
+	int		 writers;	/* Writer threads.		*/
+	int		 threads;	/* Readers this run.		*/
+	int		 k;		/* Table kind.			*/
+	int		 i;		/* Key or thread number.	*/
+	int		 ret = EXIT_SUCCESS;
+
+	entries		= (argc > 1 ? atoi(argv[1]) : 100000);
+	lookups		= (argc > 2 ? atoi(argv[2]) : 1000000);
+	maxthreads	= (argc > 3 ? atoi(argv[3]) :
+	    (int)sysconf(_SC_NPROCESSORS_ONLN));
+	writers		= (argc > 4 ? atoi(argv[4]) : 0);
+	keysize		= (argc > 5 ? atoi(argv[5]) : 8);
+
+	if (entries < 1 || lookups < 1 || maxthreads < 1 || writers < 0 ||
+	    keysize < (int)sizeof (unsigned int)) {
+		(void) fprintf(stderr, usage);
+		return (EXIT_FAILURE);
+
+	} /* if (entries < 1 || ...) {...} */
+
+	keys = (char *)malloc((size_t)entries * keysize);
+	tids = (thread_t *)malloc((maxthreads + writers) * sizeof (*tids));
+	if (keys == NULL || tids == NULL) {
+		(void) perror("malloc");
+		return (EXIT_FAILURE);
+
+	} /* if (keys == NULL || tids == NULL) {...} */
+
+	for (i = 0; i < entries; ++i) {
+		make_key(&keys[(size_t)i * keysize], i);
+
+	} /* for (i = 0; i < entries; ++i) {...} */
+
+	(void) thr_setconcurrency(maxthreads + writers);
+	(void) printf("%-16s %8s %14s %8s\n",
+	    "table", "readers", "lookups/sec", "speedup");
+
+	for (k = 0; k < NKINDS; ++k) {
+		if ((ht = ht_create(entries, keysize, kinds[k].options)) ==
+		    NULL) {
+
+			(void) perror("ht_create");
+			return (EXIT_FAILURE);
+
+		} /* if ((ht = ht_create(...)) == NULL) {...} */
+
+		for (i = 0; i < entries; ++i) {
+			(void) ht_insert_key(ht,
+			    &keys[(size_t)i * keysize],
+			    &keys[(size_t)i * keysize]);
+
+		} /* for (i = 0; i < entries; ++i) {...} */
+
+		base = 0;
+		for (threads = 1; ; threads *= 2) {
+			if (threads > maxthreads) {
+				threads = maxthreads;
+
+			} /* if (threads > maxthreads) {...} */
+
+			bad	= 0;
+			done	= 0;
+			for (i = 0; i < writers; ++i) {
+				(void) thr_create(NULL, 0, writer,
+				    (void *)(uintptr_t)i, THR_BOUND,
+				    &tids[maxthreads + i]);
+
+			} /* for (i = 0; i < writers; ++i) {...} */
+
+			start = gethrtime();
+			for (i = 0; i < threads; ++i) {
+				(void) thr_create(NULL, 0, reader,
+				    (void *)(uintptr_t)i, THR_BOUND, &tids[i]);
+
+			} /* for (i = 0; i < threads; ++i) {...} */
+
+			for (i = 0; i < threads; ++i) {
+				(void) thr_join(tids[i], NULL, &status);
+				bad += (long)status;
+
+			} /* for (i = 0; i < threads; ++i) {...} */
+
+			rate = (double)lookups * threads * 1e9 /
+			    (double)(gethrtime() - start);
+
+			done = 1;
+			for (i = 0; i < writers; ++i) {
+				(void) thr_join(tids[maxthreads + i], NULL,
+				    &status);
+				bad += (long)status;
+
+			} /* for (i = 0; i < writers; ++i) {...} */
+
+			if (base == 0) {
+				base = rate;
+
+			} /* if (base == 0) {...} */
+
+			(void) printf("%-16s %8d %14.0f %8.2f\n",
+			    kinds[k].name, threads, rate, rate / base);
+
+			if (bad != 0) {
+				(void) fprintf(stderr,
+				    "%s: %ld failed lookups or updates\n",
+				    kinds[k].name, bad);
+				ret = EXIT_FAILURE;
+
+			} /* if (bad != 0) {...} */
+
+			if (threads == maxthreads) {
+				break;
+
+			} /* if (threads == maxthreads) {...} */
+
+		} /* for (threads = 1; ; threads *= 2) {...} */
+
+		(void) ht_destroy(ht);
+
+	} /* for (k = 0; k < NKINDS; ++k) {...} */
+
+	return (ret);
+
+} /* int main(int argc, char *argv[]) {...} */
@@ -0,0 +1,315 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright 2007 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <hashtable_typed.h>
+
+static const char usage[] =
+"\n"
+"Usage:	typed [<entries> [<lookups>]]\n"
+"\n"
+"Where:\n"
+"	<entries>	is the number of keys loaded into each table.\n"
+"			(Default 100000.)\n"
+"	<lookups>	is the number of lookups timed each way.\n"
+"			(Default 4000000.)\n"
+"\n"
+"Output:\n"
+"	Checks typed tables of small (inline) and large keys against the\n"
+"	library calls on the same tables, then prints the lookup rate of\n"
+"	a plain table, of the library calls on a typed table, and of the\n"
+"	typed lookups.\n"
+"\n";
+
+/*
+ * A key too big to be copied into the slots.
+ */
+typedef struct wide_key {
+	uint64_t	 hi;
+	uint64_t	 lo;
+
+} wide_key_t;
+
+#define	WIDE_HASH(k)		ht_typed_mix((k).hi * 31 + (k).lo)
+#define	WIDE_EQUAL(a, b)	((a).hi == (b).hi && (a).lo == (b).lo)
+
+HT_TYPED_DECLARE(uint_ht, uint_t, HT_TYPED_HASH_INT, HT_TYPED_EQUAL)
+HT_TYPED_DECLARE(wide_ht, wide_key_t, WIDE_HASH, WIDE_EQUAL)
+
+/*
+ *
+ *  static int
+ *  check_uint(int entries)
+ *
+ *  Description:
+ *	Load a typed table of uint_t keys, then check that the typed and
+ *	library calls agree on every key, present, absent and deleted, and
+ *	that the typed lookups were counted.
+ *
+ */
+static int
+check_uint(int entries)
+{
+	/*
+	 * Locals...
+	 */
+	void		*ht;		/* Table being checked.		*/
+	ht_stats_t	 stats;		/* Its statistics.		*/
+	uint_t		 key;		/* Key number.			*/
+	int		 bad = 0;	/* Failed checks.		*/
+
+	if ((ht = uint_ht_create(16, hto_resize_implicit)) == NULL) {
+		(void) perror("uint_ht_create");
+		return (1);
+
+	} /* if ((ht = uint_ht_create(...)) == NULL) {...} */
+
+	for (key = 0; key < entries; ++key) {
+		if (uint_ht_insert(ht, &key, (void *)(uintptr_t)(key + 1))) {
+			++bad;
+
+		} /* if (uint_ht_insert(ht, &key, ...)) {...} */
+
+	} /* for (key = 0; key < entries; ++key) {...} */
+
+	key = 0;
+	if (uint_ht_insert(ht, &key, (void *)1) == 0 || errno != EEXIST) {
+		++bad;
+
+	} /* if (uint_ht_insert(ht, &key, ...) == 0 || ...) {...} */
+
+	for (key = 0; key < entries * 2; ++key) {
+		if (uint_ht_locate(ht, key) != (key < entries ?
+		    (void *)(uintptr_t)(key + 1) : NULL) ||
+		    ht_locate_key(ht, &key) != uint_ht_locate(ht, key)) {
+
+			++bad;
+
+		} /* if (uint_ht_locate(ht, key) != ...) {...} */
+
+	} /* for (key = 0; key < entries * 2; ++key) {...} */
+
+	for (key = 0; key < entries; key += 2) {
+		if (uint_ht_delete(ht, &key) != (void *)(uintptr_t)(key + 1)) {
+			++bad;
+
+		} /* if (uint_ht_delete(ht, &key) != ...) {...} */
+
+	} /* for (key = 0; key < entries; key += 2) {...} */
+
+	for (key = 0; key < entries; ++key) {
+		if ((uint_ht_locate(ht, key) == NULL) != ((key & 1) == 0)) {
+			++bad;
+
+		} /* if ((uint_ht_locate(ht, key) == NULL) != ...) {...} */
+
+	} /* for (key = 0; key < entries; ++key) {...} */
+
+	if (ht_stats(ht, &stats) || stats.probes < (u_longlong_t)entries * 5 ||
+	    stats.hits > stats.probes || stats.errors != 0) {
+
+		++bad;
+
+	} /* if (ht_stats(ht, &stats) || ...) {...} */
+
+	if (bad != 0) {
+		(void) fprintf(stderr, "uint_ht: %d failed checks\n", bad);
+
+	} /* if (bad != 0) {...} */
+
+	(void) ht_destroy(ht);
+	return (bad);
+
+} /* int check_uint(int entries) {...} */
+
+/*
+ *
+ *  static int
+ *  check_wide(int entries)
+ *
+ *  Description:
+ *	As check_uint(), for keys the table keeps pointers to.
+ *
+ */
+static int
+check_wide(int entries)
+{
+	/*
+	 * Locals...
+	 */
+	void		*ht;		/* Table being checked.		*/
+	wide_key_t	*keys;		/* The keys, which must stay.	*/
+	wide_key_t	 key;		/* Key looked up.		*/
+	int		 i;		/* Key number.			*/
+	int		 bad = 0;	/* Failed checks.		*/
+
+	if ((keys = (wide_key_t *)malloc(entries * sizeof (*keys))) == NULL ||
+	    (ht = wide_ht_create(entries, 0)) == NULL) {
+
+		(void) perror("wide_ht_create");
+		return (1);
+
+	} /* if ((keys = ...) == NULL || ...) {...} */
+
+	for (i = 0; i < entries; ++i) {
+		keys[i].hi = i;
+		keys[i].lo = ~(uint64_t)i;
+		if (wide_ht_insert(ht, &keys[i], &keys[i])) {
+			++bad;
+
+		} /* if (wide_ht_insert(ht, &keys[i], &keys[i])) {...} */
+
+	} /* for (i = 0; i < entries; ++i) {...} */
+
+	for (i = 0; i < entries * 2; ++i) {
+		key.hi = i;
+		key.lo = ~(uint64_t)i;
+		if (wide_ht_locate(ht, key) !=
+		    (i < entries ? &keys[i] : NULL) ||
+		    ht_locate_key(ht, &key) != wide_ht_locate(ht, key)) {
+
+			++bad;
+
+		} /* if (wide_ht_locate(ht, key) != ...) {...} */
+
+	} /* for (i = 0; i < entries * 2; ++i) {...} */
+
+	for (i = 0; i < entries; ++i) {
+		if (wide_ht_delete(ht, &keys[i]) != &keys[i]) {
+			++bad;
+
+		} /* if (wide_ht_delete(ht, &keys[i]) != &keys[i]) {...} */
+
+	} /* for (i = 0; i < entries; ++i) {...} */
+
+	if (bad != 0) {
+		(void) fprintf(stderr, "wide_ht: %d failed checks\n", bad);
+
+	} /* if (bad != 0) {...} */
+
+	(void) ht_destroy(ht);
+	(void) free(keys);
+	return (bad);
+
+} /* int check_wide(int entries) {...} */
+
+int
+main(int argc, char *argv[])
+{
+	void		*plain;		/* Library table.		*/
+	void		*typed;		/* Typed table.			*/
+	hrtime_t	 start;		/* Start of a run.		*/
+	double		 rate[3];	/* Lookups per second.		*/
+	unsigned int	 x;		/* Pseudo random state.		*/
+	uint_t		 key;		/* Key number.			*/
+	long		 misses = 0;	/* Lookups that failed.		*/
+	int		 entries;	/* Number of loaded keys.	*/
+	int		 lookups;	/* Lookups each way.		*/
+	int		 i;		/* Lookup number.		*/
+	int		 r;		/* Run number.			*/
+
+	entries	= (argc > 1 ? atoi(argv[1]) : 100000);
+	lookups	= (argc > 2 ? atoi(argv[2]) : 4000000);
+
+	if (entries < 1 || lookups < 1) {
+		(void) fprintf(stderr, usage);
+		return (EXIT_FAILURE);
+
+	} /* if (entries < 1 || lookups < 1) {...} */
+
+	if (check_uint(entries) != 0 || check_wide(entries) != 0) {
+		return (EXIT_FAILURE);
+
+	} /* if (check_uint(entries) != 0 || ...) {...} */
+
+	plain = ht_create(entries, sizeof (uint_t), hto_open_addressing);
+	typed = uint_ht_create(entries, 0);
+	if (plain == NULL || typed == NULL) {
+		(void) perror("ht_create");
+		return (EXIT_FAILURE);
+
+	} /* if (plain == NULL || typed == NULL) {...} */
+
+	for (key = 0; key < entries; ++key) {
+		(void) ht_insert_key(plain, &key,
+		    (void *)(uintptr_t)(key + 1));
+		(void) uint_ht_insert(typed, &key,
+		    (void *)(uintptr_t)(key + 1));
+
+	} /* for (key = 0; key < entries; ++key) {...} */
+
+	/*
+	 * Each run looks the same keys up in the same pseudo random order.
+	 */
+	for (r = 0; r < 3; ++r) {
+		x	= 1;
+		start	= gethrtime();
+		for (i = 0; i < lookups; ++i) {
+			x	= x * 1103515245U + 12345U;
+			key	= (x >> 8) % entries;
+			if ((r == 0 ? ht_locate_key(plain, &key) :
+			    r == 1 ? ht_locate_key(typed, &key) :
+			    uint_ht_locate(typed, key)) !=
+			    (void *)(uintptr_t)(key + 1)) {
+
+				++misses;
+
+			} /* if ((r == 0 ? ... : ...) != ...) {...} */
+
+		} /* for (i = 0; i < lookups; ++i) {...} */
+
+		rate[r] = (double)lookups * 1e9 /
+		    (double)(gethrtime() - start);
+
+	} /* for (r = 0; r < 3; ++r) {...} */
+
+	(void) printf("%-24s %14s %8s\n", "lookup", "lookups/sec", "speedup");
+	(void) printf("%-24s %14.0f %8.2f\n", "ht_locate_key, plain",
+	    rate[0], 1.0);
+	(void) printf("%-24s %14.0f %8.2f\n", "ht_locate_key, typed",
+	    rate[1], rate[1] / rate[0]);
+	(void) printf("%-24s %14.0f %8.2f\n", "uint_ht_locate",
+	    rate[2], rate[2] / rate[0]);
+
+	(void) ht_destroy(plain);
+	(void) ht_destroy(typed);
+
+	if (misses != 0) {
+		(void) fprintf(stderr, "%ld failed lookups\n", misses);
+		return (EXIT_FAILURE);
+
+	} /* if (misses != 0) {...} */
+
+	return (EXIT_SUCCESS);
+
+} /* int main(int argc, char *argv[]) {...} */
@@ -99,6 +99,22 @@ typedef enum jnl_DetailLevel {
 	jnlDL_VERBOSE	= (jnlDL_STACK / 2)	 /* Almost everything... */
 } jnl_DetailLevel_t;
 
+/*
+ *	JNL_DL_CEILING - build time detail level ceiling.
+ *
+ *	jnl_LOG() calls (and so jnl_PROGRESS(), jnl_VERBOSE() and the like)
+ *	with a constant level above the ceiling compile to nothing, whatever
+ *	TJNL_DETAIL says at run time.  The default keeps every level; build
+ *	with e.g. -DJNL_DL_CEILING=jnlDL_PROGRESS to drop verbose logging
+ *	from a stress binary.  ASSERTION, RESULT and DIAGNOSTIC messages are
+ *	never compiled out.
+ */
+#ifndef	JNL_DL_CEILING
+#define	JNL_DL_CEILING	jnlDL_ENCYCLOPEDIC
+#endif
+
+#define	JNL_DL_COMPILED(l) ((l) <= JNL_DL_CEILING || (l) <= jnlDL_DIAGNOSTIC)
+
 /*
  *	jnl_DetailLevel_Description_t - complex data type
  *
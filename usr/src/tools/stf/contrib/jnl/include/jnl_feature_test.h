@@ -51,6 +51,25 @@ extern "C" {
 
 #define	_STF_JNL_VARIADIC_MACROS	1
 
+/*
+ * Thread local storage.
+ *
+ * The per-thread message buffers are found through a __thread pointer
+ * when the compiler supports it (Sun Studio 12, GNUC version 3.3 or
+ * later) and through a hashtable keyed by thread id otherwise.
+ *
+ * Compiler switch -D_STF_JNL_TLS=0 selects the hashtable.
+ */
+#ifndef	_STF_JNL_TLS
+#if (defined(__SUNPRO_C) && __SUNPRO_C >= 0x590) || \
+	(defined(__GNUC__) && (__GNUC__ > 3 || \
+	(__GNUC__ == 3 && __GNUC_MINOR__ >= 3)))
+#define	_STF_JNL_TLS	1
+#else
+#define	_STF_JNL_TLS	0
+#endif
+#endif
+
 #ifdef	__cplusplus
 }
 #endif
@@ -187,10 +187,17 @@ jnl_dl_level_fetch(char *description);
  *
  *      <trace line> is a line of stack track appropriate for the language in
  *              which the test was written.
+ *
+ *  Notes:
+ *	The level is checked before any of the other arguments are evaluated,
+ *	so a filtered message costs no formatting at all; arguments such as
+ *	jnl_OPERATION(...) are not even called. The level expression itself
+ *	is evaluated twice. See also JNL_DL_CEILING in jnl_detail.h.
  */
 #if (_STF_JNL_VARIADIC_MACROS >= 1)
 
-#define	jnl_LOG(...) (jnl_log_(__FILE__, __LINE__, __VA_ARGS__))
+#define	jnl_LOG(l, ...) ((JNL_DL_COMPILED(l) && jnl_dl_check(l)) ? \
+	jnl_log_(__FILE__, __LINE__, (l), __VA_ARGS__) : 0)
 
 int
 jnl_log_(char *file__,
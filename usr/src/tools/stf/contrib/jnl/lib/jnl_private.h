@@ -55,7 +55,7 @@ static char *jnl_message_title[] = {
  */
 typedef enum buffer_sizes {
 	jnlBS_TOC	= 1024,		/* Table of contents default.	*/
-	jnlBS_LOG	= 4096,		/* jnl_LOG() buffer size.	*/
+	jnlBS_LOG	= 4096,		/* jnl_LOG() buffer, else heap.	*/
 	jnlBS_format	= 1024,		/* Intermediate format strings.	*/
 	jnlBS_OPERATION	= 1024,		/* jnl_OPERATION() buffer size.	*/
 	jnlBS_EXPECTED	= 1024,		/* jnl_EXPECTED() buffer size.	*/
@@ -83,6 +83,14 @@ typedef struct jnl_buffer {
 	char		*buffer[jnlBI_MAX_];	/* Pointers to buffers */
 } jnl_buffer_t;
 
+#if (_STF_JNL_TLS >= 1)
+/*
+ * The calling thread's jnl_buffers, allocated on first use. jnl_key only
+ * carries the destructor that frees them at thread exit.
+ */
+static __thread jnl_buffer_t	*jnl_tls	= (jnl_buffer_t *)NULL;
+static thread_key_t		 jnl_key;
+#else
 /*
  * Pointer to the table of contents for the jnl_buffers.
  *
@@ -92,6 +100,13 @@ typedef struct jnl_buffer {
  */
 static void			*jnl_toc	= (void *)NULL;
 
+/*
+ * The table of contents is keyed by thread_t alone, so its lookups are
+ * compiled in here with the hash and compare for a thread_t.
+ */
+HT_TYPED_DECLARE(jnl_toc_ht, thread_t, HT_TYPED_HASH_INT, HT_TYPED_EQUAL)
+#endif
+
 /*
  * Detail level for journal calls -- defaults to jnlDL_PROGRESS.
  */
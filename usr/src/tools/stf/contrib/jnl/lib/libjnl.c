@@ -36,7 +36,7 @@
 #include <thread.h>
 #include <unistd.h>
 
-#include <hashtable.h>
+#include <hashtable_typed.h>
 #include <stf.h>
 #include <jnl.h>
 
@@ -152,7 +152,7 @@ jnl_internal_error_(char *format_string, ...)
  *  _jnlDL_init_()
  *
  *  Description:
- *	Initialize the detail level and create a table of contents for the
+ *	Initialize the detail level and set up per-thread storage for the
  *	message buffers. This routines gets called at library load time before
  *	main() gets invoked.
  *
@@ -168,6 +168,9 @@ jnl_internal_error_(char *format_string, ...)
 static void
 _jnl_init_();
 
+static void
+_jnl_buffer_free(void *buffer);
+
 #pragma init(_jnl_init_)
 
 static void
@@ -216,25 +219,158 @@ _jnl_init_() {
 
 	} /* if (detail_level_env != (char *)NULL) {...} */
 
+#if (_STF_JNL_TLS >= 1)
+	/*
+	 * Message buffers live in thread local storage; the key exists only
+	 * to free them when their thread exits.
+	 */
+	if (thr_keycreate(&jnl_key, _jnl_buffer_free) != 0) {
+		jnl_internal_error("_jnl_DL_init_():\n"
+		    " - thr_keycreate() failed with error %d",
+		    errno);
+
+		exit(EXIT_FAILURE);
+
+	} /* if (thr_keycreate(...) != 0) {...} */
+#else
 	/*
-	 * Create a hashtable to keep track of message buffers.
+	 * Create a hashtable to keep track of message buffers. Thread ids
+	 * fit in the slots of an open addressing table, so a lookup doesn't
+	 * chase any pointers. The table sizes itself to however many threads
+	 * journal, rather than sitting at jnlBS_TOC or doubling whenever it
+	 * fills.
 	 */
-	jnl_toc = ht_create(jnlBS_TOC, sizeof (thread_t), 0);
+	jnl_toc = jnl_toc_ht_create(jnlBS_TOC, hto_resize_implicit);
 	if (jnl_toc == (void *)NULL) {
 		jnl_internal_error("_jnl_DL_init_():\n"
-		    " - ht_create(%d, %d, %d) failed with error %d",
+		    " - jnl_toc_ht_create(%d, %d) failed with error %d",
 		    jnlBS_TOC,
-		    sizeof (thread_t),
-		    0);
+		    hto_resize_implicit,
+		    errno);
 
 		exit(EXIT_FAILURE);
 
 	} /* if (jnl_toc == (void *)NULL) {...} */
+#endif
 
 	return;
 
 } /* void _jnl_init_() {...} */
 
+/*
+ * void
+ * _jnl_buffer_free(void *buffer);
+ *
+ * Description:
+ *	Release a jnl_buffer_t and its message buffers. With thread local
+ *	buffers this is the thread specific data destructor, so it runs as
+ *	each thread that used the journal exits.
+ *
+ * Parameters:
+ *	void *buffer
+ *		Input - The jnl_buffer_t to release.
+ *
+ * Return value:
+ *	None.
+ */
+static void
+_jnl_buffer_free(void *buffer)
+{
+	/*
+	 * Locals...
+	 */
+	jnl_buffer_t		*jnl = (jnl_buffer_t *)buffer;
+	jnl_buffer_index_t	 j;	/* Buffer index.		*/
+
+	if (jnl == (jnl_buffer_t *)NULL) {
+		return;
+	}
+
+	for (j = jnlBI_MIN_; j < jnlBI_MAX_; ++j) {
+
+		(void) free(jnl->buffer[j]);
+
+	} /* for (...; j < jnlBI_MAX_; ++j) {...} */
+
+	(void) free(jnl);
+
+#if (_STF_JNL_TLS >= 1)
+	jnl_tls = (jnl_buffer_t *)NULL;
+#endif
+
+	return;
+
+} /* void _jnl_buffer_free(void *buffer) {...} */
+
+/*
+ * jnl_buffer_t *
+ * _jnl_buffer_alloc(thread_t thread_id);
+ *
+ * Description:
+ *	Allocate a message buffer structure and a message buffer of each
+ *	type for the thread passed.
+ *
+ * Parameters:
+ *	thread_t	threadid
+ *		Input - Identity of the thread the buffers are for.
+ *
+ * Return value:
+ *	jnl_buffer_t *	The new buffers, or (jnl_buffer_t *)NULL if they
+ *			could not all be allocated.
+ */
+static jnl_buffer_t *
+_jnl_buffer_alloc(thread_t thread_id)
+{
+	/*
+	 * Locals...
+	 */
+	jnl_buffer_t		*jnl;	/* Buffers for this thread.	*/
+	jnl_buffer_index_t	 i;	/* Buffer index.		*/
+
+	jnl = (jnl_buffer_t *)calloc(1, sizeof (*jnl));
+	if (jnl == (jnl_buffer_t *)NULL) {
+
+		/*
+		 * Something's broken!
+		 */
+		jnl_internal_error("_jnl_buffer_alloc(%d)\n"
+		    "Failed to allocate message buffer toc.",
+		    thread_id);
+
+		return ((jnl_buffer_t *)NULL);
+
+	} /* if (jnl == (jnl_buffer_t *)NULL) {...} */
+
+	/*
+	 * Get a buffer for each message type.
+	 */
+	for (i = jnlBI_MIN_; i < jnlBI_MAX_; ++i) {
+
+		jnl->buffer[i] = (char *)malloc(jnl_message_buffer_size[i]);
+		if (jnl->buffer[i] == (char *)NULL) {
+
+			/*
+			 * At least one of them could not be allocated.
+			 * So free up everything and return failure.
+			 */
+			_jnl_buffer_free(jnl);
+			jnl_internal_error("_jnl_buffer_alloc(%d)\n"
+			    "Failed to allocate message buffer(%d).",
+			    thread_id,
+			    i);
+
+			return ((jnl_buffer_t *)NULL);
+
+		} /* if (jnl->buffer[i] == (char *)NULL) {...} */
+
+	} /* for (... i = jnlBI_MIN_; i < jnlBI_MAX_; ++i) {...} */
+
+	jnl->thread_id = thread_id;
+
+	return (jnl);
+
+} /* jnl_buffer_t *_jnl_buffer_alloc(thread_t thread_id) {...} */
+
 /*
  * char *
  * _jnl_buffer_fetch(thread_t thread_id, jnl_buffer_index_t index);
@@ -242,7 +378,11 @@ _jnl_init_() {
  * Description:
  *	Fetch the address of the message buffer indicated by the index passed.
  *	If there are no message buffers for this thread yet, then some will be
- *	allocated and installed into the table of content first.
+ *	allocated first.
+ *
+ *	Where thread local storage is available the calling thread's buffers
+ *	hang off jnl_tls, and thread_id must be the calling thread. Otherwise
+ *	they are kept in the table of contents, keyed by thread_id.
  *
  * Parameters:
  *	thread_t	threadid
@@ -262,8 +402,6 @@ _jnl_buffer_fetch(thread_t thread_id, jnl_buffer_index_t index)
 	 */
 	jnl_buffer_t		*jnl;	/* Buffers for this thread.	*/
 	int			 ret;	/* Just a return value.		*/
-	jnl_buffer_index_t	 i;	/* Buffer index.		*/
-	jnl_buffer_index_t	 j;	/* Ditto...			*/
 
 	/*
 	 * Make sure we're not using bogus parameters.
@@ -278,10 +416,46 @@ _jnl_buffer_fetch(thread_t thread_id, jnl_buffer_index_t index)
 
 	} /* if (indexn < jnlBI_MIN_ || index >= jnlBI_MAX_) {...} */
 
+#if (_STF_JNL_TLS >= 1)
+
+	/*
+	 * The fast path: this thread has been here before.
+	 */
+	jnl = jnl_tls;
+	if (jnl != (jnl_buffer_t *)NULL) {
+		return (jnl->buffer[index]);
+	}
+
+	jnl = _jnl_buffer_alloc(thread_id);
+	if (jnl == (jnl_buffer_t *)NULL) {
+		return ((char *)NULL);
+	}
+
+	/*
+	 * Register the buffers with the thread specific data key, only so
+	 * the destructor frees them when this thread exits.
+	 */
+	ret = thr_setspecific(jnl_key, (void *)jnl);
+	if (ret != 0) {
+		_jnl_buffer_free(jnl);
+		jnl_internal_error("_jnl_buffer_fetch(%d, %d)\n"
+		    "thr_setspecific() returned %d.",
+		    thread_id,
+		    index,
+		    ret);
+
+		return ((char *)NULL);
+
+	} /* if (ret != 0) {...} */
+
+	jnl_tls = jnl;
+
+#else	/* _STF_JNL_TLS */
+
 	/*
 	 * Probe the table of contents for buffers for the thread passed.
 	 */
-	jnl = (jnl_buffer_t *)ht_locate_key(jnl_toc, &thread_id);
+	jnl = (jnl_buffer_t *)jnl_toc_ht_locate(jnl_toc, thread_id);
 	if (jnl == (jnl_buffer_t *)NULL) {
 
 		/*
@@ -295,12 +469,12 @@ _jnl_buffer_fetch(thread_t thread_id, jnl_buffer_index_t index)
 			 * Loser! Something's really broken.
 			 */
 			jnl_internal_error("_jnl_buffer_fetch(%d, %d)\n"
-			    "ht_locate_key(%p, %p) failed.\n"
+			    "jnl_toc_ht_locate(%p, %d) failed.\n"
 			    "errno = %d, %s",
 			    thread_id,
 			    index,
 			    jnl_toc,
-			    &thread_id,
+			    thread_id,
 			    errno,
 			    strerror(errno));
 
@@ -309,75 +483,16 @@ _jnl_buffer_fetch(thread_t thread_id, jnl_buffer_index_t index)
 		} /* if (errno != ENOENT && errno != ENOTDIR) {...} */
 
 		/*
-		 * Allocate a message buffer structure and the message buffers,
-		 * then insert them into the table of contents.
+		 * Allocate the message buffers, then insert them into the
+		 * table of contents.
 		 */
-		jnl = (jnl_buffer_t *)malloc(sizeof (*jnl));
+		jnl = _jnl_buffer_alloc(thread_id);
 		if (jnl == (jnl_buffer_t *)NULL) {
-
-			/*
-			 * Something's broken!
-			 */
-			jnl_internal_error("_jnl_buffer_fetch(%d, %d)\n"
-			    "Failed to allocate message buffer toc.",
-			    thread_id,
-			    index);
-
 			return ((char *)NULL);
+		}
 
-		} /* if (buffer == (jnl_buffer_t *)NULL) {...} */
-
-		/*
-		 * Get a buffer for each message type.
-		 */
-		jnl->buffer[jnlBI_OPERATION]	=
-		    (char *)malloc(jnlBS_OPERATION);
-
-		jnl->buffer[jnlBI_EXPECTED]	=
-		    (char *)malloc(jnlBS_EXPECTED);
-
-		jnl->buffer[jnlBI_ERROR]	=
-		    (char *)malloc(jnlBS_ERROR);
-
-		jnl->buffer[jnlBI_ACTION]	=
-		    (char *)malloc(jnlBS_ACTION);
-
-		/*
-		 * Check for allocation failures.
-		 */
-		for (i = jnlBI_MIN_; i < jnlBI_MAX_; ++i) {
-
-			if (jnl->buffer[i] == (char *)NULL) {
-
-				/*
-				 * At least one of them could not be allocated.
-				 * So free up everything and return failure.
-				 */
-				for (j = jnlBI_MIN_; j < jnlBI_MAX_; ++j) {
-
-					(void) free(jnl->buffer[j]);
-
-				} /* for (...; j < jnlBI_MAX_; ++j) {...} */
-
-				(void) free(jnl);
-				jnl_internal_error("jnl_buffer_fetch(%d, %d)\n"
-				    "Failed to allocate message buffer(%d).",
-				    thread_id,
-				    index,
-				    i);
-
-				return ((char *)NULL);
-
-			} /* if (jnl->buffer[i] == (char *)NULL) {...} */
-
-		} /* for (... i = jnlBI_MIN_; i < jnlBI_MAX_; ++i) {...} */
-
-		/*
-		 * Put this new entry into the table of contents.
-		 */
-		jnl->thread_id = thread_id;
-		ret = ht_insert_key(jnl_toc,
-		    (void *)&jnl->thread_id,
+		ret = jnl_toc_ht_insert(jnl_toc,
+		    &jnl->thread_id,
 		    (void *)jnl);
 
 		if (ret != 0) {
@@ -385,20 +500,14 @@ _jnl_buffer_fetch(thread_t thread_id, jnl_buffer_index_t index)
 			/*
 			 * Huh? That didn't seem to work.
 			 */
-			for (j = jnlBI_MIN_; j < jnlBI_MAX_; ++j) {
-
-				(void) free(jnl->buffer[j]);
-
-			} /* for (...; j < jnlBI_MAX_; ++j) {...} */
-
-			(void) free(jnl);
+			_jnl_buffer_free(jnl);
 			jnl_internal_error("_jnl_buffer_fetch(%d, %d)\n"
-			    "ht_insert_key(%p, %p, %p) returned %d.\n"
+			    "jnl_toc_ht_insert(%p, %p, %p) returned %d.\n"
 			    "Could not insert new journal buffer group.",
 			    thread_id,
 			    index,
 			    jnl_toc,
-			    &jnl->thread_id,
+			    &thread_id,
 			    jnl,
 			    ret);
 
@@ -408,6 +517,8 @@ _jnl_buffer_fetch(thread_t thread_id, jnl_buffer_index_t index)
 
 	} /* if (buffer == (jnl_buffer_t *)NULL) {...} */
 
+#endif	/* _STF_JNL_TLS */
+
 	/*
 	 * Return the buffer desired...
 	 */
@@ -781,14 +892,15 @@ jnl_vlog_(jnl_DetailLevel_t level, char *format_string, va_list args)
 	/*
 	 * Locals...
 	 */
-	int	 ret;		/* Just a return value.			*/
-	char	 format_buffer[jnlBS_format]; /* Intermediate format string. */
-	char	 jnl_buffer[jnlBS_LOG];	/* Buffer to send to journal.	*/
+	int	 hlen;		/* Length of the message header.	*/
+	int	 blen;		/* Length of the caller's text.		*/
+	size_t	 len;		/* Length of the whole block.		*/
+	char	 jnl_buffer[jnlBS_LOG];	/* Usual buffer for the journal. */
+	char	*block;		/* Block to send to the journal.	*/
+	size_t	 size;		/* Size of block.			*/
+	va_list	 copy;		/* In case the text must be redone.	*/
 	jnlDL_Description_t *jnlDL_desc;	/* Level description.	*/
-	char	*fmt;		/* Primary format string.		*/
-	char	*p;		/* For pretty printing the output.	*/
-	char	*s;		/* Ditto.				*/
-	char	 c;		/* Just a character.			*/
+	char	*fmt;		/* Header format string.		*/
 
 	/*
 	 * If the level passed is too high, then there's nothing to do this
@@ -807,92 +919,105 @@ jnl_vlog_(jnl_DetailLevel_t level, char *format_string, va_list args)
 #if (_STF_JNL_VARIADIC_MACROS >= 1)
 
 	if (jnlDL_desc->level == level) {
-		fmt = "[ - %s (file: %s, line: %d) - ]\n%s";
+		fmt = "[ - %s (file: %s, line: %d) - ]\n";
 
 	} else {
-		fmt = "[ - ~%s (file: %s, line: %d) - ]\n%s";
+		fmt = "[ - ~%s (file: %s, line: %d) - ]\n";
 
 	} /* if (jnlDL_desc->level != level) {...} */
 
-	ret = snprintf(format_buffer,
-	    sizeof (format_buffer),
-	    fmt,
-	    jnlDL_desc->description,
-	    file__,
-	    line__,
-	    format_string);
+#define	JNL_VLOG_HEADER(b, s) snprintf((b), (s), fmt, \
+	jnlDL_desc->description, \
+	file__, \
+	line__)
 #else
 	if (jnlDL_desc->level == level) {
-		fmt = "[ - %s - ]\n%s";
+		fmt = "[ - %s - ]\n";
 
 	} else {
-		fmt = "[ - ~%s - ]\n%s";
+		fmt = "[ - ~%s - ]\n";
 
 	} /* if (jnlDL_desc->level != level) {...} */
 
-	ret = snprintf(format_buffer,
-	    sizeof (format_buffer),
-	    fmt,
-	    jnlDL_desc->description,
-	    format_string);
+#define	JNL_VLOG_HEADER(b, s) snprintf((b), (s), fmt, \
+	jnlDL_desc->description)
 #endif
+
 	/*
-	 * Finally, initialize the vargs list and put the caller's data into
-	 * the buffer.
+	 * Format the header and the caller's text straight into the block,
+	 * once. Only if the block will not fit in the local buffer is it
+	 * done again, into one from the heap that is big enough.
 	 */
-	ret = vsnprintf(jnl_buffer, sizeof (jnl_buffer), format_buffer, args);
-	if (ret < 0) {
+	block = jnl_buffer;
+	size = sizeof (jnl_buffer);
+
+	hlen = JNL_VLOG_HEADER(block, size);
+	va_copy(copy, args);
+	if (hlen >= 0 && hlen < size) {
+		blen = vsnprintf(block + hlen, size - hlen, format_string, copy);
+
+	} else {
+		blen = vsnprintf((char *)NULL, 0, format_string, copy);
+
+	} /* if (hlen >= 0 && hlen < size) {...} else {...} */
+	va_end(copy);
+
+	if (hlen < 0 || blen < 0) {
 		jnl_internal_error("jnl_log_():\n"
 		    "vsnprintf(%p, %d, %p, ...) returned %d.\n"
 		    "Could not format journal message.",
-		    jnl_buffer,
-		    sizeof (jnl_buffer),
-		    format_buffer,
-		    ret);
+		    block,
+		    size,
+		    format_string,
+		    (hlen < 0) ? hlen : blen);
 
 		return (-1);
 
-	} /* if (vsnprintf(jbuffer, args) < 0) {...} */
+	} /* if (hlen < 0 || blen < 0) {...} */
 
 	/*
-	 * Finally, commit this beast to the journal file!
-	 * In order to make this look pretty in the journal, I need to scan
-	 * for new line characters and send each line individually.
+	 * Room is needed for the trailing blank line and its newline too.
 	 */
-	for (s = p = jnl_buffer; *p; ++s) {
-		if (*s == '\n' || *s == '\0') {
+	len = hlen + blen;
+	if (len + 3 > size) {
+		size = len + 3;
+		block = (char *)malloc(size);
+		if (block == (char *)NULL) {
+			jnl_internal_error("jnl_log_():\n"
+			    "Could not allocate %lu bytes for journal message.",
+			    (ulong_t)size);
 
-			/*
-			 * If they point to the same place, then we have
-			 * either adjacent \n characters or we started with
-			 * a \n character.
-			 */
-			if (s == p) {
-				(void) stf_jnl_msg(" ");
+			return (-1);
 
-			} else /* if (s != p) */ {
-				c  = *s;
-				*s = '\0';
-				(void) stf_jnl_msg(p);
-				*s = c;
+		} /* if (block == (char *)NULL) {...} */
 
-			} /* if (s == p) {...} else {...} */
+		(void) JNL_VLOG_HEADER(block, size);
+		(void) vsnprintf(block + hlen, size - hlen, format_string,
+		    args);
 
-			/*
-			 * Whatever we printed, advance the scanning pointer
-			 * past it, and update the printing pointer to the
-			 * new location.
-			 */
-			p = s + (*s == '\0' ? 0 : 1);
+	} /* if (len + 3 > size) {...} */
 
-		} /* if (*s == '\n') {...} */
-
-	} /* for (fmt = jnl_buffer; *fmt; ++fmt) {...} */
+#undef	JNL_VLOG_HEADER
 
 	/*
-	 * Finally, put one blank line after the message for legibility.
+	 * Finally, put one blank line after the message for legibility, and
+	 * commit this beast to the journal file. stf_jnl_msg_lines() sends
+	 * each line as a message of its own, all in one write.
 	 */
-	(void) stf_jnl_msg(" ");
+	if (block[len - 1] != '\n') {
+		block[len++] = '\n';
+
+	} /* if (block[len - 1] != '\n') {...} */
+
+	block[len++] = ' ';
+	block[len] = '\0';
+
+	stf_jnl_msg_lines(block);
+
+	if (block != jnl_buffer) {
+		free(block);
+
+	} /* if (block != jnl_buffer) {...} */
 
 	/*
 	 * Guess it worked...
@@ -86,7 +86,9 @@ void stf_jnl_testcase_end(char [], int, int);
 void stf_jnl_assert_start(char *);
 void stf_jnl_assert_end(int);
 void stf_jnl_msg(char *);
+void stf_jnl_msg_lines(char *);
 void stf_jnl_totals(char *, int *);
+void stf_jnl_flush();
 
 /*
  * this was moved here per an RFE for use with the ldi testsuite though it is
@@ -33,6 +33,7 @@ extern "C" {
 #endif
 
 #include <stf.h>
+#include <stf_jbin.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -44,7 +45,10 @@ extern "C" {
 #include <wait.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
+#include <zlib.h>
 #include <synch.h>
+#include <atomic.h>
 
 #define	LIBVERS 1.4	/* libtpi version number, same as VERS in Makefile */
 #define	MAXCHAR 8192
@@ -66,12 +70,27 @@ extern "C" {
 /* Environment Variables */
 #define	VARFILE		"VARFILE"	/* variable file, get appended w/pid */
 #define	JNLNAME		"STF_JOURNAL"	/* journal file */
+#define	JNLBUFSIZE	"STF_JNL_BUFSIZE"	/* journal write buffer size */
+#define	JNLFLUSHAGE	"STF_JNL_FLUSHAGE"	/* max buffered age, msec */
+#define	JNLLATENCY	"STF_JNL_LATENCY"	/* max captured output delay */
+#define	JNLSTAMP	"STF_JNL_STAMP"	/* time captured output lines */
+#define	JNLCOMPRESS	"STF_JNL_COMPRESS"	/* gzip level of the journal */
 #define	SUITE		"SUITE"		/* suite name */
 #define	TBIN		"TBIN"		/* test binary dir */
 #define	TRES		"TRES"		/* test results dir */
 #define	TEXP		"TEXP"		/* test ?? */
 #define	DIR		"DIR"		/* test ?? */
 
+/* Journal writer defaults */
+#define	JNL_FLUSHAGE_DEFAULT	1000	/* msec, when buffering is enabled */
+#define	JNL_ZBUFSIZE_DEFAULT	8192	/* buffer size, when compressing */
+#define	JNL_LATENCY_DEFAULT	100	/* msec, stf_jnl_context output */
+
+/* stf_capture_run() results */
+#define	STF_CAPTURE_EXITED	0	/* the child exited */
+#define	STF_CAPTURE_TIMEDOUT	1	/* the deadline passed first */
+#define	STF_CAPTURE_STOPPED	2	/* stf_capture_stop() was called */
+
 /* format of jvarfile */
 struct jvars {
 	mutex_t jvar_mlock;
@@ -84,6 +103,33 @@ struct jvars {
 	unsigned int short jsubcnt;
 };
 
+/*
+ * Version 2 of the jvarfile appends a table of slots to the original
+ * layout, which old readers still map on its own.  Each concurrently
+ * running testcase owns the slot of its process group and keeps its
+ * assertion strings there; the counters in the legacy part are updated
+ * with atomics, by every writer.  jvar_mlock is still initialized for
+ * old writers and guards the legacy strings when no slot is free, but
+ * the version 2 paths never take it.
+ */
+#define	JVARS_MAGIC	0x4a564152	/* "JVAR" */
+#define	JVARS_VERSION	2
+#define	JVARS_NSLOTS	64
+
+struct jvars_slot {
+	volatile uint32_t js_owner;	/* process group, 0 when free */
+	char js_asrt[256];
+	char js_subid[256];
+	char js_argid[256];
+};
+
+struct jvars_file {
+	struct jvars jf_legacy;		/* must stay first */
+	uint32_t jf_magic;
+	uint32_t jf_version;
+	struct jvars_slot jf_slot[JVARS_NSLOTS];
+};
+
 void stf_jnl_end();
 void stf_jnl_env();
 void stf_jnl_msg(char *);
@@ -100,14 +146,45 @@ static char *get_dt(void);
 static char *get_status_name(int);
 static char *get_time(void);
 static void print_entry(char *, int);
+static void jnl_flush_locked(void);
+static void writev_all(int, struct iovec *, int, const char *);
+static void jnl_writev_locked(struct iovec *, int);
+static void jbin_open_locked(void);
+static void jbin_flush_locked(void);
+static uint8_t jbin_result(const char *);
+static void jbin_header(stf_jbin_rec_t *, const char *, size_t);
+static void jbin_add(const char *, size_t);
+static void capture_write(int, ssize_t, char *);
+static int capture_tag(char *, const char *);
+static void out_add(const char *, size_t, int);
+static void out_stage_add(const char *, size_t);
+static void out_flush(void);
+static void out_flush_aged(void);
 static char *build_id(char *sub_id, char *arg_id);
 
+static struct tm *get_tm(hrtime_t);
+
 static struct jvars *
 vfile_mmap();
+static struct jvars_slot *jvars_slot(pid_t, int);
 
 int stf_jnl_open();
 int stf_jnl_close();
 
+void stf_child_watch_init();
+void stf_child_watch_reset();
+int stf_child_watch(pid_t);
+short stf_child_events(int);
+int stf_child_exited(int, pid_t);
+
+void stf_capture_init(int);
+void stf_capture_stop();
+int stf_capture_run(int, int, int, pid_t, hrtime_t);
+void stf_capture_end(int, int);
+
+void stf_parse_timeout(char *, time_t *);
+void stf_kill_group(pid_t);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,113 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+
+/*
+ * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#ifndef _STF_JBIN_H
+#define	_STF_JBIN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+/*
+ * Binary companion journal.
+ *
+ * When STF_JOURNAL_BIN names a file, libstf appends a binary record to
+ * it for every record it writes to the text journal.  A record is a
+ * fixed size header followed by the exact text that went to the text
+ * journal, padded to an 8 byte boundary, so the text journal can be
+ * rebuilt from the binary one byte for byte.  The file is written in
+ * the native byte order of the machine that ran the tests.
+ *
+ * "stf_jnl_bin -i" seals the file by appending a JBIN_T_INDEX record:
+ * an array of stf_jbin_idx_t, one per testcase in file order, then the
+ * string table of testcase names, then a stf_jbin_trailer_t which is
+ * always the last thing in a sealed file.  A reader maps the file,
+ * checks the trailer magic and goes straight to the index.  Records
+ * appended after sealing are still found by a sequential scan, which
+ * skips index records; sealing again indexes the whole file.
+ */
+
+#define	JBINNAME	"STF_JOURNAL_BIN"	/* binary journal file */
+
+#define	JBIN_REC_MAGIC	0x4a52			/* "JR" */
+#define	JBIN_MAGIC	0x314e49424a465453ULL	/* "STFJBIN1" */
+#define	JBIN_ALIGN(n)	(((n) + 7) & ~(size_t)7)
+
+/* record types */
+#define	JBIN_T_OTHER		0
+#define	JBIN_T_START		1	/* Start */
+#define	JBIN_T_END		2	/* End */
+#define	JBIN_T_ENV		3	/* STF_ENV */
+#define	JBIN_T_TC_START		4	/* Test_Case_Start */
+#define	JBIN_T_TC_END		5	/* Test_Case_End */
+#define	JBIN_T_ASSERT_START	6	/* Assertion_Start */
+#define	JBIN_T_ASSERT_END	7	/* Assertion_End */
+#define	JBIN_T_MSG		8	/* Msg */
+#define	JBIN_T_TOTALS		9	/* Totals */
+#define	JBIN_T_CAPTURE		10	/* captured stdout/stderr lines */
+#define	JBIN_T_INDEX		11	/* index written by stf_jnl_bin -i */
+
+#define	JBIN_NORESULT		0xff	/* jr_result of a record without one */
+
+typedef struct stf_jbin_rec {
+	uint16_t	jr_magic;	/* JBIN_REC_MAGIC */
+	uint8_t		jr_type;	/* JBIN_T_* */
+	uint8_t		jr_result;	/* STF result index, or JBIN_NORESULT */
+	uint32_t	jr_len;		/* bytes of text that follow */
+	int32_t		jr_pid;		/* pid in the text record */
+	int32_t		jr_tcid;	/* testcase: its process group */
+	uint64_t	jr_ns;		/* gethrtime() when written */
+} stf_jbin_rec_t;
+
+typedef struct stf_jbin_idx {
+	int32_t		ji_tcid;	/* pid of the testcase */
+	uint32_t	ji_name;	/* name, offset in the string table */
+	uint64_t	ji_start;	/* offset of the Test_Case_Start record */
+	uint64_t	ji_end;		/* of the Test_Case_End, 0 if none */
+	uint64_t	ji_start_ns;
+	uint64_t	ji_end_ns;
+	uint8_t		ji_result;	/* STF result index, or JBIN_NORESULT */
+	uint8_t		ji_pad[7];
+} stf_jbin_idx_t;
+
+typedef struct stf_jbin_trailer {
+	uint64_t	jt_magic;	/* JBIN_MAGIC */
+	uint64_t	jt_records;	/* offset of the index record */
+	uint64_t	jt_index;	/* offset of the first stf_jbin_idx_t */
+	uint64_t	jt_strtab;	/* offset of the string table */
+	uint32_t	jt_nindex;	/* number of stf_jbin_idx_t */
+	uint32_t	jt_strsize;	/* size of the string table */
+} stf_jbin_trailer_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _STF_JBIN_H */
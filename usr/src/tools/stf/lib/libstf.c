@@ -27,15 +27,83 @@
 #include <sys/utsname.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <pwd.h>
 #include <stf_impl.h>
 #include <stf.h>
 #include <string.h>
 #include <unistd.h>
 #include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/uio.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
+#endif
 
 /*LINTLIBRARY*/
 
+/*
+ *	Journal writer state.  The journal is opened once per process and
+ *	kept open.  When STF_JNL_BUFSIZE is set, whole records collect in
+ *	jnl_wbuf and go out together; every flush is a single write() of
+ *	complete records, so O_APPEND never lets them interleave with the
+ *	records of other processes.
+ */
+static mutex_t	jnl_wlock = DEFAULTMUTEX;
+static int	jnl_wfd = -1;		/* cached journal descriptor */
+static char	*jnl_wname = NULL;	/* STF_JOURNAL jnl_wfd was opened on */
+static char	*jnl_wbuf = NULL;	/* pending records */
+static size_t	jnl_wlen = 0;		/* bytes pending in jnl_wbuf */
+static size_t	jnl_wsize = 0;		/* buffer size, 0 is write-through */
+
+static struct jvars_file *jvfile = NULL; /* VARFILE, when it has slots */
+static hrtime_t	jnl_wage = 0;		/* max age of pending records */
+static hrtime_t	jnl_wfirst = 0;		/* when the oldest record arrived */
+
+/*
+ *	Binary companion journal, see stf_jbin.h.  Its records are
+ *	buffered along with the text records and flushed with them.
+ */
+static int	jnl_bfd = -1;		/* STF_JOURNAL_BIN descriptor */
+static char	*jnl_bname = NULL;	/* STF_JOURNAL_BIN path of jnl_bfd */
+static char	*jnl_bbuf = NULL;	/* pending binary records */
+static size_t	jnl_blen = 0;
+static size_t	jnl_bsize = 0;		/* twice jnl_wsize, room for headers */
+static pid_t	cap_tcid = 0;		/* testcase of captured output */
+
+/*
+ *	Compressed journal.  With STF_JNL_COMPRESS set, every flush of the
+ *	journal is written as a complete gzip member by a single write(),
+ *	so the members of concurrent writers never interleave and the
+ *	journal stays a valid gzip file that can be read while it grows.
+ *	Buffering is forced on to give the members something to compress;
+ *	a crash loses at most a buffer or JNL_FLUSHAGE worth of records.
+ */
+static int	jnl_zlevel = 0;		/* gzip level, 0 is plain text */
+static z_stream	jnl_zs;
+static Bytef	*jnl_zbuf = NULL;	/* compressed member */
+static size_t	jnl_zsize = 0;
+
+static const struct {
+	const char *tag;
+	uint8_t type;
+} jbin_types[] = {
+	{ JNL_START,		JBIN_T_START },
+	{ JNL_END,		JBIN_T_END },
+	{ JNL_ENV,		JBIN_T_ENV },
+	{ JNL_TESTCASE_START,	JBIN_T_TC_START },
+	{ JNL_TESTCASE_END,	JBIN_T_TC_END },
+	{ JNL_ASSERT_START,	JBIN_T_ASSERT_START },
+	{ JNL_ASSERT_END,	JBIN_T_ASSERT_END },
+	{ JNL_MSG,		JBIN_T_MSG },
+	{ JNL_TOTALS,		JBIN_T_TOTALS },
+	{ "stdout",		JBIN_T_CAPTURE },
+	{ "stderr",		JBIN_T_CAPTURE }
+};
+
 /*
  *	Beginning of journaling, print start and uname info, called from
  *	jnl_context
@@ -48,7 +116,8 @@ pid_error()
 	    "STF implementation does not handle getpid() > INT_MAX ";
 	int jnl_fd = stf_jnl_open();
 
-	(void) write(jnl_fd, msg_pid_error, strlen(msg_pid_error));
+	print_entry(msg_pid_error, jnl_fd);
+	stf_jnl_flush();
 	(void) fsync(jnl_fd);
 	exit(1);
 }
@@ -75,7 +144,7 @@ stf_jnl_start_pid(int pid)
 	static char var_envname[40];
 	int var_fd;
 	pid_t vpid;
-	static struct jvars vf_init;
+	static struct jvars_file vf_init;
 	struct jvars *vfptr;
 	mode_t old_umask;
 
@@ -84,6 +153,8 @@ stf_jnl_start_pid(int pid)
 	struct passwd *pw;
 
 	char buffer[MAXCHAR + 2];
+	struct timeval anchor;
+	hrtime_t anchor_hr;
 	char *username;
 	char stdtag[] = "stderr| ";
 
@@ -110,36 +181,39 @@ stf_jnl_start_pid(int pid)
 		perror("jnl_start: vfile_mmap : open");
 		(void) snprintf(buffer, sizeof (buffer),
 		    "%sjnl_start: vfile_mmap error\n", stdtag);
-		(void) write(jnl_fd, buffer, strlen(buffer));
+		print_entry(buffer, jnl_fd);
 		exit(1);
 	}
 	(void) umask(old_umask);
 
-	if ((mutex_init(&vf_init.jvar_mlock, USYNC_PROCESS, 0)) != 0) {
+	if ((mutex_init(&vf_init.jf_legacy.jvar_mlock, USYNC_PROCESS, 0)) !=
+	    0) {
 		perror("jnl_start: mutex_init ");
 		(void) snprintf(buffer, sizeof (buffer),
 		    "%sjnl_start: mutex_init error\n", stdtag);
-		(void) write(jnl_fd, buffer, strlen(buffer));
+		print_entry(buffer, jnl_fd);
 		exit(1);
 	}
 
-	vf_init.jasrt[0] = '?';
-	vf_init.jsubid[0] = '\0';
-	vf_init.jargid[0] = '\0';
-	vf_init.jseq = 0;
-	vf_init.jblk = 0;
-	vf_init.jact = 0;
-	vf_init.jsubcnt = 0;
-
-	if (write(var_fd, &vf_init, sizeof (struct jvars)) == -1) {
+	vf_init.jf_legacy.jasrt[0] = '?';
+	vf_init.jf_legacy.jsubid[0] = '\0';
+	vf_init.jf_legacy.jargid[0] = '\0';
+	vf_init.jf_legacy.jseq = 0;
+	vf_init.jf_legacy.jblk = 0;
+	vf_init.jf_legacy.jact = 0;
+	vf_init.jf_legacy.jsubcnt = 0;
+	vf_init.jf_magic = JVARS_MAGIC;
+	vf_init.jf_version = JVARS_VERSION;
+
+	if (write(var_fd, &vf_init, sizeof (struct jvars_file)) == -1) {
 		perror("jnl_start: write ");
 		(void) snprintf(buffer, sizeof (buffer),
 		    "jnl_start: write error\n");
-		(void) write(jnl_fd, buffer, strlen(buffer));
+		print_entry(buffer, jnl_fd);
 		exit(1);
 	}
 
-	vfptr = &vf_init;
+	vfptr = &vf_init.jf_legacy;
 
 	/* mmap the variable file */
 	vfptr = (struct jvars *)mmap((caddr_t)0,
@@ -152,7 +226,7 @@ stf_jnl_start_pid(int pid)
 		perror("jnl_start: vfile_mmap : mmap");
 		(void) snprintf(buffer, sizeof (buffer),
 		    "%sjnl_start: VARFILE mmap error\n", stdtag);
-		(void) write(jnl_fd, buffer, strlen(buffer));
+		print_entry(buffer, jnl_fd);
 		exit(1);
 	}
 	(void) close(var_fd);
@@ -160,7 +234,7 @@ stf_jnl_start_pid(int pid)
 	if (uname(&unames) < 0) {
 		(void) snprintf(buffer, sizeof (buffer),
 		    "%sjnl_start: uname error\n", stdtag);
-		(void) write(jnl_fd, buffer, strlen(buffer));
+		print_entry(buffer, jnl_fd);
 		exit(1);
 	}
 
@@ -175,24 +249,36 @@ stf_jnl_start_pid(int pid)
 			username = pw->pw_name;
 	}
 
+	/*
+	 * The last field anchors the gethrtime() stamps in the journal to
+	 * the wall clock: seconds.microseconds since the epoch, read back to
+	 * back with gethrtime().
+	 */
+	anchor_hr = gethrtime();
+	(void) gettimeofday(&anchor, NULL);
+
 	/* jnl start string (2 lines) */
 	(void) snprintf(buffer, sizeof (buffer),
-	    "%s| %s %s (%ld) | tpi %1.1f | %s %d |\n",
+	    "%s| %s %s (%ld) | tpi %1.1f | %s %d | %ld.%06ld %llu |\n",
 	    JNL_START,
 	    get_dt(),
 	    username,
 	    (unsigned long)userid,
 	    LIBVERS,
 	    get_time(),
-	    vfptr->jact);
+	    vfptr->jact,
+	    (long)anchor.tv_sec,
+	    (long)anchor.tv_usec,
+	    anchor_hr);
 
-	(void) write(jnl_fd, buffer, strlen(buffer));
+	print_entry(buffer, jnl_fd);
 
 	(void) snprintf(buffer, sizeof (buffer), "%s| %d %s %s %s %s %s |\n",
 	    JNL_START, pid, unames.sysname,
 	    unames.release, unames.version, unames.machine,
 	    unames.nodename);
-	(void) write(jnl_fd, buffer, strlen(buffer));
+	print_entry(buffer, jnl_fd);
+	(void) stf_jnl_close(jnl_fd);
 }
 
 /* print the environment variables set */
@@ -273,7 +359,7 @@ stf_jnl_end_pid(int pid)
 	jnl_fd = stf_jnl_open();
 	(void) snprintf(buffer, sizeof (buffer),
 	    "%s| %d %s |\n", JNL_END, pid, get_time());
-	(void) write(jnl_fd, buffer, strlen(buffer));
+	print_entry(buffer, jnl_fd);
 	/* remove the varfile */
 	if ((vfile = getenv(VARFILE)) != NULL) {
 		if (unlink(vfile) != 0) {
@@ -298,7 +384,7 @@ stf_jnl_msg_pid(int pid, char *msg)
 	}
 	buf_ptr = &buffer[0];
 	(void) snprintf(buf_ptr, sizeof (buffer),
-	    "%s| %d | %s\n", JNL_MSG, pid, msg);
+	    "%s| %d %llu | %s\n", JNL_MSG, pid, gethrtime(), msg);
 	print_entry(buffer, jnl_fd);
 
 	(void) stf_jnl_close(jnl_fd);
@@ -317,6 +403,72 @@ stf_jnl_msg(char *msg)
 	}
 }
 
+/*
+ * Journal each line of text as a Msg record, the whole block in one
+ * append so it cannot interleave with other writers.  A trailing newline
+ * does not start another record; empty lines are written as a blank.
+ */
+void
+stf_jnl_msg_lines(char *text)
+{
+	pid_t pid = getpid();
+	char prefix[64];
+	char line[MAXCHAR];
+	char *block, *bp, *p, *nl;
+	size_t plen, size, len;
+	int jnl_fd;
+
+	if (pid > INT_MAX) {
+		pid_error();
+		exit(1);
+	}
+	plen = snprintf(prefix, sizeof (prefix), "%s| %d %llu | ", JNL_MSG,
+	    (int)pid, gethrtime());
+
+	/* each line costs its text plus a prefix, a blank and a newline */
+	size = strlen(text) + plen + 3;
+	for (p = text; (p = strchr(p, '\n')) != NULL; p++)
+		size += plen + 2;
+
+	if ((block = malloc(size)) == NULL) {
+		/* no room to build the block, send it a line at a time */
+		for (p = text; *p != '\0'; p = (*nl == '\0') ? nl : nl + 1) {
+			if ((nl = strchr(p, '\n')) == NULL)
+				nl = p + strlen(p);
+			len = nl - p;
+			if (len >= sizeof (line))
+				len = sizeof (line) - 1;
+			(void) memcpy(line, p, len);
+			line[len] = '\0';
+			stf_jnl_msg_pid((int)pid, len == 0 ? " " : line);
+		}
+		return;
+	}
+
+	bp = block;
+	for (p = text; *p != '\0'; p = (*nl == '\0') ? nl : nl + 1) {
+		if ((nl = strchr(p, '\n')) == NULL)
+			nl = p + strlen(p);
+		(void) memcpy(bp, prefix, plen);
+		bp += plen;
+		if (nl == p) {
+			*bp++ = ' ';
+		} else {
+			(void) memcpy(bp, p, nl - p);
+			bp += nl - p;
+		}
+		*bp++ = '\n';
+	}
+	*bp = '\0';
+
+	if (bp != block) {
+		jnl_fd = stf_jnl_open();
+		print_entry(block, jnl_fd);
+		(void) stf_jnl_close(jnl_fd);
+	}
+	free(block);
+}
+
 
 /* Start of Journal Assertion, called from timeout only */
 void
@@ -324,6 +476,7 @@ stf_jnl_testcase_start_pid(int pid, char **jnl_asrt_line)
 {
 	/* variables for var file */
 	struct jvars *vfptr;
+	struct jvars_slot *js;
 	short activity;
 
 	char buffer[MAXCHAR + 2];
@@ -349,19 +502,31 @@ stf_jnl_testcase_start_pid(int pid, char **jnl_asrt_line)
 	} else {
 		activity = vfptr->jact;
 
-		/* lock the var file and increment the sequence count */
-		if (mutex_lock(&(vfptr->jvar_mlock)) != 0) {
-			perror("stf_jnl_testcase_start: mutex_lock ");
-			exit(1);
-		}
-
-		(void) strcpy(vfptr->jasrt, jnl_asrt_name);
-		++vfptr->jseq;
-
-		/* unlock the var file */
-		if (mutex_unlock(&(vfptr->jvar_mlock)) != 0) {
-			perror("stf_jnl_testcase_start: mutex_unlock ");
-			exit(1);
+		if ((js = jvars_slot(getpgrp(), 1)) != NULL) {
+			/* our own slot, the legacy copy is for old readers */
+			(void) strlcpy(js->js_asrt, jnl_asrt_name,
+			    sizeof (js->js_asrt));
+			js->js_subid[0] = '\0';
+			js->js_argid[0] = '\0';
+			(void) strlcpy(vfptr->jasrt, jnl_asrt_name,
+			    sizeof (vfptr->jasrt));
+			atomic_inc_16((volatile uint16_t *)&vfptr->jseq);
+		} else {
+			/* the lock guards the strings, jseq is atomic */
+			if (mutex_lock(&(vfptr->jvar_mlock)) != 0) {
+				perror("stf_jnl_testcase_start: mutex_lock ");
+				exit(1);
+			}
+
+			(void) strcpy(vfptr->jasrt, jnl_asrt_name);
+
+			/* unlock the var file */
+			if (mutex_unlock(&(vfptr->jvar_mlock)) != 0) {
+				perror("stf_jnl_testcase_start: "
+				    "mutex_unlock ");
+				exit(1);
+			}
+			atomic_inc_16((volatile uint16_t *)&vfptr->jseq);
 		}
 	}
 
@@ -392,6 +557,7 @@ stf_jnl_testcase_end(char *jnl_asrt_name, int child_pid, int status)
 {
 	/* variable for var file */
 	struct jvars *vfptr;
+	struct jvars_slot *js;
 	int activity, exitstatus;
 
 	char buffer[MAXCHAR + 2];
@@ -403,18 +569,11 @@ stf_jnl_testcase_end(char *jnl_asrt_name, int child_pid, int status)
 		activity = -1;
 	} else {
 		activity = vfptr->jact;
-		/* lock var file and increment sequence count */
-		if ((mutex_lock(&(vfptr->jvar_mlock))) != 0) {
-			perror("stf_jnl_testcase_end: mutex_lock ");
-			exit(1);
-		}
-
-		++vfptr->jseq;
-
-		if ((mutex_unlock(&(vfptr->jvar_mlock))) != 0) {
-			perror("stf_jnl_testcase_end: mutex_unlock ");
-			exit(1);
-		}
+		atomic_inc_16((volatile uint16_t *)&vfptr->jseq);
+		/* the testcase ran as process group child_pid */
+		if ((js = jvars_slot(child_pid, 0)) != NULL)
+			(void) atomic_cas_32(&js->js_owner,
+			    (uint32_t)child_pid, 0);
 	}
 
 	buf_ptr = &buffer[0];
@@ -481,6 +640,7 @@ void
 stf_jnl_assert_start_pid(int pid, char *subid)
 {
 	struct jvars *vfptr;
+	struct jvars_slot *js;
 	int jnl_fd;
 
 	char buffer[MAXCHAR + 2];
@@ -496,6 +656,17 @@ stf_jnl_assert_start_pid(int pid, char *subid)
 		sub_id = subid;
 		argid = nullid;
 		asrt = nullid;
+	} else if ((js = jvars_slot(getpgrp(), 0)) != NULL) {
+		activity = vfptr->jact;
+		sub_id = subid;
+
+		(void) strlcpy(js->js_subid, subid, sizeof (js->js_subid));
+		(void) strlcpy(vfptr->jsubid, subid, sizeof (vfptr->jsubid));
+		asrt = &js->js_asrt[0];
+		argid = &js->js_argid[0];
+
+		(void) atomic_swap_16((volatile uint16_t *)&vfptr->jblk, 0);
+		(void) atomic_swap_16((volatile uint16_t *)&vfptr->jseq, 0);
 	} else {
 		if (mutex_lock(&(vfptr->jvar_mlock)) != 0) {
 			perror("stf_jnl_assert_start: mutex_lock ");
@@ -509,13 +680,14 @@ stf_jnl_assert_start_pid(int pid, char *subid)
 		asrt = &vfptr->jasrt[0];
 		argid = &vfptr->jargid[0];
 
-		vfptr->jblk = 0;
-		vfptr->jseq = 0;
-
 		if (mutex_unlock(&(vfptr->jvar_mlock)) != 0) {
 			perror("stf_jnl_assert_start: mutex_unlock ");
 			exit(1);
 		}
+
+		/* slot holders update these without the lock */
+		(void) atomic_swap_16((volatile uint16_t *)&vfptr->jblk, 0);
+		(void) atomic_swap_16((volatile uint16_t *)&vfptr->jseq, 0);
 	}
 
 	/* print journal entry */
@@ -559,6 +731,7 @@ void
 stf_jnl_assert_end_pid(int pid, int result)
 {
 	struct jvars *vfptr;
+	struct jvars_slot *js;
 	char buffer[MAXCHAR + 2];
 	char *buf_ptr, *sub_id, *asrt, *argid, nullid[1];
 	short activity;
@@ -573,6 +746,11 @@ stf_jnl_assert_end_pid(int pid, int result)
 		sub_id = nullid;
 		asrt = nullid;
 		argid = nullid;
+	} else if ((js = jvars_slot(getpgrp(), 0)) != NULL) {
+		activity = vfptr->jact;
+		asrt = &js->js_asrt[0];
+		sub_id = &js->js_subid[0];
+		argid = &js->js_argid[0];
 	} else {
 		activity = vfptr->jact;
 		asrt = &vfptr->jasrt[0];
@@ -610,6 +788,7 @@ void
 stf_jnl_totals_pid(int pid, char *id_name, int *result_cts)
 {
 	struct jvars *vfptr;
+	struct jvars_slot *js;
 
 	int i;
 	char all_results[MAXCHAR],  buffer[MAXCHAR + 2], nullid[1];
@@ -624,6 +803,8 @@ stf_jnl_totals_pid(int pid, char *id_name, int *result_cts)
 	/* Get the assertion name from the varfile */
 	if ((vfptr = vfile_mmap()) == (struct jvars *)-1) {
 		asrt = nullid;
+	} else if ((js = jvars_slot(getpgrp(), 0)) != NULL) {
+		asrt = &js->js_asrt[0];
 	} else {
 		asrt = &vfptr->jasrt[0];
 	}
@@ -659,24 +840,46 @@ harness_error(char *errorbuf)
 
 	(void) snprintf(printbuf, sizeof (printbuf),
 	    "XXX| STF harness error: %s\n", errorbuf);
-	(void) write(jfd, printbuf, strlen(printbuf));
+	print_entry(printbuf, jfd);
 
 	(void) stf_jnl_close(jfd);
 }
 
+/*
+ * Calendar time for journal records.  Formatting it takes a trip to the
+ * clock and localtime(), so the result is kept until the wall clock
+ * second changes; that is tracked against gethrtime(), and most records
+ * cost no system call at all.  now is the gethrtime() of the record.
+ */
+static struct tm *
+get_tm(hrtime_t now)
+{
+	static struct tm tm;
+	static hrtime_t stale = 0;	/* gethrtime() when tm goes stale */
+	struct timeval tv;
+	time_t t;
+
+	if (stale == 0 || now >= stale) {
+		(void) gettimeofday(&tv, NULL);
+		t = tv.tv_sec;
+		if (localtime_r(&t, &tm) == NULL) {
+			(void) fprintf(stderr, "error in localtime\n");
+			exit(1);
+		}
+		stale = now + NANOSEC -
+		    (hrtime_t)tv.tv_usec * (NANOSEC / MICROSEC);
+	}
+	return (&tm);
+}
+
 /* get date */
 static char *
 get_dt()
 {
-	time_t t;
 	struct tm *tp;
 	static char dt_str[20];
 
-	(void) time(&t);
-	if ((tp = localtime(&t)) == NULL) {
-		(void) fprintf(stderr, "error in localtime\n");
-		exit(1);
-	}
+	tp = get_tm(gethrtime());
 	(void) snprintf(dt_str, sizeof (dt_str),
 	    "%04d%02d%02d", tp->tm_year + 1900, tp->tm_mon + 1,
 	    tp->tm_mday);
@@ -708,29 +911,378 @@ build_id(char *sub_id, char *arg_id)
 	return (id_string);
 }
 
+/*
+ * The time field of a record: the wall clock followed by the gethrtime()
+ * it was read at, "HH:MM:SS <ns>".  The stamp is inside the field, ahead
+ * of the activity count, not at the end of the record:
+ *
+ *	Test_Case_Start| <pid> <line> | HH:MM:SS <ns> <activity> |
+ *	Test_Case_End| <pid> <name> | <result> | HH:MM:SS <ns> <activity> |
+ *	Assertion_Start| <pid> <id> | HH:MM:SS <ns> <activity> |
+ *	Assertion_End| <pid> <id> | <result> | HH:MM:SS <ns> <activity> |
+ *	End| <pid> HH:MM:SS <ns> |
+ *
+ * Msg records carry a stamp of their own after the pid, ahead of the
+ * text, and Start ends with the anchor written by stf_jnl_start_pid():
+ *
+ *	Msg| <pid> <ns> | <text>
+ *	Start| <date> <user> (<uid>) | tpi <vers> | HH:MM:SS <ns> <activity> |
+ *	    <sec>.<usec> <ns> |
+ *
+ * stf_jnl_times.pl and stf_jnl_durations.pl find the stamps in these
+ * places, and stf_filter.pl drops the Msg one when comparing messages.
+ */
 static char *
 get_time()
 {
-	time_t t;
 	struct tm *tp;
-	static char time_str[32];
+	static char time_str[48];
+	hrtime_t now = gethrtime();
 
-	(void) time(&t);
-	if ((tp = localtime(&t)) == NULL) {
-		(void) fprintf(stderr, "error in localtime\n");
-		exit(1);
-	}
+	tp = get_tm(now);
 	(void) snprintf(time_str, sizeof (time_str),
 	    "%02d:%02d:%02d %llu", tp->tm_hour, tp->tm_min,
-	    tp->tm_sec, gethrtime());
+	    tp->tm_sec, now);
 	return (time_str);
 }
 
-/* print the buffer */
+/*
+ * Write everything pending in the journal buffer.  The caller holds
+ * jnl_wlock.  A short write only happens on a full or broken file
+ * system; finish it rather than drop the tail of a record.
+ */
+static void
+jnl_flush_locked(void)
+{
+	struct iovec iov;
+
+	if (jnl_wlen > 0) {
+		iov.iov_base = jnl_wbuf;
+		iov.iov_len = jnl_wlen;
+		jnl_writev_locked(&iov, 1);
+	}
+	jnl_wlen = 0;
+	jbin_flush_locked();
+}
+
+/*
+ * Write to the cached journal, as one gzip member when compressing.
+ * The caller holds jnl_wlock, which also protects jnl_zs.  iov is
+ * consumed.
+ */
+static void
+jnl_writev_locked(struct iovec *iov, int iovcnt)
+{
+	struct iovec ziov;
+	size_t len = 0;
+	Bytef *nbuf;
+	int i, ret;
+
+	if (jnl_zlevel == 0) {
+		writev_all(jnl_wfd, iov, iovcnt, "stf_jnl: write");
+		return;
+	}
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	if (deflateReset(&jnl_zs) != Z_OK)
+		goto zfail;
+	if (jnl_zsize < deflateBound(&jnl_zs, len)) {
+		if ((nbuf = realloc(jnl_zbuf, deflateBound(&jnl_zs, len))) ==
+		    NULL)
+			goto zfail;
+		jnl_zbuf = nbuf;
+		jnl_zsize = deflateBound(&jnl_zs, len);
+	}
+	jnl_zs.next_out = jnl_zbuf;
+	jnl_zs.avail_out = jnl_zsize;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len == 0)
+			continue;
+		jnl_zs.next_in = (Bytef *)iov[i].iov_base;
+		jnl_zs.avail_in = iov[i].iov_len;
+		if (deflate(&jnl_zs, Z_NO_FLUSH) != Z_OK)
+			goto zfail;
+	}
+	ret = deflate(&jnl_zs, Z_FINISH);
+	if (ret != Z_STREAM_END)
+		goto zfail;
+
+	ziov.iov_base = (caddr_t)jnl_zbuf;
+	ziov.iov_len = jnl_zsize - jnl_zs.avail_out;
+	writev_all(jnl_wfd, &ziov, 1, "stf_jnl: write");
+	return;
+
+zfail:
+	/* plain text now would make the rest of the journal unreadable */
+	(void) fprintf(stderr, "stf_jnl: journal compression failed: %s\n",
+	    jnl_zs.msg != NULL ? jnl_zs.msg : "out of memory");
+}
+
+/*
+ * writev() all of iov, finishing any short write.  iov is consumed.
+ */
+static void
+writev_all(int fd, struct iovec *iov, int iovcnt, const char *who)
+{
+	ssize_t count;
+
+	while (iovcnt > 0) {
+		if ((count = writev(fd, iov, iovcnt)) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror(who);
+			break;
+		}
+		/* step over whatever a short write did not finish */
+		while (iovcnt > 0 && count >= iov->iov_len) {
+			count -= iov->iov_len;
+			++iov;
+			--iovcnt;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (caddr_t)iov->iov_base + count;
+			iov->iov_len -= count;
+		}
+	}
+}
+
+/*
+ * (Re)open the binary journal to follow STF_JOURNAL_BIN.  A binary
+ * journal that cannot be opened is reported and left off; the text
+ * journal is what the harness depends on.  Called with jnl_wlock held.
+ */
+static void
+jbin_open_locked(void)
+{
+	char *name = getenv(JBINNAME);
+
+	if (jnl_bfd != -1) {
+		if (name != NULL && strcmp(name, jnl_bname) == 0)
+			return;
+		jbin_flush_locked();
+		(void) close(jnl_bfd);
+		free(jnl_bname);
+		jnl_bfd = -1;
+	}
+	if (name == NULL)
+		return;
+
+	if ((jnl_bfd = open(name, (O_CREAT | O_WRONLY | O_APPEND),
+	    0666)) == -1) {
+		perror("stf_jnl_open: binary journal open");
+		return;
+	}
+	(void) fcntl(jnl_bfd, F_SETFD, FD_CLOEXEC);
+	jnl_bname = strdup(name);
+
+	if (jnl_wsize > 0 && jnl_bbuf == NULL &&
+	    (jnl_bbuf = malloc(jnl_wsize * 2)) != NULL)
+		jnl_bsize = jnl_wsize * 2;
+}
+
+/* write the pending binary records, with jnl_wlock held */
+static void
+jbin_flush_locked(void)
+{
+	struct iovec iov;
+
+	if (jnl_blen > 0) {
+		iov.iov_base = jnl_bbuf;
+		iov.iov_len = jnl_blen;
+		writev_all(jnl_bfd, &iov, 1, "stf_jnl_flush: binary write");
+	}
+	jnl_blen = 0;
+}
+
+/*
+ * The result of a Test_Case_End or Assertion_End record, which is the
+ * first word of its third field.
+ */
+static uint8_t
+jbin_result(const char *p)
+{
+	size_t n;
+	int i;
+
+	if ((p = strchr(p, '|')) == NULL || (p = strchr(p + 1, '|')) == NULL)
+		return (JBIN_NORESULT);
+	while (*++p == ' ')
+		;
+	for (i = 0; i < STF_MAX_RESULTS; i++) {
+		n = strlen(result_tbl[i]);
+		if (strncmp(p, result_tbl[i], n) == 0 &&
+		    (p[n] == ' ' || p[n] == '_' || p[n] == '|'))
+			return (i);
+	}
+	return (JBIN_NORESULT);
+}
+
+/*
+ * Fill in the binary header for a text record.  The type, pid and
+ * result are taken from the text, which is cheap next to parsing it
+ * again afterwards.  Records other than the testcase ones belong to the
+ * testcase running as the writer's process group.
+ */
+static void
+jbin_header(stf_jbin_rec_t *rec, const char *text, size_t len)
+{
+	const char *bar;
+	size_t n;
+	int i;
+
+	(void) memset(rec, 0, sizeof (*rec));
+	rec->jr_magic = JBIN_REC_MAGIC;
+	rec->jr_type = JBIN_T_OTHER;
+	rec->jr_result = JBIN_NORESULT;
+	rec->jr_len = (uint32_t)len;
+	rec->jr_ns = gethrtime();
+
+	if ((bar = memchr(text, '|', len)) != NULL) {
+		n = bar - text;
+		for (i = 0; i < sizeof (jbin_types) / sizeof (jbin_types[0]);
+		    i++) {
+			if (strlen(jbin_types[i].tag) == n &&
+			    strncmp(text, jbin_types[i].tag, n) == 0) {
+				rec->jr_type = jbin_types[i].type;
+				break;
+			}
+		}
+	}
+
+	if (bar == NULL || rec->jr_type == JBIN_T_START ||
+	    (rec->jr_pid = (int32_t)atol(bar + 1)) <= 0)
+		rec->jr_pid = (int32_t)getpid();
+
+	switch (rec->jr_type) {
+	case JBIN_T_TC_END:
+	case JBIN_T_ASSERT_END:
+		rec->jr_result = jbin_result(text);
+		/* FALLTHROUGH */
+	default:
+		rec->jr_tcid = (int32_t)getpgrp();
+		break;
+	}
+	if (rec->jr_type == JBIN_T_TC_START || rec->jr_type == JBIN_T_TC_END)
+		rec->jr_tcid = rec->jr_pid;
+}
+
+/*
+ * Queue the binary record for text, or write it straight away when
+ * the journal is not buffered.  Called with jnl_wlock held.
+ */
+static void
+jbin_add(const char *text, size_t len)
+{
+	static const char pad[8];
+	stf_jbin_rec_t rec;
+	struct iovec iov[3];
+	size_t size = JBIN_ALIGN(sizeof (rec) + len);
+
+	jbin_header(&rec, text, len);
+
+	if (jnl_blen + size > jnl_bsize)
+		jbin_flush_locked();
+	if (size > jnl_bsize) {
+		iov[0].iov_base = (caddr_t)&rec;
+		iov[0].iov_len = sizeof (rec);
+		iov[1].iov_base = (caddr_t)text;
+		iov[1].iov_len = len;
+		iov[2].iov_base = (caddr_t)pad;
+		iov[2].iov_len = size - sizeof (rec) - len;
+		writev_all(jnl_bfd, iov, 3, "stf_jnl: binary write");
+		return;
+	}
+	(void) memcpy(jnl_bbuf + jnl_blen, &rec, sizeof (rec));
+	(void) memcpy(jnl_bbuf + jnl_blen + sizeof (rec), text, len);
+	(void) memset(jnl_bbuf + jnl_blen + sizeof (rec) + len, 0,
+	    size - sizeof (rec) - len);
+	jnl_blen += size;
+}
+
+/* push any buffered journal records out to the journal file */
+void
+stf_jnl_flush()
+{
+	(void) mutex_lock(&jnl_wlock);
+	if (jnl_wfd != -1)
+		jnl_flush_locked();
+	(void) mutex_unlock(&jnl_wlock);
+}
+
+/*
+ * Return when the oldest buffered record is due out, going by
+ * STF_JNL_FLUSHAGE, or 0 when none is buffered.  A record only waits for
+ * the next one to be written, so anything that sleeps with records
+ * buffered must flush them by then itself.
+ */
+static hrtime_t
+jnl_due(void)
+{
+	hrtime_t due = 0;
+
+	(void) mutex_lock(&jnl_wlock);
+	if (jnl_wlen > 0)
+		due = jnl_wfirst + jnl_wage;
+	(void) mutex_unlock(&jnl_wlock);
+	return (due);
+}
+
+/* flush buffered records that are due out */
+static void
+jnl_flush_aged(void)
+{
+	(void) mutex_lock(&jnl_wlock);
+	if (jnl_wlen > 0 && gethrtime() - jnl_wfirst >= jnl_wage)
+		jnl_flush_locked();
+	(void) mutex_unlock(&jnl_wlock);
+}
+
+/*
+ * print the buffer
+ *
+ * Each call is one complete journal record.  Records for the cached
+ * journal are collected in jnl_wbuf when buffering is enabled and are
+ * only ever flushed as a whole.
+ */
 void
 print_entry(char *jnl_ptr, int fd)
 {
-	(void) write(fd, jnl_ptr, strlen(jnl_ptr));
+	size_t len = strlen(jnl_ptr);
+	struct iovec iov;
+	hrtime_t now;
+
+	if (fd != jnl_wfd || (jnl_wsize == 0 && jnl_bfd == -1)) {
+		(void) write(fd, jnl_ptr, len);
+		return;
+	}
+
+	(void) mutex_lock(&jnl_wlock);
+	if (jnl_bfd != -1)
+		jbin_add(jnl_ptr, len);
+	iov.iov_base = jnl_ptr;
+	iov.iov_len = len;
+	if (jnl_wsize == 0) {
+		jnl_writev_locked(&iov, 1);
+		(void) mutex_unlock(&jnl_wlock);
+		return;
+	}
+	now = gethrtime();
+	if (jnl_wlen + len > jnl_wsize)
+		jnl_flush_locked();
+	if (len >= jnl_wsize) {
+		/* too big to buffer, it goes out on its own */
+		jnl_writev_locked(&iov, 1);
+	} else {
+		if (jnl_wlen == 0)
+			jnl_wfirst = now;
+		(void) memcpy(jnl_wbuf + jnl_wlen, jnl_ptr, len);
+		jnl_wlen += len;
+		if (now - jnl_wfirst >= jnl_wage)
+			jnl_flush_locked();
+	}
+	(void) mutex_unlock(&jnl_wlock);
 }
 
 /* map the result code to result name in the name table, jnl.h	*/
@@ -742,6 +1294,10 @@ get_status_name(int exit_no)
 	    ? result_tbl[OTHER_INDEX] : result_tbl[exit_no];
 }
 
+/*
+ * Return the journal descriptor.  The journal is opened on first use and
+ * stays open; it is only reopened if STF_JOURNAL has changed since.
+ */
 int
 stf_jnl_open()
 {
@@ -752,28 +1308,757 @@ stf_jnl_open()
 	jnl_file = (char *)getenv(JNLNAME);
 	if (jnl_file == NULL) { /* no env var for jnl file set */
 		/* default to stdout */
-		jnl_fd = 1;
-		/* fdopen(jnl_fd, "w+"); */
-	} else {
-		if ((jnl_fd = open(jnl_file, (O_CREAT | O_WRONLY | O_APPEND),
-		    0666)) == -1) {
-			perror("stf_jnl_open: jnlfile open");
-			exit(1);
-		}
+		return (1);
+	}
+
+	(void) mutex_lock(&jnl_wlock);
+	if (jnl_wfd != -1 && strcmp(jnl_file, jnl_wname) == 0) {
+		jnl_fd = jnl_wfd;
+		(void) mutex_unlock(&jnl_wlock);
+		return (jnl_fd);
 	}
+
+	if ((jnl_fd = open(jnl_file, (O_CREAT | O_WRONLY | O_APPEND),
+	    0666)) == -1) {
+		perror("stf_jnl_open: jnlfile open");
+		exit(1);
+	}
+	(void) fcntl(jnl_fd, F_SETFD, FD_CLOEXEC);
+
+	if (jnl_wfd != -1) {	/* STF_JOURNAL moved */
+		jnl_flush_locked();
+		(void) close(jnl_wfd);
+		free(jnl_wname);
+	}
+	jnl_wfd = jnl_fd;
+	jnl_wname = strdup(jnl_file);
+	jbin_open_locked();
+	(void) mutex_unlock(&jnl_wlock);
+
 	return (jnl_fd);
 }
 
 int
 stf_jnl_close(int fd)
 {
-	if (fd == 1)
+	if (fd == 1 || fd == jnl_wfd)
 		return (0);
 	else {
 		return (close(fd));
 	}
 }
 
+/*
+ *	Child supervision.  The tools that run a test wait on a descriptor
+ *	that becomes ready when the child exits, so an idle supervisor
+ *	sleeps in poll() instead of waking up on a timer.  The descriptor
+ *	is a pidfd where the kernel has one, otherwise a signalfd for
+ *	SIGCHLD on Linux and /proc/<pid> on Solaris.  The child is never
+ *	reaped here; that is left to the caller's waitpid().
+ *
+ *	stf_child_watch_init() must be called before the fork and
+ *	stf_child_watch_reset() in the child before it execs.
+ */
+static int	child_sigfd = -1;	/* SIGCHLD signalfd, if used */
+static int	child_procfd = -1;	/* /proc/<pid> descriptor, if used */
+static sigset_t	child_oldmask;		/* signal mask before init */
+
+void
+stf_child_watch_init()
+{
+#if defined(__linux__)
+	sigset_t set;
+	int fd;
+
+#ifdef SYS_pidfd_open
+	if ((fd = syscall(SYS_pidfd_open, getpid(), 0)) != -1) {
+		(void) close(fd);	/* pidfds work, nothing to set up */
+		return;
+	}
+#endif
+	/* block SIGCHLD so it stays pending until the signalfd is read */
+	(void) sigemptyset(&set);
+	(void) sigaddset(&set, SIGCHLD);
+	(void) sigprocmask(SIG_BLOCK, &set, &child_oldmask);
+	child_sigfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+#endif
+}
+
+void
+stf_child_watch_reset()
+{
+	if (child_sigfd != -1)
+		(void) sigprocmask(SIG_SETMASK, &child_oldmask, NULL);
+}
+
+/*
+ * Return a descriptor to poll() for stf_child_events() on the exit of
+ * pid, or -1 with errno set.
+ */
+int
+stf_child_watch(pid_t pid)
+{
+	char proc_file[32];
+	int fd;
+
+#if defined(__linux__)
+	if (child_sigfd != -1)
+		return (child_sigfd);
+#ifdef SYS_pidfd_open
+	if ((fd = syscall(SYS_pidfd_open, pid, 0)) != -1) {
+		(void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+		return (fd);
+	}
+#endif
+#endif
+	(void) snprintf(proc_file, sizeof (proc_file), "/proc/%d", (int)pid);
+	if ((fd = open(proc_file, O_RDONLY)) != -1) {
+		(void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+		child_procfd = fd;
+	}
+	return (fd);
+}
+
+/*
+ * Return the poll() events to ask for on watch descriptor fd.  A /proc
+ * file is always readable; it shows the exit of its process as POLLPRI.
+ */
+short
+stf_child_events(int fd)
+{
+	return (fd == child_procfd ? POLLPRI : POLLIN);
+}
+
+/*
+ * Called when the watch descriptor polled ready; returns 1 once pid has
+ * exited.  A SIGCHLD signalfd also fires for stopped children and for
+ * other children, and a /proc file can poll ready for other reasons, so
+ * every wakeup is checked against the child itself.
+ */
+int
+stf_child_exited(int fd, pid_t pid)
+{
+	siginfo_t info;
+#if defined(__linux__)
+	struct signalfd_siginfo ssi;
+
+	if (fd == child_sigfd) {
+		while (read(fd, &ssi, sizeof (ssi)) == sizeof (ssi))
+			;
+	}
+#endif
+	info.si_pid = 0;
+	if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == -1)
+		return (1);	/* already reaped, or not ours */
+	return (info.si_pid == pid);
+}
+
+/*
+ *	Output capture, shared by stf_jnl_context and stf_supervise.  The
+ *	test's stdout and stderr arrive on two pipes; stderr and journal
+ *	records (lines starting with a NUL on the stdout pipe) are copied
+ *	through as they arrive, stdout is tagged a line at a time.
+ *
+ *	Tagged output is assembled into an iovec list and written with one
+ *	writev() instead of a write() per byte.  Runs of stderr and journal
+ *	bytes point straight into the read buffer, so they are written
+ *	before capture_write() returns; completed stdout lines are copied to
+ *	out_stage and may wait for more output, but never longer than
+ *	out_latency.
+ */
+#define	OUT_IOV_MAX	64
+#define	OUT_STAGE	(MAXCHAR * 8)
+#define	CAP_TAGMAX	40		/* "stdout| <hrtime> | " */
+
+static int cap_fd = 1;			/* where captured output goes */
+static int cap_stamp = 0;		/* STF_JNL_STAMP: time each line */
+
+/* stdout storage buffer */
+static char outbuf[MAXCHAR + CAP_TAGMAX + 4];
+/* pointer to stdout storage buffer */
+static char *p_out = outbuf;
+
+static short cr_needed = 0;  /* flag for carriage return */
+
+static struct iovec out_iov[OUT_IOV_MAX];
+static int out_iovcnt = 0;		/* entries used in out_iov */
+static size_t out_pending = 0;		/* bytes described by out_iov */
+static int out_borrowed = 0;		/* out_iov points into a read buffer */
+static char out_stage[OUT_STAGE];	/* copies of completed stdout lines */
+static size_t out_stagelen = 0;
+static hrtime_t out_first = 0;		/* when the oldest output arrived */
+static hrtime_t out_latency;		/* how long output may be held */
+static int cap_stop[2] = { -1, -1 };	/* stf_capture_stop() self-pipe */
+
+/*
+ * Send captured output to fd, normally the journal.
+ */
+void
+stf_capture_init(int fd)
+{
+	char *env;
+	int i;
+
+	cap_fd = fd;
+	cap_stamp = (getenv(JNLSTAMP) != NULL);
+	out_latency = (hrtime_t)JNL_LATENCY_DEFAULT * (NANOSEC / MILLISEC);
+	if ((env = getenv(JNLLATENCY)) != NULL)
+		out_latency = (hrtime_t)atol(env) * (NANOSEC / MILLISEC);
+
+	if (cap_stop[0] == -1 && pipe(cap_stop) == 0) {
+		for (i = 0; i < 2; i++) {
+			(void) fcntl(cap_stop[i], F_SETFD, FD_CLOEXEC);
+			(void) fcntl(cap_stop[i], F_SETFL, O_NONBLOCK);
+		}
+	}
+}
+
+/*
+ * Make stf_capture_run() return STF_CAPTURE_STOPPED, now or when it is
+ * next called.  Only does a write(2), so it can be called from a signal
+ * handler.
+ */
+void
+stf_capture_stop()
+{
+	char c = 0;
+
+	if (cap_stop[1] != -1)
+		(void) write(cap_stop[1], &c, 1);
+}
+
+/*
+ * Copy output from the stdout pipe outfd and the stderr pipe errfd
+ * until the child pid, watched by childfd, exits.  The poll blocks until
+ * there is output, the child exits or deadline (a gethrtime() value, 0
+ * for none) passes; a shorter timeout is only used while captured output
+ * is waiting out its latency.
+ *
+ * Returns STF_CAPTURE_EXITED, STF_CAPTURE_TIMEDOUT, STF_CAPTURE_STOPPED
+ * or -1 on error.
+ */
+int
+stf_capture_run(int outfd, int errfd, int childfd, pid_t pid,
+    hrtime_t deadline)
+{
+	pollfd_t pollfds[4];
+	char buf[MAXCHAR];
+	int pollval;
+	int timeout;
+	ssize_t count;
+	int j;
+	short events;	/* temp revents holder */
+	hrtime_t now, wait, due;
+
+	cap_tcid = pid;
+
+	/* stdout and jnl pipe */
+	pollfds[0].fd = outfd;
+	pollfds[0].events = POLLIN | POLLRDNORM | POLLRDBAND;
+
+	/* stderr pipe */
+	pollfds[1].fd = errfd;
+	pollfds[1].events = POLLIN | POLLRDNORM | POLLRDBAND;
+
+	/* child process */
+	pollfds[2].fd = childfd;
+	pollfds[2].events = stf_child_events(childfd);
+
+	/* stf_capture_stop(), left unread so every later call stops too */
+	pollfds[3].fd = cap_stop[0];
+	pollfds[3].events = POLLIN;
+
+	for (;;) {
+		now = gethrtime();
+		wait = -1;
+		if (deadline != 0) {
+			if (now >= deadline)
+				return (STF_CAPTURE_TIMEDOUT);
+			wait = deadline - now;
+		}
+		if (out_pending > 0) {
+			if (now - out_first >= out_latency)
+				wait = 0;
+			else if (wait == -1 ||
+			    out_first + out_latency - now < wait)
+				wait = out_first + out_latency - now;
+		}
+		if ((due = jnl_due()) != 0) {
+			if (now >= due)
+				wait = 0;
+			else if (wait == -1 || due - now < wait)
+				wait = due - now;
+		}
+		if (wait == -1) {
+			timeout = -1;
+		} else {
+			/* round up to the next msec, poll() takes an int */
+			wait = (wait + (NANOSEC / MILLISEC) - 1) /
+			    (NANOSEC / MILLISEC);
+			timeout = (wait > INT_MAX) ? INT_MAX : (int)wait;
+		}
+
+		if ((pollval = poll(pollfds, 4, timeout)) < 0) {
+			if (errno == EINTR)
+				continue;
+			/* error */
+			perror("stf_capture: poll failed");
+			return (-1);
+		}
+		if (pollval == 0) { /* held output is due, or deadline */
+			out_flush_aged();
+			jnl_flush_aged();
+			continue;
+		}
+
+		for (j = 0; j < 2; j++) { /* check the pipes for data */
+			if (!(pollfds[j].revents)) continue;
+
+			events = pollfds[j].revents;
+
+			if (events & (POLLERR | POLLNVAL)) {
+				/* error */
+				perror("stf_capture: poll error");
+				return (-1);
+			}
+			/* Incomming data on pipe to be journalled */
+			if ((count = read(pollfds[j].fd,
+			    buf, sizeof (buf))) > 0) {
+				capture_write(j, count, buf);
+			} else if (count == 0) {
+				/* all writers gone, stop polling it */
+				pollfds[j].fd = -1;
+			}
+		}
+
+		if (pollfds[3].revents)
+			return (STF_CAPTURE_STOPPED);
+
+		/* Check the child events */
+
+		if (!(pollfds[2].revents))	continue;
+
+		events = pollfds[2].revents;
+
+		if (events & (POLLERR | POLLNVAL)) {
+			/* error */
+			perror("stf_capture: poll error");
+			return (-1);
+		}
+		if (stf_child_exited(childfd, pid)) {
+			/* child finished */
+			return (STF_CAPTURE_EXITED);
+		}
+	}
+}
+
+/*
+ * Copy whatever is left in the pipes, finish any partial line and write
+ * out everything held.  A background process can keep a pipe open after
+ * the child exits, so this does not wait for end of file.
+ */
+void
+stf_capture_end(int outfd, int errfd)
+{
+	char buf[MAXCHAR];
+	ssize_t count;
+	int fds[2];
+	int i;
+
+	fds[0] = outfd;
+	fds[1] = errfd;
+	for (i = 0; i < 2; i++) {
+		(void) fcntl(fds[i], F_SETFL, O_NONBLOCK);
+		while ((count = read(fds[i], buf, sizeof (buf))) > 0)
+			capture_write(i, count, buf);
+	}
+	if (p_out != outbuf) {	/* did the stdout buffer get printed? */
+		if (cr_needed == 1)
+			out_add("\n", 1, 0);
+		out_stage_add(outbuf, p_out - outbuf);
+		out_add("\n", 1, 0);
+		cr_needed = 0;
+	}
+
+	if (cr_needed == 1)
+		out_add("\n", 1, 0);
+	out_flush();
+}
+
+/*
+ * Queue n bytes at p for the journal.  Bytes that follow the previous
+ * entry in memory extend it, so a run of untagged input costs one iovec.
+ * borrowed says p lives in a buffer that is about to be reused.
+ */
+static void
+out_add(const char *p, size_t n, int borrowed)
+{
+	struct iovec *iov;
+
+	if (n == 0)
+		return;
+
+	iov = (out_iovcnt > 0) ? &out_iov[out_iovcnt - 1] : NULL;
+	if (iov != NULL && (char *)iov->iov_base + iov->iov_len == p) {
+		iov->iov_len += n;
+	} else {
+		if (out_iovcnt == OUT_IOV_MAX)
+			out_flush();
+		iov = &out_iov[out_iovcnt++];
+		iov->iov_base = (caddr_t)p;
+		iov->iov_len = n;
+	}
+
+	if (out_pending == 0)
+		out_first = gethrtime();
+	out_pending += n;
+	out_borrowed |= borrowed;
+}
+
+/*
+ * Queue a copy of n bytes at p, for output whose source buffer will be
+ * overwritten before the next flush.
+ */
+static void
+out_stage_add(const char *p, size_t n)
+{
+	char *stage;
+
+	/*
+	 * Make room first: a flush from out_add() would empty the stage
+	 * after these bytes had been copied into it.
+	 */
+	if (out_stagelen + n > sizeof (out_stage) ||
+	    out_iovcnt == OUT_IOV_MAX)
+		out_flush();
+	stage = &out_stage[out_stagelen];
+	(void) memcpy(stage, p, n);
+	out_stagelen += n;
+	out_add(stage, n, 0);
+}
+
+/*
+ * Write everything queued with as few writev() calls as the kernel allows.
+ */
+static void
+out_flush(void)
+{
+	static const char pad[8];
+	struct iovec biov[OUT_IOV_MAX + 2];
+	stf_jbin_rec_t rec;
+	size_t size;
+
+	/* the binary journal gets the same bytes as one capture record */
+	if (out_pending > 0 && cap_fd == jnl_wfd && jnl_bfd != -1) {
+		(void) memset(&rec, 0, sizeof (rec));
+		rec.jr_magic = JBIN_REC_MAGIC;
+		rec.jr_type = JBIN_T_CAPTURE;
+		rec.jr_result = JBIN_NORESULT;
+		rec.jr_len = (uint32_t)out_pending;
+		rec.jr_pid = (int32_t)cap_tcid;
+		rec.jr_tcid = (int32_t)cap_tcid;
+		rec.jr_ns = gethrtime();
+		size = JBIN_ALIGN(sizeof (rec) + out_pending);
+
+		biov[0].iov_base = (caddr_t)&rec;
+		biov[0].iov_len = sizeof (rec);
+		(void) memcpy(&biov[1], out_iov,
+		    out_iovcnt * sizeof (struct iovec));
+		biov[out_iovcnt + 1].iov_base = (caddr_t)pad;
+		biov[out_iovcnt + 1].iov_len = size - sizeof (rec) -
+		    out_pending;
+
+		(void) mutex_lock(&jnl_wlock);
+		jbin_flush_locked();
+		writev_all(jnl_bfd, biov, out_iovcnt + 2,
+		    "stf_capture: binary writev");
+		(void) mutex_unlock(&jnl_wlock);
+	}
+
+	if (cap_fd == jnl_wfd && jnl_zlevel != 0) {
+		(void) mutex_lock(&jnl_wlock);
+		jnl_writev_locked(out_iov, out_iovcnt);
+		(void) mutex_unlock(&jnl_wlock);
+	} else {
+		writev_all(cap_fd, out_iov, out_iovcnt, "stf_capture: writev");
+	}
+
+	out_iovcnt = 0;
+	out_pending = 0;
+	out_borrowed = 0;
+	out_stagelen = 0;
+}
+
+/*
+ * Flush queued output that has been held for out_latency or longer.
+ */
+static void
+out_flush_aged(void)
+{
+	if (out_pending > 0 && gethrtime() - out_first >= out_latency)
+		out_flush();
+}
+
+/*
+ * Put the tag for a captured line at buf, followed by the time the line
+ * was read when STF_JNL_STAMP is set.  Returns the length of the tag.
+ */
+static int
+capture_tag(char *buf, const char *tag)
+{
+	if (cap_stamp == 0) {
+		(void) strcpy(buf, tag);
+		return (strlen(tag));
+	}
+	return (snprintf(buf, CAP_TAGMAX, "%s%llu | ", tag, gethrtime()));
+}
+
+/*
+ * process the output stream in buffer, adding std tags where needed
+ */
+static void
+capture_write(int pipenum, ssize_t nbytes, char buf[])
+{
+	static const char stdout_tag[] = "stdout| ";
+	static const char stderr_tag[] = "stderr| ";
+	char tag[CAP_TAGMAX];
+	static const char newline[] = "\n";
+	unsigned int i;
+	static unsigned int outcount = 0;
+	/* flag for a journal entry */
+	static unsigned short jnl_entry = 0;
+	/* flag for whether stdout tag was written */
+	static unsigned short out_tagged = 0;
+	/* flag as to whether stderr tag was written */
+	static short err_tagged = 0;
+	static char errmsg[MAXCHAR];
+	int len;
+
+/*
+ * note: all stdout messages are buffered until a new line is reached
+ *	any stderr messages and jnl messages are assumed to be
+ *	unbuffered so the characters should be printed as received
+ */
+
+for (i = 0; i < nbytes; i++) {
+
+		switch (buf[i]) {
+		case '\0':
+			if (pipenum == 0) {  /* begin jnl entry */
+				jnl_entry = 1;
+				if (cr_needed == 1) {
+					out_add(newline, 1, 0);
+					cr_needed = 0;
+				}
+			} else {  /* stderr, print it now */
+				out_add(&buf[i], 1, 1);
+				cr_needed = 1;
+			}
+			break;
+
+		case '\n':
+			cr_needed = 0;
+			if (jnl_entry == 1) {  /* eol jnl entry */
+				out_add(&buf[i], 1, 1);
+				jnl_entry = 0;
+
+			} else if (pipenum == 1) {	/* eol of stderr */
+				if (err_tagged == 0) {	/* print stderr tag */
+					out_stage_add(tag,
+					    capture_tag(tag, stderr_tag));
+					err_tagged = 1;
+				}
+				out_add(&buf[i], 1, 1);
+				err_tagged = 0;
+
+			} else {  /* eol buffered stdout */
+				if (out_tagged == 0) {	/* buffered stdout */
+					p_out += capture_tag(p_out,
+					    stdout_tag);
+					out_tagged = 1;
+				}
+				*p_out++ = buf[i];
+				/* queue the complete line */
+				out_stage_add(outbuf, p_out - outbuf);
+				p_out = outbuf; /* reset to beginning */
+				outcount = 0;
+				out_tagged = 0;
+			}
+			break;
+
+		default:
+			if (jnl_entry == 1) { /* jnl */
+				out_add(&buf[i], 1, 1);
+				break;
+
+			} else if (pipenum == 1) { /* stderr */
+				if (err_tagged == 0) {
+					out_stage_add(tag,
+					    capture_tag(tag, stderr_tag));
+					err_tagged = 1;
+				}
+				out_add(&buf[i], 1, 1);
+				cr_needed = 1;
+				break;
+
+			} else {  /* buffered stdout */
+				if (out_tagged == 0) {	/* buffered stdout */
+					p_out += capture_tag(p_out,
+					    stdout_tag);
+					out_tagged = 1;
+				}
+				*p_out++ = buf[i];
+					/* assume it is stdout */
+				++outcount;
+
+				/* check size of stdout buffer */
+				if (outcount > MAXCHAR - 1) {	/* overflow */
+					out_stage_add(outbuf, p_out - outbuf);
+
+					len = snprintf(errmsg, MAXCHAR,
+					    "\n%s: Warning: buffer overflow,"
+					    " lines limited to %d bytes\n",
+					    stderr_tag,
+					    MAXCHAR);
+
+					out_stage_add(errmsg, len);
+
+					p_out = outbuf; /* reset to beginning */
+					out_tagged = 0;
+					outcount = 0;
+					cr_needed = 0;
+				}
+			}
+			break;
+		}
+	}
+
+	/*
+	 * Anything that still points into buf has to go now; completed
+	 * stdout lines may wait for company.
+	 */
+	if (out_borrowed || out_pending >= sizeof (out_stage) / 2)
+		out_flush();
+	else
+		out_flush_aged();
+}
+
+/*
+ *	Time limits and process groups, shared by stf_timeout and
+ *	stf_supervise.
+ */
+enum units {hours, minutes, seconds, none};
+
+/*
+ * parse_value(stringpp, value_units)
+ *	Extract a value from the string, and return it.
+ *	Move string pointer.  Set units of the value.
+ */
+static time_t
+parse_value(char **stringpp, enum units *value_units)
+{
+	time_t value;
+	char *new_stringp;
+
+	errno = 0;	/* since we'll be checking it when perhaps no error */
+
+	/* the cast is valid */
+	value = (time_t)strtol(*stringpp, &new_stringp, 10);
+	if ((value == INT_MAX || value == INT_MIN) && errno == ERANGE) {
+		(void) fprintf(stderr, "limit <%s> exceeds maximum allowed"
+		    " value %u\n", *stringpp, INT_MAX);
+	}
+	switch (*new_stringp) {
+	case '\0':
+		*value_units = none;
+		break;
+	case 'h':
+		*value_units = hours;
+		new_stringp++;
+		break;
+	case 'm':
+		*value_units = minutes;
+		new_stringp++;
+		break;
+	case 's':
+		*value_units = seconds;
+		new_stringp++;
+		break;
+	default:
+		(void) fprintf(stderr, "bad limit value <%s>, unrecognized "
+		    "character %c\n", *stringpp, *new_stringp);
+	}
+	*stringpp = new_stringp;
+	return (value);
+}
+
+/*
+ * stf_parse_timeout(limit_string, duration)
+ *	parse the argument limit_string
+ *	   <time>: do the command until <time> has passed
+ *		<time> is of the form 3h23m45s
+ *		if it's just a number the default is for
+ *		seconds for backwards compatibility.
+ */
+void
+stf_parse_timeout(char *limit_string, time_t *duration)
+{
+	char *value_string = limit_string;
+	time_t value;
+	enum units value_units;
+
+	*duration = (time_t)-1;
+
+	value = parse_value(&value_string, &value_units);
+	*duration = 0;
+	if (value_units == hours) {
+		*duration = 60 * 60 * value;
+		value = parse_value(&value_string, &value_units);
+	}
+	if (value_units == minutes) {
+		*duration += 60 * value;
+		value = parse_value(&value_string, &value_units);
+	}
+	if (value_units == seconds) {
+		*duration += value;
+		value = parse_value(&value_string, &value_units);
+	}
+	if (value_units == none) {	/* all processed */
+		*duration += value;	/* default to seconds */
+		if (*duration == 0) {
+			(void) fprintf(stderr,
+			    "duration <%s> is 0\n",
+			    limit_string);
+
+		}
+		return;
+	}
+	(void) fprintf(stderr, "time limit <%s> is bad\n", limit_string);
+}
+
+/*
+ * Hang up the process group led by pid, give it ten seconds to go away,
+ * then kill whatever is left.
+ */
+void
+stf_kill_group(pid_t pid)
+{
+	int i, child_status;
+	if (pid > 0) {
+		(void) kill(-pid, SIGHUP);
+		for (i = 0; i < 10; i++) {
+			if (waitpid(pid, &child_status, WNOHANG)
+			    == pid) {
+				break;
+			}
+			(void) sleep(1);
+		}
+		(void) kill(-pid, SIGKILL);
+		(void) sleep(3);
+	}
+
+}
+
 struct jvars *
 vfile_mmap()
 {
@@ -781,6 +2066,8 @@ vfile_mmap()
 	char *vfile;
 	int var_fd;
 	mode_t old_umask;
+	struct stat st;
+	size_t size;
 
 	if (jv) { /* already mmapped */
 		return (jv);
@@ -802,8 +2089,14 @@ vfile_mmap()
 	}
 	(void) umask(old_umask);
 
+	/* a file written by an older stf_jnl_start has no slots */
+	size = sizeof (struct jvars);
+	if (fstat(var_fd, &st) == 0 &&
+	    st.st_size >= (off_t)sizeof (struct jvars_file))
+		size = sizeof (struct jvars_file);
+
 	jv = (struct jvars *)mmap((caddr_t)0,
-	    sizeof (struct jvars),
+	    size,
 	    (PROT_READ | PROT_WRITE),
 	    MAP_SHARED,
 	    var_fd,
@@ -811,19 +2104,127 @@ vfile_mmap()
 
 	if (jv == (void *)-1) {
 		perror("vfile_mmap : mmap");
+		jv = 0;
 		return ((struct jvars *)-1);
 	}
 	(void) close(var_fd);
+
+	if (size == sizeof (struct jvars_file) &&
+	    ((struct jvars_file *)jv)->jf_magic == JVARS_MAGIC &&
+	    ((struct jvars_file *)jv)->jf_version >= JVARS_VERSION)
+		jvfile = (struct jvars_file *)jv;
 	return (jv);
 }
 
+/*
+ * Find the jvarfile slot owned by process group pgid, claiming a free
+ * one when claim is set.  Slots change hands with a compare and swap on
+ * js_owner, so no lock is taken.  When the table is full, a slot whose
+ * process group has gone away without a Test_Case_End is taken over.
+ * Returns NULL for a version 1 file or when every slot is busy, and
+ * the caller falls back to the legacy fields.
+ */
+static struct jvars_slot *
+jvars_slot(pid_t pgid, int claim)
+{
+	struct jvars_slot *js;
+	uint32_t owner;
+	int i;
+
+	if (jvfile == NULL || pgid <= 0)
+		return (NULL);
+
+	for (i = 0; i < JVARS_NSLOTS; i++) {
+		if (jvfile->jf_slot[i].js_owner == (uint32_t)pgid)
+			return (&jvfile->jf_slot[i]);
+	}
+	if (claim == 0)
+		return (NULL);
+
+	for (i = 0; i < JVARS_NSLOTS; i++) {
+		js = &jvfile->jf_slot[i];
+		if (js->js_owner == 0 &&
+		    atomic_cas_32(&js->js_owner, 0, (uint32_t)pgid) == 0)
+			return (js);
+	}
+	for (i = 0; i < JVARS_NSLOTS; i++) {
+		js = &jvfile->jf_slot[i];
+		owner = js->js_owner;
+		if (owner != 0 && kill(-(pid_t)owner, 0) == -1 &&
+		    errno == ESRCH &&
+		    atomic_cas_32(&js->js_owner, owner, (uint32_t)pgid) ==
+		    owner)
+			return (js);
+	}
+	return (NULL);
+}
+
 static void
 _case_init_();
+static void
+_case_fini_();
 
 #pragma init(_case_init_)
+#pragma fini(_case_fini_)
+
+/*
+ * fork() handlers: hold the writer lock across the fork with the buffer
+ * drained, so a record is never written by both parent and child.
+ */
+static void
+jnl_atfork_prepare(void)
+{
+	(void) mutex_lock(&jnl_wlock);
+	if (jnl_wfd != -1)
+		jnl_flush_locked();
+}
+
+static void
+jnl_atfork_release(void)
+{
+	(void) mutex_unlock(&jnl_wlock);
+}
 
 static void
 _case_init_()
 {
+	char *env;
+
 	setbuf(stdout, NULL);
+
+	/* journal write buffering is off unless STF_JNL_BUFSIZE is set */
+	if ((env = getenv(JNLBUFSIZE)) != NULL && atol(env) > 0) {
+		jnl_wsize = (size_t)atol(env);
+		if ((jnl_wbuf = malloc(jnl_wsize)) == NULL)
+			jnl_wsize = 0;
+	}
+	if ((env = getenv(JNLCOMPRESS)) != NULL && atoi(env) > 0) {
+		jnl_zlevel = atoi(env) > Z_BEST_COMPRESSION ?
+		    Z_BEST_COMPRESSION : atoi(env);
+		/* windowBits + 16 asks for a gzip header and trailer */
+		if (deflateInit2(&jnl_zs, jnl_zlevel, Z_DEFLATED,
+		    MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			(void) fprintf(stderr,
+			    "stf_jnl: %s ignored, deflateInit failed\n",
+			    JNLCOMPRESS);
+			jnl_zlevel = 0;
+		}
+	}
+	if (jnl_zlevel != 0 && jnl_wsize == 0) {
+		jnl_wsize = JNL_ZBUFSIZE_DEFAULT;
+		if ((jnl_wbuf = malloc(jnl_wsize)) == NULL)
+			jnl_wsize = 0;
+	}
+	jnl_wage = (hrtime_t)JNL_FLUSHAGE_DEFAULT * (NANOSEC / MILLISEC);
+	if ((env = getenv(JNLFLUSHAGE)) != NULL)
+		jnl_wage = (hrtime_t)atol(env) * (NANOSEC / MILLISEC);
+
+	(void) pthread_atfork(jnl_atfork_prepare, jnl_atfork_release,
+	    jnl_atfork_release);
+}
+
+static void
+_case_fini_()
+{
+	stf_jnl_flush();
 }